@@ -293,6 +293,26 @@ int dmtcp_send_query_to_coordinator(const char *id,
                                     void *val,
                                     uint32_t *val_len);
 
+/*
+ * Batched versions of the above, for plugins that publish or look up many
+ * keys at once: all num keys go to the coordinator in a single message.
+ * For queries, val_lens[i] is the size of the buffer vals[i] on input, and
+ * the size of the value found (0 if none) on output.  The query returns the
+ * number of keys found.
+ */
+int dmtcp_send_key_val_pairs_to_coordinator(const char *id,
+                                            uint32_t num,
+                                            const void *const *keys,
+                                            const uint32_t *key_lens,
+                                            const void *const *vals,
+                                            const uint32_t *val_lens);
+int dmtcp_send_queries_to_coordinator(const char *id,
+                                      uint32_t num,
+                                      const void *const *keys,
+                                      const uint32_t *key_lens,
+                                      void **vals,
+                                      uint32_t *val_lens);
+
 /*
  * This API can be used to create a new NS database, generate a unique
  * id, populate the database with the unique id, and return the generated
@@ -456,6 +476,17 @@ void dmtcp_unblock_ckpt_signal(void);
 void dmtcp_close_protected_fd(int fd);
 int dmtcp_protected_environ_fd(void);
 
+/* FOR EXPERTS ONLY:
+ *   Threads for a plugin to parallelize work inside an event hook, e.g.,
+ *  saving large files at DMTCP_EVENT_PRECHECKPOINT.  They bypass the DMTCP
+ *  thread wrappers, are never checkpointed, and must be joined with
+ *  dmtcp_join_helper_thread() before the hook returns.
+ */
+int dmtcp_create_helper_thread(pthread_t *thread,
+                               void *(*start_routine)(void *),
+                               void *arg);
+int dmtcp_join_helper_thread(pthread_t thread, void **retval);
+
 /* FOR EXPERTS ONLY:
  *   The DMTCP internal pid plugin ensures that the application sees only
  *  a virtual pid, which can be translated to the current real pid
@@ -32,6 +32,7 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -235,5 +236,11 @@ class map : public std::map<K, V, std::less<K>, DmtcpAlloc<std::pair<K, V> > >
 template<typename K>
 class set : public std::set<K, std::less<K>, DmtcpAlloc<K> >
 {};
+
+template<typename K, typename V, typename H = std::hash<K> >
+class unordered_map
+  : public std::unordered_map<K, V, H, std::equal_to<K>,
+                              DmtcpAlloc<std::pair<const K, V> > >
+{};
 }
 #endif // ifndef DMTCPALLOC_H
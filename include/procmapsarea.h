@@ -56,9 +56,61 @@ typedef char *VA;  /* VA = virtual address */
 
 typedef enum ProcMapsAreaProperties {
   DMTCP_ZERO_PAGE = 0x0001,
-  DMTCP_SKIP_WRITING_TEXT_SEGMENTS = 0x0002
+  DMTCP_SKIP_WRITING_TEXT_SEGMENTS = 0x0002,
+  DMTCP_CHUNKED_AREA = 0x0004,
+  DMTCP_FILE_BACKED_PAGES = 0x0008,
+  DMTCP_HOT_MAP = 0x0010,
+  DMTCP_SYSV_SHM_SEGMENT = 0x0020,
+  DMTCP_SYSV_SHM_DATA = 0x0040,
+  DMTCP_HUGE_PAGES = 0x0080,
+  DMTCP_HUGETLB = 0x0100,
+  DMTCP_NUMA_MAP = 0x0200,
+  DMTCP_HUGE_PAGE_ADVISED = 0x0400
 } ProcMapsAreaProperties;
 
+/* An area with DMTCP_HUGE_PAGES was backed by transparent huge pages (or was
+ * madvise()d with MADV_HUGEPAGE, which also sets DMTCP_HUGE_PAGE_ADVISED), and
+ * one with DMTCP_HUGETLB was mapped from hugetlbfs with pages of
+ * huge_page_size bytes.  The zero pages of such areas are elided in huge page
+ * aligned pieces, and mtcp_restart maps each piece with huge pages again
+ * before reading the data, falling back to normal pages if none are
+ * available.  Only DMTCP_HUGE_PAGE_ADVISED areas are madvise()d again.
+ */
+
+/* A SysV shared-memory area is saved as a header-only area with
+ * DMTCP_SYSV_SHM_SEGMENT, followed by the usual (possibly zero-page) areas
+ * covering its contents, each with DMTCP_SYSV_SHM_DATA.  On restart, the
+ * segment is created (with its saved mode and huge page size) and attached
+ * first, and the data is read straight into it; the svipc plugin then adopts
+ * the segment instead of copying, and restores a read-only attachment.
+ */
+
+#define DMTCP_HOT_MAP_BYTES 2048
+
+/* On a NUMA machine, an area with DMTCP_NUMA_MAP records where its pages
+ * were placed at checkpoint time.  mtcp_restart binds each part of the area
+ * to its node (MPOL_PREFERRED) while reading the data, so that the pages are
+ * allocated there instead of on the node of the restarting thread, and then
+ * restores the memory policy of the area.
+ */
+#define DMTCP_NUMA_MAP_BYTES 512
+#define DMTCP_NUMA_NO_NODE   0xff
+#define DMTCP_NUMA_NO_POLICY (-1)
+
+/* With the chunk store enabled, the data of a DMTCP_CHUNKED_AREA is not
+ * stored in the ckpt image.  Instead, the area header is followed by a list
+ * of ChunkRefs whose sizes add up to the area size.  The data of each chunk
+ * is stored once in <ckpt dir>/DMTCP_CHUNK_STORE_DIR/<h>/<hash>, where <hash>
+ * is the 32 hex digits of hash[0] and hash[1] and <h> is its first two digits.
+ * See src/chunkstore.cpp.
+ */
+#define DMTCP_CHUNK_STORE_DIR "ckpt_chunks"
+
+typedef struct ChunkRef {
+  uint64_t hash[2];
+  uint64_t size;
+} ChunkRef;
+
 typedef union ProcMapsArea {
   struct {
     union {
@@ -101,6 +153,35 @@ typedef union ProcMapsArea {
     uint64_t properties;
 
     char name[FILENAMESIZE];
+
+    // For DMTCP_FILE_BACKED_PAGES: mtime of the file at checkpoint time.
+    uint64_t mtime_sec;
+    uint64_t mtime_nsec;
+
+    // For DMTCP_HOT_MAP: bit i of hot_map is set if a page in the i-th
+    // hot_map_granule bytes of the area was resident at checkpoint time.
+    uint64_t hot_map_granule;
+    uint8_t hot_map[DMTCP_HOT_MAP_BYTES];
+
+    // For DMTCP_HUGETLB: the hugetlbfs page size.
+    uint64_t huge_page_size;
+
+    // For DMTCP_NUMA_MAP: the mode and nodes (0-63) of the memory policy
+    // set for the area with mbind(), or DMTCP_NUMA_NO_POLICY.  numa_map[i]
+    // is the node of most pages in [numa_map_start + i * numa_map_granule,
+    // numa_map_start + (i + 1) * numa_map_granule), or DMTCP_NUMA_NO_NODE.
+    // An area that was split when saved keeps the map of the whole area.
+    int64_t numa_policy;
+    uint64_t numa_nodemask;
+    uint64_t numa_map_start;
+    uint64_t numa_map_granule;
+    uint8_t numa_map[DMTCP_NUMA_MAP_BYTES];
+
+    // For DMTCP_SYSV_SHM_SEGMENT: the permission bits of the segment and the
+    // shmat() flags of the saved attachment.  A DMTCP_HUGETLB segment was
+    // created with SHM_HUGETLB and pages of huge_page_size bytes.
+    int64_t shm_mode;
+    int64_t shm_flags;
   };
   char _padding[4096];
 } ProcMapsArea;
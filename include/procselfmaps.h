@@ -6,6 +6,22 @@
 
 namespace dmtcp
 {
+// One line of /proc/self/maps.  Unlike ProcMapsArea, the name is not copied:
+// it points into the buffer of the ProcSelfMaps object (nameLen bytes, not
+// NUL-terminated) and is valid until that object is destroyed.
+struct ProcMapsEntry {
+  VA addr;
+  VA endAddr;
+  off_t offset;
+  int prot;
+  int flags;
+  unsigned long devmajor;
+  unsigned long devminor;
+  ino_t inodenum;
+  const char *name;
+  size_t nameLen;
+};
+
 class ProcSelfMaps
 {
   public:
@@ -23,10 +39,9 @@ class ProcSelfMaps
     size_t getNumAreas() const { return numAreas; }
 
     int getNextArea(ProcMapsArea *area);
+    int getNextEntry(ProcMapsEntry *entry);
 
   private:
-    unsigned long int readDec();
-    unsigned long int readHex();
     bool isValidData();
 
     char *data;
@@ -22,6 +22,7 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <sys/uio.h>
 #include "procmapsarea.h"
 
 #ifndef EXTERNC
@@ -77,6 +78,9 @@ EXTERNC int dmtcp_modify_env_enabled(void) __attribute__((weak));
 EXTERNC int dmtcp_ptrace_enabled(void) __attribute__((weak));
 EXTERNC int dmtcp_unique_ckpt_enabled(void) __attribute__((weak));
 EXTERNC bool dmtcp_svipc_inside_shmdt(void) __attribute__((weak));
+EXTERNC bool dmtcp_svipc_restores_shm_in_place(const void *addr, int *mode,
+                                               int *shmflg)
+  __attribute__((weak));
 
 
 /*
@@ -119,6 +123,7 @@ bool isSysVShmArea(const ProcMapsArea &area);
 bool isIBShmArea(const ProcMapsArea &area);
 
 ssize_t writeAll(int fd, const void *buf, size_t count);
+ssize_t writevAll(int fd, struct iovec *iov, int iovcnt);
 ssize_t readAll(int fd, void *buf, size_t count);
 ssize_t skipBytes(int fd, size_t count);
 
@@ -21,25 +21,38 @@
 #ifndef __DMTCP_UTIL_H__
 #define __DMTCP_UTIL_H__
 
+#include <errno.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 
+// The kernel's SCM_MAX_FD: the most fds that one message can carry.
+#define UTIL_IPC_MAX_FDS 253
+
 namespace dmtcp
 {
 namespace Util
 {
+// Send numFds (at most UTIL_IPC_MAX_FDS) fds in a single message.
 static inline int
-sendFd(int restoreFd,
-       int32_t fd,
-       void *data,
-       size_t len,
-       struct sockaddr_un &addr,
-       socklen_t addrLen)
+sendFds(int restoreFd,
+        const int32_t *fds,
+        size_t numFds,
+        void *data,
+        size_t len,
+        struct sockaddr_un &addr,
+        socklen_t addrLen,
+        int flags = 0)
 {
   struct iovec iov;
   struct msghdr hdr;
   struct cmsghdr *cmsg;
-  char cms[CMSG_SPACE(sizeof(int32_t))];
+  char cms[CMSG_SPACE(sizeof(int32_t) * UTIL_IPC_MAX_FDS)];
+
+  if (numFds == 0 || numFds > UTIL_IPC_MAX_FDS) {
+    errno = EINVAL;
+    return -1;
+  }
 
   iov.iov_base = data;
   iov.iov_len = len;
@@ -50,26 +63,43 @@ sendFd(int restoreFd,
   hdr.msg_iov = &iov;
   hdr.msg_iovlen = 1;
   hdr.msg_control = (caddr_t)cms;
-  hdr.msg_controllen = CMSG_LEN(sizeof(int32_t));
+  hdr.msg_controllen = CMSG_SPACE(sizeof(int32_t) * numFds);
 
   cmsg = CMSG_FIRSTHDR(&hdr);
-  cmsg->cmsg_len = CMSG_LEN(sizeof(fd));
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int32_t) * numFds);
   cmsg->cmsg_level = SOL_SOCKET;
   cmsg->cmsg_type = SCM_RIGHTS;
 
-  memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(int32_t) * numFds);
 
-  return sendmsg(restoreFd, &hdr, 0);
+  return sendmsg(restoreFd, &hdr, flags);
 }
 
-static inline int32_t
-receiveFd(int restoreFd, void *data, size_t len)
+static inline int
+sendFd(int restoreFd,
+       int32_t fd,
+       void *data,
+       size_t len,
+       struct sockaddr_un &addr,
+       socklen_t addrLen)
+{
+  return sendFds(restoreFd, &fd, 1, data, len, addr, addrLen);
+}
+
+// Receive one message sent by sendFds().  Returns the number of fds in it,
+// or -1; *dataLen is set to the number of bytes of data received.
+static inline int
+receiveFds(int restoreFd,
+           int32_t *fds,
+           size_t maxFds,
+           void *data,
+           size_t len,
+           size_t *dataLen)
 {
-  int32_t fd;
   struct iovec iov;
   struct msghdr hdr;
   struct cmsghdr *cmsg;
-  char cms[CMSG_SPACE(sizeof(int32_t))];
+  char cms[CMSG_SPACE(sizeof(int32_t) * UTIL_IPC_MAX_FDS)];
 
   iov.iov_base = data;
   iov.iov_len = len;
@@ -83,16 +113,42 @@ receiveFd(int restoreFd, void *data, size_t len)
   hdr.msg_control = (caddr_t)cms;
   hdr.msg_controllen = sizeof cms;
 
-  if (recvmsg(restoreFd, &hdr, 0) == -1) {
+  ssize_t n = recvmsg(restoreFd, &hdr, 0);
+  if (n == -1) {
+    return -1;
+  }
+  if (hdr.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+    errno = EMSGSIZE;
     return -1;
   }
 
   cmsg = CMSG_FIRSTHDR(&hdr);
-  if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+  if (cmsg == NULL ||
+      cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
     return -1;
   }
-  memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
 
+  size_t numFds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int32_t);
+  if (numFds > maxFds) {
+    errno = EMSGSIZE;
+    return -1;
+  }
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(int32_t) * numFds);
+  if (dataLen != NULL) {
+    *dataLen = n;
+  }
+
+  return numFds;
+}
+
+static inline int32_t
+receiveFd(int restoreFd, void *data, size_t len)
+{
+  int32_t fd;
+
+  if (receiveFds(restoreFd, &fd, 1, data, len, NULL) != 1) {
+    return -1;
+  }
   return fd;
 }
 }
@@ -275,6 +275,7 @@ class VirtualIdTable
 
       jalib::JBinarySerializeWriterRaw mapwr(mapFile, fd);
       mapwr & _idMapTable;
+      mapwr.flush();
 
       _do_unlock_tbl();
       Util::unlockFile(fd);
@@ -23,12 +23,19 @@
 #include "jalloc.h"
 #include <pthread.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <unistd.h>
 
 // Make highest chunk size large; avoid a raw_alloc calling mmap()
 // during /proc/self/maps
-#define MAX_CHUNKSIZE (4 * 1024)
+#define MIN_CHUNKSIZE (32)
+#define MAX_CHUNKSIZE (16 * 1024)
+#define NUM_LEVELS    (10)  // MIN_CHUNKSIZE << i, for i < NUM_LEVELS
+
+// Chunks up to this size are cached per thread; larger ones always go
+// through the shared free lists.
+#define MAX_CACHED_CHUNKSIZE (4 * 1024)
 
 using namespace jalib;
 
@@ -97,65 +104,122 @@ _dealloc_raw(void *ptr, size_t n)
 # endif // ifdef JALIB_USE_MALLOC
 }
 
-template<size_t _N>
+/*
+ * Free chunks of one size.
+ *
+ * Free chunks are handed out to threads in batches: a batch is a list of
+ * chunks linked through `next`, whose first chunk also records the length
+ * of the list and links to the next batch.  The shared free list is a
+ * lock-free stack of batches.  Each thread keeps a small cache of chunks
+ * (a ThreadCache) and takes or returns a whole batch with one
+ * compare-and-swap when the cache runs empty or grows too large.
+ *
+ * The head of the shared stack packs the pointer to the first batch with a
+ * counter that is bumped on every push, so that a batch that was popped and
+ * pushed back in the meantime (ABA) fails the compare-and-swap.  Chunks are
+ * never unmapped, so reading `nextBatch` of a chunk that was popped by
+ * another thread is harmless.
+ */
+#if defined(__x86_64__) || defined(__aarch64__)
+
+// User-space addresses fit in 48 bits; the counter uses the top 16 bits.
+# define STACK_TAG_SHIFT 48
+#else // if defined(__x86_64__) || defined(__aarch64__)
+# define STACK_TAG_SHIFT 32
+#endif // if defined(__x86_64__) || defined(__aarch64__)
+#define STACK_PTR_MASK ((1ULL << STACK_TAG_SHIFT) - 1)
+
+struct ThreadCache {
+  void *list;
+  size_t count;
+};
+
 class JFixedAllocStack
 {
   public:
-    enum { N = _N };
-    JFixedAllocStack()
+    void initialize(size_t chunkSize, size_t blockSize)
     {
-      if (_blockSize == 0) {
-        _blockSize = 4 * MAX_CHUNKSIZE;
+      _chunkSize = chunkSize;
+      _blockSize = blockSize;
+
+      // Enough chunks to make a batch about 2 KB, but at least one chunk.
+      _batchSize = 2048 / chunkSize;
+      if (_batchSize == 0) {
+        _batchSize = 1;
       }
-      _root = NULL;
-      _numExpands = 0;
     }
 
-    void initialize(int blockSize)
-    {
-      _blockSize = blockSize;
-    }
+    size_t chunkSize() { return _chunkSize; }
 
-    size_t chunkSize() { return N; }
+    bool isCached() { return _chunkSize <= MAX_CACHED_CHUNKSIZE; }
 
-    // allocate a chunk of size N
-    void *allocate()
+    // allocate a chunk from the thread's cache
+    void *allocate(ThreadCache *cache)
     {
-      FreeItem *item = NULL;
+      if (cache->count == 0) {
+        FreeItem *batch = popBatch();
+        cache->list = batch;
+        cache->count = batch->count;
+      }
 
-      do {
-        if (_root == NULL) {
-          expand();
-        }
+      FreeItem *item = static_cast<FreeItem *>(cache->list);
+      cache->list = item->next;
+      cache->count--;
+      item->next = NULL;
+      return item;
+    }
 
-        // NOTE: _root could still be NULL (if other threads consumed all
-        // blocks that were made available from expand().  In such case, we
-        // loop once again.
+    // deallocate a chunk to the thread's cache
+    void deallocate(ThreadCache *cache, void *ptr)
+    {
+      if (ptr == NULL) { return; }
+      FreeItem *item = static_cast<FreeItem *>(ptr);
+      item->next = static_cast<FreeItem *>(cache->list);
+      cache->list = item;
+      cache->count++;
+
+      if (cache->count >= 2 * _batchSize) {
+        // Give the most recently freed batch back to the shared stack.
+        FreeItem *last = item;
+        for (size_t i = 1; i < _batchSize; i++) {
+          last = last->next;
+        }
+        cache->list = last->next;
+        cache->count -= _batchSize;
+        last->next = NULL;
+        pushBatch(item, _batchSize);
+      }
+    }
 
-        /* Atomically does the following operation:
-         *   item = _root;
-         *   _root = item->next;
-         */
-        item = _root;
-      } while (!item ||
-               !__sync_bool_compare_and_swap(&_root, item, item->next));
+    // allocate a chunk directly from the shared stack
+    void *allocate()
+    {
+      FreeItem *batch = popBatch();
 
-      item->next = NULL;
-      return item;
+      if (batch->count > 1) {
+        pushBatch(batch->next, batch->count - 1);
+      }
+      batch->next = NULL;
+      return batch;
     }
 
-    // deallocate a chunk of size N
+    // deallocate a chunk directly to the shared stack
     void deallocate(void *ptr)
     {
       if (ptr == NULL) { return; }
       FreeItem *item = static_cast<FreeItem *>(ptr);
-      do {
-        /* Atomically does the following operation:
-         *   item->next = _root;
-         *   _root = item;
-         */
-        item->next = _root;
-      } while (!__sync_bool_compare_and_swap(&_root, item->next, item));
+      item->next = NULL;
+      pushBatch(item, 1);
+    }
+
+    // return all chunks in the thread's cache to the shared stack
+    void flush(ThreadCache *cache)
+    {
+      if (cache->count > 0) {
+        pushBatch(static_cast<FreeItem *>(cache->list), cache->count);
+        cache->list = NULL;
+        cache->count = 0;
+      }
     }
 
     int numExpands()
@@ -163,93 +227,173 @@ class JFixedAllocStack
       return _numExpands;
     }
 
-    void preExpand()
+  protected:
+    struct FreeItem {
+      FreeItem *next;       // next chunk in this batch
+      FreeItem *nextBatch;  // next batch on the stack (first chunk only)
+      size_t count;         // length of this batch (first chunk only)
+    };
+
+    static uint64_t makeHead(FreeItem *item, uint64_t tag)
     {
-      // Force at least numChunks chunks to become free.
-      const int numAllocs = 10;
-      void *allocatedItem[numAllocs];
+      return (uint64_t)(uintptr_t)item | (tag << STACK_TAG_SHIFT);
+    }
 
-      for (int i = 0; i < numAllocs; i++) {
-        allocatedItem[i] = allocate();
-      }
+    static FreeItem *headItem(uint64_t head)
+    {
+      return (FreeItem *)(uintptr_t)(head & STACK_PTR_MASK);
+    }
 
-      // if (_root == NULL) { expand(); }
-      for (int i = 0; i < numAllocs; i++) {
-        deallocate(allocatedItem[i]);
-      }
+    static uint64_t headTag(uint64_t head)
+    {
+      return head >> STACK_TAG_SHIFT;
+    }
+
+    void pushBatch(FreeItem *batch, size_t count)
+    {
+      uint64_t oldHead;
+      uint64_t newHead;
+
+      batch->count = count;
+      do {
+        oldHead = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+        batch->nextBatch = headItem(oldHead);
+        newHead = makeHead(batch, headTag(oldHead) + 1);
+      } while (!__sync_bool_compare_and_swap(&_head, oldHead, newHead));
+    }
+
+    // pop a batch, expanding the stack as needed
+    FreeItem *popBatch()
+    {
+      uint64_t oldHead;
+      uint64_t newHead;
+      FreeItem *batch;
+
+      do {
+        oldHead = __atomic_load_n(&_head, __ATOMIC_ACQUIRE);
+        batch = headItem(oldHead);
+        if (batch == NULL) {
+          // NOTE: the stack could be empty again by the time we retry, if
+          // other threads consumed all batches made available by expand().
+          expand();
+          continue;
+        }
+        newHead = makeHead(batch->nextBatch, headTag(oldHead));
+      } while (batch == NULL ||
+               !__sync_bool_compare_and_swap(&_head, oldHead, newHead));
+      return batch;
     }
 
-  protected:
     // allocate more raw memory when stack is empty
     void expand()
     {
-      _numExpands++;
-      if (_root != NULL &&
+      __sync_fetch_and_add(&_numExpands, 1);
+      if (_head != 0 &&
           fred_record_replay_enabled && fred_record_replay_enabled()) {
-        // TODO: why is expand being called? If you see this message, raise lvl2
-        // allocation level.
+        // TODO: why is expand being called? If you see this message, raise
+        // the block size of this level in initialize().
         char expand_msg[] = "\n\n\n******* EXPAND IS CALLED *******\n\n\n";
         write(2, expand_msg, sizeof(expand_msg));
 
         // jalib::fflush(stderr);
         abort();
       }
-      FreeItem *bufs = static_cast<FreeItem *>(_alloc_raw(_blockSize));
-      int count = _blockSize / sizeof(FreeItem);
-      for (int i = 0; i < count - 1; ++i) {
-        bufs[i].next = bufs + i + 1;
+      char *bufs = static_cast<char *>(_alloc_raw(_blockSize));
+      size_t count = _blockSize / _chunkSize;
+      for (size_t i = 0; i < count; i += _batchSize) {
+        size_t n = count - i < _batchSize ? count - i : _batchSize;
+        FreeItem *batch = (FreeItem *)(bufs + i * _chunkSize);
+        for (size_t j = 0; j < n - 1; j++) {
+          FreeItem *item = (FreeItem *)(bufs + (i + j) * _chunkSize);
+          item->next = (FreeItem *)(bufs + (i + j + 1) * _chunkSize);
+        }
+        ((FreeItem *)(bufs + (i + n - 1) * _chunkSize))->next = NULL;
+        pushBatch(batch, n);
       }
-
-      do {
-        /* Atomically does the following operation:
-         *   bufs[count-1].next = _root;
-         *   _root = bufs;
-         */
-        bufs[count - 1].next = _root;
-      } while (!__sync_bool_compare_and_swap(&_root, bufs[count - 1].next,
-                                             bufs));
     }
 
-  protected:
-    struct FreeItem {
-      union {
-        FreeItem *next;
-        char buf[N];
-      };
-    };
-
   private:
-    FreeItem *volatile _root;
-    size_t _blockSize = 0;
+    volatile uint64_t _head;
+    size_t _chunkSize;
+    size_t _blockSize;
+    size_t _batchSize;
     char padding[128];
     int volatile _numExpands;
 };
 } // namespace jalib
 
-jalib::JFixedAllocStack<64>lvl1;
-jalib::JFixedAllocStack<256>lvl2;
-jalib::JFixedAllocStack<1024>lvl3;
-# if MAX_CHUNKSIZE <= 1024
-#  error MAX_CHUNKSIZE must be larger
-# endif // if MAX_CHUNKSIZE <= 1024
-jalib::JFixedAllocStack<MAX_CHUNKSIZE>lvl4;
+static jalib::JFixedAllocStack levels[NUM_LEVELS];
+
+/*
+ * Per-thread caches, one per level.
+ *
+ * A signal handler that allocates while the interrupted code is updating
+ * the same cache finds the cache busy and uses the shared stacks instead.
+ * Once a thread is exiting, its caches are flushed and disabled for good.
+ * Threads that bypass the pthread_create wrapper (DMTCP's own helper
+ * threads) never reach ThreadSync::threadExiting(); the destructor of
+ * threadCacheKey flushes their caches instead.
+ */
+enum ThreadCacheState {
+  CACHE_IDLE,
+  CACHE_BUSY,
+  CACHE_DISABLED
+};
+
+static __thread jalib::ThreadCache threadCaches[NUM_LEVELS];
+static __thread int threadCacheState = CACHE_IDLE;
+static __thread bool threadCacheRegistered = false;
+static pthread_key_t threadCacheKey;
+
+static void
+threadCacheDestructor(void *)
+{
+  jalib::JAllocDispatcher::threadExiting();
+}
+
+static inline void
+registerThreadCache()
+{
+  if (!threadCacheRegistered) {
+    threadCacheRegistered = true;
+    pthread_setspecific(threadCacheKey, (void *)1);
+  }
+}
+
+static int
+levelIndex(size_t n)
+{
+  int i = 0;
+  size_t chunkSize = MIN_CHUNKSIZE;
+
+  while (chunkSize < n) {
+    chunkSize <<= 1;
+    i++;
+  }
+  return i;
+}
 
 void
 jalib::JAllocDispatcher::initialize(void)
 {
-  if (fred_record_replay_enabled != 0 && fred_record_replay_enabled()) {
-    /* We need a greater arena size to eliminate mmap() calls that could happen
-       at different times for record vs. replay. */
-    lvl1.initialize(1024 * 1024 * 16);
-    lvl2.initialize(1024 * 1024 * 16);
-    lvl3.initialize(1024 * 32 * 16);
-    lvl4.initialize(1024 * 32 * 16);
-  } else {
-    lvl1.initialize(1024 * 16);
-    lvl2.initialize(1024 * 16);
-    lvl3.initialize(1024 * 32);
-    lvl4.initialize(1024 * 32);
+  for (int i = 0; i < NUM_LEVELS; i++) {
+    size_t chunkSize = (size_t)MIN_CHUNKSIZE << i;
+    size_t blockSize;
+    if (fred_record_replay_enabled != 0 && fred_record_replay_enabled()) {
+      /* We need a greater arena size to eliminate mmap() calls that could
+         happen at different times for record vs. replay. */
+      blockSize = chunkSize <= 256 ? 1024 * 1024 * 16 : 1024 * 32 * 16;
+    } else {
+      blockSize = chunkSize <= 256 ? 1024 * 16 : 1024 * 32;
+    }
+
+    // preExpand() takes 10 chunks at once; get them from a single block.
+    if (blockSize < 16 * chunkSize) {
+      blockSize = 16 * chunkSize;
+    }
+    levels[i].initialize(chunkSize, blockSize);
   }
+  pthread_key_create(&threadCacheKey, threadCacheDestructor);
   _initialized = true;
 }
 
@@ -259,18 +403,21 @@ jalib::JAllocDispatcher::allocate(size_t n)
   if (!_initialized) {
     initialize();
   }
-  void *retVal;
-  if (n <= lvl1.chunkSize()) {
-    retVal = lvl1.allocate();
-  } else if (n <= lvl2.chunkSize()) {
-    retVal = lvl2.allocate();
-  } else if (n <= lvl3.chunkSize()) {
-    retVal = lvl3.allocate();
-  } else if (n <= lvl4.chunkSize()) {
-    retVal = lvl4.allocate();
-  } else {
-    retVal = _alloc_raw(n);
+  if (n > MAX_CHUNKSIZE) {
+    return _alloc_raw(n);
+  }
+
+  int i = levelIndex(n);
+  if (!levels[i].isCached() || threadCacheState != CACHE_IDLE) {
+    return levels[i].allocate();
   }
+
+  registerThreadCache();
+  threadCacheState = CACHE_BUSY;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  void *retVal = levels[i].allocate(&threadCaches[i]);
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  threadCacheState = CACHE_IDLE;
   return retVal;
 }
 
@@ -282,33 +429,66 @@ jalib::JAllocDispatcher::deallocate(void *ptr, size_t n)
     write(2, msg, sizeof(msg));
     abort();
   }
-  if (n <= lvl1.N) {
-    lvl1.deallocate(ptr);
-  } else if (n <= lvl2.N) {
-    lvl2.deallocate(ptr);
-  } else if (n <= lvl3.N) {
-    lvl3.deallocate(ptr);
-  } else if (n <= lvl4.N) {
-    lvl4.deallocate(ptr);
-  } else {
+  if (n > MAX_CHUNKSIZE) {
     _dealloc_raw(ptr, n);
+    return;
+  }
+
+  int i = levelIndex(n);
+  if (!levels[i].isCached() || threadCacheState != CACHE_IDLE) {
+    levels[i].deallocate(ptr);
+    return;
+  }
+
+  registerThreadCache();
+  threadCacheState = CACHE_BUSY;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  levels[i].deallocate(&threadCaches[i], ptr);
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  threadCacheState = CACHE_IDLE;
+}
+
+void
+jalib::JAllocDispatcher::threadExiting()
+{
+  if (!_initialized || threadCacheState != CACHE_IDLE) {
+    return;
+  }
+
+  threadCacheState = CACHE_DISABLED;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  for (int i = 0; i < NUM_LEVELS; i++) {
+    levels[i].flush(&threadCaches[i]);
   }
 }
 
 int
 jalib::JAllocDispatcher::numExpands()
 {
-  return lvl1.numExpands() + lvl2.numExpands() +
-         lvl3.numExpands() + lvl4.numExpands();
+  int n = 0;
+
+  for (int i = 0; i < NUM_LEVELS; i++) {
+    n += levels[i].numExpands();
+  }
+  return n;
 }
 
 void
 jalib::JAllocDispatcher::preExpand()
 {
-  lvl1.preExpand();
-  lvl2.preExpand();
-  lvl3.preExpand();
-  lvl4.preExpand();
+  // Force at least numChunks chunks of each level to become free.
+  const int numAllocs = 10;
+  void *allocatedItem[numAllocs];
+
+  for (int i = 0; i < NUM_LEVELS; i++) {
+    size_t chunkSize = (size_t)MIN_CHUNKSIZE << i;
+    for (int j = 0; j < numAllocs; j++) {
+      allocatedItem[j] = allocate(chunkSize);
+    }
+    for (int j = 0; j < numAllocs; j++) {
+      deallocate(allocatedItem[j], chunkSize);
+    }
+  }
 }
 
 #else // ifdef JALIB_ALLOCATOR
@@ -328,6 +508,10 @@ jalib::JAllocDispatcher::deallocate(void *ptr, size_t)
 {
   ::free(ptr);
 }
+
+void
+jalib::JAllocDispatcher::threadExiting()
+{}
 #endif // ifdef JALIB_ALLOCATOR
 
 #ifdef OVERRIDE_GLOBAL_ALLOCATOR
@@ -55,6 +55,10 @@ class JAllocDispatcher
 
     static int numExpands();
     static void preExpand();
+
+    // Return the calling thread's cached free chunks to the shared pool.
+    // Must be called before a thread exits.
+    static void threadExiting();
 };
 
 class JAlloc
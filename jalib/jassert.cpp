@@ -21,9 +21,13 @@
 
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <sched.h>
+#include <stdint.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <execinfo.h>  /* For backtrace() */
@@ -37,6 +41,9 @@
 #undef JASSERT_CONT_A
 #undef JASSERT_CONT_B
 
+// A failing JASSERT tries this many times to flush the trace buffers.
+#define JTRACE_FLUSH_RETRIES 1000
+
 using namespace jalib;
 int jassert_quiet = 0;
 
@@ -104,10 +111,11 @@ jassert_internal::JAssert::Text(const char *msg)
   return *this;
 }
 
-jassert_internal::JAssert::JAssert(bool exitWhenDone)
+jassert_internal::JAssert::JAssert(bool exitWhenDone, bool isTrace)
   : JASSERT_CONT_A(*this)
   , JASSERT_CONT_B(*this)
   , _exitWhenDone(exitWhenDone)
+  , _isTrace(isTrace)
 {}
 
 jassert_internal::JAssert::~JAssert()
@@ -117,6 +125,14 @@ jassert_internal::JAssert::~JAssert()
     Print(" (");
     Print(getpid());
     Print("): Terminating...\n");
+
+    // Make sure the trace leading up to the failure makes it to the log.
+    // Don't wait for long: the thread holding the flush lock may be
+    // suspended, or may be the one that failed.
+    for (int i = 0; i < JTRACE_FLUSH_RETRIES && !flush_trace_buffers(false);
+         i++) {
+      sched_yield();
+    }
     jassert_safe_print(ss.str().c_str());
     ss.str("");
 
@@ -127,7 +143,12 @@ jassert_internal::JAssert::~JAssert()
   }
 
   if (!ss.str().empty()) {
-    jassert_safe_print(ss.str().c_str());
+    if (_isTrace) {
+      const dmtcp::string &str = ss.str();
+      jassert_trace_print(str.c_str(), str.length());
+    } else {
+      jassert_safe_print(ss.str().c_str());
+    }
   }
 
   if (_exitWhenDone) {
@@ -367,3 +388,283 @@ jassert_internal::jassert_safe_print(const char *str)
     }
   }
 }
+
+/*
+ * Asynchronous JTRACE backend.
+ *
+ * Each thread that emits a JTRACE gets its own single-producer ring buffer.
+ * The owning thread is the only writer of 'head'; whoever holds the flush lock
+ * is the only writer of 'tail'.  Thus appending a record never takes a lock
+ * and never makes a system call unless the ring is full.
+ *
+ * Rings are linked into a global push-only list so that any thread can drain
+ * them.  They are never freed; when a thread exits, its ring is marked as
+ * retired and is handed to the next thread that needs one once it has been
+ * drained.  Since the rings live in ordinary process memory, records that were
+ * not yet flushed at checkpoint time are restored along with the process and
+ * flushed after restart.
+ *
+ * Each record is a JTraceRecordHeader followed by 'len' bytes of message text.
+ * Records are written to the log file as-is; util/dmtcp_jtrace_decode.py
+ * converts them back to text (and can sort them by timestamp).
+ */
+namespace
+{
+#define JTRACE_RECORD_MAGIC 0x52544a00 /* "\0JTR" in little-endian order */
+
+struct JTraceRecordHeader {
+  uint32_t magic;
+  uint32_t len;
+  uint64_t timestamp; // CLOCK_REALTIME in nanoseconds
+  uint32_t tid;
+  uint32_t seq;
+};
+
+enum JTraceRingState {
+  JTRACE_RING_FREE,
+  JTRACE_RING_OWNED,
+  JTRACE_RING_RETIRED
+};
+
+struct JTraceRing {
+  JTraceRing *next;
+  volatile int state;
+  volatile size_t head;
+  volatile size_t tail;
+  uint32_t tid;
+  uint32_t seq;
+  bool inAppend;
+  volatile size_t dropped;     // Records dropped because the ring was full.
+  size_t droppedReported;      // Only accessed under theTraceFlushLock.
+  char data[];
+};
+
+static size_t theTraceBufferSize = 0;
+static JTraceRing *volatile theTraceRings = NULL;
+static volatile int theTraceFlushLock = 0;
+static __thread JTraceRing *myTraceRing = NULL;
+}
+
+static JTraceRing *
+claimTraceRing()
+{
+  for (JTraceRing *ring = theTraceRings; ring != NULL; ring = ring->next) {
+    if (ring->state == JTRACE_RING_FREE &&
+        __sync_bool_compare_and_swap(&ring->state, JTRACE_RING_FREE,
+                                     JTRACE_RING_OWNED)) {
+      ring->tid = jalib::syscall(SYS_gettid);
+      return ring;
+    }
+  }
+
+  JTraceRing *ring =
+    (JTraceRing *)JALLOC_HELPER_MALLOC(sizeof(JTraceRing) + theTraceBufferSize);
+  if (ring == NULL) {
+    return NULL;
+  }
+  ring->state = JTRACE_RING_OWNED;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->tid = jalib::syscall(SYS_gettid);
+  ring->seq = 0;
+  ring->inAppend = false;
+  ring->dropped = 0;
+  ring->droppedReported = 0;
+
+  do {
+    /* Atomically does the following operation:
+     *   ring->next = theTraceRings;
+     *   theTraceRings = ring;
+     */
+    ring->next = theTraceRings;
+  } while (!__sync_bool_compare_and_swap(&theTraceRings, ring->next, ring));
+
+  return ring;
+}
+
+static void
+copyIntoRing(JTraceRing *ring, size_t pos, const void *src, size_t len)
+{
+  size_t offset = pos & (theTraceBufferSize - 1);
+  size_t firstPart = theTraceBufferSize - offset;
+
+  if (firstPart >= len) {
+    memcpy(ring->data + offset, src, len);
+  } else {
+    memcpy(ring->data + offset, src, firstPart);
+    memcpy(ring->data, (const char *)src + firstPart, len - firstPart);
+  }
+}
+
+// Returns false if the record could not be buffered; the caller should then
+// fall back to a synchronous write.  If the ring is full and another thread
+// is flushing, the record is dropped instead: waiting for the flusher could
+// deadlock, e.g., in a signal handler that interrupted the flusher, or in the
+// checkpoint thread while the flusher is suspended.
+static bool
+appendTraceRecord(const char *str, size_t len)
+{
+  if (myTraceRing == NULL) {
+    myTraceRing = claimTraceRing();
+    if (myTraceRing == NULL) {
+      return false;
+    }
+  }
+
+  JTraceRing *ring = myTraceRing;
+
+  // A signal handler interrupted an append in progress on this thread.
+  if (ring->inAppend) {
+    return false;
+  }
+
+  size_t recordLen = sizeof(JTraceRecordHeader) + len;
+  if (recordLen > theTraceBufferSize) {
+    return false;
+  }
+
+  ring->inAppend = true;
+  if (recordLen > theTraceBufferSize - (ring->head - ring->tail)) {
+    jassert_internal::flush_trace_buffers(false);
+    if (recordLen > theTraceBufferSize - (ring->head - ring->tail)) {
+      ring->dropped++;
+      ring->inAppend = false;
+      return true;
+    }
+  }
+
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  JTraceRecordHeader hdr;
+  hdr.magic = JTRACE_RECORD_MAGIC;
+  hdr.len = len;
+  hdr.timestamp = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  hdr.tid = ring->tid;
+  hdr.seq = ring->seq++;
+
+  copyIntoRing(ring, ring->head, &hdr, sizeof(hdr));
+  copyIntoRing(ring, ring->head + sizeof(hdr), str, len);
+
+  // Publish the record only after its contents are visible to the flusher.
+  __sync_synchronize();
+  ring->head += recordLen;
+  ring->inAppend = false;
+  return true;
+}
+
+static void
+drainTraceRing(JTraceRing *ring)
+{
+  size_t head = ring->head;
+  size_t tail = ring->tail;
+
+  __sync_synchronize();
+  if (head != tail && theLogFileFd != -1) {
+    size_t offset = tail & (theTraceBufferSize - 1);
+    size_t len = head - tail;
+    size_t firstPart = theTraceBufferSize - offset;
+    if (firstPart >= len) {
+      jalib::writeAll(theLogFileFd, ring->data + offset, len);
+    } else {
+      jalib::writeAll(theLogFileFd, ring->data + offset, firstPart);
+      jalib::writeAll(theLogFileFd, ring->data, len - firstPart);
+    }
+  }
+  ring->tail = head;
+
+  size_t dropped = ring->dropped;
+  if (dropped != ring->droppedReported && theLogFileFd != -1) {
+    char msg[128];
+    int len = snprintf(msg, sizeof(msg),
+                       "[%u] %zu trace records dropped; ring buffer full\n",
+                       ring->tid, dropped - ring->droppedReported);
+    if (len > 0 && (size_t)len < sizeof(msg)) {
+      jalib::writeAll(theLogFileFd, msg, len);
+    }
+    ring->droppedReported = dropped;
+  }
+
+  if (ring->state == JTRACE_RING_RETIRED && ring->head == ring->tail) {
+    __sync_bool_compare_and_swap(&ring->state, JTRACE_RING_RETIRED,
+                                 JTRACE_RING_FREE);
+  }
+}
+
+void
+jassert_internal::jassert_trace_print(const char *str, size_t len)
+{
+  if (theTraceBufferSize == 0 || !appendTraceRecord(str, len)) {
+    jassert_safe_print(str);
+  }
+}
+
+void
+jassert_internal::set_trace_buffer_size(size_t size)
+{
+  // Once rings have been handed out, their size can no longer change.
+  if (theTraceRings != NULL) {
+    return;
+  }
+
+  // Round up to a power of two so that offsets can be computed with a mask.
+  size_t bufSize = 0;
+  if (size > 0) {
+    bufSize = 4096;
+    while (bufSize < size) {
+      bufSize <<= 1;
+    }
+  }
+  theTraceBufferSize = bufSize;
+}
+
+bool
+jassert_internal::flush_trace_buffers(bool wait)
+{
+  if (theTraceBufferSize == 0) {
+    return true;
+  }
+
+  while (!__sync_bool_compare_and_swap(&theTraceFlushLock, 0, 1)) {
+    if (!wait) {
+      return false;
+    }
+    sched_yield();
+  }
+
+  for (JTraceRing *ring = theTraceRings; ring != NULL; ring = ring->next) {
+    drainTraceRing(ring);
+  }
+
+  __sync_lock_release(&theTraceFlushLock);
+  return true;
+}
+
+void
+jassert_internal::trace_thread_exit()
+{
+  if (myTraceRing != NULL) {
+    myTraceRing->state = JTRACE_RING_RETIRED;
+    myTraceRing = NULL;
+  }
+}
+
+// The parent process still owns (and will flush) any records that were
+// buffered before fork.  Drop them in the child and recycle the rings of
+// threads that do not exist in the child.
+void
+jassert_internal::trace_reset_on_fork()
+{
+  theTraceFlushLock = 0;
+  for (JTraceRing *ring = theTraceRings; ring != NULL; ring = ring->next) {
+    ring->tail = ring->head;
+    ring->inAppend = false;
+    ring->droppedReported = ring->dropped;
+    if (ring != myTraceRing) {
+      ring->state = JTRACE_RING_FREE;
+    }
+  }
+  if (myTraceRing != NULL) {
+    myTraceRing->tid = jalib::syscall(SYS_gettid);
+  }
+}
@@ -109,7 +109,7 @@ class JAssert
 
     ///
     /// constructor: sets members
-    JAssert(bool exitWhenDone);
+    JAssert(bool exitWhenDone, bool isTrace = false);
 
     ///
     /// destructor: exits program if exitWhenDone is set
@@ -131,6 +131,10 @@ class JAssert
     ///
     /// if set true (on construction) call exit() on destruction
     bool _exitWhenDone;
+
+    ///
+    /// if set true, the message may be deferred to the per-thread trace buffer
+    bool _isTrace;
     dmtcp::ostringstream ss;
 };
 
@@ -141,6 +145,18 @@ void jassert_safe_print(const char *);
 void jassert_init();
 void close_stderr();
 
+// Asynchronous JTRACE backend.  When enabled with a non-zero buffer size,
+// JTRACE messages are appended as binary records to a lock-free per-thread
+// ring buffer instead of being written synchronously.  The rings are drained
+// into the log file by jassert_flush_trace_buffers().  Use
+// util/dmtcp_jtrace_decode.py to decode the resulting log file.
+void jassert_trace_print(const char *str, size_t len);
+void set_trace_buffer_size(size_t size);
+// Returns false if wait is false and another thread is already flushing.
+bool flush_trace_buffers(bool wait);
+void trace_thread_exit();
+void trace_reset_on_fork();
+
 template<typename T>
 inline JAssert&
 JAssert::Print(const T &t)
@@ -188,6 +204,18 @@ void set_log_file(const dmtcp::string &path,
 
 #define JASSERT_CLOSE_STDERR() (jassert_internal::close_stderr());
 
+#define JASSERT_SET_TRACE_BUFFER(size) \
+  (jassert_internal::set_trace_buffer_size(size));
+
+// Blocks until all per-thread trace buffers have been drained.
+#define JASSERT_FLUSH_TRACE_BUFFERS() \
+  (jassert_internal::flush_trace_buffers(true));
+
+// Drains the trace buffers only if no other thread is currently doing so.
+// Safe to call from the checkpoint thread while user threads are suspended.
+#define JASSERT_TRY_FLUSH_TRACE_BUFFERS() \
+  (jassert_internal::flush_trace_buffers(false));
+
 #define JASSERT_ERRNO     (strerror(errno))
 
 #define JASSERT_PRINT(str) jassert_internal::JAssert(false).Print(str)
@@ -211,8 +239,8 @@ void set_log_file(const dmtcp::string &path,
     JASSERT_FUNC).Print("; REASON='" reason "'\n")
 
 #ifdef LOGGING
-# define JTRACE(msg)                \
-  jassert_internal::JAssert(false). \
+# define JTRACE(msg)                      \
+  jassert_internal::JAssert(false, true). \
   JASSERT_CONTEXT("TRACE", msg).JASSERT_CONT_A
 #else // ifdef LOGGING
 # define JTRACE(msg)                                              \
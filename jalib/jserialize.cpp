@@ -26,15 +26,29 @@
 #include <stdio.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+
+// Size of the write buffer of JBinarySerializeWriterRaw.
+#define WRITE_BUFFER_SIZE (64 * 1024)
 
 jalib::JBinarySerializeWriterRaw::JBinarySerializeWriterRaw(
   const dmtcp::string &path, int fd)
   : JBinarySerializer(path)
   , _fd(fd)
+  , _buf(NULL)
+  , _bufLen(0)
 {
   JASSERT(_fd >= 0)(path)(JASSERT_ERRNO).Text("open(path) failed");
 }
 
+jalib::JBinarySerializeWriterRaw::~JBinarySerializeWriterRaw()
+{
+  flush();
+  if (_buf != NULL) {
+    JALLOC_HELPER_FREE(_buf);
+  }
+}
+
 jalib::JBinarySerializeWriter::JBinarySerializeWriter(const dmtcp::string &path)
   : JBinarySerializeWriterRaw(path,
                               jalib::open(path.c_str(),
@@ -55,6 +69,7 @@ jalib::JBinarySerializeReader::JBinarySerializeReader(const dmtcp::string &path)
 
 jalib::JBinarySerializeWriter::~JBinarySerializeWriter()
 {
+  flush();
   close(_fd);
 }
 
@@ -73,6 +88,7 @@ jalib::JBinarySerializeReaderRaw::isReader() { return true; }
 void
 jalib::JBinarySerializeWriterRaw::rewind()
 {
+  flush();
   JASSERT(lseek(_fd, 0, SEEK_SET) == 0)(strerror(errno)).Text("Cannot rewind");
 }
 
@@ -87,6 +103,7 @@ jalib::JBinarySerializeWriterRaw::isempty()
 {
   struct stat buf;
 
+  flush();
   JASSERT(fstat(_fd, &buf) == 0);
   return buf.st_size == 0;
 }
@@ -116,13 +133,66 @@ jalib::JBinarySerializeReaderRaw::isEOF()
 void
 jalib::JBinarySerializeWriterRaw::readOrWrite(void *buffer, size_t len)
 {
-  size_t ret = jalib::writeAll(_fd, buffer, len);
-
-  JASSERT(ret == len) (filename()) (len) (JASSERT_ERRNO)
-  .Text("write() failed");
+  if (_bufLen + len <= WRITE_BUFFER_SIZE) {
+    if (_buf == NULL) {
+      _buf = (char *)JALLOC_HELPER_MALLOC(WRITE_BUFFER_SIZE);
+    }
+    memcpy(_buf + _bufLen, buffer, len);
+    _bufLen += len;
+  } else {
+    writeBuffered(buffer, len);
+  }
   _bytes += len;
 }
 
+void
+jalib::JBinarySerializeWriterRaw::flush()
+{
+  writeBuffered(NULL, 0);
+}
+
+// Write out the buffered data, followed by len bytes at buffer, with as
+// few writev() calls as possible.
+void
+jalib::JBinarySerializeWriterRaw::writeBuffered(const void *buffer, size_t len)
+{
+  struct iovec iov[2];
+  int iovcnt = 0;
+
+  if (_bufLen > 0) {
+    iov[iovcnt].iov_base = _buf;
+    iov[iovcnt].iov_len = _bufLen;
+    iovcnt++;
+  }
+  if (len > 0) {
+    iov[iovcnt].iov_base = (void *)buffer;
+    iov[iovcnt].iov_len = len;
+    iovcnt++;
+  }
+
+  struct iovec *iovp = iov;
+  while (iovcnt > 0) {
+    ssize_t ret = writev(_fd, iovp, iovcnt);
+    if (ret == -1) {
+      JASSERT(errno == EINTR || errno == EAGAIN)
+        (filename()) (_bufLen) (len) (JASSERT_ERRNO)
+      .Text("write() failed");
+      continue;
+    }
+    JASSERT(ret > 0) (filename()) (_bufLen) (len).Text("write() failed");
+    while (iovcnt > 0 && (size_t)ret >= iovp->iov_len) {
+      ret -= iovp->iov_len;
+      iovp++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iovp->iov_base = (char *)iovp->iov_base + ret;
+      iovp->iov_len -= ret;
+    }
+  }
+  _bufLen = 0;
+}
+
 void
 jalib::JBinarySerializeReaderRaw::readOrWrite(void *buffer, size_t len)
 {
@@ -29,6 +29,9 @@
 #include <stdint.h>
 #include <string>
 #include <vector>
+#if __cplusplus >= 201103L
+# include <type_traits>
+#endif // if __cplusplus >= 201103L
 
 #define JSERIALIZE_ASSERT_POINT(str)                                \
   { char versionCheck[] = str;                                      \
@@ -38,6 +41,36 @@
             correctValue)(versionCheck)(correctValue)(o.filename()) \
     .Text("invalid file format"); }
 
+// Markers around individual container elements only help to debug the
+// serialization code itself, and make up most of the size of large tables,
+// so release builds omit them.  Each container records which of the two
+// formats it uses, so that a file written by a build with a different DEBUG
+// setting is reported as such.
+#ifdef DEBUG
+# define JSERIALIZE_ELEMENT_POINT(str) JSERIALIZE_ASSERT_POINT(str)
+# define JSERIALIZE_ELEMENT_FORMAT     "elements:marked"
+#else // ifdef DEBUG
+# define JSERIALIZE_ELEMENT_POINT(str)
+# define JSERIALIZE_ELEMENT_FORMAT     "elements:packed"
+#endif // ifdef DEBUG
+
+#define JSERIALIZE_FORMAT_POINT()                                       \
+  { char formatCheck[] = JSERIALIZE_ELEMENT_FORMAT;                     \
+    dmtcp::string correctValue = formatCheck;                           \
+    o &formatCheck;                                                     \
+    JASSERT(formatCheck ==                                              \
+            correctValue)(formatCheck)(correctValue)(o.filename())      \
+    .Text("file was written by a DMTCP build with a different DEBUG"    \
+          " setting"); }
+
+// Types that serialize(T&) copies byte for byte; containers of them are
+// copied with a single readOrWrite() call.
+#if __cplusplus >= 201103L
+# define JSERIALIZE_IS_RAW(T) std::is_trivially_copyable<T>::value
+#else // if __cplusplus >= 201103L
+# define JSERIALIZE_IS_RAW(T) __is_pod(T)
+#endif // if __cplusplus >= 201103L
+
 namespace jalib
 {
 class JBinarySerializer
@@ -78,6 +111,7 @@ class JBinarySerializer
       JBinarySerializer &o = *this;
 
       JSERIALIZE_ASSERT_POINT("dmtcp::vector:");
+      JSERIALIZE_FORMAT_POINT();
 
       // establish the size
       uint32_t len = t.size();
@@ -87,10 +121,16 @@ class JBinarySerializer
       t.resize(len);
 
       // now serialize all the elements
-      for (size_t i = 0; i < len; ++i) {
-        JSERIALIZE_ASSERT_POINT("[");
-        serialize(t[i]);
-        JSERIALIZE_ASSERT_POINT("]");
+      if (JSERIALIZE_IS_RAW(T)) {
+        if (len > 0) {
+          readOrWrite(&t[0], len * sizeof(T));
+        }
+      } else {
+        for (size_t i = 0; i < len; ++i) {
+          JSERIALIZE_ELEMENT_POINT("[");
+          serialize(t[i]);
+          JSERIALIZE_ELEMENT_POINT("]");
+        }
       }
 
       JSERIALIZE_ASSERT_POINT("endvector");
@@ -99,13 +139,15 @@ class JBinarySerializer
     template<typename K, typename V>
     void serializePair(K &key, V &val)
     {
+#ifdef DEBUG
       JBinarySerializer &o = *this;
+#endif // ifdef DEBUG
 
-      JSERIALIZE_ASSERT_POINT("[");
+      JSERIALIZE_ELEMENT_POINT("[");
       serialize(key);
-      JSERIALIZE_ASSERT_POINT(",");
+      JSERIALIZE_ELEMENT_POINT(",");
       serialize(val);
-      JSERIALIZE_ASSERT_POINT("]");
+      JSERIALIZE_ELEMENT_POINT("]");
     }
 
     template<typename K, typename V>
@@ -114,13 +156,16 @@ class JBinarySerializer
       JBinarySerializer &o = *this;
 
       JSERIALIZE_ASSERT_POINT("dmtcp::map:");
+      JSERIALIZE_FORMAT_POINT();
 
       // establish the size
       uint32_t len = t.size();
       serialize(len);
 
       // now serialize all the elements
-      if (isReader()) {
+      if (JSERIALIZE_IS_RAW(K) && JSERIALIZE_IS_RAW(V)) {
+        serializeRawMap(t, len);
+      } else if (isReader()) {
         K key; V val;
         for (size_t i = 0; i < len; i++) {
           serializePair(key, val);
@@ -138,6 +183,38 @@ class JBinarySerializer
       JSERIALIZE_ASSERT_POINT("endmap");
     }
 
+    // The entries of a map with raw keys and values are stored as an array
+    // of (key, value) records, moved through a fixed-size stack buffer.
+    template<typename K, typename V>
+    void serializeRawMap(dmtcp::map<K, V> &t, uint32_t len)
+    {
+      struct Entry {
+        K key;
+        V val;
+      };
+      enum { N = sizeof(Entry) < 4096 ? 4096 / sizeof(Entry) : 1 };
+      Entry entries[N];
+
+      typename dmtcp::map<K, V>::iterator it = t.begin();
+      for (uint32_t done = 0; done < len;) {
+        size_t n = len - done < (uint32_t)N ? len - done : (size_t)N;
+        if (isReader()) {
+          readOrWrite(entries, n * sizeof(Entry));
+          for (size_t i = 0; i < n; i++) {
+            t[entries[i].key] = entries[i].val;
+          }
+        } else {
+          memset((void *)entries, 0, n * sizeof(Entry));
+          for (size_t i = 0; i < n; i++, ++it) {
+            entries[i].key = it->first;
+            entries[i].val = it->second;
+          }
+          readOrWrite(entries, n * sizeof(Entry));
+        }
+        done += n;
+      }
+    }
+
     const dmtcp::string &filename() const { return _filename; }
 
     size_t bytes() const { return _bytes; }
@@ -160,18 +237,29 @@ JBinarySerializer::serialize<dmtcp::string>(dmtcp::string &t)
   readOrWrite(&t[0], len);
 }
 
+/*
+ * Writes are collected in a buffer and reach the fd on flush(), when the
+ * buffer fills up, or when the writer is destroyed.  Call flush() before
+ * writing to the fd directly while the writer is still alive.
+ */
 class JBinarySerializeWriterRaw : public JBinarySerializer
 {
   public:
     JBinarySerializeWriterRaw(const dmtcp::string &file, int fd);
+    ~JBinarySerializeWriterRaw();
     void readOrWrite(void *buffer, size_t len);
     bool isReader();
     void rewind();
     bool isempty();
+    void flush();
     int fd() { return _fd; }
 
   protected:
+    void writeBuffered(const void *buffer, size_t len);
+
     int _fd;
+    char *_buf;
+    size_t _bufLen;
 };
 
 class JBinarySerializeWriter : public JBinarySerializeWriterRaw
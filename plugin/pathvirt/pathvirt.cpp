@@ -13,6 +13,7 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <sys/time.h>
@@ -21,6 +22,7 @@
 #include <sys/vfs.h>
 #include <cstring>
 #include <cstdlib>
+#include <algorithm>
 
 #undef open
 #undef open64
@@ -39,7 +41,7 @@
 #define ENV_NEW_DPP        "DMTCP_NEW_PATH_PREFIX"
 #define MAX_ENV_VAR_SIZE   10*1024
 
-#define VIRTUAL_TO_PHYSICAL_PATH(virt) virtual_to_physical_path(virt)
+#define VIRTUAL_TO_PHYSICAL_PATH(virt, buf) virtual_to_physical_path(virt, buf)
 
 #define _real_open       NEXT_FNC(open)
 #define _real_open64     NEXT_FNC(open64)
@@ -82,8 +84,8 @@ static char newPathPrefixList[MAX_ENV_VAR_SIZE];
 static bool tmpBufferModified = false;
 static pthread_rwlock_t  listRwLock;
 
-static dmtcp::string
-virtual_to_physical_path(const char *virt_path);
+static const char *
+virtual_to_physical_path(const char *virt_path, char *buf);
 
 EXTERNC int dmtcp_pathvirt_enabled() { return 1; }
 
@@ -92,110 +94,181 @@ EXTERNC int dmtcp_pathvirt_enabled() { return 1; }
  */
 
 /*
- * Compare the input path and the path delimited by start and end.
- * Return true if the latter is the prefix of path.
- * */
+ * Compiled form of the prefix lists.
+ *
+ * The colon lists only change on restart and exec, while every wrapped
+ * libc call needs a translation.  So the lists are compiled once into an
+ * immutable table: the non-empty elements of the original list, sorted by
+ * prefix, each paired with the element at the same index in the new list.
+ * Translation then reduces to a binary search for each '/'-delimited
+ * prefix of the path, and needs neither listRwLock nor any allocation.
+ */
+struct PrefixEntry {
+  const char *oldPrefix;
+  size_t oldLen;
+  const char *newPrefix;  // NULL if the new list has no element at index
+  size_t newLen;
+  int index;              // position in the original colon list
+};
 
-static bool
-pathsCmp(const char *path,
-         const char *start,
-         const char *end)
-{
-  return (end - start > 0 &&
-          strncmp(path, start, end - start) == 0 &&
-          (path[end - start] == '\0' || // they are equal
-           path[end - start] == '/'));  // path has additional sub dirs
-}
+struct PrefixTable {
+  dmtcp::string oldList;
+  dmtcp::string newList;
+  dmtcp::vector<PrefixEntry> entries;
+  size_t minLen;
+  size_t maxLen;
+};
+
+/* NULL unless paths should be swapped. */
+static PrefixTable *prefixTable = NULL;
 
 /*
- * clfind - returns first index in colonList which is a prefix for path
- *          modifies the @listPtr to point to the element in colonList
+ * Tables replaced by compilePrefixTable().  A thread that loaded one just
+ * before the swap may still be searching it, possibly after being suspended
+ * across a checkpoint, so they are never freed.  The lists are only
+ * recompiled on restart and after exec, so few accumulate.
  */
-static int
-clfind(const char *colonList,  // IN
-       const char *path,       // IN
-       char **listPtr)         // OUT
-{
-    int index = 0;
-    char *element = const_cast<char *>(colonList);
-    char *colon = NULL;
-
-    /* while there is a colon present, loop */
-    while ((colon = strchr(element, ':'))) {
-        /* check if element is a prefix of path. here, colon - element is
-           an easy way to calculate the length of the element in the list
-           to use as the size parameter to strncmp */
-        if (pathsCmp(path, element, colon)) {
-            JTRACE("Prefix match for path") (element) (path);
-            *listPtr = element;
-            return index;
-        }
+static dmtcp::vector<PrefixTable *> retiredPrefixTables;
 
-        /* move element to point to next element */
-        element = colon + 1;
+static int
+prefixCmp(const char *a, size_t aLen, const char *b, size_t bLen)
+{
+  int ret = memcmp(a, b, aLen < bLen ? aLen : bLen);
+  if (ret != 0) {
+    return ret;
+  }
+  return aLen < bLen ? -1 : (aLen > bLen ? 1 : 0);
+}
 
-        index++;
-    }
+static bool
+entryLess(const PrefixEntry &a, const PrefixEntry &b)
+{
+  int ret = prefixCmp(a.oldPrefix, a.oldLen, b.oldPrefix, b.oldLen);
+  return ret < 0 || (ret == 0 && a.index < b.index);
+}
 
-    /* process the last element in the list */
-    if (pathsCmp(path, element, element + strlen(element))) {
-        JTRACE("Prefix match for path") (element) (path);
-        *listPtr = element;
-        return index;
-    }
+/*
+ * splitList - split colonList into (pointer, length) pairs, including any
+ *             empty elements, so that indices match the original list
+ */
+static void
+splitList(const char *colonList,
+          dmtcp::vector<std::pair<const char *, size_t> > *elements)
+{
+  const char *element = colonList;
+  const char *colon = NULL;
 
-    /* not found */
-    JTRACE("No match found") (colonList) (path);
-    return -1;
+  while ((colon = strchr(element, ':'))) {
+    elements->push_back(std::make_pair(element, (size_t)(colon - element)));
+    element = colon + 1;
+  }
+  elements->push_back(std::make_pair(element, strlen(element)));
 }
 
 /*
- * clget - returns pointer to element in colonList at index i
- *         and NULL if not found
+ * compilePrefixTable - rebuild prefixTable from the current lists
  *
- * NOTE: argument `int i` is declared signed (versus unsigned) because we
- * commonly expect this argument to be the return value of a `clfind` call. If
- * the `clfind` caller did not check the return value and passes in a negative
- * int, this will harmless fail in a "clean" manner, typewise, rather than
- * "harmlessly" failing due to an underlying signed->unsigned type cast.
+ * Only called on restart and right after exec.
  */
-static char*
-clget(const char *colonList, int i)
-{
-    int curr_ind = 0;
-    char *element = const_cast<char *>(colonList);
-    char *colon = NULL;
-
-    /* iterate through elements until last one */
-    while ((colon = strchr(element, ':'))) {
-        /* if we are at the request index, return pointer to start of element */
-        if (curr_ind == i)
-            return element;
-
-        /* otherwise, advance pointer to next element and bump current index */
-        element = colon + 1;
-        curr_ind++;
+static void
+compilePrefixTable()
+{
+  PrefixTable *table = NULL;
+
+  if (shouldSwap) {
+    table = new PrefixTable;
+    table->oldList = oldPathPrefixList;
+    table->newList = newPathPrefixList;
+    table->minLen = (size_t)-1;
+    table->maxLen = 0;
+
+    dmtcp::vector<std::pair<const char *, size_t> > oldElements;
+    dmtcp::vector<std::pair<const char *, size_t> > newElements;
+    splitList(table->oldList.c_str(), &oldElements);
+    splitList(table->newList.c_str(), &newElements);
+
+    for (size_t i = 0; i < oldElements.size(); i++) {
+      /* empty elements never match a path */
+      if (oldElements[i].second == 0) {
+        continue;
+      }
+      PrefixEntry entry;
+      entry.oldPrefix = oldElements[i].first;
+      entry.oldLen = oldElements[i].second;
+      entry.newPrefix = i < newElements.size() ? newElements[i].first : NULL;
+      entry.newLen = i < newElements.size() ? newElements[i].second : 0;
+      entry.index = i;
+      table->entries.push_back(entry);
+      table->minLen = std::min(table->minLen, entry.oldLen);
+      table->maxLen = std::max(table->maxLen, entry.oldLen);
+    }
+
+    /* For duplicate prefixes, only the first one in the list can match. */
+    std::sort(table->entries.begin(), table->entries.end(), entryLess);
+    size_t n = 0;
+    for (size_t i = 0; i < table->entries.size(); i++) {
+      if (n == 0 ||
+          prefixCmp(table->entries[n - 1].oldPrefix,
+                    table->entries[n - 1].oldLen,
+                    table->entries[i].oldPrefix,
+                    table->entries[i].oldLen) != 0) {
+        table->entries[n++] = table->entries[i];
+      }
     }
+    table->entries.resize(n);
 
-    /* last element */
-    if (curr_ind == i)
-        return element;
+    JTRACE("Compiled path prefix table")
+      (table->oldList) (table->newList) (table->entries.size());
+  }
 
-    /* not found */
-    return NULL;
+  PrefixTable *oldTable = __atomic_exchange_n(&prefixTable, table,
+                                              __ATOMIC_ACQ_REL);
+  if (oldTable != NULL) {
+    retiredPrefixTables.push_back(oldTable);
+  }
 }
 
 /*
- * clgetsize - returns size of an element pointed to by @element in the
- *             list
+ * findPrefix - returns the entry for the first element of the original list
+ *              that is a prefix of path, or NULL if there is none
+ *
+ * An element is a prefix of path if path equals it, or continues with '/'.
  */
-static size_t
-clgetsize(const char *colonList, const char *element)
-{
-    /* either calculate the element's length, or call
-     * strlen if element was last one */
-    const char *colon = strchr(element, ':');
-    return colon ? colon - element : strlen(element);
+static const PrefixEntry *
+findPrefix(const PrefixTable *table, const char *path)
+{
+  const PrefixEntry *match = NULL;
+
+  for (size_t len = 0; len <= table->maxLen; len++) {
+    char c = path[len];
+    if ((c == '/' || c == '\0') && len >= table->minLen) {
+      size_t lo = 0;
+      size_t hi = table->entries.size();
+      while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const PrefixEntry &e = table->entries[mid];
+        int ret = prefixCmp(e.oldPrefix, e.oldLen, path, len);
+        if (ret == 0) {
+          if (match == NULL || e.index < match->index) {
+            match = &e;
+          }
+          break;
+        } else if (ret < 0) {
+          lo = mid + 1;
+        } else {
+          hi = mid;
+        }
+      }
+    }
+    if (c == '\0') {
+      break;
+    }
+  }
+
+  if (match != NULL) {
+    JTRACE("Prefix match for path") (match->oldPrefix) (path);
+  }
+  return match;
 }
 
 static void
@@ -272,6 +345,7 @@ pathvirtInitialize()
      * virtual_to_physical_path can know whether to try to swap or not
      */
     shouldSwap = *oldPathPrefixList && *newPathPrefixList;
+    compilePrefixTable();
 }
 
 EXTERNC void
@@ -307,9 +381,12 @@ get_new_path_prefix_list()
 EXTERNC const char*
 get_virtual_to_physical_path(const char *virt_path)
 {
-  static dmtcp::string temp;
-  temp = VIRTUAL_TO_PHYSICAL_PATH(virt_path);
-  return temp.c_str();
+  static char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(virt_path, physBuf);
+  if (phys_path != physBuf && phys_path != NULL) {
+    snprintf(physBuf, sizeof(physBuf), "%s", phys_path);
+  }
+  return phys_path == NULL ? NULL : physBuf;
 }
 
 /*
@@ -363,6 +440,7 @@ pathvirt_EventHook(DmtcpEvent_t event, DmtcpEventData_t *data)
            snprintf(newPathPrefixList, sizeof(newPathPrefixList),
                     "%s", newPrefixList);
            shouldSwap = *oldPathPrefixList && *newPathPrefixList;
+           compilePrefixTable();
        }
        break;
     }
@@ -406,8 +484,8 @@ DMTCP_DECL_PLUGIN(pathvirt_plugin);
 static int _open_open64_work(int(*fn) (const char *path, int flags, ...),
                              const char *path, int flags, mode_t mode)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   int fd = -1;
   fd = (*fn)(phys_path, flags, mode);
@@ -469,8 +547,8 @@ static FILE *_fopen_fopen64_work(FILE*(*fn) (const char *path,
                                              const char *mode),
                                  const char *path, const char *mode)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   FILE* file = NULL;
   file = (*fn)(phys_path, mode);
@@ -490,8 +568,8 @@ extern "C" FILE *fopen64(const char* path, const char* mode)
 
 extern "C" FILE *freopen(const char *path, const char *mode, FILE *stream)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
   FILE *file = _real_freopen(phys_path, mode, stream);
 
   return file;
@@ -503,8 +581,8 @@ extern "C" int openat(int dirfd, const char *path, int flags, ...)
   va_start(arg, flags);
   mode_t mode = va_arg(arg, int);
   va_end(arg);
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
   int fd = _real_openat(dirfd, phys_path, flags, mode);
   return fd;
 }
@@ -525,8 +603,8 @@ extern "C" int openat64(int dirfd, const char *path, int flags, ...)
   va_start(arg, flags);
   mode_t mode = va_arg(arg, int);
   va_end(arg);
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
   int fd = _real_openat64(dirfd, phys_path, flags, mode);
   return fd;
 }
@@ -543,8 +621,8 @@ extern "C" int __openat64_2(int dirfd, const char *path, int flags)
 
 extern "C" DIR *opendir(const char *name)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(name);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(name, physBuf);
   DIR *dir = _real_opendir(phys_path);
   return dir;
 }
@@ -555,8 +633,8 @@ extern "C" int __xstat(int vers, const char *path, struct stat *buf)
   if (retval == -1 && errno == EFAULT) {
     // EFAULT means path or buf was a bad address.  So, we're done.  Return.
   } else {
-    dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-    const char *phys_path = temp.c_str();
+    char physBuf[PATH_MAX];
+    const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
     retval = _real_xstat(vers, phys_path, buf); // Re-do it with correct path.
   }
   return retval;
@@ -568,8 +646,8 @@ extern "C" int __xstat64(int vers, const char *path, struct stat64 *buf)
   if (retval == -1 && errno == EFAULT) {
     // EFAULT means path or buf was a bad address.  So, we're done.  Return.
   } else {
-    dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-    const char *phys_path = temp.c_str();
+    char physBuf[PATH_MAX];
+    const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
     retval = _real_xstat64(vers, phys_path, buf);
   }
   return retval;
@@ -581,8 +659,8 @@ extern "C" int __lxstat(int vers, const char *path, struct stat *buf)
   if (retval == -1 && errno == EFAULT) {
     // EFAULT means path or buf was a bad address.  So, we're done.  Return.
   } else {
-    dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-    const char *phys_path = temp.c_str();
+    char physBuf[PATH_MAX];
+    const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
     retval = _real_lxstat(vers, phys_path, buf);
   }
   return retval;
@@ -594,8 +672,8 @@ extern "C" int __lxstat64(int vers, const char *path, struct stat64 *buf)
   if (retval == -1 && errno == EFAULT) {
     // EFAULT means path or buf was a bad address.  So, we're done.  Return.
   } else {
-    dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-    const char *phys_path = temp.c_str();
+    char physBuf[PATH_MAX];
+    const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
     retval = _real_lxstat64(vers, phys_path, buf);
   }
   return retval;
@@ -603,8 +681,8 @@ extern "C" int __lxstat64(int vers, const char *path, struct stat64 *buf)
 
 extern "C" ssize_t readlink(const char *path, char *buf, size_t bufsiz)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
   ssize_t retval = _real_readlink(phys_path, buf, bufsiz);
   return retval;
 }
@@ -617,8 +695,8 @@ extern "C" ssize_t __readlink_chk(const char *path, char *buf,
 
 extern "C" char *realpath(const char *path, char *resolved_path)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
   char *ret = _real_realpath(phys_path, resolved_path);
   return ret;
 }
@@ -641,110 +719,110 @@ extern "C" char *canonicalize_file_name(const char *path)
 
 extern "C" int access(const char *path, int mode)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   return _real_access(phys_path, mode);
 }
 
 extern "C" int truncate(const char *path, off_t length)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   return _real_truncate(phys_path, length);
 }
 
 extern "C" int rename(const char *oldpath, const char *newpath)
 {
-  dmtcp::string temp1 = VIRTUAL_TO_PHYSICAL_PATH(oldpath);
-  dmtcp::string temp2 = VIRTUAL_TO_PHYSICAL_PATH(newpath);
-  const char *old_phys_path = temp1.c_str();
-  const char *new_phys_path = temp2.c_str();
+  char physBuf1[PATH_MAX];
+  char physBuf2[PATH_MAX];
+  const char *old_phys_path = VIRTUAL_TO_PHYSICAL_PATH(oldpath, physBuf1);
+  const char *new_phys_path = VIRTUAL_TO_PHYSICAL_PATH(newpath, physBuf2);
 
   return _real_rename(old_phys_path, new_phys_path);
 }
 
 extern "C" int mkdir(const char *path, mode_t mode)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   return _real_mkdir(phys_path, mode);
 }
 
 extern "C" int chmod(const char *path, mode_t mode)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   return _real_chmod(phys_path, mode);
 }
 
 extern "C" int unlink(const char *path)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   return _real_unlink(phys_path);
 }
 
 extern "C" int chdir(const char *path)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   return _real_chdir(phys_path);
 }
 
 extern "C" int remove(const char *path)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   return _real_remove(phys_path);
 }
 
 extern "C" int rmdir(const char *path)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   return _real_rmdir(phys_path);
 }
 
 extern "C" int link(const char *oldpath, const char *newpath)
 {
-  dmtcp::string temp1 = VIRTUAL_TO_PHYSICAL_PATH(oldpath);
-  dmtcp::string temp2 = VIRTUAL_TO_PHYSICAL_PATH(newpath);
-  const char *old_phys_path = temp1.c_str();
-  const char *new_phys_path = temp2.c_str();
+  char physBuf1[PATH_MAX];
+  char physBuf2[PATH_MAX];
+  const char *old_phys_path = VIRTUAL_TO_PHYSICAL_PATH(oldpath, physBuf1);
+  const char *new_phys_path = VIRTUAL_TO_PHYSICAL_PATH(newpath, physBuf2);
 
   return _real_link(old_phys_path, new_phys_path);
 }
 
 extern "C" int symlink(const char *oldpath, const char *newpath)
 {
-  dmtcp::string temp1 = VIRTUAL_TO_PHYSICAL_PATH(oldpath);
-  dmtcp::string temp2 = VIRTUAL_TO_PHYSICAL_PATH(newpath);
-  const char *old_phys_path = temp1.c_str();
-  const char *new_phys_path = temp2.c_str();
+  char physBuf1[PATH_MAX];
+  char physBuf2[PATH_MAX];
+  const char *old_phys_path = VIRTUAL_TO_PHYSICAL_PATH(oldpath, physBuf1);
+  const char *new_phys_path = VIRTUAL_TO_PHYSICAL_PATH(newpath, physBuf2);
 
   return _real_symlink(old_phys_path, new_phys_path);
 }
 
 extern "C" long pathconf(const char *path, int name)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   return _real_pathconf(phys_path, name);
 }
 
 extern "C" int statfs(const char *path, struct statfs *buf)
 {
-  dmtcp::string temp = VIRTUAL_TO_PHYSICAL_PATH(path);
-  const char *phys_path = temp.c_str();
+  char physBuf[PATH_MAX];
+  const char *phys_path = VIRTUAL_TO_PHYSICAL_PATH(path, physBuf);
 
   return _real_statfs(phys_path, buf);
 }
@@ -752,18 +830,24 @@ extern "C" int statfs(const char *path, struct statfs *buf)
 /*
  * Resolve the path if path is a symbolic link
  *
- * path should be a physical path.
+ * path should be a physical path; it may point into buf.  Returns either
+ * path itself or buf, which must hold PATH_MAX bytes.
  */
-static dmtcp::string
-resolve_symlink(const char *path)
+static const char *
+resolve_symlink(const char *path, char *buf)
 {
   struct stat statBuf;
   if (_real_lxstat(_STAT_VER, path, &statBuf) == 0
       && S_ISLNK(statBuf.st_mode)) {
-    char buf[PATH_MAX];
-    memset(buf, 0, sizeof(buf));
-    JASSERT(_real_readlink(path, buf, sizeof(buf) - 1) != -1);
-    return virtual_to_physical_path(buf);
+    char target[PATH_MAX];
+    memset(target, 0, sizeof(target));
+    JASSERT(_real_readlink(path, target, sizeof(target) - 1) != -1);
+    const char *phys_path = virtual_to_physical_path(target, buf);
+    if (phys_path == target) {
+      strcpy(buf, target);
+      return buf;
+    }
+    return phys_path;
   }
 
   return path;
@@ -772,9 +856,10 @@ resolve_symlink(const char *path)
 /*
  * virtual_to_physical_path - translate virtual to physical path
  *
- * Returns a dmtcp::string for the corresponding physical path to the given
- * virtual path. If no path translation occurred, the given virtual path
- * will simply be returned as a dmtcp::string.
+ * Returns the physical path corresponding to the given virtual path.  If a
+ * translation occurred, it is written to buf (PATH_MAX bytes, provided by
+ * the caller) and buf is returned; otherwise the given virtual path itself
+ * is returned.
  *
  * Conceptually, an original path prior to the first checkpoint is considered a
  * "virtual path".  After a restart, it will be substituted using the latest
@@ -784,52 +869,39 @@ resolve_symlink(const char *path)
  * virtual path to the latest "physical path", which will correspond to the
  * current, post-restart filesystem.
  */
-dmtcp::string
-virtual_to_physical_path(const char *virt_path)
+static const char *
+virtual_to_physical_path(const char *virt_path, char *buf)
 {
-    char *oldPathPtr = NULL;
-    dmtcp::string virtPathString(virt_path?virt_path:"");
-    dmtcp::string physPathString;
+    const PrefixTable *table = __atomic_load_n(&prefixTable, __ATOMIC_ACQUIRE);
 
     /* quickly return if no swap or NULL path */
-    if (!shouldSwap || !virt_path) {
-        return virtPathString;
+    if (table == NULL || virt_path == NULL) {
+        return virt_path;
     }
 
-    /* yes, should swap */
-
-    pthread_rwlock_rdlock(&listRwLock);
     /* check if path is in list of registered paths to swap out */
-    int index = clfind(oldPathPrefixList, virt_path, &oldPathPtr);
-    if (index == -1) {
-      pthread_rwlock_unlock(&listRwLock);
-      return resolve_symlink(virtPathString.c_str());
+    const PrefixEntry *entry = findPrefix(table, virt_path);
+    if (entry == NULL) {
+      return resolve_symlink(virt_path, buf);
     }
 
-    /* found it in old list, now get a pointer to the new prefix to swap in*/
-    char *physPathPtr = clget(newPathPrefixList, index);
-    if (physPathPtr == NULL) {
-        pthread_rwlock_unlock(&listRwLock);
-        return virtPathString;
+    /* found it in old list, but there is no new prefix to swap in */
+    if (entry->newPrefix == NULL) {
+        return virt_path;
     }
 
-    size_t newElementSz = clgetsize(newPathPrefixList, physPathPtr);
-    size_t oldElementSz = clgetsize(oldPathPrefixList, oldPathPtr);
-
-    /* temporarily null terminate new element */
-    physPathPtr[newElementSz] = '\0';
-
     /* finally, create full path with the new prefix swapped in */
-    physPathString = physPathPtr;
-    physPathString += "/";
-    physPathString += (virt_path + oldElementSz);
-    JTRACE("Matching virtual path to real path")
-      (virtPathString) (physPathString);
-
-    /* repair the colon list */
-    physPathPtr[newElementSz] = ':';
-
-    pthread_rwlock_unlock(&listRwLock);
+    const char *suffix = virt_path + entry->oldLen;
+    size_t suffixLen = strlen(suffix);
+    if (entry->newLen + 1 + suffixLen >= PATH_MAX) {
+      JWARNING(false) (virt_path) (entry->newLen + 1 + suffixLen)
+        .Text("Physical path too long; not translating");
+      return virt_path;
+    }
+    memcpy(buf, entry->newPrefix, entry->newLen);
+    buf[entry->newLen] = '/';
+    memcpy(buf + entry->newLen + 1, suffix, suffixLen + 1);
+    JTRACE("Matching virtual path to real path") (virt_path) (buf);
 
-    return resolve_symlink(physPathString.c_str());
+    return resolve_symlink(buf, buf);
 }
@@ -0,0 +1,360 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2008 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "jassert.h"
+#include "chunkstore.h"
+#include "constants.h"
+#include "syscallwrappers.h"
+#include "util.h"
+
+/* Chunk boundaries are chosen with a gear-based rolling hash (as in FastCDC),
+ * so that an insertion or deletion in one part of the memory only changes the
+ * chunks around it.  Identical data in different processes or in different
+ * checkpoint generations thus results in identical chunks, even if it is
+ * mapped at different offsets.
+ *
+ * Chunks are named by their 128-bit MurmurHash3.  A chunk file is first
+ * written under a temporary name, synced, and then renamed into place, so
+ * that a file under the final name is always complete, even after a crash,
+ * and processes storing the same chunk concurrently do not see partial
+ * files.  A chunk that is already present gets its mtime updated instead,
+ * so that util/dmtcp_prune_chunks.py does not remove chunks that a ckpt
+ * image in progress (and not yet in any reference list) uses.
+ *
+ * NOTE: This code runs while the memory areas are being written.  It must not
+ * allocate memory, since that could change the memory layout (see
+ * mtcp_writememoryareas()).
+ */
+#define CHUNK_MIN_SIZE (64 * 1024)
+#define CHUNK_MAX_SIZE (1024 * 1024)
+#define CHUNK_MASK     ((1ULL << 18) - 1) /* ~256 KB after CHUNK_MIN_SIZE */
+
+#define CHUNK_REFS_PER_WRITE 256
+
+#define CHUNK_REF_LIST_SUFFIX ".chunks"
+#define CHUNK_HASH_LEN        32
+
+using namespace dmtcp;
+
+static bool chunkStoreEnabled = false;
+static char chunkDir[PATH_MAX];
+static uint64_t gear[256];
+
+// The reference list of the image being written: one hash per line.
+static int refListFd = -1;
+static char refListBuf[4096];
+static size_t refListLen = 0;
+
+static uint64_t numChunks = 0;
+static uint64_t numNewChunks = 0;
+static uint64_t totalBytes = 0;
+static uint64_t newBytes = 0;
+
+static inline uint64_t
+rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+fmix64(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+// MurmurHash3_x64_128 by Austin Appleby (public domain).
+static void
+murmurHash3_x64_128(const void *key, size_t len, uint64_t out[2])
+{
+  const uint8_t *data = (const uint8_t *)key;
+  const size_t nblocks = len / 16;
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+  uint64_t h1 = 0;
+  uint64_t h2 = 0;
+  uint64_t k1;
+  uint64_t k2;
+
+  for (size_t i = 0; i < nblocks; i++) {
+    memcpy(&k1, data + i * 16, sizeof(k1));
+    memcpy(&k2, data + i * 16 + 8, sizeof(k2));
+
+    k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+    k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+    h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+  }
+
+  const uint8_t *tail = data + nblocks * 16;
+  size_t rem = len & 15;
+  k1 = 0;
+  k2 = 0;
+  for (size_t i = rem; i > 8; i--) {
+    k2 ^= (uint64_t)tail[i - 1] << ((i - 9) * 8);
+  }
+  if (rem > 8) {
+    k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+  }
+  for (size_t i = rem < 8 ? rem : 8; i > 0; i--) {
+    k1 ^= (uint64_t)tail[i - 1] << ((i - 1) * 8);
+  }
+  if (rem > 0) {
+    k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+  }
+
+  h1 ^= len;
+  h2 ^= len;
+  h1 += h2;
+  h2 += h1;
+  h1 = fmix64(h1);
+  h2 = fmix64(h2);
+  h1 += h2;
+  h2 += h1;
+  out[0] = h1;
+  out[1] = h2;
+}
+
+static void
+initGearTable()
+{
+  // splitmix64; any fixed sequence of random values will do, but it must be
+  // the same for all processes for chunks to be shared.
+  uint64_t x = 0x9e3779b97f4a7c15ULL;
+
+  for (size_t i = 0; i < 256; i++) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    gear[i] = z ^ (z >> 31);
+  }
+}
+
+static size_t
+nextChunkSize(const char *buf, size_t len)
+{
+  if (len <= CHUNK_MIN_SIZE) {
+    return len;
+  }
+
+  size_t maxLen = len < CHUNK_MAX_SIZE ? len : CHUNK_MAX_SIZE;
+  uint64_t h = 0;
+  for (size_t i = CHUNK_MIN_SIZE; i < maxLen; i++) {
+    h = (h << 1) + gear[(uint8_t)buf[i]];
+    if ((h & CHUNK_MASK) == 0) {
+      return i + 1;
+    }
+  }
+  return maxLen;
+}
+
+static void
+flushRefList()
+{
+  if (refListLen > 0) {
+    JASSERT(Util::writeAll(refListFd, refListBuf, refListLen) ==
+            (ssize_t)refListLen) (JASSERT_ERRNO);
+    refListLen = 0;
+  }
+}
+
+static void
+addToRefList(const char *hash)
+{
+  if (refListFd == -1) {
+    return;
+  }
+  if (refListLen + CHUNK_HASH_LEN + 1 > sizeof(refListBuf)) {
+    flushRefList();
+  }
+  memcpy(refListBuf + refListLen, hash, CHUNK_HASH_LEN);
+  refListBuf[refListLen + CHUNK_HASH_LEN] = '\n';
+  refListLen += CHUNK_HASH_LEN + 1;
+}
+
+static void
+storeChunk(const ChunkRef &ref, const char *data)
+{
+  char subdir[PATH_MAX];
+  char path[PATH_MAX];
+  char tmpPath[PATH_MAX];
+  char hash[CHUNK_HASH_LEN + 1];
+
+  snprintf(hash, sizeof(hash), "%016llx%016llx",
+           (unsigned long long)ref.hash[0], (unsigned long long)ref.hash[1]);
+  // chunkDir is short enough for these; see ChunkStore::prepare().
+  JASSERT(snprintf(subdir, sizeof(subdir), "%s/%.2s", chunkDir, hash) <
+          (int)sizeof(subdir)) (chunkDir);
+  JASSERT(snprintf(path, sizeof(path), "%s/%s", subdir, hash) <
+          (int)sizeof(path)) (chunkDir);
+
+  numChunks++;
+  totalBytes += ref.size;
+  addToRefList(hash);
+
+  struct stat st;
+  if (stat(path, &st) == 0 && (uint64_t)st.st_size == ref.size) {
+    // Keep dmtcp_prune_chunks.py from removing it before the image that
+    // uses it is listed.
+    utimes(path, NULL);
+    return;
+  }
+
+  JASSERT(mkdir(subdir, S_IRWXU) == 0 || errno == EEXIST)
+    (subdir) (JASSERT_ERRNO);
+
+  // getpid() is virtual and not unique across computations sharing a
+  // ckptdir; let mkstemp pick a name that nobody else is writing to.
+  JASSERT(snprintf(tmpPath, sizeof(tmpPath), "%s.temp.XXXXXX", path) <
+          (int)sizeof(tmpPath)) (path);
+  int fd = _real_mkostemps(tmpPath, 0, O_CLOEXEC);
+  JASSERT(fd != -1) (tmpPath) (JASSERT_ERRNO);
+  JASSERT(Util::writeAll(fd, data, ref.size) == (ssize_t)ref.size)
+    (tmpPath) (JASSERT_ERRNO);
+  // A chunk is trusted once it has its final name; make sure all of it is
+  // on disk before it gets that name.
+  JASSERT(fsync(fd) == 0) (tmpPath) (JASSERT_ERRNO);
+  JASSERT(_real_close(fd) == 0) (tmpPath) (JASSERT_ERRNO);
+  JASSERT(rename(tmpPath, path) == 0) (tmpPath) (path) (JASSERT_ERRNO);
+
+  numNewChunks++;
+  newBytes += ref.size;
+}
+
+bool
+ChunkStore::isEnabled()
+{
+  return chunkStoreEnabled;
+}
+
+void
+ChunkStore::prepare(const string &ckptDir)
+{
+  const char *env = getenv(ENV_VAR_CHUNK_STORE);
+
+  chunkStoreEnabled = env != NULL && strcmp(env, "0") != 0;
+  if (!chunkStoreEnabled) {
+    return;
+  }
+
+  if (gear[0] == 0) {
+    initGearTable();
+  }
+
+  string dir = ckptDir + "/" DMTCP_CHUNK_STORE_DIR;
+  JASSERT(dir.length() < sizeof(chunkDir) - 64) (dir);
+  strcpy(chunkDir, dir.c_str());
+  JASSERT(mkdir(chunkDir, S_IRWXU) == 0 || errno == EEXIST)
+    (chunkDir) (JASSERT_ERRNO)
+  .Text("Error creating chunk store directory");
+
+  numChunks = numNewChunks = totalBytes = newBytes = 0;
+}
+
+/* Start the reference list of ckptFilename.  It is written under a temporary
+ * name, which dmtcp_prune_chunks.py also honors, until the image is complete.
+ */
+void
+ChunkStore::openRefList(const string &ckptFilename)
+{
+  if (!chunkStoreEnabled) {
+    return;
+  }
+
+  string tmpList = ckptFilename + CHUNK_REF_LIST_SUFFIX ".temp";
+  refListFd = _real_open(tmpList.c_str(), O_CREAT | O_WRONLY | O_TRUNC,
+                         S_IRUSR | S_IWUSR);
+  JASSERT(refListFd != -1) (tmpList) (JASSERT_ERRNO);
+  refListLen = 0;
+}
+
+/* Give the reference list its final name, next to the completed image.  An
+ * image written without the chunk store has no list.
+ */
+void
+ChunkStore::commitRefList(const string &ckptFilename)
+{
+  string list = ckptFilename + CHUNK_REF_LIST_SUFFIX;
+
+  if (refListFd == -1) {
+    unlink(list.c_str());
+    return;
+  }
+
+  string tmpList = list + ".temp";
+  flushRefList();
+  JASSERT(fsync(refListFd) == 0) (tmpList) (JASSERT_ERRNO);
+  JASSERT(_real_close(refListFd) == 0) (tmpList) (JASSERT_ERRNO);
+  refListFd = -1;
+  JASSERT(rename(tmpList.c_str(), list.c_str()) == 0)
+    (tmpList) (list) (JASSERT_ERRNO);
+}
+
+void
+ChunkStore::writeArea(int fd, Area *area)
+{
+  ChunkRef refs[CHUNK_REFS_PER_WRITE];
+  size_t numRefs = 0;
+
+  area->properties |= DMTCP_CHUNKED_AREA;
+  Util::writeAll(fd, area, sizeof(*area));
+
+  const char *data = area->addr;
+  size_t remaining = area->size;
+  while (remaining > 0) {
+    ChunkRef &ref = refs[numRefs++];
+    ref.size = nextChunkSize(data, remaining);
+    murmurHash3_x64_128(data, ref.size, ref.hash);
+    storeChunk(ref, data);
+
+    data += ref.size;
+    remaining -= ref.size;
+
+    if (numRefs == CHUNK_REFS_PER_WRITE || remaining == 0) {
+      Util::writeAll(fd, refs, numRefs * sizeof(ChunkRef));
+      numRefs = 0;
+    }
+  }
+}
+
+void
+ChunkStore::printStats()
+{
+  if (!chunkStoreEnabled) {
+    return;
+  }
+  JTRACE("Chunk store statistics")
+    (chunkDir) (numChunks) (numNewChunks) (totalBytes) (newBytes);
+}
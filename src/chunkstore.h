@@ -0,0 +1,50 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2008 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include "dmtcpalloc.h"
+#include "procmapsarea.h"
+
+// Content-addressed store for the memory contents of checkpoint images.
+// When enabled (DMTCP_CHUNK_STORE=1), memory areas are split into
+// content-defined chunks that are written once into a chunk directory shared
+// by all processes (and all generations) using the same checkpoint directory.
+// The image itself then holds only a list of ChunkRefs for each area.
+//
+// Chunks are never removed at checkpoint time, since other processes and
+// computations may share them.  Instead, the hashes of the chunks used by
+// each image are listed in <image>.chunks, and util/dmtcp_prune_chunks.py
+// removes the chunks that no listed image refers to any more.
+namespace dmtcp
+{
+namespace ChunkStore
+{
+bool isEnabled();
+void prepare(const string &ckptDir);
+void openRefList(const string &ckptFilename);
+void commitRefList(const string &ckptFilename);
+void writeArea(int fd, Area *area);
+void printStats();
+}
+}
+#endif // ifndef CHUNK_STORE_H
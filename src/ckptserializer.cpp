@@ -42,6 +42,7 @@
 #include <signal.h>
 #include <unistd.h>
 #include "ckptserializer.h"
+#include "chunkstore.h"
 #include "constants.h"
 #include "dmtcp.h"
 #include "protectedfds.h"
@@ -425,11 +426,13 @@ CkptSerializer::writeCkptImage(void *mtcpHdr, size_t mtcpHdrLen)
 
   JTRACE("Thread performing checkpoint.") (dmtcp_gettid());
   createCkptDir();
+  ChunkStore::prepare(ProcessInfo::instance().getCkptDir());
   forked_ckpt_status = test_and_prepare_for_forked_ckpt();
   if (forked_ckpt_status == FORKED_CKPT_PARENT) {
     JTRACE("*** Using forked checkpointing.\n");
     return;
   }
+  ChunkStore::openRefList(ckptFilename);
 
   /* fd will either point to the ckpt file to write, or else the write end
    * of a pipe leading to a compression child process.
@@ -470,6 +473,7 @@ CkptSerializer::writeCkptImage(void *mtcpHdr, size_t mtcpHdrLen)
    * So, gzip process can continue to write to file even after renaming.
    */
   JASSERT(rename(tempCkptFilename.c_str(), ckptFilename.c_str()) == 0);
+  ChunkStore::commitRefList(ckptFilename);
 
   if (forked_ckpt_status == FORKED_CKPT_CHILD) {
     // Use _exit() instead of exit() to avoid popping atexit() handlers
@@ -489,6 +493,7 @@ CkptSerializer::writeDmtcpHeader(int fd)
 
   jalib::JBinarySerializeWriterRaw wr("", fd);
   ProcessInfo::instance().serialize(wr);
+  wr.flush();
   ssize_t written = len + wr.bytes();
 
   // We must write in multiple of PAGE_SIZE
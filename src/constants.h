@@ -58,6 +58,9 @@
 #define INITIAL_VIRTUAL_PID         40000
 #define MAX_VIRTUAL_PID             400000000
 
+// Number of virtual pids handed to a worker per DMT_VIRTUAL_PID_LEASE request.
+#define VIRTUAL_PID_LEASE_SIZE      16
+
 // NEEDED FOR STRINGIFY(DEFAULT_PORT)
 #define QUOTE(arg) #arg
 #define STRINGIFY(arg) QUOTE(arg)
@@ -96,9 +99,15 @@
 #define ENV_VAR_EXPLICIT_SRUN       "DMTCP_EXPLICIT_SRUN"
 #define ENV_VAR_SKIP_WRITING_TEXT_SEGMENTS \
                                     "DMTCP_SKIP_WRITING_TEXT_SEGMENTS"
+#define ENV_VAR_CHUNK_STORE         "DMTCP_CHUNK_STORE"
+#define ENV_VAR_SKIP_CLEAN_FILE_PAGES "DMTCP_SKIP_CLEAN_FILE_PAGES"
+#define ENV_VAR_SYNC_FORK           "DMTCP_SYNC_FORK"
 
 #define ENV_VAR_COORD_LOGFILE       "DMTCP_COORD_LOG_FILENAME"
 
+// Size (in bytes) of the per-thread JTRACE buffer; see jalib/jassert.cpp.
+#define ENV_VAR_JTRACE_BUFFER_SIZE  "DMTCP_JTRACE_BUFFER_SIZE"
+
 // it is not yet safe to change these; these names are hard-wired in the code
 #define ENV_VAR_STDERR_PATH         "JALIB_STDERR_PATH"
 #define ENV_VAR_COMPRESSION         "DMTCP_GZIP"
@@ -140,12 +149,17 @@
   ENV_VAR_SCREENDIR,                  \
   ENV_VAR_VIRTUAL_PID,                \
   ENV_VAR_SKIP_WRITING_TEXT_SEGMENTS, \
+  ENV_VAR_JTRACE_BUFFER_SIZE,         \
+  ENV_VAR_CHUNK_STORE,                \
+  ENV_VAR_SKIP_CLEAN_FILE_PAGES,      \
+  ENV_VAR_SYNC_FORK,                  \
   ENV_DELTACOMPRESSION
 
 #define DMTCP_RESTART_CMD       "dmtcp_restart"
 
 #define RESTART_SCRIPT_BASENAME "dmtcp_restart_script"
 #define RESTART_SCRIPT_EXT      "sh"
+#define RESTART_MANIFEST_EXT    "json"
 
 #define DMTCP_FILE_HEADER       "DMTCP_CHECKPOINT_IMAGE_v2.0\n"
 
@@ -30,6 +30,7 @@
 #include <semaphore.h>  // for sem_post(&sem_launch)
 #include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 #include "../jalib/jconvert.h"
 #include "../jalib/jfilesystem.h"
@@ -54,6 +55,20 @@ int nsSock = -1;
 // Shared between getCoordHostAndPort() and setCoordPort()
 static int _cachedPort = 0;
 
+// Virtual pids leased from the coordinator for our future children.  Lets
+// fork() register the child without waiting for a coordinator round trip.
+static pid_t _leasedVirtualPids[VIRTUAL_PID_LEASE_SIZE];
+static size_t _numLeasedVirtualPids = 0;
+
+// Set by createNewConnectionBeforeFork() when the DMT_NEW_WORKER handshake
+// was sent without reading the reply; inherited by the child, which then
+// reads the DMT_ACCEPT before anything else on the coordinator socket.
+// Whichever of the checkpoint thread or exec() gets there first reads it,
+// under handshakeReplyLock.
+static bool _handshakeSentAsync = false;
+static volatile int _handshakeReplyPending = 0;
+static DmtcpMutex handshakeReplyLock = DMTCP_MUTEX_INITIALIZER;
+
 void init();
 void restart();
 void setCoordPort(int port);
@@ -64,6 +79,8 @@ DmtcpMessage sendRecvHandshake(int fd,
                                DmtcpMessage msg,
                                string progname,
                                UniquePid *compId = NULL);
+void sendHandshake(int fd, DmtcpMessage msg, string progname);
+DmtcpMessage recvHandshakeReply(int fd, UniquePid *compId = NULL);
 
 void sendMsgToCoordinatorRaw(int fd,
                              DmtcpMessage msg,
@@ -96,6 +113,11 @@ eventHook(DmtcpEvent_t event, DmtcpEventData_t *data)
       restart();
       break;
 
+    case DMTCP_EVENT_ATFORK_PARENT:
+      // Only the child reads the reply to an asynchronous handshake.
+      _handshakeSentAsync = false;
+      break;
+
   default:
     break;
   }
@@ -122,6 +144,9 @@ restart()
 {
   _real_close(nsSock);
   nsSock = -1;
+
+  // Leases belong to the pre-checkpoint coordinator.
+  _numLeasedVirtualPids = 0;
 }
 
 void
@@ -193,6 +218,24 @@ setCoordPort(int port)
   _cachedPort = port;
 }
 
+// DmtcpMessage carries whole seconds.  The coordinator itself accepts
+// fractional intervals (e.g. 0.5); round those up here, so that they do not
+// turn into 0, which disables interval checkpointing.
+static uint32_t
+parseCkptInterval(const char *str)
+{
+  double seconds = strtod(str, NULL);
+
+  if (!(seconds > 0)) {
+    return 0;
+  }
+  if (seconds >= 0xfffffffe) {
+    return 0xfffffffe;
+  }
+  uint32_t ret = (uint32_t)seconds;
+  return ret < seconds ? ret + 1 : ret;
+}
+
 static uint32_t
 getCkptInterval()
 {
@@ -203,7 +246,7 @@ getCkptInterval()
    *   hello_local.theCheckpointInterval: DMTCPMESSAGE_SAME_CKPT_INTERVAL
    */
   if (interval != NULL) {
-    ret = jalib::StringToInt(interval);
+    ret = parseCkptInterval(interval);
   }
 
   // Tell the coordinator the ckpt interval only once.  It can change later.
@@ -247,6 +290,12 @@ void resetOnFork(int sock)
   sendMsgToCoordinator(msg);
   _real_close(nsSock);
   nsSock = -1;
+
+  // The parent's leases are not ours to hand out.
+  _numLeasedVirtualPids = 0;
+  DmtcpMutexInit(&handshakeReplyLock, DMTCP_MUTEX_NORMAL);
+  _handshakeReplyPending = _handshakeSentAsync;
+  _handshakeSentAsync = false;
 }
 
 void
@@ -276,7 +325,7 @@ connectAndSendUserCommand(char c,
   if (c == 'i') {
     const char *interval = getenv(ENV_VAR_CKPT_INTR);
     if (interval != NULL) {
-      msg.theCheckpointInterval = jalib::StringToInt(interval);
+      msg.theCheckpointInterval = parseCkptInterval(interval);
     }
   }
   JASSERT(Util::writeAll(coordFd, &msg, sizeof(msg)) == sizeof(msg));
@@ -346,6 +395,28 @@ updateCoordCkptDir(const char *dir)
   sendMsgToCoordinator(msg, dir, strlen(dir) + 1);
 }
 
+// Send msg and its extra data, given in up to two pieces, with one writev()
+// where possible, so that the coordinator gets the whole message at once.
+static void
+writeMsg(int fd,
+         const DmtcpMessage &msg,
+         const void *data1,
+         size_t len1,
+         const void *data2 = NULL,
+         size_t len2 = 0)
+{
+  struct iovec iov[3];
+
+  iov[0].iov_base = (void *)&msg;
+  iov[0].iov_len = sizeof(msg);
+  iov[1].iov_base = (void *)data1;
+  iov[1].iov_len = len1;
+  iov[2].iov_base = (void *)data2;
+  iov[2].iov_len = len2;
+  size_t total = sizeof(msg) + len1 + len2;
+  JASSERT(Util::writevAll(fd, iov, 3) == (ssize_t)total) (total);
+}
+
 void
 sendMsgToCoordinatorRaw(int fd,
                         DmtcpMessage msg,
@@ -358,10 +429,7 @@ sendMsgToCoordinatorRaw(int fd,
   if (extraData != NULL) {
     msg.extraBytes = len;
   }
-  JASSERT(Util::writeAll(fd, &msg, sizeof(msg)) == sizeof(msg));
-  if (extraData != NULL) {
-    JASSERT(Util::writeAll(fd, extraData, len) == (ssize_t)len);
-  }
+  writeMsg(fd, msg, extraData, extraData != NULL ? len : 0);
 }
 
 void
@@ -424,8 +492,28 @@ void sendMsgToCoordinator(const DmtcpMessage &msg, const string &data)
                           data.c_str(), data.length() + 1);
 }
 
+void
+recvPendingHandshakeReply()
+{
+  if (!_handshakeReplyPending) {
+    return;
+  }
+
+  // If the other thread is already reading the reply, this blocks until it
+  // is done; a rejection then terminates us before exec() or any further
+  // coordinator traffic.
+  DmtcpMutexLock(&handshakeReplyLock);
+  if (_handshakeReplyPending) {
+    DmtcpMessage reply = recvHandshakeReply(coordinatorSocket);
+    _handshakeReplyPending = 0;
+    JTRACE("Coordinator accepted leased virtual pid") (reply.virtualPid);
+  }
+  DmtcpMutexUnlock(&handshakeReplyLock);
+}
+
 void recvMsgFromCoordinator(DmtcpMessage *msg, void **extraData)
 {
+  recvPendingHandshakeReply();
   recvMsgFromCoordinatorRaw(coordinatorSocket, msg, extraData);
 }
 
@@ -573,11 +661,8 @@ createNewConnToCoord(CoordinatorMode mode)
   JASSERT(Util::isValidFd(coordinatorSocket));
 }
 
-DmtcpMessage
-sendRecvHandshake(int fd,
-                  DmtcpMessage msg,
-                  string progname,
-                  UniquePid *compId)
+void
+sendHandshake(int fd, DmtcpMessage msg, string progname)
 {
   if (dmtcp_virtual_to_real_pid) {
     msg.realPid = dmtcp_virtual_to_real_pid(getpid());
@@ -595,7 +680,12 @@ sendRecvHandshake(int fd,
   strcpy(&buf[hostname.length() + 1], progname.c_str());
 
   sendMsgToCoordinatorRaw(fd, msg, buf, buflen);
+}
 
+DmtcpMessage
+recvHandshakeReply(int fd, UniquePid *compId)
+{
+  DmtcpMessage msg;
   recvMsgFromCoordinatorRaw(fd, &msg);
   msg.assertValid();
 
@@ -625,6 +715,16 @@ sendRecvHandshake(int fd,
   return msg;
 }
 
+DmtcpMessage
+sendRecvHandshake(int fd,
+                  DmtcpMessage msg,
+                  string progname,
+                  UniquePid *compId)
+{
+  sendHandshake(fd, msg, progname);
+  return recvHandshakeReply(fd, compId);
+}
+
 void
 connectToCoordOnStartup(CoordinatorMode mode,
                         string progname,
@@ -667,6 +767,38 @@ connectToCoordOnStartup(CoordinatorMode mode,
   memcpy(localIP, &hello_remote.ipAddr, sizeof hello_remote.ipAddr);
 }
 
+static pid_t
+getLeasedVirtualPid()
+{
+  if (_numLeasedVirtualPids == 0) {
+    if (nsSock == -1) {
+      nsSock = createNewSocketToCoordinator(COORD_ANY);
+      JASSERT(nsSock != -1);
+      nsSock = Util::changeFd(nsSock, PROTECTED_NS_FD);
+      JASSERT(nsSock == PROTECTED_NS_FD);
+      DmtcpMessage m(DMT_NAME_SERVICE_WORKER);
+      JASSERT(Util::writeAll(nsSock, &m, sizeof(m)) == sizeof(m));
+    }
+
+    DmtcpMessage msg(DMT_VIRTUAL_PID_LEASE);
+    msg.numPeers = VIRTUAL_PID_LEASE_SIZE;
+    JASSERT(Util::writeAll(nsSock, &msg, sizeof(msg)) == sizeof(msg));
+    msg.poison();
+
+    JASSERT(Util::readAll(nsSock, &msg, sizeof(msg)) == sizeof(msg));
+    msg.assertValid();
+    JASSERT(msg.type == DMT_VIRTUAL_PID_LEASE_RESPONSE) (msg.type);
+    JASSERT(msg.extraBytes > 0 &&
+            msg.extraBytes <= sizeof(_leasedVirtualPids) &&
+            msg.extraBytes % sizeof(pid_t) == 0) (msg.extraBytes);
+    JASSERT(Util::readAll(nsSock, _leasedVirtualPids, msg.extraBytes) ==
+            (ssize_t)msg.extraBytes);
+    _numLeasedVirtualPids = msg.extraBytes / sizeof(pid_t);
+    JTRACE("Leased virtual pids from coordinator") (_numLeasedVirtualPids);
+  }
+  return _leasedVirtualPids[--_numLeasedVirtualPids];
+}
+
 int
 createNewConnectionBeforeFork(string& progname)
 {
@@ -682,14 +814,26 @@ createNewConnectionBeforeFork(string& progname)
   JASSERT(sock != -1);
 
   DmtcpMessage hello_local(DMT_NEW_WORKER);
-  DmtcpMessage hello_remote = sendRecvHandshake(sock, hello_local, progname);
-  JASSERT(hello_remote.virtualPid != -1);
+  pid_t virtualPid = -1;
+  _handshakeSentAsync = false;
+  if (dmtcp_is_running_state() && getenv(ENV_VAR_SYNC_FORK) == NULL) {
+    // Fast path: register the child under a leased virtual pid; the child
+    // reads the coordinator's DMT_ACCEPT itself (recvPendingHandshakeReply).
+    hello_local.virtualPid = getLeasedVirtualPid();
+    sendHandshake(sock, hello_local, progname);
+    virtualPid = hello_local.virtualPid;
+    _handshakeSentAsync = true;
+  } else {
+    DmtcpMessage hello_remote = sendRecvHandshake(sock, hello_local, progname);
+    virtualPid = hello_remote.virtualPid;
+  }
+  JASSERT(virtualPid != -1);
 
   if (dmtcp_virtual_to_real_pid) {
-    JTRACE("Got virtual pid from coordinator") (hello_remote.virtualPid);
+    JTRACE("Got virtual pid from coordinator") (virtualPid);
     pid_t pid = getpid();
     pid_t realPid = dmtcp_virtual_to_real_pid(pid);
-    Util::setVirtualPidEnvVar(hello_remote.virtualPid, pid, realPid);
+    Util::setVirtualPidEnvVar(virtualPid, pid, realPid);
   }
   return sock;
 }
@@ -772,6 +916,25 @@ sendCkptFilename()
   sendMsgToCoordinator(msg, buf, buflen);
 }
 
+// Returns the socket for name-service requests: the coordinator socket
+// during checkpoint/restart, and a dedicated socket while running.
+static int
+nameServiceSocket()
+{
+  if (!dmtcp_is_running_state()) {
+    return coordinatorSocket;
+  }
+  if (nsSock == -1) {
+    nsSock = createNewSocketToCoordinator(COORD_ANY);
+    JASSERT(nsSock != -1);
+    nsSock = Util::changeFd(nsSock, PROTECTED_NS_FD);
+    JASSERT(nsSock == PROTECTED_NS_FD);
+    DmtcpMessage m(DMT_NAME_SERVICE_WORKER);
+    JASSERT(Util::writeAll(nsSock, &m, sizeof(m)) == sizeof(m));
+  }
+  return nsSock;
+}
+
 int
 sendKeyValPairToCoordinator(const char *id,
                             const void *key,
@@ -786,22 +949,9 @@ sendKeyValPairToCoordinator(const char *id,
   msg.keyLen = key_len;
   msg.valLen = val_len;
   msg.extraBytes = key_len + val_len;
-  int sock = coordinatorSocket;
-  if (dmtcp_is_running_state()) {
-    if (nsSock == -1) {
-      nsSock = createNewSocketToCoordinator(COORD_ANY);
-      JASSERT(nsSock != -1);
-      nsSock = Util::changeFd(nsSock, PROTECTED_NS_FD);
-      sock = nsSock;
-      DmtcpMessage m(DMT_NAME_SERVICE_WORKER);
-      JASSERT(Util::writeAll(sock, &m, sizeof(m)) == sizeof(m));
-    }
-    sock = nsSock;
-  }
+  int sock = nameServiceSocket();
 
-  JASSERT(Util::writeAll(sock, &msg, sizeof(msg)) == sizeof(msg));
-  JASSERT(Util::writeAll(sock, key, key_len) == (ssize_t)key_len);
-  JASSERT(Util::writeAll(sock, val, val_len) == (ssize_t)val_len);
+  writeMsg(sock, msg, key, key_len, val, val_len);
 
   return 1;
 }
@@ -824,26 +974,13 @@ sendQueryToCoordinator(const char *id,
   msg.keyLen = key_len;
   msg.valLen = 0;
   msg.extraBytes = key_len;
-  int sock = coordinatorSocket;
-
   if (key == NULL || key_len == 0 || val == NULL || val_len == 0) {
     return 0;
   }
 
-  if (dmtcp_is_running_state()) {
-    if (nsSock == -1) {
-      nsSock = createNewSocketToCoordinator(COORD_ANY);
-      JASSERT(nsSock != -1);
-      nsSock = Util::changeFd(nsSock, PROTECTED_NS_FD);
-      JASSERT(nsSock == PROTECTED_NS_FD);
-      DmtcpMessage m(DMT_NAME_SERVICE_WORKER);
-      JASSERT(Util::writeAll(nsSock, &m, sizeof(m)) == sizeof(m));
-    }
-    sock = nsSock;
-  }
+  int sock = nameServiceSocket();
 
-  JASSERT(Util::writeAll(sock, &msg, sizeof(msg)) == sizeof(msg));
-  JASSERT(Util::writeAll(sock, key, key_len) == (ssize_t)key_len);
+  writeMsg(sock, msg, key, key_len);
 
   msg.poison();
 
@@ -875,26 +1012,13 @@ int getUniqueIdFromCoordinator(const char *id,
   msg.extraBytes = key_len;
   msg.uniqueIdOffset = offset;
   msg.valLen = *val_len;
-  int sock = coordinatorSocket;
-
   if (key == NULL || key_len == 0 || val == NULL || val_len == 0) {
     return 0;
   }
 
-  if (dmtcp_is_running_state()) {
-    if (nsSock == -1) {
-      nsSock = createNewSocketToCoordinator(COORD_ANY);
-      JASSERT(nsSock != -1);
-      nsSock = Util::changeFd(nsSock, PROTECTED_NS_FD);
-      JASSERT(nsSock == PROTECTED_NS_FD);
-      DmtcpMessage m(DMT_NAME_SERVICE_WORKER);
-      JASSERT(Util::writeAll(nsSock, &m, sizeof(m)) == sizeof(m));
-    }
-    sock = nsSock;
-  }
+  int sock = nameServiceSocket();
 
-  JASSERT(Util::writeAll(sock, &msg, sizeof(msg)) == sizeof(msg));
-  JASSERT(Util::writeAll(sock, key, key_len) == (ssize_t)key_len);
+  writeMsg(sock, msg, key, key_len);
 
   msg.poison();
 
@@ -910,26 +1034,123 @@ int getUniqueIdFromCoordinator(const char *id,
   return *val_len;
 }
 
+// Publishes num key-value pairs with a single message.
 int
-sendQueryAllToCoordinator(const char *id, void **buf, int *len)
+sendKeyValPairsToCoordinator(const char *id,
+                             uint32_t num,
+                             const void *const *keys,
+                             const uint32_t *key_lens,
+                             const void *const *vals,
+                             const uint32_t *val_lens)
 {
-  DmtcpMessage msg(DMT_NAME_SERVICE_QUERY_ALL);
+  DmtcpMessage msg(DMT_REGISTER_NAME_SERVICE_DATA_BATCH);
+
+  if (num == 0) {
+    return 1;
+  }
 
   JWARNING(strlen(id) < sizeof(msg.nsid));
   strncpy(msg.nsid, id, sizeof msg.nsid);
-  int sock = coordinatorSocket;
-  if (dmtcp_is_running_state()) {
-    if (nsSock == -1) {
-      nsSock = createNewSocketToCoordinator(COORD_ANY);
-      JASSERT(nsSock != -1);
-      nsSock = Util::changeFd(nsSock, PROTECTED_NS_FD);
-      JASSERT(nsSock == PROTECTED_NS_FD);
-      DmtcpMessage m(DMT_NAME_SERVICE_WORKER);
-      JASSERT(Util::writeAll(nsSock, &m, sizeof(m)) == sizeof(m));
+
+  vector<char> buf;
+  for (uint32_t i = 0; i < num; i++) {
+    uint32_t lens[2] = { key_lens[i], val_lens[i] };
+    JASSERT(lens[0] > 0 && lens[1] > 0) (id) (i) (lens[0]) (lens[1]);
+    size_t pos = buf.size();
+    buf.resize(pos + sizeof(lens) + lens[0] + lens[1]);
+    memcpy(&buf[pos], lens, sizeof(lens));
+    memcpy(&buf[pos + sizeof(lens)], keys[i], lens[0]);
+    memcpy(&buf[pos + sizeof(lens) + lens[0]], vals[i], lens[1]);
+  }
+  msg.keyLen = 0;
+  msg.valLen = 0;
+  msg.extraBytes = buf.size();
+
+  int sock = nameServiceSocket();
+  writeMsg(sock, msg, &buf[0], buf.size());
+
+  return 1;
+}
+
+// Looks up num keys with a single request and reply.  On input, val_lens[i]
+// is the size of the buffer vals[i]; on output, it is the size of the value
+// copied there, or 0 if the key was not found.  Returns the number of keys
+// found.
+int
+sendQueriesToCoordinator(const char *id,
+                         uint32_t num,
+                         const void *const *keys,
+                         const uint32_t *key_lens,
+                         void **vals,
+                         uint32_t *val_lens)
+{
+  DmtcpMessage msg(DMT_NAME_SERVICE_QUERY_BATCH);
+
+  if (num == 0) {
+    return 0;
+  }
+
+  JWARNING(strlen(id) < sizeof(msg.nsid));
+  strncpy(msg.nsid, id, sizeof msg.nsid);
+
+  vector<char> buf;
+  for (uint32_t i = 0; i < num; i++) {
+    uint32_t keyLen = key_lens[i];
+    JASSERT(keyLen > 0) (id) (i);
+    size_t pos = buf.size();
+    buf.resize(pos + sizeof(keyLen) + keyLen);
+    memcpy(&buf[pos], &keyLen, sizeof(keyLen));
+    memcpy(&buf[pos + sizeof(keyLen)], keys[i], keyLen);
+  }
+  msg.keyLen = 0;
+  msg.valLen = 0;
+  msg.extraBytes = buf.size();
+
+  int sock = nameServiceSocket();
+  writeMsg(sock, msg, &buf[0], buf.size());
+
+  msg.poison();
+  JASSERT(Util::readAll(sock, &msg, sizeof(msg)) == sizeof(msg));
+  msg.assertValid();
+  JASSERT(msg.type == DMT_NAME_SERVICE_QUERY_BATCH_RESPONSE &&
+          msg.extraBytes == msg.valLen);
+
+  buf.resize(msg.extraBytes);
+  if (msg.extraBytes > 0) {
+    JASSERT(Util::readAll(sock, &buf[0], msg.extraBytes) ==
+            (ssize_t)msg.extraBytes);
+  }
+
+  const char *p = buf.empty() ? NULL : &buf[0];
+  const char *end = p + buf.size();
+  int found = 0;
+  for (uint32_t i = 0; i < num; i++) {
+    uint32_t valLen;
+    JASSERT(p + sizeof(valLen) <= end) (i) (num);
+    memcpy(&valLen, p, sizeof(valLen));
+    p += sizeof(valLen);
+    JASSERT(p + valLen <= end && valLen <= val_lens[i])
+      (i) (valLen) (val_lens[i]);
+    memcpy(vals[i], p, valLen);
+    val_lens[i] = valLen;
+    p += valLen;
+    if (valLen > 0) {
+      found++;
     }
-    sock = nsSock;
   }
 
+  return found;
+}
+
+int
+sendQueryAllToCoordinator(const char *id, void **buf, int *len)
+{
+  DmtcpMessage msg(DMT_NAME_SERVICE_QUERY_ALL);
+
+  JWARNING(strlen(id) < sizeof(msg.nsid));
+  strncpy(msg.nsid, id, sizeof msg.nsid);
+  int sock = nameServiceSocket();
+
   JASSERT(Util::writeAll(sock, &msg, sizeof(msg)) == sizeof(msg));
   msg.poison();
 
@@ -1004,7 +1225,7 @@ setupVirtualCoordinator(CoordinatorInfo *coordInfo, struct in_addr *localIP)
   coordInfo->timeStamp = coordId.time();
   coordInfo->addrLen = 0;
   if (getenv(ENV_VAR_CKPT_INTR) != NULL) {
-    coordInfo->interval = (uint32_t)strtol(getenv(ENV_VAR_CKPT_INTR), NULL, 0);
+    coordInfo->interval = parseCkptInterval(getenv(ENV_VAR_CKPT_INTR));
   } else {
     coordInfo->interval = 0;
   }
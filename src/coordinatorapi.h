@@ -70,6 +70,7 @@ void sendMsgToCoordinator(DmtcpMessage msg,
                           size_t len = 0);
 void sendMsgToCoordinator(const DmtcpMessage &msg, const string &data);
 void recvMsgFromCoordinator(DmtcpMessage *msg, void **extraData = NULL);
+void recvPendingHandshakeReply();
 bool waitForBarrier(const string& barrier, uint32_t *numPeers = NULL);
 char *connectAndSendUserCommand(char c,
                                 int *coordCmdStatus = NULL,
@@ -99,6 +100,19 @@ int getUniqueIdFromCoordinator(const char *id,
                                uint32_t *val_len,
                                uint32_t offset = 1);
 
+int sendKeyValPairsToCoordinator(const char *id,
+                                 uint32_t num,
+                                 const void *const *keys,
+                                 const uint32_t *key_lens,
+                                 const void *const *vals,
+                                 const uint32_t *val_lens);
+int sendQueriesToCoordinator(const char *id,
+                             uint32_t num,
+                             const void *const *keys,
+                             const uint32_t *key_lens,
+                             void **vals,
+                             uint32_t *val_lens);
+
 int sendQueryAllToCoordinator(const char *id, void **buf, int *len);
 
 } // namespace CoordinatorAPI
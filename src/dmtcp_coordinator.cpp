@@ -38,6 +38,12 @@
  * onData called when a message arrives at a client's port.  It either      *
  *   processes a per-client special request, or continues the protocol      *
  *   for a checkpoint or restart sequence (see below).                      *
+ * onProxyEvent called when a dmtcp_nodeproxy reports a new channel or a    *
+ *   combined barrier arrival (see proxylink.h).  Each proxied process      *
+ *   otherwise looks like a directly connected client.                      *
+ * Once every worker has sent its checkpoint filename, the restart script   *
+ *   and its JSON manifest are written by a helper thread; the event loop   *
+ *   hears back through onRestartScriptWritten.                             *
  *                                                                          *
  * updateMinimumState() is responsible for keeping track of states.         *
  * The coordinator keeps a ComputationStatus, with minimumState and         *
@@ -60,11 +66,14 @@
 #include "dmtcp_coordinator.h"
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <math.h>
 #include <netdb.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -78,6 +87,7 @@
 #include "dmtcpmessagetypes.h"
 #include "lookup_service.h"
 #include "protectedfds.h"
+#include "proxylink.h"
 #include "restartscript.h"
 #include "tokenize.h"
 #include "syscallwrappers.h"
@@ -123,8 +133,12 @@ static const char *theUsage =
   "      Run silently in the background after detaching from the parent "
   "process.\n"
   "  -i, --interval (environment variable DMTCP_CHECKPOINT_INTERVAL):\n"
-  "      Time in seconds between automatic checkpoints\n"
+  "      Time in seconds (e.g. 600 or 0.5) between automatic checkpoints\n"
   "      (default: 0, disabled)\n"
+  "  --mtbf SECONDS\n"
+  "      Mean time between failures of the computation.  If given, the time\n"
+  "      between automatic checkpoints is adapted to the measured cost of a\n"
+  "      checkpoint (Young/Daly optimum); --interval is used until then.\n"
   "  --coord-logfile PATH (environment variable DMTCP_COORD_LOG_FILENAME\n"
   "              Coordinator will dump its logs to the given file\n"
   "  -q, --quiet \n"
@@ -150,6 +164,10 @@ static bool killAfterCkpt = false;
 static bool killAfterCkptOnce = false;
 static int blockUntilDoneRemote = -1;
 
+// Set once the checkpoint requested by a blocking 'bc' command has begun;
+// whoever reaps that checkpoint's restart script writer sends the reply.
+static bool blockUntilDoneCkptStarted = false;
+
 static DmtcpCoordinator prog;
 
 /* The coordinator can receive a second checkpoint request while processing the
@@ -171,18 +189,40 @@ static bool workersRunningAndSuspendMsgSent = false;
 static bool killInProgress = false;
 static bool uniqueCkptFilenames = false;
 
-/* If dmtcp_launch/dmtcp_restart specifies '-i', theCheckpointInterval
+/* If dmtcp_launch/dmtcp_restart specifies '-i', theCheckpointIntervalMs
  * will be reset accordingly (valid for current computation).  If dmtcp_command
  * specifies '-i' (or if user interactively invokes 'i' in coordinator),
- * then both theCheckpointInterval and theDefaultCheckpointInterval are set.
- * A value of '0' means:  never checkpoint (manual checkpoint only).
+ * then both theCheckpointIntervalMs and theDefaultCheckpointIntervalMs are
+ * set.  A value of '0' means:  never checkpoint (manual checkpoint only).
+ * Intervals are in milliseconds here, and in seconds in DmtcpMessages.
+ */
+static uint64_t theCheckpointIntervalMs = 0; /* Current checkpoint interval */
+static uint64_t theDefaultCheckpointIntervalMs = 0; /* Reset to this on new
+                                                       comp. */
+
+/* The interval timer is a timerfd in the event loop.  timerExpired is set
+ * when it fires, and cleared when the checkpoint starts, which is deferred
+ * until all workers are RUNNING.
  */
-static uint32_t theCheckpointInterval = 0; /* Current checkpoint interval */
-static uint32_t theDefaultCheckpointInterval = 0; /* Reset to this on new comp.
-                                                     */
+static int ckptTimerFd = -1;
 static bool timerExpired = false;
 
+/* With --mtbf, the interval follows Daly's higher-order estimate of the
+ * optimum checkpoint interval,
+ *   T = sqrt(2 C M) * (1 + sqrt(C / 2M) / 3 + C / 18M) - C,  if C < 2M,
+ *   T = M,                                                   otherwise,
+ * where M is the mean time between failures and C the cost of a checkpoint:
+ * a moving average of the time from DMT_DO_CHECKPOINT until all workers are
+ * running again.
+ */
+static double theMtbf = 0;       /* seconds; 0: fixed interval */
+static double ckptCost = 0;      /* seconds; 0: not measured yet */
+static bool ckptInProgress = false;
+static struct timespec ckptStartTime;
+
 static void resetCkptTimer();
+static void updateAdaptiveInterval();
+static string formatInterval(uint64_t ms);
 
 const int STDIN_FD = fileno(stdin);
 
@@ -219,15 +259,25 @@ static pid_t _nextVirtualPid = INITIAL_VIRTUAL_PID;
 static int theNextClientNumber = 1;
 vector<CoordClient *>clients;
 
+// Connections from dmtcp_nodeproxy; see proxylink.h.
+static set<ProxyLink *>proxyLinks;
+
+// Created by the event loop; see restartscript.h.
+static RestartScript::AsyncWriter *scriptWriter = NULL;
+
 CoordClient::CoordClient(const jalib::JSocket &sock,
                          const struct sockaddr_storage *addr,
                          socklen_t len,
                          DmtcpMessage &hello_remote,
                          int isNSWorker)
   : _sock(sock),
-    _barrier("")
+    _barrier(""),
+    _outPos(0),
+    _watchingOutput(false)
 {
   _isNSWorker = isNSWorker;
+  _proxyLink = NULL;
+  _proxyChannel = 0;
   _realPid = hello_remote.realPid;
   _clientNumber = theNextClientNumber++;
   _identity = hello_remote.from;
@@ -236,6 +286,117 @@ CoordClient::CoordClient(const jalib::JSocket &sock,
   _ip = inet_ntoa(in->sin_addr);
 }
 
+void
+CoordClient::sendMsg(const DmtcpMessage &msg, const void *extraData)
+{
+  struct iovec iov[2];
+  int iovcnt = 1;
+  size_t len = sizeof(msg);
+  ssize_t sent = 0;
+
+  iov[0].iov_base = (void *)&msg;
+  iov[0].iov_len = sizeof(msg);
+  if (msg.extraBytes > 0) {
+    iov[1].iov_base = (void *)extraData;
+    iov[1].iov_len = msg.extraBytes;
+    iovcnt = 2;
+    len += msg.extraBytes;
+  }
+
+  if (!hasPendingOutput()) {
+    struct msghdr hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.msg_iov = iov;
+    hdr.msg_iovlen = iovcnt;
+    do {
+      sent = sendmsg(_sock.sockfd(), &hdr, MSG_DONTWAIT | MSG_NOSIGNAL);
+    } while (sent == -1 && errno == EINTR);
+    if (sent == -1) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        // The client is gone; onDisconnect() will follow.
+        JTRACE("error sending message") (_clientNumber) (JASSERT_ERRNO);
+        return;
+      }
+      sent = 0;
+    }
+    if ((size_t)sent == len) {
+      return;
+    }
+  }
+  queueOutput(iov, iovcnt, sent);
+}
+
+// Append all but the first skip bytes of iov to the output queue.
+void
+CoordClient::queueOutput(const struct iovec *iov, int iovcnt, size_t skip)
+{
+  if (_outPos > 0 && _outPos >= _outBuf.size() / 2) {
+    _outBuf.erase(0, _outPos);
+    _outPos = 0;
+  }
+  for (int i = 0; i < iovcnt; i++) {
+    if (skip >= iov[i].iov_len) {
+      skip -= iov[i].iov_len;
+      continue;
+    }
+    _outBuf.append((const char *)iov[i].iov_base + skip,
+                   iov[i].iov_len - skip);
+    skip = 0;
+  }
+  watchOutput(true);
+}
+
+// Send as much of the queued output as the socket takes.  With block set,
+// wait until all of it is sent.  On error, the output is dropped.
+void
+CoordClient::flushOutput(bool block)
+{
+  int flags = MSG_NOSIGNAL | (block ? 0 : MSG_DONTWAIT);
+
+  while (hasPendingOutput()) {
+    ssize_t rc = ::send(_sock.sockfd(), &_outBuf[_outPos],
+                        _outBuf.size() - _outPos, flags);
+    if (rc == -1 && errno == EINTR) {
+      continue;
+    }
+    if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && !block) {
+      return;
+    }
+    if (rc <= 0) {
+      JTRACE("error sending queued messages")
+        (_clientNumber) (_outBuf.size() - _outPos) (JASSERT_ERRNO);
+      break;
+    }
+    _outPos += rc;
+  }
+  _outBuf.clear();
+  _outPos = 0;
+  watchOutput(false);
+}
+
+// Ask the event loop for EPOLLOUT while there is queued output.
+void
+CoordClient::watchOutput(bool watch)
+{
+  if (watch == _watchingOutput) {
+    return;
+  }
+
+  struct epoll_event ev;
+#ifdef EPOLLRDHUP
+  ev.events = EPOLLIN | EPOLLRDHUP;
+#else // ifdef EPOLLRDHUP
+  ev.events = EPOLLIN;
+#endif // ifdef EPOLLRDHUP
+  if (watch) {
+    ev.events |= EPOLLOUT;
+  }
+  ev.data.ptr = this;
+  JASSERT(epoll_ctl(epollFd, EPOLL_CTL_MOD, _sock.sockfd(), &ev) != -1)
+    (JASSERT_ERRNO);
+  _watchingOutput = watch;
+}
+
 void
 CoordClient::readProcessInfo(DmtcpMessage &msg)
 {
@@ -253,7 +414,8 @@ DmtcpCoordinator::getNewVirtualPid()
 {
   pid_t pid = -1;
 
-  JASSERT(_virtualPidToClientMap.size() < MAX_VIRTUAL_PID / 1000)
+  JASSERT(_virtualPidToClientMap.size() + _leasedVirtualPids.size() +
+          _retiredVirtualPids.size() < MAX_VIRTUAL_PID / 1000)
   .Text("Exceeded maximum number of processes allowed");
   while (1) {
     pid = _nextVirtualPid;
@@ -261,7 +423,7 @@ DmtcpCoordinator::getNewVirtualPid()
     if (_nextVirtualPid > MAX_VIRTUAL_PID) {
       _nextVirtualPid = INITIAL_VIRTUAL_PID;
     }
-    if (_virtualPidToClientMap.find(pid) == _virtualPidToClientMap.end()) {
+    if (!isVirtualPidInUse(pid)) {
       break;
     }
   }
@@ -269,6 +431,61 @@ DmtcpCoordinator::getNewVirtualPid()
   return pid;
 }
 
+bool
+DmtcpCoordinator::isVirtualPidInUse(pid_t pid) const
+{
+  return _virtualPidToClientMap.find(pid) != _virtualPidToClientMap.end() ||
+         _leasedVirtualPids.find(pid) != _leasedVirtualPids.end() ||
+         _retiredVirtualPids.find(pid) != _retiredVirtualPids.end();
+}
+
+void
+DmtcpCoordinator::leaseVirtualPids(CoordClient *client,
+                                   const DmtcpMessage &msg)
+{
+  size_t n = msg.numPeers;
+  if (n == 0 || n > VIRTUAL_PID_LEASE_SIZE) {
+    n = VIRTUAL_PID_LEASE_SIZE;
+  }
+
+  pid_t pids[VIRTUAL_PID_LEASE_SIZE];
+  for (size_t i = 0; i < n; i++) {
+    pids[i] = getNewVirtualPid();
+    _leasedVirtualPids[pids[i]] = client;
+  }
+
+  DmtcpMessage reply(DMT_VIRTUAL_PID_LEASE_RESPONSE);
+  reply.extraBytes = n * sizeof(pid_t);
+  client->sendMsg(reply, pids);
+}
+
+void
+DmtcpCoordinator::retireVirtualPidLeases(CoordClient *client)
+{
+  map<pid_t, CoordClient *>::iterator i = _leasedVirtualPids.begin();
+  while (i != _leasedVirtualPids.end()) {
+    if (i->second == client) {
+      _retiredVirtualPids[i->first] = 0;
+      _leasedVirtualPids.erase(i++);
+    } else {
+      ++i;
+    }
+  }
+}
+
+void
+DmtcpCoordinator::claimVirtualPid(pid_t pid)
+{
+  if (_leasedVirtualPids.erase(pid) == 0 &&
+      _retiredVirtualPids.erase(pid) == 0) {
+    // The lease predates this computation (e.g., the coordinator was reset
+    // while the fork was in flight).  Fine, as long as nobody else has it.
+    JASSERT(_virtualPidToClientMap.find(pid) == _virtualPidToClientMap.end())
+      (pid).Text("Worker connected with a virtual pid that is in use");
+    JTRACE("Worker connected with an unknown virtual pid lease") (pid);
+  }
+}
+
 static string replyData = "";
 
 void
@@ -301,18 +518,20 @@ DmtcpCoordinator::handleUserCommand(char cmd, DmtcpMessage *reply /*= NULL*/)
     break;
   case 'i':
     JTRACE("setting checkpoint interval...");
-    updateCheckpointInterval(theCheckpointInterval);
-    if (theCheckpointInterval == 0) {
+    updateCheckpointInterval(DMTCPMESSAGE_SAME_CKPT_INTERVAL);
+    if (theCheckpointIntervalMs == 0) {
       printf("Current Checkpoint Interval:"
              " Disabled (checkpoint manually instead)\n");
     } else {
-      printf("Current Checkpoint Interval: %d\n", theCheckpointInterval);
+      printf("Current Checkpoint Interval: %s\n",
+             formatInterval(theCheckpointIntervalMs).c_str());
     }
-    if (theDefaultCheckpointInterval == 0) {
+    if (theDefaultCheckpointIntervalMs == 0) {
       printf("Default Checkpoint Interval:"
              " Disabled (checkpoint manually instead)\n");
     } else {
-      printf("Default Checkpoint Interval: %d\n", theDefaultCheckpointInterval);
+      printf("Default Checkpoint Interval: %s\n",
+             formatInterval(theDefaultCheckpointIntervalMs).c_str());
     }
     break;
   case 'l':
@@ -349,6 +568,7 @@ DmtcpCoordinator::handleUserCommand(char cmd, DmtcpMessage *reply /*= NULL*/)
     broadcastMessage(DMT_KILL_PEER);
     JASSERT_STDERR << "DMTCP coordinator exiting... (per request)\n";
     for (size_t i = 0; i < clients.size(); i++) {
+      clients[i]->flushOutput(true);
       clients[i]->sock().close();
     }
     listenSock->close();
@@ -372,7 +592,8 @@ DmtcpCoordinator::handleUserCommand(char cmd, DmtcpMessage *reply /*= NULL*/)
     if (reply != NULL) {
       reply->numPeers = s.numPeers;
       reply->isRunning = running;
-      reply->theCheckpointInterval = theCheckpointInterval;
+      // Round up, so that a sub-second interval is not reported as disabled.
+      reply->theCheckpointInterval = (theCheckpointIntervalMs + 999) / 1000;
     } else {
       printStatus(s.numPeers, running);
     }
@@ -401,10 +622,10 @@ DmtcpCoordinator::printStatus(size_t numPeers, bool isRunning)
     << "Port: " << thePort << std::endl
     << "Checkpoint Interval: ";
 
-  if (theCheckpointInterval == 0) {
+  if (theCheckpointIntervalMs == 0) {
     o << "disabled (checkpoint manually instead)" << std::endl;
   } else {
-    o << theCheckpointInterval << std::endl;
+    o << formatInterval(theCheckpointIntervalMs) << std::endl;
   }
 
   o << "Exit on last client: " << exitOnLast << std::endl
@@ -460,13 +681,17 @@ DmtcpCoordinator::releaseBarrier(const string &barrier)
                      prevBarrier.c_str());
     if (status.minimumState == WorkerState::RUNNING) {
       JNOTE("Checkpoint complete; all workers running");
+      if (ckptInProgress) {
+        ckptInProgress = false;
+        updateAdaptiveInterval();
+      }
       resetCkptTimer();
     }
   }
 }
 
 void
-DmtcpCoordinator::processBarrier(const string &barrier)
+DmtcpCoordinator::processBarrier(const string &barrier, int numArrived)
 {
   // Check if this is the first process to reach barrier.
   if (currentBarrier.empty()) {
@@ -475,84 +700,142 @@ DmtcpCoordinator::processBarrier(const string &barrier)
     JASSERT(barrier == currentBarrier) (barrier) (currentBarrier);
   }
 
-  ++workersAtCurrentBarrier;
+  workersAtCurrentBarrier += numArrived;
 
   releaseBarrier(barrier);
 }
 
+void
+DmtcpCoordinator::processProxyBarrier(ProxyLink *link,
+                                      const string &barrier,
+                                      const vector<NodeProxyArrival> &arrivals)
+{
+  int numArrived = 0;
+
+  JTRACE("got DMT_PROXY_BARRIER message") (barrier) (arrivals.size());
+  for (size_t i = 0; i < arrivals.size(); i++) {
+    CoordClient *client = link->client(arrivals[i].channel);
+    if (client == NULL) {
+      // Disconnected while the proxy was collecting the arrivals.
+      continue;
+    }
+    client->setState((WorkerState::eWorkerState)arrivals[i].state);
+    JWARNING(barrier != client->barrier()) (barrier) (client->barrier());
+    client->setBarrier(barrier);
+    numArrived++;
+  }
+
+  if (numArrived > 0) {
+    processBarrier(barrier, numArrived);
+  }
+}
+
 
 void
-DmtcpCoordinator::recordCkptFilename(CoordClient *client, const char *extraData)
+DmtcpCoordinator::recordCkptFilename(const char *extraData)
 {
-  client->setState(WorkerState::CHECKPOINTED);
   JASSERT(extraData != NULL)
   .Text("extra data expected with DMT_CKPT_FILENAME message");
 
-  string ckptFilename = extraData;
-  string hostname = extraData + ckptFilename.length() + 1;
-  string shellType;
-
-  ckptFilename = extraData;
-  shellType = extraData + ckptFilename.length() + 1;
-  hostname = extraData + shellType.length() + 1 + ckptFilename.length() + 1;
-
-  JTRACE("recording restart info") (ckptFilename) (hostname);
-  JTRACE ( "recording restart info with shellType" )
-    ( ckptFilename ) ( hostname ) (shellType);
-  if(shellType.empty())
-    _restartFilenames[hostname].push_back ( ckptFilename );
-  else if(shellType == "rsh")
-    _rshCmdFileNames[hostname].push_back( ckptFilename );
-  else if(shellType == "ssh")
-    _sshCmdFileNames[hostname].push_back( ckptFilename );
-  else {
-    JASSERT(0)(shellType)
-      .Text("Shell command not supported. Report this to DMTCP community.");
-  }
+  // The script generation groups these by host and shell type later on, in
+  // the restart script writer's thread.
+  RestartScript::CkptFile file;
+  file.filename = extraData;
+  file.shellType = extraData + file.filename.length() + 1;
+  file.hostname = extraData + file.filename.length() + 1 +
+    file.shellType.length() + 1;
+
+  JTRACE("recording restart info with shellType")
+    (file.filename) (file.hostname) (file.shellType);
+  _ckptFiles.push_back(file);
   _numRestartFilenames++;
+}
 
-  if (_numRestartFilenames == _numCkptWorkers) {
-    const string restartScriptPath =
-      RestartScript::writeScript(ckptDir,
-                                 uniqueCkptFilenames,
-                                 ckptTimeStamp,
-                                 theCheckpointInterval,
-                                 thePort,
-                                 compId,
-                                 _restartFilenames,
-                                 _rshCmdFileNames,
-                                 _sshCmdFileNames);
-
-    JNOTE("Checkpoint complete. Wrote restart script") (restartScriptPath);
-
-    JTIMER_STOP(checkpoint);
-
-    if (blockUntilDone) {
-      DmtcpMessage blockUntilDoneReply(DMT_USER_CMD_RESULT);
-      JNOTE("replying to dmtcp_command:  we're done");
-
-      // These were set in DmtcpCoordinator::onConnect in this file
-      jalib::JSocket remote(blockUntilDoneRemote);
-      remote << blockUntilDoneReply;
-      remote.close();
-      blockUntilDone = false;
-      blockUntilDoneRemote = -1;
-    }
+void
+DmtcpCoordinator::processCkptFilenames()
+{
+  if (_numRestartFilenames != _numCkptWorkers) {
+    return;
+  }
 
-    if (killAfterCkpt || killAfterCkptOnce) {
-      JNOTE("Checkpoint Done. Killing all peers.");
-      broadcastMessage(DMT_KILL_PEER);
-      killAfterCkptOnce = false;
-    } else {
-      // On checkpoint/resume, we should not be resetting the lookup service.
-      //   This is absolutely required by the InfiniBand plugin.
-      // lookupService.reset();
-    }
-    _numRestartFilenames = 0;
-    _numCkptWorkers = 0;
+  RestartScript::ScriptInfo info;
+  info.ckptDir = ckptDir;
+  info.uniqueCkptFilenames = uniqueCkptFilenames;
+  info.ckptTimeStamp = ckptTimeStamp;
+  info.checkpointInterval = (theCheckpointIntervalMs + 999) / 1000;
+  info.port = thePort;
+  info.compId = compId;
+  info.files.swap(_ckptFiles);
+  scriptWriter->start(info);
+
+  if (killAfterCkpt || killAfterCkptOnce) {
+    JNOTE("Checkpoint Done. Killing all peers.");
+    broadcastMessage(DMT_KILL_PEER);
+    killAfterCkptOnce = false;
+  } else {
+    // On checkpoint/resume, we should not be resetting the lookup service.
+    //   This is absolutely required by the InfiniBand plugin.
+    // lookupService.reset();
+  }
+  _numRestartFilenames = 0;
+  _numCkptWorkers = 0;
+
+  // All the workers have checkpointed so now it is safe to reset this flag.
+  workersRunningAndSuspendMsgSent = false;
+}
+
+static void
+waitForRestartScript()
+{
+  if (!scriptWriter->isBusy()) {
+    return;
+  }
+
+  const string restartScriptPath = scriptWriter->wait();
+
+  JNOTE("Checkpoint complete. Wrote restart script") (restartScriptPath);
+
+  JTIMER_STOP(checkpoint);
+
+  if (blockUntilDone && blockUntilDoneCkptStarted) {
+    DmtcpMessage blockUntilDoneReply(DMT_USER_CMD_RESULT);
+    JNOTE("replying to dmtcp_command:  we're done");
+
+    // These were set in DmtcpCoordinator::processDmtUserCmd in this file
+    jalib::JSocket remote(blockUntilDoneRemote);
+    remote << blockUntilDoneReply;
+    remote.close();
+    blockUntilDone = false;
+    blockUntilDoneRemote = -1;
+    blockUntilDoneCkptStarted = false;
+  }
+}
+
+void
+DmtcpCoordinator::onRestartScriptWritten()
+{
+  // A no-op if startCheckpoint() has already waited for the writer.
+  waitForRestartScript();
+}
 
-    // All the workers have checkpointed so now it is safe to reset this flag.
-    workersRunningAndSuspendMsgSent = false;
+static void
+sendReply(CoordClient *client,
+          const DmtcpMessage &reply,
+          const vector<char> &data)
+{
+  client->sendMsg(reply, data.empty() ? NULL : &data[0]);
+}
+
+// For name-service requests that arrive as the first message on a new
+// connection, which is closed right after the reply.
+static void
+sendReply(jalib::JSocket &remote,
+          const DmtcpMessage &reply,
+          const vector<char> &data)
+{
+  remote << reply;
+  if (!data.empty()) {
+    remote.writeAll(&data[0], data.size());
   }
 }
 
@@ -570,6 +853,9 @@ DmtcpCoordinator::onData(CoordClient *client)
     extraData = new char[msg.extraBytes];
     client->sock().readAll(extraData, msg.extraBytes);
   }
+  if (client->proxyLink() != NULL) {
+    client->proxyLink()->channelRead();
+  }
 
   WorkerState::eWorkerState prevClientState = client->state();
   client->setState(msg.state);
@@ -602,15 +888,16 @@ DmtcpCoordinator::onData(CoordClient *client)
 
   // Fall though
   case DMT_CKPT_FILENAME:
-    recordCkptFilename(client, extraData);
+    client->setState(WorkerState::CHECKPOINTED);
+    recordCkptFilename(extraData);
+    processCkptFilenames();
     break;
 
   case DMT_GET_CKPT_DIR:
   {
     DmtcpMessage reply(DMT_GET_CKPT_DIR_RESULT);
     reply.extraBytes = ckptDir.length() + 1;
-    client->sock() << reply;
-    client->sock().writeAll(ckptDir.c_str(), reply.extraBytes);
+    client->sendMsg(reply, ckptDir.c_str());
     break;
   }
   case DMT_UPDATE_CKPT_DIR:
@@ -634,23 +921,58 @@ DmtcpCoordinator::onData(CoordClient *client)
   case DMT_NAME_SERVICE_QUERY:
   {
     JTRACE("received NAME_SERVICE_QUERY msg") (client->identity());
-    lookupService.respondToQuery(client->sock(), msg,
-                                 (const void *)extraData);
+    DmtcpMessage nsReply;
+    vector<char> nsData;
+    lookupService.respondToQuery(msg, (const void *)extraData,
+                                 &nsReply, &nsData);
+    sendReply(client, nsReply, nsData);
     break;
   }
 
   case DMT_NAME_SERVICE_GET_UNIQUE_ID:
   {
     JTRACE("received NAME_SERVICE_GET_UNIQUE_ID msg") (client->identity());
-    lookupService.respondToQuery(client->sock(), msg,
-                                 (const void *)extraData);
+    DmtcpMessage nsReply;
+    vector<char> nsData;
+    lookupService.respondToQuery(msg, (const void *)extraData,
+                                 &nsReply, &nsData);
+    sendReply(client, nsReply, nsData);
     break;
   }
 
   case DMT_NAME_SERVICE_QUERY_ALL:
   {
     JTRACE("received NAME_SERVICE_QUERY_ALL msg") (client->identity());
-    lookupService.sendAllMappings(client->sock(), msg);
+    DmtcpMessage nsReply;
+    vector<char> nsData;
+    lookupService.sendAllMappings(msg, &nsReply, &nsData);
+    sendReply(client, nsReply, nsData);
+    break;
+  }
+
+  case DMT_REGISTER_NAME_SERVICE_DATA_BATCH:
+  {
+    JTRACE("received REGISTER_NAME_SERVICE_DATA_BATCH msg")
+      (client->identity());
+    lookupService.registerDataBatch(msg, (const void *)extraData);
+    break;
+  }
+
+  case DMT_NAME_SERVICE_QUERY_BATCH:
+  {
+    JTRACE("received NAME_SERVICE_QUERY_BATCH msg") (client->identity());
+    DmtcpMessage nsReply;
+    vector<char> nsData;
+    lookupService.respondToQueryBatch(msg, (const void *)extraData,
+                                      &nsReply, &nsData);
+    sendReply(client, nsReply, nsData);
+    break;
+  }
+
+  case DMT_VIRTUAL_PID_LEASE:
+  {
+    JTRACE("received VIRTUAL_PID_LEASE msg") (client->identity());
+    leaseVirtualPids(client, msg);
     break;
   }
 
@@ -697,9 +1019,28 @@ removeStaleSharedAreaFile()
   unlink(o.str().c_str());
 }
 
+static void
+detachFromProxy(CoordClient *client)
+{
+  ProxyLink *link = client->proxyLink();
+
+  if (link == NULL) {
+    return;
+  }
+  link->removeClient(client->proxyChannel());
+  if (link->isClosed() && link->numClients() == 0) {
+    proxyLinks.erase(link);
+    delete link;
+  }
+}
+
 static void
 preExitCleanup()
 {
+  if (scriptWriter != NULL) {
+    // Don't leave a half-written restart script behind.
+    scriptWriter->wait();
+  }
   removeStaleSharedAreaFile();
   JTRACE("Removing port-file") (thePortFile);
   unlink(thePortFile.c_str());
@@ -708,7 +1049,9 @@ preExitCleanup()
 void
 DmtcpCoordinator::onDisconnect(CoordClient *client)
 {
+  detachFromProxy(client);
   if (client->isNSWorker()) {
+    retireVirtualPidLeases(client);
     client->sock().close();
     delete client;
     return;
@@ -736,10 +1079,11 @@ DmtcpCoordinator::onDisconnect(CoordClient *client)
     // thus we need to reset it to false once all the processes in the
     // computations have disconnected.
     killInProgress = false;
-    if (theCheckpointInterval != theDefaultCheckpointInterval) {
-      updateCheckpointInterval(theDefaultCheckpointInterval);
+    if (theCheckpointIntervalMs != theDefaultCheckpointIntervalMs) {
+      theCheckpointIntervalMs = theDefaultCheckpointIntervalMs;
+      resetCkptTimer();
       JNOTE("CheckpointInterval reset on end of current computation")
-        (theCheckpointInterval);
+        (formatInterval(theCheckpointIntervalMs));
     }
   } else {
     // If all other workers are at currentBarrier, release it.
@@ -769,11 +1113,15 @@ DmtcpCoordinator::initializeComputation()
   curTimeStamp = 0; // Drop timestamp to 0
   numPeers = -1; // Drop number of peers to unknown
   blockUntilDone = false;
+  blockUntilDoneCkptStarted = false;
   killAfterCkptOnce = false;
   workersAtCurrentBarrier = 0;
 
   prevBarrier.clear();
   currentBarrier.clear();
+
+  _leasedVirtualPids.clear();
+  _retiredVirtualPids.clear();
 }
 
 void
@@ -790,21 +1138,49 @@ DmtcpCoordinator::onConnect()
     return;
   }
 
+  onConnect(remote, &remoteAddr, remoteLen);
+}
+
+/*
+ * Handles the first message on a new connection, accepted either directly
+ * or as a new channel of a dmtcp_nodeproxy.  Returns the client if the
+ * connection stays open as one.
+ */
+CoordClient *
+DmtcpCoordinator::onConnect(jalib::JSocket &remote,
+                            const struct sockaddr_storage *remoteAddr,
+                            socklen_t remoteLen)
+{
   DmtcpMessage hello_remote;
   hello_remote.poison();
   JTRACE("Reading from incoming connection...");
   remote >> hello_remote;
   if (!remote.isValid()) {
     remote.close();
-    return;
+    return NULL;
   }
 
   if (hello_remote.type == DMT_NAME_SERVICE_WORKER) {
-    CoordClient *client = new CoordClient(remote, &remoteAddr, remoteLen,
+    CoordClient *client = new CoordClient(remote, remoteAddr, remoteLen,
                                           hello_remote);
 
     addDataSocket(client);
-    return;
+    return client;
+  }
+  if (hello_remote.type == DMT_PROXY_HELLO) {
+    ProxyLink *link = new ProxyLink(remote, remoteAddr, remoteLen);
+    DmtcpMessage hello_local(DMT_ACCEPT);
+    remote << hello_local;
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = link;
+    JASSERT(epoll_ctl(epollFd, EPOLL_CTL_ADD, link->eventFd(), &ev) != -1)
+      (JASSERT_ERRNO);
+    proxyLinks.insert(link);
+    link->start();
+    JNOTE("node proxy connected") (hello_remote.from);
+    return NULL;
   }
   if (hello_remote.type == DMT_NAME_SERVICE_QUERY) {
     JASSERT(hello_remote.extraBytes > 0) (hello_remote.extraBytes);
@@ -812,10 +1188,13 @@ DmtcpCoordinator::onConnect()
     remote.readAll(extraData, hello_remote.extraBytes);
 
     JTRACE("received NAME_SERVICE_QUERY msg on running") (hello_remote.from);
-    lookupService.respondToQuery(remote, hello_remote, extraData);
+    DmtcpMessage nsReply;
+    vector<char> nsData;
+    lookupService.respondToQuery(hello_remote, extraData, &nsReply, &nsData);
+    sendReply(remote, nsReply, nsData);
     delete[] extraData;
     remote.close();
-    return;
+    return NULL;
   }
   if (hello_remote.type == DMT_NAME_SERVICE_GET_UNIQUE_ID) {
     JASSERT(hello_remote.extraBytes > 0) (hello_remote.extraBytes);
@@ -824,10 +1203,13 @@ DmtcpCoordinator::onConnect()
 
     JTRACE("received NAME_SERVICE_GET_UNIQUE_ID msg on running")
           (hello_remote.from);
-    lookupService.respondToQuery(remote, hello_remote, extraData);
+    DmtcpMessage nsReply;
+    vector<char> nsData;
+    lookupService.respondToQuery(hello_remote, extraData, &nsReply, &nsData);
+    sendReply(remote, nsReply, nsData);
     delete[] extraData;
     remote.close();
-    return;
+    return NULL;
   }
   if (hello_remote.type == DMT_REGISTER_NAME_SERVICE_DATA) {
     JASSERT(hello_remote.extraBytes > 0) (hello_remote.extraBytes);
@@ -839,7 +1221,35 @@ DmtcpCoordinator::onConnect()
     lookupService.registerData(hello_remote, (const void *)extraData);
     delete[] extraData;
     remote.close();
-    return;
+    return NULL;
+  }
+  if (hello_remote.type == DMT_REGISTER_NAME_SERVICE_DATA_BATCH) {
+    JASSERT(hello_remote.extraBytes > 0) (hello_remote.extraBytes);
+    char *extraData = new char[hello_remote.extraBytes];
+    remote.readAll(extraData, hello_remote.extraBytes);
+
+    JTRACE("received REGISTER_NAME_SERVICE_DATA_BATCH msg on running")
+      (hello_remote.from);
+    lookupService.registerDataBatch(hello_remote, (const void *)extraData);
+    delete[] extraData;
+    remote.close();
+    return NULL;
+  }
+  if (hello_remote.type == DMT_NAME_SERVICE_QUERY_BATCH) {
+    JASSERT(hello_remote.extraBytes > 0) (hello_remote.extraBytes);
+    char *extraData = new char[hello_remote.extraBytes];
+    remote.readAll(extraData, hello_remote.extraBytes);
+
+    JTRACE("received NAME_SERVICE_QUERY_BATCH msg on running")
+      (hello_remote.from);
+    DmtcpMessage nsReply;
+    vector<char> nsData;
+    lookupService.respondToQueryBatch(hello_remote, extraData,
+                                      &nsReply, &nsData);
+    sendReply(remote, nsReply, nsData);
+    delete[] extraData;
+    remote.close();
+    return NULL;
   }
 
   if (hello_remote.type == DMT_USER_CMD) {
@@ -847,7 +1257,7 @@ DmtcpCoordinator::onConnect()
     // dmtcp_command.
     updateCheckpointInterval(hello_remote.theCheckpointInterval);
     processDmtUserCmd(hello_remote, remote);
-    return;
+    return NULL;
   }
 
   if (killInProgress) {
@@ -857,7 +1267,7 @@ DmtcpCoordinator::onConnect()
     msg.type = DMT_KILL_PEER;
     remote << msg;
     remote.close();
-    return;
+    return NULL;
   }
 
   // If no client is connected to Coordinator, then there can be only zero data
@@ -866,7 +1276,7 @@ DmtcpCoordinator::onConnect()
     initializeComputation();
   }
 
-  CoordClient *client = new CoordClient(remote, &remoteAddr, remoteLen,
+  CoordClient *client = new CoordClient(remote, remoteAddr, remoteLen,
                                         hello_remote);
 
   if (hello_remote.extraBytes > 0) {
@@ -875,8 +1285,8 @@ DmtcpCoordinator::onConnect()
 
   if (hello_remote.type == DMT_RESTART_WORKER) {
     if (!validateRestartingWorkerProcess(hello_remote, remote,
-                                         &remoteAddr, remoteLen)) {
-      return;
+                                         remoteAddr, remoteLen)) {
+      return NULL;
     }
     client->virtualPid(hello_remote.from.pid());
     _virtualPidToClientMap[client->virtualPid()] = client;
@@ -884,11 +1294,16 @@ DmtcpCoordinator::onConnect()
     // Comping from dmtcp_launch or fork(), ssh(), etc.
     JASSERT(hello_remote.state == WorkerState::RUNNING ||
             hello_remote.state == WorkerState::UNKNOWN);
-    JASSERT(hello_remote.virtualPid == -1);
-    client->virtualPid(getNewVirtualPid());
+    if (hello_remote.virtualPid == -1) {
+      client->virtualPid(getNewVirtualPid());
+    } else {
+      // Forked by a worker using one of its leased virtual pids.
+      claimVirtualPid(hello_remote.virtualPid);
+      client->virtualPid(hello_remote.virtualPid);
+    }
     if (!validateNewWorkerProcess(hello_remote, remote, client,
-                                  &remoteAddr, remoteLen)) {
-      return;
+                                  remoteAddr, remoteLen)) {
+      return NULL;
     }
     _virtualPidToClientMap[client->virtualPid()] = client;
   } else {
@@ -903,6 +1318,7 @@ DmtcpCoordinator::onConnect()
   addDataSocket(client);
 
   JTRACE("END") (clients.size());
+  return client;
 }
 
 void
@@ -917,9 +1333,16 @@ DmtcpCoordinator::processDmtUserCmd(DmtcpMessage &hello_remote,
   // if previous 'b' blocking prefix command had set blockUntilDone
   if (blockUntilDone && blockUntilDoneRemote == -1 &&
       hello_remote.coordCmd == 'c') {
-    // Reply will be done in DmtcpCoordinator::onData in this file.
+    // Reply will be done in waitForRestartScript() in this file.
     blockUntilDoneRemote = remote.sockfd();
     handleUserCommand(hello_remote.coordCmd, &reply);
+    if (reply.coordCmdStatus != CoordCmdStatus::NOERROR) {
+      // No checkpoint was started; don't leave the command hanging.
+      blockUntilDone = false;
+      blockUntilDoneRemote = -1;
+      remote << reply;
+      remote.close();
+    }
   } else if (hello_remote.coordCmd == 'i') {
     // theDefaultCheckpointInterval = hello_remote.theCheckpointInterval;
     // theCheckpointInterval = theDefaultCheckpointInterval;
@@ -1121,13 +1544,16 @@ DmtcpCoordinator::startCheckpoint()
   ComputationStatus s = getStatus();
   if (s.minimumState == WorkerState::RUNNING && s.minimumStateUnanimous
       && !workersRunningAndSuspendMsgSent) {
+    // The previous checkpoint's restart script must be complete before the
+    // next one begins.
+    waitForRestartScript();
     uniqueCkptFilenames = false;
     time(&ckptTimeStamp);
+    clock_gettime(CLOCK_MONOTONIC, &ckptStartTime);
+    ckptInProgress = true;
     JTIMER_START(checkpoint);
     _numRestartFilenames = 0;
-    _restartFilenames.clear();
-    _rshCmdFileNames.clear();
-    _sshCmdFileNames.clear();
+    _ckptFiles.clear();
     compId.incrementGeneration();
     JNOTE("starting checkpoint; incrementing generation; suspending all nodes")
       (s.numPeers) (compId.computationGeneration());
@@ -1135,6 +1561,21 @@ DmtcpCoordinator::startCheckpoint()
     // Pass number of connected peers to all clients
     broadcastMessage(DMT_DO_CHECKPOINT);
 
+    // The restart script reaped above belonged to an earlier checkpoint; a
+    // blocking command waits for this one.
+    blockUntilDoneCkptStarted = blockUntilDone;
+
+    // Any fork() racing with its parent's exit has long connected after two
+    // checkpoints; release the retired leases by then.
+    map<pid_t, int>::iterator i = _retiredVirtualPids.begin();
+    while (i != _retiredVirtualPids.end()) {
+      if (++i->second >= 2) {
+        _retiredVirtualPids.erase(i++);
+      } else {
+        ++i;
+      }
+    }
+
     // Suspend Message has been sent but the workers are still in running
     // state.  If the coordinator receives another checkpoint request from user
     // at this point, it should fail.
@@ -1169,11 +1610,19 @@ DmtcpCoordinator::broadcastMessage(DmtcpMessageType type,
   }
 
   JTRACE("sending message")(type);
+
+  // Workers behind a dmtcp_nodeproxy get one copy per proxy.
+  map<ProxyLink *, vector<uint32_t> >proxied;
   for (size_t i = 0; i < clients.size(); i++) {
-    clients[i]->sock() << msg;
-    if (extraBytes > 0) {
-      clients[i]->sock().writeAll((const char *)extraData, extraBytes);
+    if (clients[i]->proxyLink() != NULL) {
+      proxied[clients[i]->proxyLink()].push_back(clients[i]->proxyChannel());
+      continue;
     }
+    clients[i]->sendMsg(msg, extraData);
+  }
+  map<ProxyLink *, vector<uint32_t> >::iterator it;
+  for (it = proxied.begin(); it != proxied.end(); it++) {
+    it->first->broadcast(msg, extraData, it->second);
   }
   workersAtCurrentBarrier = 0;
 }
@@ -1222,8 +1671,6 @@ signalHandler(int signum)
 {
   if (signum == SIGINT) {
     prog.handleUserCommand('q');
-  } else if (signum == SIGALRM) {
-    timerExpired = true;
   } else {
     JASSERT(false).Text("Not reached");
   }
@@ -1239,7 +1686,6 @@ setupSignalHandlers()
   action.sa_handler = signalHandler;
 
   sigaction(SIGINT, &action, NULL);
-  sigaction(SIGALRM, &action, NULL);
 }
 
 // This code is also copied to ssh.cpp:updateCoordHost()
@@ -1345,26 +1791,91 @@ calcLocalAddr()
   coordHostname = hostname;
 }
 
+// Seconds, with milliseconds if needed.
+static string
+formatInterval(uint64_t ms)
+{
+  ostringstream o;
+
+  o << ms / 1000;
+  if (ms % 1000 != 0) {
+    o << '.' << std::setw(3) << std::setfill('0') << ms % 1000;
+  }
+  return o.str();
+}
+
+// Seconds, possibly fractional, to milliseconds.
+static uint64_t
+parseInterval(const char *str)
+{
+  double seconds = strtod(str, NULL);
+
+  return seconds > 0 ? (uint64_t)(seconds * 1000 + 0.5) : 0;
+}
+
+// (Re)start the interval timer; an interval of 0 stops it.
 static void
 resetCkptTimer()
 {
-  alarm(theCheckpointInterval);
+  if (ckptTimerFd == -1) {
+    // Armed by eventLoop() once the timer exists.
+    return;
+  }
+
+  struct itimerspec spec;
+  memset(&spec, 0, sizeof(spec));
+  spec.it_value.tv_sec = theCheckpointIntervalMs / 1000;
+  spec.it_value.tv_nsec = (theCheckpointIntervalMs % 1000) * 1000000;
+  JASSERT(timerfd_settime(ckptTimerFd, 0, &spec, NULL) == 0)
+    (theCheckpointIntervalMs) (JASSERT_ERRNO);
+}
+
+// Called when a checkpoint started by startCheckpoint() has completed.
+static void
+updateAdaptiveInterval()
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double cost = (now.tv_sec - ckptStartTime.tv_sec) +
+    (now.tv_nsec - ckptStartTime.tv_nsec) / 1e9;
+  ckptCost = ckptCost == 0 ? cost : (ckptCost + cost) / 2;
+
+  // An interval of 0 means that the user wants no automatic checkpoints.
+  if (!(theMtbf > 0) || theCheckpointIntervalMs == 0) {
+    return;
+  }
+
+  double interval = theMtbf;
+  if (ckptCost < 2 * theMtbf) {
+    double r = ckptCost / (2 * theMtbf);
+    interval = sqrt(2 * ckptCost * theMtbf) * (1 + sqrt(r) / 3 + r / 9) -
+      ckptCost;
+  }
+  // Keep the conversion below defined and the timer within range.
+  interval = MIN(MAX(interval, 0.001), (double)UINT32_MAX);
+  uint64_t intervalMs = (uint64_t)(interval * 1000);
+  if (intervalMs != theCheckpointIntervalMs) {
+    JNOTE("Adapted checkpoint interval to checkpoint cost")
+      (cost) (ckptCost) (theMtbf) (formatInterval(intervalMs));
+    theCheckpointIntervalMs = intervalMs;
+  }
 }
 
 void
 DmtcpCoordinator::updateCheckpointInterval(uint32_t interval)
 {
   static bool firstClient = true;
+  uint64_t intervalMs = theCheckpointIntervalMs;
 
-  if ((interval != DMTCPMESSAGE_SAME_CKPT_INTERVAL &&
-       interval != theCheckpointInterval) ||
-      firstClient) {
-    int oldInterval = theCheckpointInterval;
-    if (interval != DMTCPMESSAGE_SAME_CKPT_INTERVAL) {
-      theCheckpointInterval = interval;
-    }
+  if (interval != DMTCPMESSAGE_SAME_CKPT_INTERVAL) {
+    intervalMs = (uint64_t)interval * 1000;
+  }
+  if (intervalMs != theCheckpointIntervalMs || firstClient) {
+    string oldInterval = formatInterval(theCheckpointIntervalMs);
+    theCheckpointIntervalMs = intervalMs;
     JNOTE("CheckpointInterval updated (for this computation only)")
-      (oldInterval) (theCheckpointInterval);
+      (oldInterval) (formatInterval(theCheckpointIntervalMs));
     firstClient = false;
     resetCkptTimer();
   }
@@ -1399,34 +1910,38 @@ DmtcpCoordinator::eventLoop(bool daemon)
       (JASSERT_ERRNO);
   }
 
+  scriptWriter = new RestartScript::AsyncWriter();
+  ev.events = EPOLLIN;
+  ev.data.ptr = scriptWriter;
+  JASSERT(epoll_ctl(epollFd, EPOLL_CTL_ADD, scriptWriter->eventFd(), &ev) != -1)
+    (JASSERT_ERRNO);
+
+  ckptTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  JASSERT(ckptTimerFd != -1) (JASSERT_ERRNO);
+  ev.events = EPOLLIN;
+  ev.data.ptr = &ckptTimerFd;
+  JASSERT(epoll_ctl(epollFd, EPOLL_CTL_ADD, ckptTimerFd, &ev) != -1)
+    (JASSERT_ERRNO);
+  resetCkptTimer();
+
   while (true) {
-    // Wait until either there is some activity on client sockets, or the timer
-    // has expired.
+    // Wait until there is some activity on client sockets or the timer.
     int nfds;
     do {
       nfds = epoll_wait(epollFd, events, MAX_EVENTS, -1);
-    } while (nfds < 0 && errno == EINTR && !timerExpired);
-
-
-    // The ckpt timer has expired; it's time to checkpoint.
-    //   NOTE:  We need minimumStateUnanimous and RUNNING, in case
-    //   worker had reached 'main()' of application and paused (e.g.,
-    //   under GDB), while the ckpt interval timer went off.  We want
-    //   startCheckpoint() to be deferred until the worker is RUNNING.
-    ComputationStatus s = getStatus();
-    if (timerExpired &&
-        s.minimumStateUnanimous && s.minimumState == WorkerState::RUNNING) {
-      timerExpired = false;
-      startCheckpoint();
-      continue;
-    }
+    } while (nfds < 0 && errno == EINTR);
 
-    // alarm() is not always the only source of interrupts.
-    // For example, any signal, including signal 0 or SIGWINCH can cause this.
+    // Any signal, including signal 0 or SIGWINCH, can cause this.
     JASSERT(nfds != -1 || errno == EINTR) (JASSERT_ERRNO);
 
     for (int n = 0; n < nfds; ++n) {
       void *ptr = events[n].data.ptr;
+
+      // Only clients with queued output (see CoordClient::sendMsg) ask for
+      // EPOLLOUT.
+      if (events[n].events & EPOLLOUT) {
+        ((CoordClient *)ptr)->flushOutput();
+      }
       if ((events[n].events & EPOLLHUP) ||
 #ifdef EPOLLRDHUP
           (events[n].events & EPOLLRDHUP) ||
@@ -1443,6 +1958,16 @@ DmtcpCoordinator::eventLoop(bool daemon)
       } else if (events[n].events & EPOLLIN) {
         if (ptr == (void *)listenSock) {
           onConnect();
+        } else if (ptr == (void *)scriptWriter) {
+          onRestartScriptWritten();
+        } else if (ptr == (void *)&ckptTimerFd) {
+          uint64_t expirations;
+          if (read(ckptTimerFd, &expirations, sizeof(expirations)) > 0) {
+            timerExpired = true;
+          }
+        } else if (!proxyLinks.empty() &&
+                   proxyLinks.find((ProxyLink *)ptr) != proxyLinks.end()) {
+          onProxyEvent((ProxyLink *)ptr);
         } else if (ptr == (void *)STDIN_FILENO) {
           char buf[1];
           int ret = Util::readAll(STDIN_FD, buf, sizeof(buf));
@@ -1460,6 +1985,75 @@ DmtcpCoordinator::eventLoop(bool daemon)
         }
       }
     }
+
+    // The ckpt timer has expired; it's time to checkpoint.
+    //   NOTE:  We need minimumStateUnanimous and RUNNING, in case
+    //   worker had reached 'main()' of application and paused (e.g.,
+    //   under GDB), while the ckpt interval timer went off.  We want
+    //   startCheckpoint() to be deferred until the worker is RUNNING.
+    if (timerExpired) {
+      ComputationStatus s = getStatus();
+      if (s.minimumStateUnanimous && s.minimumState == WorkerState::RUNNING) {
+        timerExpired = false;
+        startCheckpoint();
+      }
+    }
+  }
+}
+
+void
+DmtcpCoordinator::onProxyEvent(ProxyLink *link)
+{
+  ProxyLink::Event ev;
+
+  while (link->nextEvent(&ev)) {
+    switch (ev.type) {
+    case ProxyLink::NEW_CHANNEL:
+    {
+      jalib::JSocket remote(ev.fd);
+      CoordClient *client = onConnect(remote, link->addr(), link->addrLen());
+      link->channelRead();
+      if (client != NULL) {
+        client->proxy(link, ev.channel);
+        link->addClient(ev.channel, client);
+      }
+      break;
+    }
+
+    case ProxyLink::BARRIER:
+      processProxyBarrier(link, ev.barrier, ev.arrivals);
+      break;
+
+    case ProxyLink::CKPT_FILENAMES:
+      for (size_t i = 0; i < ev.filenames.size(); i++) {
+        const ProxyLink::CkptFilename &filename = ev.filenames[i];
+        CoordClient *client = link->client(filename.channel);
+        if (client != NULL) {
+          client->setState(WorkerState::CHECKPOINTED);
+        }
+        if (filename.type == DMT_UNIQUE_CKPT_FILENAME) {
+          uniqueCkptFilenames = true;
+        }
+        recordCkptFilename(filename.data.c_str());
+      }
+      processCkptFilenames();
+      break;
+
+    case ProxyLink::CLOSED:
+    {
+      struct epoll_event dummy;
+      JASSERT(epoll_ctl(epollFd, EPOLL_CTL_DEL, link->eventFd(), &dummy) != -1)
+        (JASSERT_ERRNO);
+      link->join();
+
+      // Otherwise, the last proxied client to disconnect deletes the link.
+      if (link->numClients() == 0) {
+        proxyLinks.erase(link);
+        delete link;
+      }
+      return;
+    }
+    }
   }
 }
 
@@ -1538,6 +2132,15 @@ main(int argc, char **argv)
       useLogFile = true;
       logFilename = argv[1];
       shift; shift;
+    } else if (argc > 1 && s == "--mtbf") {
+      char *endptr;
+      theMtbf = strtod(argv[1], &endptr);
+      if (endptr == argv[1] || *endptr != '\0' ||
+          !(theMtbf > 0) || isinf(theMtbf)) {
+        fprintf(stderr, theUsage, DEFAULT_PORT);
+        return 1;
+      }
+      shift; shift;
     } else if (s == "-i" || s == "--interval") {
       setenv(ENV_VAR_CKPT_INTR, argv[1], 1);
       shift; shift;
@@ -1624,8 +2227,8 @@ main(int argc, char **argv)
   // parse checkpoint interval
   const char *interval = getenv(ENV_VAR_CKPT_INTR);
   if (interval != NULL) {
-    theDefaultCheckpointInterval = jalib::StringToInt(interval);
-    theCheckpointInterval = theDefaultCheckpointInterval;
+    theDefaultCheckpointIntervalMs = parseInterval(interval);
+    theCheckpointIntervalMs = theDefaultCheckpointIntervalMs;
   }
 
 #if 0
@@ -1634,10 +2237,10 @@ main(int argc, char **argv)
       "dmtcp_coordinator starting..." <<
       "\n    Port: " << thePort <<
       "\n    Checkpoint Interval: ";
-    if (theCheckpointInterval == 0) {
+    if (theCheckpointIntervalMs == 0) {
       JASSERT_STDERR << "disabled (checkpoint manually instead)";
     } else {
-      JASSERT_STDERR << theCheckpointInterval;
+      JASSERT_STDERR << formatInterval(theCheckpointIntervalMs);
     }
     JASSERT_STDERR <<
       "\n    Exit on last client: " << exitOnLast << "\n";
@@ -1649,10 +2252,13 @@ main(int argc, char **argv)
                     "\n    Port: %d"
                     "\n    Checkpoint Interval: ",
             coordHostname.c_str(), inet_ntoa(localhostIPAddr), thePort);
-    if (theCheckpointInterval == 0) {
+    if (theCheckpointIntervalMs == 0) {
       fprintf(stderr, "disabled (checkpoint manually instead)");
     } else {
-      fprintf(stderr, "%d", theCheckpointInterval);
+      fprintf(stderr, "%s", formatInterval(theCheckpointIntervalMs).c_str());
+    }
+    if (theMtbf > 0) {
+      fprintf(stderr, " (adapted to MTBF of %g s)", theMtbf);
     }
     fprintf(stderr, "\n    Exit on last client: %d\n", exitOnLast);
   }
@@ -1694,10 +2300,9 @@ main(int argc, char **argv)
     }
   }
 
-  /* We set up the signal handler for SIGINT and SIGALRM.
+  /* We set up the signal handler for SIGINT.
    * SIGINT is used to send DMT_KILL_PEER message to all the connected peers
    * before exiting.
-   * SIGALRM is used for interval checkpointing.
    */
   setupSignalHandlers();
 
@@ -1714,9 +2319,6 @@ main(int argc, char **argv)
     sigset_t set;
     sigfillset(&set);
 
-    // unblock SIGALRM because we are using alarm() for interval checkpointing
-    sigdelset(&set, SIGALRM);
-
     // sigprocmask is only per-thread; but the coordinator is single-threaded.
     sigprocmask(SIG_BLOCK, &set, NULL);
   }
@@ -22,12 +22,17 @@
 #ifndef DMTCPDMTCPCOORDINATOR_H
 #define DMTCPDMTCPCOORDINATOR_H
 
+#include <sys/uio.h>
 #include "../jalib/jsocket.h"
 #include "dmtcpalloc.h"
 #include "dmtcpmessagetypes.h"
+#include "nodeproxy.h"
+#include "restartscript.h"
 
 namespace dmtcp
 {
+class ProxyLink;
+
 class CoordClient
 {
   public:
@@ -73,9 +78,32 @@ class CoordClient
 
     int isNSWorker() { return _isNSWorker; }
 
+    // Non-NULL if the client is connected through a dmtcp_nodeproxy.
+    ProxyLink *proxyLink() const { return _proxyLink; }
+
+    uint32_t proxyChannel() const { return _proxyChannel; }
+
+    void proxy(ProxyLink *link, uint32_t channel)
+    {
+      _proxyLink = link;
+      _proxyChannel = channel;
+    }
+
     void readProcessInfo(DmtcpMessage &msg);
 
+    // Send msg, followed by msg.extraBytes of extraData, without blocking.
+    // Whatever the socket does not take right away is queued, in order, and
+    // sent by flushOutput() once the socket is writable again, so that a
+    // slow client does not hold up the coordinator.
+    void sendMsg(const DmtcpMessage &msg, const void *extraData = NULL);
+    void flushOutput(bool block = false);
+
+    bool hasPendingOutput() const { return _outPos < _outBuf.size(); }
+
   private:
+    void queueOutput(const struct iovec *iov, int iovcnt, size_t skip);
+    void watchOutput(bool watch);
+
     UniquePid _identity;
     int _clientNumber;
     jalib::JSocket _sock;
@@ -87,6 +115,13 @@ class CoordClient
     pid_t _realPid;
     pid_t _virtualPid;
     int _isNSWorker;
+    ProxyLink *_proxyLink;
+    uint32_t _proxyChannel;
+
+    // Output not yet taken by the socket starts at _outBuf[_outPos].
+    string _outBuf;
+    size_t _outPos;
+    bool _watchingOutput;
 };
 
 class DmtcpCoordinator
@@ -101,6 +136,13 @@ class DmtcpCoordinator
 
     void onData(CoordClient *client);
     void onConnect();
+    CoordClient *onConnect(jalib::JSocket &remote,
+                           const struct sockaddr_storage *remoteAddr,
+                           socklen_t remoteLen);
+    void onProxyEvent(ProxyLink *link);
+    void processProxyBarrier(ProxyLink *link,
+                             const string &barrier,
+                             const vector<NodeProxyArrival> &arrivals);
     void onDisconnect(CoordClient *client);
     void eventLoop(bool daemon);
 
@@ -112,11 +154,13 @@ class DmtcpCoordinator
                           size_t extraBytes = 0,
                           const void *extraData = NULL);
 
-    void processBarrier(const string &barrier);
+    void processBarrier(const string &barrier, int numArrived = 1);
     void releaseBarrier(const string &barrier);
 
     bool startCheckpoint();
-    void recordCkptFilename(CoordClient *client, const char *barrierList);
+    void recordCkptFilename(const char *extraData);
+    void processCkptFilenames();
+    void onRestartScriptWritten();
 
     void handleUserCommand(char cmd, DmtcpMessage *reply = NULL);
     void printStatus(size_t numPeers, bool isRunning);
@@ -140,20 +184,27 @@ class DmtcpCoordinator
     }
 
     pid_t getNewVirtualPid();
-
-    void writeRestartScript();
+    bool isVirtualPidInUse(pid_t pid) const;
+    void leaseVirtualPids(CoordClient *client, const DmtcpMessage &msg);
+    void retireVirtualPidLeases(CoordClient *client);
+    void claimVirtualPid(pid_t pid);
 
   private:
     size_t _numCkptWorkers;
     size_t _numRestartFilenames;
 
-    // Store whether rsh/ssh was used
-    map< string, vector<string> > _rshCmdFileNames;
-    map< string, vector<string> > _sshCmdFileNames;
-
-    // map from hostname to checkpoint files
-    map<string, vector<string> >_restartFilenames;
+    // Checkpoint files reported so far in the current checkpoint.
+    vector<RestartScript::CkptFile> _ckptFiles;
     map<pid_t, CoordClient *>_virtualPidToClientMap;
+
+    // Virtual pids leased to a worker (via its name-service connection) for
+    // its future children.
+    map<pid_t, CoordClient *>_leasedVirtualPids;
+
+    // Leases whose holder has disconnected; value is the number of
+    // checkpoints started since.  A child forked just before its parent
+    // exited may still connect with one of these.
+    map<pid_t, int>_retiredVirtualPids;
 };
 }
 #endif // ifndef DMTCPDMTCPCOORDINATOR_H
@@ -97,6 +97,21 @@ static const char *theUsage =
   "  --ckptdir PATH (environment variable DMTCP_CHECKPOINT_DIR)\n"
   "              Directory to store checkpoint images\n"
   "              (default: curr dir at launch)\n"
+  "  --chunk-store, --no-chunk-store, (environment variable DMTCP_CHUNK_STORE)\n"
+  "              Store memory contents as content-addressed chunks in\n"
+  "              <ckptdir>/ckpt_chunks, shared by all processes\n"
+  "              and generations using that dir (default: 0).  Remove\n"
+  "              chunks no longer used with util/dmtcp_prune_chunks.py\n"
+  "  --skip-clean-file-pages (environment variable DMTCP_SKIP_CLEAN_FILE_PAGES)\n"
+  "              Do not save pages of private file mappings that were never\n"
+  "              modified; they are mapped again from the file on restart,\n"
+  "              which must then be unchanged (default: save all pages)\n"
+  "  --sync-fork (environment variable DMTCP_SYNC_FORK)\n"
+  "              Wait for the coordinator to accept a forked child before\n"
+  "              fork() returns.  By default, the child checks the reply\n"
+  "              itself, and if the coordinator rejects it (e.g., during\n"
+  "              a restart), the child is terminated after fork() has\n"
+  "              already succeeded in the parent.\n"
   "  --ckpt-open-files\n"
   "  --checkpoint-open-files\n"
   "              Checkpoint open files and restore old working dir.\n"
@@ -258,6 +273,18 @@ processArgs(int *orig_argc, const char ***orig_argv)
     } else if (s == "--no-gzip") {
       setenv(ENV_VAR_COMPRESSION, "0", 1);
       shift;
+    } else if (s == "--chunk-store") {
+      setenv(ENV_VAR_CHUNK_STORE, "1", 1);
+      shift;
+    } else if (s == "--no-chunk-store") {
+      setenv(ENV_VAR_CHUNK_STORE, "0", 1);
+      shift;
+    } else if (s == "--skip-clean-file-pages") {
+      setenv(ENV_VAR_SKIP_CLEAN_FILE_PAGES, "1", 1);
+      shift;
+    } else if (s == "--sync-fork") {
+      setenv(ENV_VAR_SYNC_FORK, "1", 1);
+      shift;
     }
 #ifdef HBICT_DELTACOMP
     else if (s == "--hbict") {
@@ -0,0 +1,855 @@
+/****************************************************************************
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+/****************************************************************************
+ * dmtcp_nodeproxy: an optional per-node aggregator between the workers on  *
+ * one node and dmtcp_coordinator.  Workers are pointed at the proxy        *
+ * instead of the coordinator (DMTCP_COORD_HOST/DMTCP_COORD_PORT) and need  *
+ * no other changes.  The proxy                                             *
+ *   - multiplexes all local connections over one coordinator connection,   *
+ *   - holds DMT_BARRIER messages until every local worker has arrived and  *
+ *     then reports all of them in a single DMT_PROXY_BARRIER,              *
+ *   - fans out DMT_PROXY_BROADCAST messages (e.g. DMT_BARRIER_RELEASED)    *
+ *     to the local workers, and                                            *
+ *   - answers repeated DMT_NAME_SERVICE_QUERY lookups from a local cache.  *
+ * See nodeproxy.h for the wire format.                                     *
+ *                                                                          *
+ * The cache holds only successful lookups, and is dropped whenever a       *
+ * local process registers new name-service data and whenever the local     *
+ * workers reach a barrier.  Name-service users register their data, pass  *
+ * a barrier, and only then query, so an entry never outlives the phase     *
+ * in which it was fetched.                                                 *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../jalib/jassert.h"
+#include "../jalib/jconvert.h"
+#include "../jalib/jsocket.h"
+#include "constants.h"
+#include "dmtcpalloc.h"
+#include "dmtcpmessagetypes.h"
+#include "nodeproxy.h"
+#include "util.h"
+
+#define BINARY_NAME "dmtcp_nodeproxy"
+
+#define READ_CHUNK_SIZE (64 * 1024)
+
+using namespace dmtcp;
+
+static const char *theUsage =
+  "Usage: dmtcp_nodeproxy [OPTIONS]\n"
+  "Aggregate the traffic between the DMTCP processes on this node and\n"
+  "dmtcp_coordinator.  Start one proxy per node, then launch the processes\n"
+  "on that node with --coord-host localhost --coord-port <proxy port>.\n\n"
+  "Options:\n"
+  "  -h, --coord-host HOSTNAME (environment variable DMTCP_COORD_HOST)\n"
+  "      Hostname where dmtcp_coordinator is run (default: localhost)\n"
+  "  -p, --coord-port PORT_NUM (environment variable DMTCP_COORD_PORT)\n"
+  "      Port where dmtcp_coordinator is run (default: "
+                                                  STRINGIFY(DEFAULT_PORT) ")\n"
+  "  --port PORT_NUM\n"
+  "      Port on which the proxy listens for local processes\n"
+  "      (default: 0, a random free port)\n"
+  "  --port-file FILENAME\n"
+  "      File to write listener port number.\n"
+  "  --daemon\n"
+  "      Run silently in the background after detaching from the parent\n"
+  "      process.\n"
+  "  -q, --quiet \n"
+  "      Skip startup msg.\n"
+  "  --help:\n"
+  "      Print this message and exit.\n"
+  "  --version:\n"
+  "      Print version information and exit.\n"
+  "\n"
+  HELP_AND_CONTACT_INFO
+  "\n";
+
+struct Channel {
+  int fd;
+  uint32_t key;          // Index into channels.
+  uint32_t id;           // Channel number upstream; 0 until first forwarded.
+  DmtcpMessageType helloType;
+  bool closing;          // Closed by the coordinator; close after flushing.
+  string in;             // Local process -> proxy, not yet parsed.
+  string out;            // Proxy -> local process, not yet written.
+  string down;           // Coordinator -> local process, not yet parsed.
+  bool atBarrier;
+  string barrier;
+  WorkerState::eWorkerState state;
+  int awaitingReplies;
+  list<string>queries;   // Cache keys of forwarded DMT_NAME_SERVICE_QUERYs.
+  DmtcpMessageType ckptFilenameType;
+  string ckptFilename;   // Extra data of a DMT_CKPT_FILENAME not yet sent.
+};
+
+// Channel numbers are handed out in the order in which channels first send
+// something upstream, so that the coordinator can treat any lower number
+// that it does not know as already closed.
+static map<uint32_t, Channel>channels;
+static map<uint32_t, uint32_t>channelKeys;   // upstream id -> key
+static uint32_t nextKey = 0;
+static uint32_t nextChannel = NODEPROXY_CONTROL_CHANNEL + 1;
+
+static jalib::JSocket upstream(-1);
+static string upstreamIn;
+static string upstreamOut;
+
+static map<string, string>nsCache;
+
+static bool
+isWorker(const Channel &c)
+{
+  return c.helloType == DMT_NEW_WORKER || c.helloType == DMT_RESTART_WORKER;
+}
+
+static bool
+isRequest(DmtcpMessageType type)
+{
+  switch (type) {
+  case DMT_NAME_SERVICE_QUERY:
+  case DMT_NAME_SERVICE_QUERY_ALL:
+  case DMT_NAME_SERVICE_GET_UNIQUE_ID:
+  case DMT_NAME_SERVICE_QUERY_BATCH:
+  case DMT_GET_CKPT_DIR:
+  case DMT_VIRTUAL_PID_LEASE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool
+isReply(DmtcpMessageType type)
+{
+  switch (type) {
+  case DMT_NAME_SERVICE_QUERY_RESPONSE:
+  case DMT_NAME_SERVICE_QUERY_ALL_RESPONSE:
+  case DMT_NAME_SERVICE_GET_UNIQUE_ID_RESPONSE:
+  case DMT_NAME_SERVICE_QUERY_BATCH_RESPONSE:
+  case DMT_GET_CKPT_DIR_RESULT:
+  case DMT_VIRTUAL_PID_LEASE_RESPONSE:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static string
+cacheKey(const DmtcpMessage &msg, const char *key)
+{
+  string k(msg.nsid, strnlen(msg.nsid, sizeof(msg.nsid)));
+
+  k.push_back('\0');
+  k.append(key, msg.keyLen);
+  return k;
+}
+
+static void
+flushUpstream()
+{
+  size_t written = 0;
+
+  while (written < upstreamOut.size()) {
+    ssize_t n = send(upstream.sockfd(), upstreamOut.data() + written,
+                     upstreamOut.size() - written, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1 && errno == EAGAIN) {
+      break;
+    }
+    JASSERT(n > 0) (JASSERT_ERRNO).Text("Lost connection to coordinator");
+    written += n;
+  }
+  upstreamOut.erase(0, written);
+}
+
+static void
+sendUpstream(uint32_t channel, const void *buf, size_t len)
+{
+  NodeProxyFrame frame;
+
+  frame.channel = channel;
+  frame.len = len;
+  upstreamOut.append((const char *)&frame, sizeof(frame));
+  upstreamOut.append((const char *)buf, len);
+  flushUpstream();
+}
+
+static void
+flushLocal(Channel &c)
+{
+  size_t written = 0;
+
+  while (written < c.out.size()) {
+    ssize_t n = send(c.fd, c.out.data() + written, c.out.size() - written,
+                     MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1 && errno == EAGAIN) {
+      break;
+    }
+    if (n <= 0) {
+      // The local process is gone; readLocal() will notice.
+      written = c.out.size();
+      break;
+    }
+    written += n;
+  }
+  c.out.erase(0, written);
+}
+
+static void
+writeLocal(Channel &c, const void *buf, size_t len)
+{
+  c.out.append((const char *)buf, len);
+  flushLocal(c);
+}
+
+static void
+assignChannelId(Channel &c)
+{
+  if (c.id == 0) {
+    c.id = nextChannel++;
+    channelKeys[c.id] = c.key;
+  }
+}
+
+// Send the pending DMT_CKPT_FILENAMEs of all local workers as one message.
+static void
+sendCkptFilenames()
+{
+  string records;
+  uint32_t count = 0;
+
+  map<uint32_t, Channel>::iterator it;
+  for (it = channels.begin(); it != channels.end(); it++) {
+    Channel &c = it->second;
+    if (c.ckptFilename.empty()) {
+      continue;
+    }
+
+    NodeProxyCkptFilename rec;
+    rec.channel = c.id;
+    rec.type = c.ckptFilenameType;
+    rec.len = c.ckptFilename.length();
+    records.append((const char *)&rec, sizeof(rec));
+    records.append(c.ckptFilename);
+    c.ckptFilename.clear();
+    count++;
+  }
+
+  if (count == 0) {
+    return;
+  }
+
+  JTRACE("Sending checkpoint filenames of local workers") (count);
+  DmtcpMessage msg(DMT_PROXY_CKPT_FILENAMES);
+  msg.numPeers = count;
+  msg.extraBytes = records.length();
+
+  string buf((const char *)&msg, sizeof(msg));
+  buf.append(records);
+  sendUpstream(NODEPROXY_CONTROL_CHANNEL, buf.data(), buf.size());
+}
+
+static void
+maybeSendCkptFilenames()
+{
+  map<uint32_t, Channel>::iterator it;
+
+  for (it = channels.begin(); it != channels.end(); it++) {
+    Channel &c = it->second;
+    if (isWorker(c) && !c.closing && c.ckptFilename.empty()) {
+      return;
+    }
+  }
+  sendCkptFilenames();
+}
+
+static void
+maybeSendBarrier()
+{
+  vector<NodeProxyArrival>arrivals;
+  string barrier;
+
+  map<uint32_t, Channel>::iterator it;
+  for (it = channels.begin(); it != channels.end(); it++) {
+    Channel &c = it->second;
+    if (!isWorker(c) || c.closing) {
+      continue;
+    }
+    if (!c.atBarrier) {
+      return;
+    }
+    if (barrier.empty()) {
+      barrier = c.barrier;
+    }
+    JASSERT(c.barrier == barrier) (c.barrier) (barrier);
+
+    NodeProxyArrival arrival;
+    arrival.channel = c.id;
+    arrival.state = c.state;
+    arrivals.push_back(arrival);
+  }
+
+  if (arrivals.empty()) {
+    return;
+  }
+
+  // Nothing that a worker sent before the barrier may arrive after it.
+  sendCkptFilenames();
+
+  JTRACE("Local workers reached barrier") (barrier) (arrivals.size());
+  DmtcpMessage msg(DMT_PROXY_BARRIER);
+  strncpy(msg.barrier, barrier.c_str(), sizeof(msg.barrier) - 1);
+  msg.numPeers = arrivals.size();
+  msg.extraBytes = arrivals.size() * sizeof(NodeProxyArrival);
+
+  string buf((const char *)&msg, sizeof(msg));
+  buf.append((const char *)&arrivals[0], msg.extraBytes);
+  sendUpstream(NODEPROXY_CONTROL_CHANNEL, buf.data(), buf.size());
+
+  for (it = channels.begin(); it != channels.end(); it++) {
+    it->second.atBarrier = false;
+  }
+  nsCache.clear();
+}
+
+static Channel *
+findChannel(uint32_t id)
+{
+  map<uint32_t, uint32_t>::iterator it = channelKeys.find(id);
+
+  return it == channelKeys.end() ? NULL : &channels[it->second];
+}
+
+static void
+closeChannel(uint32_t key)
+{
+  map<uint32_t, Channel>::iterator it = channels.find(key);
+
+  if (it == channels.end()) {
+    return;
+  }
+  if (!it->second.ckptFilename.empty()) {
+    // e.g. --exit-after-ckpt; the filename must reach the coordinator.
+    sendCkptFilenames();
+  }
+  if (it->second.id != 0) {
+    if (!it->second.closing) {
+      sendUpstream(it->second.id, NULL, 0);
+    }
+    channelKeys.erase(it->second.id);
+  }
+  close(it->second.fd);
+  channels.erase(it);
+
+  // The departed worker may have been the last one missing at a barrier.
+  maybeSendCkptFilenames();
+  maybeSendBarrier();
+}
+
+// A local process that breaks the protocol loses its connection; it must
+// not take the proxy, and with it every other process on the node, down.
+static bool
+isValidLocalMessage(const Channel &c, const DmtcpMessage &msg)
+{
+  if (!msg.isValid()) {
+    return false;
+  }
+  if (msg.extraBytes > NODEPROXY_MAX_FRAME_SIZE - sizeof(msg)) {
+    JNOTE("local message too large") (c.key) (msg.type) (msg.extraBytes);
+    return false;
+  }
+
+  switch (msg.type) {
+  case DMT_BARRIER:
+    if (strnlen(msg.barrier, sizeof(msg.barrier)) == sizeof(msg.barrier)) {
+      JNOTE("unterminated barrier name") (c.key);
+      return false;
+    }
+    if (isWorker(c)) {
+      // All local workers must agree on the barrier (see maybeSendBarrier).
+      map<uint32_t, Channel>::const_iterator it;
+      for (it = channels.begin(); it != channels.end(); it++) {
+        const Channel &other = it->second;
+        if (other.atBarrier && !other.closing && other.barrier != msg.barrier) {
+          JNOTE("local worker at a different barrier")
+            (c.key) (msg.barrier) (other.barrier);
+          return false;
+        }
+      }
+    }
+    break;
+
+  case DMT_NAME_SERVICE_QUERY:
+    if (msg.keyLen > msg.extraBytes) {
+      JNOTE("short name-service query") (c.key) (msg.keyLen) (msg.extraBytes);
+      return false;
+    }
+    break;
+
+  default:
+    break;
+  }
+  return true;
+}
+
+static void
+handleLocalMessage(Channel &c, const DmtcpMessage &msg, const char *extra)
+{
+  if (c.helloType == DMT_NULL) {
+    c.helloType = msg.type;
+  }
+
+  switch (msg.type) {
+  case DMT_BARRIER:
+    if (isWorker(c)) {
+      c.atBarrier = true;
+      c.barrier = msg.barrier;
+      c.state = msg.state;
+      maybeSendBarrier();
+      return;
+    }
+    break;
+
+  case DMT_NAME_SERVICE_QUERY:
+  {
+    string key = cacheKey(msg, extra);
+
+    // A cached answer must not overtake replies still owed to this channel.
+    map<string, string>::iterator it = nsCache.find(key);
+    if (c.awaitingReplies == 0 && it != nsCache.end()) {
+      DmtcpMessage reply(DMT_NAME_SERVICE_QUERY_RESPONSE);
+      reply.keyLen = 0;
+      reply.valLen = it->second.size();
+      reply.extraBytes = reply.valLen;
+      writeLocal(c, &reply, sizeof(reply));
+      writeLocal(c, it->second.data(), it->second.size());
+      return;
+    }
+    c.queries.push_back(key);
+    break;
+  }
+
+  case DMT_REGISTER_NAME_SERVICE_DATA:
+  case DMT_REGISTER_NAME_SERVICE_DATA_BATCH:
+    nsCache.clear();
+    break;
+
+  case DMT_CKPT_FILENAME:
+  case DMT_UNIQUE_CKPT_FILENAME:
+    if (isWorker(c)) {
+      assignChannelId(c);
+      c.ckptFilenameType = msg.type;
+      c.ckptFilename.assign(extra, msg.extraBytes);
+      maybeSendCkptFilenames();
+      return;
+    }
+    break;
+
+  default:
+    break;
+  }
+
+  if (isRequest(msg.type)) {
+    c.awaitingReplies++;
+  }
+
+  assignChannelId(c);
+  string buf((const char *)&msg, sizeof(msg));
+  buf.append(extra, msg.extraBytes);
+  sendUpstream(c.id, buf.data(), buf.size());
+}
+
+static void
+readLocal(uint32_t key)
+{
+  Channel &c = channels[key];
+  char buf[READ_CHUNK_SIZE];
+
+  ssize_t n = read(c.fd, buf, sizeof(buf));
+  if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if (n <= 0) {
+    closeChannel(key);
+    return;
+  }
+
+  c.in.append(buf, n);
+
+  size_t offset = 0;
+  while (c.in.size() - offset >= sizeof(DmtcpMessage)) {
+    DmtcpMessage msg;
+    memcpy(&msg, c.in.data() + offset, sizeof(msg));
+    if (!isValidLocalMessage(c, msg)) {
+      JWARNING(false) (c.key) (c.helloType)
+        .Text("Malformed message from local process; closing its channel");
+      closeChannel(key);
+      return;
+    }
+    if (c.in.size() - offset < sizeof(msg) + msg.extraBytes) {
+      break;
+    }
+    handleLocalMessage(c, msg, c.in.data() + offset + sizeof(msg));
+    offset += sizeof(msg) + msg.extraBytes;
+  }
+  c.in.erase(0, offset);
+}
+
+// Follow the coordinator's replies on a channel to fill the name-service
+// cache and to know when a channel has no outstanding requests.
+static void
+trackReplies(Channel &c, const char *buf, size_t len)
+{
+  c.down.append(buf, len);
+
+  size_t offset = 0;
+  while (c.down.size() - offset >= sizeof(DmtcpMessage)) {
+    DmtcpMessage msg;
+    memcpy(&msg, c.down.data() + offset, sizeof(msg));
+    msg.assertValid();
+    if (c.down.size() - offset < sizeof(msg) + msg.extraBytes) {
+      break;
+    }
+
+    if (isReply(msg.type) && c.awaitingReplies > 0) {
+      c.awaitingReplies--;
+    }
+    if (msg.type == DMT_NAME_SERVICE_QUERY_RESPONSE && !c.queries.empty()) {
+      if (msg.valLen > 0) {
+        nsCache[c.queries.front()] =
+          string(c.down.data() + offset + sizeof(msg), msg.valLen);
+      }
+      c.queries.pop_front();
+    }
+    offset += sizeof(msg) + msg.extraBytes;
+  }
+  c.down.erase(0, offset);
+}
+
+static void
+deliverLocal(Channel &c, const char *buf, size_t len)
+{
+  writeLocal(c, buf, len);
+  trackReplies(c, buf, len);
+}
+
+static void
+handleBroadcast(const char *buf, size_t len)
+{
+  DmtcpMessage msg;
+
+  JASSERT(len >= sizeof(msg)) (len);
+  memcpy(&msg, buf, sizeof(msg));
+  msg.assertValid();
+  JASSERT(msg.type == DMT_PROXY_BROADCAST) (msg.type);
+
+  size_t idsLen = msg.numPeers * sizeof(uint32_t);
+  JASSERT(len == sizeof(msg) + msg.extraBytes && idsLen <= msg.extraBytes)
+    (len) (msg.extraBytes) (msg.numPeers);
+
+  const char *ids = buf + sizeof(msg);
+  const char *inner = ids + idsLen;
+  size_t innerLen = msg.extraBytes - idsLen;
+
+  for (size_t i = 0; i < msg.numPeers; i++) {
+    uint32_t id;
+    memcpy(&id, ids + i * sizeof(id), sizeof(id));
+    Channel *c = findChannel(id);
+    if (c != NULL && !c->closing) {
+      deliverLocal(*c, inner, innerLen);
+    }
+  }
+}
+
+static void
+readUpstream()
+{
+  char buf[READ_CHUNK_SIZE];
+
+  ssize_t n = read(upstream.sockfd(), buf, sizeof(buf));
+  if (n == -1 && (errno == EAGAIN || errno == EINTR)) {
+    return;
+  }
+  if (n <= 0) {
+    JNOTE("Coordinator closed the connection; exiting.");
+    exit(0);
+  }
+
+  upstreamIn.append(buf, n);
+
+  size_t offset = 0;
+  while (upstreamIn.size() - offset >= sizeof(NodeProxyFrame)) {
+    NodeProxyFrame frame;
+    memcpy(&frame, upstreamIn.data() + offset, sizeof(frame));
+    if (upstreamIn.size() - offset < sizeof(frame) + frame.len) {
+      break;
+    }
+
+    const char *payload = upstreamIn.data() + offset + sizeof(frame);
+    if (frame.channel == NODEPROXY_CONTROL_CHANNEL) {
+      handleBroadcast(payload, frame.len);
+    } else {
+      Channel *c = findChannel(frame.channel);
+      if (c == NULL) {
+        // Already closed on our side.
+      } else if (frame.len == 0) {
+        c->closing = true;
+        if (c->out.empty()) {
+          closeChannel(c->key);
+        }
+      } else {
+        deliverLocal(*c, payload, frame.len);
+      }
+    }
+    offset += sizeof(frame) + frame.len;
+  }
+  upstreamIn.erase(0, offset);
+}
+
+static void
+acceptLocal(int listenFd)
+{
+  int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+  if (fd == -1) {
+    JWARNING(errno == EAGAIN || errno == EINTR) (JASSERT_ERRNO);
+    return;
+  }
+
+  Channel &c = channels[nextKey];
+  c.fd = fd;
+  c.key = nextKey++;
+  c.id = 0;
+  c.helloType = DMT_NULL;
+  c.closing = false;
+  c.atBarrier = false;
+  c.state = WorkerState::UNKNOWN;
+  c.awaitingReplies = 0;
+  c.ckptFilenameType = DMT_NULL;
+  JTRACE("new local connection") (c.key) (fd);
+}
+
+static void
+connectToCoordinator(const string &host, int port)
+{
+  upstream = jalib::JClientSocket(host.c_str(), port);
+  JASSERT(upstream.isValid()) (host) (port) (JASSERT_ERRNO)
+  .Text("Failed to connect to dmtcp_coordinator");
+
+  DmtcpMessage hello_local(DMT_PROXY_HELLO);
+  upstream << hello_local;
+
+  DmtcpMessage hello_remote;
+  hello_remote.poison();
+  upstream >> hello_remote;
+  hello_remote.assertValid();
+  JASSERT(hello_remote.type == DMT_ACCEPT) (hello_remote.type);
+
+  JASSERT(fcntl(upstream.sockfd(), F_SETFL, O_NONBLOCK) == 0) (JASSERT_ERRNO);
+}
+
+static void
+eventLoop(int listenFd)
+{
+  vector<struct pollfd>fds;
+  vector<uint32_t>keys;
+
+  while (true) {
+    struct pollfd pfd;
+    fds.clear();
+    keys.clear();
+
+    pfd.fd = listenFd;
+    pfd.events = POLLIN;
+    fds.push_back(pfd);
+    pfd.fd = upstream.sockfd();
+    pfd.events = POLLIN | (upstreamOut.empty() ? 0 : POLLOUT);
+    fds.push_back(pfd);
+
+    // While the coordinator is behind, leave local traffic in the sockets.
+    bool throttled = upstreamOut.size() >= NODEPROXY_MAX_PENDING;
+
+    map<uint32_t, Channel>::iterator it;
+    for (it = channels.begin(); it != channels.end(); it++) {
+      pfd.fd = it->second.fd;
+      pfd.events = (it->second.closing || throttled ? 0 : POLLIN) |
+                   (it->second.out.empty() ? 0 : POLLOUT);
+      fds.push_back(pfd);
+      keys.push_back(it->first);
+    }
+
+    int ret = poll(&fds[0], fds.size(), -1);
+    if (ret == -1 && errno == EINTR) {
+      continue;
+    }
+    JASSERT(ret != -1) (JASSERT_ERRNO);
+
+    if (fds[1].revents & POLLOUT) {
+      flushUpstream();
+    }
+    if (fds[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+      readUpstream();
+    }
+
+    for (size_t i = 0; i < keys.size(); i++) {
+      short revents = fds[i + 2].revents;
+      it = channels.find(keys[i]);
+      if (it == channels.end()) {
+        continue;
+      }
+      if (revents & POLLOUT) {
+        flushLocal(it->second);
+        if (it->second.closing && it->second.out.empty()) {
+          closeChannel(keys[i]);
+          continue;
+        }
+      }
+      if (revents & (POLLIN | POLLHUP | POLLERR)) {
+        readLocal(keys[i]);
+      }
+    }
+
+    if (fds[0].revents & POLLIN) {
+      acceptLocal(listenFd);
+    }
+
+    // A local process that stopped reading its replies must not make the
+    // proxy buffer without bound.
+    keys.clear();
+    for (it = channels.begin(); it != channels.end(); it++) {
+      if (it->second.out.size() > NODEPROXY_MAX_PENDING) {
+        keys.push_back(it->first);
+      }
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+      JWARNING(false) (keys[i]) (channels[keys[i]].out.size())
+        .Text("Local process is not reading; closing its channel");
+      closeChannel(keys[i]);
+    }
+  }
+}
+
+#define shift argc--; argv++
+
+int
+main(int argc, char **argv)
+{
+  initializeJalib();
+
+  string host = "localhost";
+  int port = DEFAULT_PORT;
+  int listenPort = 0;
+  string portFile;
+  bool daemon = false;
+  bool quiet = false;
+
+  if (getenv(ENV_VAR_NAME_HOST) != NULL) {
+    host = getenv(ENV_VAR_NAME_HOST);
+  }
+  if (getenv(ENV_VAR_NAME_PORT) != NULL) {
+    port = jalib::StringToInt(getenv(ENV_VAR_NAME_PORT));
+  }
+
+  shift;
+  while (argc > 0) {
+    string s = argv[0];
+    if (s == "--help") {
+      printf("%s", theUsage);
+      return 1;
+    } else if ((s == "--version") && argc == 1) {
+      printf("%s", DMTCP_VERSION_AND_COPYRIGHT_INFO);
+      return 1;
+    } else if (s == "-q" || s == "--quiet") {
+      quiet = true;
+      jassert_quiet++;
+      shift;
+    } else if (s == "--daemon") {
+      daemon = true;
+      shift;
+    } else if (argc > 1 && (s == "-h" || s == "--coord-host")) {
+      host = argv[1];
+      shift; shift;
+    } else if (argc > 1 && (s == "-p" || s == "--coord-port")) {
+      port = jalib::StringToInt(argv[1]);
+      shift; shift;
+    } else if (argc > 1 && s == "--port") {
+      listenPort = jalib::StringToInt(argv[1]);
+      shift; shift;
+    } else if (argc > 1 && s == "--port-file") {
+      portFile = argv[1];
+      shift; shift;
+    } else {
+      fprintf(stderr, "%s", theUsage);
+      return 1;
+    }
+  }
+
+  Util::initializeLogFile(Util::calcTmpDir(NULL), NULL, NULL);
+
+  connectToCoordinator(host, port);
+
+  jalib::JServerSocket listenSock(jalib::JSockAddr::ANY, listenPort, 128);
+  JASSERT(listenSock.isValid()) (listenPort) (JASSERT_ERRNO)
+  .Text("Failed to create listen socket.");
+  JASSERT(fcntl(listenSock.sockfd(), F_SETFL, O_NONBLOCK) == 0)
+    (JASSERT_ERRNO);
+  listenPort = listenSock.port();
+  if (!portFile.empty()) {
+    Util::writeCoordPortToFile(listenPort, portFile.c_str());
+  }
+
+  if (!quiet) {
+    fprintf(stderr, "dmtcp_nodeproxy starting..."
+                    "\n    Port: %d"
+                    "\n    Coordinator: %s:%d\n",
+            listenPort, host.c_str(), port);
+  }
+
+  if (daemon) {
+    int fd = open("/dev/null", O_RDWR);
+    JASSERT(dup2(fd, STDIN_FILENO) == STDIN_FILENO);
+    JASSERT(dup2(fd, STDOUT_FILENO) == STDOUT_FILENO);
+    JASSERT(dup2(fd, STDERR_FILENO) == STDERR_FILENO);
+    JASSERT_CLOSE_STDERR();
+    if (fd > STDERR_FILENO) {
+      close(fd);
+    }
+
+    if (fork() > 0) {
+      JTRACE("Parent Exiting after fork()");
+      exit(0);
+    }
+  }
+
+  eventLoop(listenSock.sockfd());
+  return 0;
+}
@@ -21,6 +21,7 @@
 
 #include <elf.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <sys/fcntl.h>
 #include <sys/mman.h>
@@ -135,7 +136,10 @@ string thePortFile;
 CoordinatorMode allowedModes = COORD_ANY;
 
 static void setEnvironFd();
-static void runMtcpRestart(int is32bitElf, int fd, ProcessInfo *pInfo);
+static void runMtcpRestart(int is32bitElf,
+                           int fd,
+                           ProcessInfo *pInfo,
+                           const string &ckptPath);
 static int readCkptHeader(const string &path, ProcessInfo *pInfo);
 static int openCkptFileToRead(const string &path);
 
@@ -409,7 +413,7 @@ class RestoreTarget
 #endif // if defined(__x86_64__) || defined(__aarch64__)
 
 
-      runMtcpRestart(is32bitElf, _fd, &_pInfo);
+      runMtcpRestart(is32bitElf, _fd, &_pInfo, _path);
 
       JASSERT(false).Text("unreachable");
     }
@@ -421,14 +425,27 @@ class RestoreTarget
 };
 
 static void
-runMtcpRestart(int is32bitElf, int fd, ProcessInfo *pInfo)
+runMtcpRestart(int is32bitElf,
+               int fd,
+               ProcessInfo *pInfo,
+               const string &ckptPath)
 {
   char fdBuf[8];
   char stderrFdBuf[8];
+  char chunkDirBuf[PATH_MAX];
 
   sprintf(fdBuf, "%d", fd);
   sprintf(stderrFdBuf, "%u", (unsigned int)PROTECTED_STDERR_FD);
 
+  // The chunk store (if any) lives next to the ckpt image; see chunkstore.cpp.
+  string ckptDir = jalib::Filesystem::DirName(ckptPath);
+  if (realpath(ckptDir.c_str(), chunkDirBuf) == NULL) {
+    strncpy(chunkDirBuf, ckptDir.c_str(), sizeof(chunkDirBuf) - 1);
+    chunkDirBuf[sizeof(chunkDirBuf) - 1] = '\0';
+  }
+  strncat(chunkDirBuf, "/" DMTCP_CHUNK_STORE_DIR,
+          sizeof(chunkDirBuf) - strlen(chunkDirBuf) - 1);
+
 #ifdef HAS_PR_SET_PTRACER
   if (getenv("DMTCP_GDB_ATTACH_ON_RESTART")) {
     JNOTE("\n     *******************************************************\n"
@@ -512,6 +529,7 @@ runMtcpRestart(int is32bitElf, int fd, ProcessInfo *pInfo)
     (char *)mtcprestart.c_str(),
     const_cast<char *>("--fd"), fdBuf,
     const_cast<char *>("--stderr-fd"), stderrFdBuf,
+    const_cast<char *>("--chunk-dir"), chunkDirBuf,
     // These two flag must be last, since they may become NULL
     ( mtcp_restart_pause ? const_cast<char *>("--mtcp-restart-pause") : NULL ),
     ( mtcp_restart_pause ? pause_param : NULL ),
@@ -593,10 +611,15 @@ open_ckpt_to_read(const char *filename)
   pid_t cpid;
 
   fc = first_char(filename);
-  fd = open(filename, O_RDONLY);
+  // Images are opened from several threads (loadRestoreTargets), each of which
+  // may fork a decompressor; keep our fds out of the other threads' children.
+  // loadRestoreTargets() clears FD_CLOEXEC once all images are open.
+  fd = open(filename, O_RDONLY | O_CLOEXEC);
   JASSERT(fd >= 0)(filename).Text("Failed to open file.");
 
   if (fc == DMTCP_MAGIC_FIRST) { /* no compression */
+    // mtcp_restart reads the image front to back; ask for larger readahead.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
     return fd;
   } else if (fc == GZIP_FIRST
 #ifdef HBICT_DELTACOMP
@@ -614,7 +637,7 @@ open_ckpt_to_read(const char *filename)
     }
 #endif // ifdef HBICT_DELTACOMP
 
-    JASSERT(pipe(fds) != -1) (filename)
+    JASSERT(pipe2(fds, O_CLOEXEC) != -1) (filename)
     .Text("Cannot create pipe to execute gunzip to decompress ckpt file!");
 
     cpid = fork();
@@ -639,32 +662,35 @@ open_ckpt_to_read(const char *filename)
        * wait()'d upon by the corresponding mtcp_restart processes because
        * their parent is the original dmtcp_restart process and thus they
        * become zombie.
+       *
+       * Other threads may be inside malloc or jassert at the time of the
+       * fork, so only async-signal-safe calls are made from here on.  On
+       * failure, the parent sees EOF on the pipe and reports a bad header.
        */
       cpid = fork();
-      JASSERT(cpid != -1);
-      if (cpid > 0) {
+      if (cpid != 0) {
         // Use _exit() instead of exit() to avoid popping atexit() handlers
         // registered by the parent process.
-        _exit(0);
+        _exit(cpid == -1 ? 1 : 0);
       }
 
       // Grandchild process
-      JTRACE("child process, will exec into external de-compressor");
       fd = dup(dup(dup(fd)));
       fds[1] = dup(fds[1]);
-      close(fds[0]);
-      JASSERT(fd != -1);
-      JASSERT(dup2(fd, STDIN_FILENO) == STDIN_FILENO);
+      if (fd == -1 || fds[1] == -1 ||
+          dup2(fd, STDIN_FILENO) != STDIN_FILENO ||
+          dup2(fds[1], STDOUT_FILENO) != STDOUT_FILENO) {
+        _exit(1);
+      }
       close(fd);
-      JASSERT(dup2(fds[1], STDOUT_FILENO) == STDOUT_FILENO);
       close(fds[1]);
       execvp(decomp_path, (char **)decomp_args);
-      JASSERT(decomp_path != NULL) (decomp_path)
-      .Text("Failed to launch gzip.");
 
-      /* should not get here */
-      JASSERT(false)
-      .Text("Decompression failed!  No restoration will be performed!");
+      static const char msg[] =
+        "dmtcp_restart: failed to exec the checkpoint image decompressor\n";
+      ssize_t rc = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+      (void)rc;
+      _exit(1);
     }
   } else { /* invalid magic number */
     JASSERT(false)
@@ -696,6 +722,96 @@ openCkptFileToRead(const string &path)
 
 // ************************ End of for reading checkpoint files *************
 
+// Start reading all ckpt images into the page cache, so that the I/O for all
+// of them proceeds concurrently while the process trees are being created.
+// Each of the mtcp_restart processes then finds most of its image in memory.
+// We prefetch at most half of the available memory, split evenly between the
+// images, since pages evicted before they are used would be read twice.
+// If the available memory is unknown, nothing is prefetched (a length of 0
+// would make posix_fadvise() cover the whole file).
+static void
+prefetchCkptImages(const vector<string> &paths)
+{
+  long availPages = sysconf(_SC_AVPHYS_PAGES);
+  if (availPages <= 0 || paths.empty()) {
+    return;
+  }
+  uint64_t budget = (uint64_t)availPages * Util::pageSize() / 2;
+  uint64_t perImage = budget / paths.size();
+  if (perImage == 0) {
+    JTRACE("not prefetching ckpt images; no memory available")
+      (availPages) (paths.size());
+    return;
+  }
+
+  for (size_t i = 0; i < paths.size(); i++) {
+    int fd = open(paths[i].c_str(), O_RDONLY);
+    if (fd == -1) {
+      continue;
+    }
+    int rc = posix_fadvise(fd, 0, perImage, POSIX_FADV_WILLNEED);
+    JTRACE("prefetching ckpt image") (paths[i]) (perImage) (rc);
+    close(fd);
+  }
+}
+
+static vector<string> targetPaths;
+static vector<RestoreTarget *> loadedTargets;
+static size_t nextTargetToLoad = 0;
+
+static void *
+loadRestoreTargetsThread(void *arg)
+{
+  while (true) {
+    size_t i = __sync_fetch_and_add(&nextTargetToLoad, 1);
+    if (i >= targetPaths.size()) {
+      break;
+    }
+    loadedTargets[i] = new RestoreTarget(targetPaths[i]);
+  }
+  return NULL;
+}
+
+// Read and validate the headers of all ckpt images.  For compressed images,
+// this waits on a decompressor process for each image; so do it from several
+// threads.  All threads are joined before any process is forked.
+static void
+loadRestoreTargets(const vector<string> &paths)
+{
+  long numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (numThreads < 1) {
+    numThreads = 1;
+  }
+  if ((size_t)numThreads > paths.size()) {
+    numThreads = paths.size();
+  }
+
+  targetPaths = paths;
+  loadedTargets.resize(paths.size(), NULL);
+  nextTargetToLoad = 0;
+
+  vector<pthread_t> threads(numThreads - 1);
+  for (size_t i = 0; i < threads.size(); i++) {
+    JASSERT(pthread_create(&threads[i], NULL,
+                           loadRestoreTargetsThread, NULL) == 0);
+  }
+  loadRestoreTargetsThread(NULL);
+  for (size_t i = 0; i < threads.size(); i++) {
+    JASSERT(pthread_join(threads[i], NULL) == 0);
+  }
+
+  for (size_t i = 0; i < loadedTargets.size(); i++) {
+    RestoreTarget *t = loadedTargets[i];
+    targets[t->upid()] = t;
+
+    // The image fd is handed to mtcp_restart across exec().
+    int flags = fcntl(t->fd(), F_GETFD);
+    JASSERT(flags != -1 && fcntl(t->fd(), F_SETFD, flags & ~FD_CLOEXEC) != -1)
+      (t->upid()) (JASSERT_ERRNO);
+  }
+}
+
 
 static void
 setEnvironFd()
@@ -883,6 +999,7 @@ main(int argc, char **argv)
   JTRACE("New dmtcp_restart process; _argc_ ckpt images") (argc);
 
   bool doAbort = false;
+  vector<string> ckptImages;
   for (; argc > 0; shift) {
     string restorename(argv[0]);
     struct stat buf;
@@ -915,8 +1032,12 @@ main(int argc, char **argv)
     }
 
     JTRACE("Will restart ckpt image") (argv[0]);
-    RestoreTarget *t = new RestoreTarget(argv[0]);
-    targets[t->upid()] = t;
+    ckptImages.push_back(argv[0]);
+  }
+
+  if (!ckptImages.empty()) {
+    prefetchCkptImages(ckptImages);
+    loadRestoreTargets(ckptImages);
   }
 
   // Prepare list of independent process tree roots
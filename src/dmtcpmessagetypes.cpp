@@ -130,6 +130,18 @@ dmtcp::operator<<(dmtcp::ostream &o, const DmtcpMessageType &s)
     OSHIFTPRINTF(DMT_NAME_SERVICE_GET_UNIQUE_ID)
     OSHIFTPRINTF(DMT_NAME_SERVICE_GET_UNIQUE_ID_RESPONSE)
 
+    OSHIFTPRINTF(DMT_REGISTER_NAME_SERVICE_DATA_BATCH)
+    OSHIFTPRINTF(DMT_NAME_SERVICE_QUERY_BATCH)
+    OSHIFTPRINTF(DMT_NAME_SERVICE_QUERY_BATCH_RESPONSE)
+
+    OSHIFTPRINTF(DMT_VIRTUAL_PID_LEASE)
+    OSHIFTPRINTF(DMT_VIRTUAL_PID_LEASE_RESPONSE)
+
+    OSHIFTPRINTF(DMT_PROXY_HELLO)
+    OSHIFTPRINTF(DMT_PROXY_BARRIER)
+    OSHIFTPRINTF(DMT_PROXY_BROADCAST)
+    OSHIFTPRINTF(DMT_PROXY_CKPT_FILENAMES)
+
   default:
     JASSERT(false) (s).Text("Invalid Message Type");
 
@@ -73,6 +73,21 @@ enum DmtcpMessageType {
 
   DMT_NAME_SERVICE_GET_UNIQUE_ID,
   DMT_NAME_SERVICE_GET_UNIQUE_ID_RESPONSE,
+
+  DMT_REGISTER_NAME_SERVICE_DATA_BATCH,  // many key-value pairs, one message
+  DMT_NAME_SERVICE_QUERY_BATCH,          // many keys, one message
+  DMT_NAME_SERVICE_QUERY_BATCH_RESPONSE,
+
+  DMT_VIRTUAL_PID_LEASE,     // worker asks for a batch of virtual pids to
+                             // hand out to its future children
+  DMT_VIRTUAL_PID_LEASE_RESPONSE,
+
+  DMT_PROXY_HELLO,           // on connect established nodeproxy-coordinator
+  DMT_PROXY_BARRIER,         // nodeproxy -> coordinator: combined arrivals
+  DMT_PROXY_BROADCAST,       // coordinator -> nodeproxy: one message, many
+                             // local workers
+  DMT_PROXY_CKPT_FILENAMES,  // nodeproxy -> coordinator: the local workers'
+                             // DMT_CKPT_FILENAMEs, in one message
 };
 
 namespace CoordCmdStatus
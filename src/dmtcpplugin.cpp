@@ -19,7 +19,9 @@
  *  <http://www.gnu.org/licenses/>.                                         *
  ****************************************************************************/
 
+#include <errno.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "coordinatorapi.h"
 #include "dmtcp.h"
@@ -458,6 +460,28 @@ dmtcp_unblock_ckpt_signal(void)
   JASSERT(_real_pthread_sigmask(SIG_UNBLOCK, &signals_set, NULL) == 0);
 }
 
+EXTERNC int
+dmtcp_create_helper_thread(pthread_t *thread,
+                           void *(*start_routine)(void *),
+                           void *arg)
+{
+  return _real_pthread_create(thread, NULL, start_routine, arg);
+}
+
+EXTERNC int
+dmtcp_join_helper_thread(pthread_t thread, void **retval)
+{
+  // pthread_join() is wrapped; see threadwrappers.cpp.
+  int ret;
+  do {
+    struct timespec ts;
+    JASSERT(clock_gettime(CLOCK_REALTIME, &ts) != -1);
+    ts.tv_sec += 1;
+    ret = _real_pthread_timedjoin_np(thread, retval, &ts);
+  } while (ret == ETIMEDOUT);
+  return ret;
+}
+
 EXTERNC int
 dmtcp_send_key_val_pair_to_coordinator(const char *id,
                                        const void *key,
@@ -486,6 +510,30 @@ dmtcp_send_query_to_coordinator(const char *id,
   return CoordinatorAPI::sendQueryToCoordinator(id, key, key_len, val, val_len);
 }
 
+EXTERNC int
+dmtcp_send_key_val_pairs_to_coordinator(const char *id,
+                                        uint32_t num,
+                                        const void *const *keys,
+                                        const uint32_t *key_lens,
+                                        const void *const *vals,
+                                        const uint32_t *val_lens)
+{
+  return CoordinatorAPI::sendKeyValPairsToCoordinator(id, num, keys, key_lens,
+                                                      vals, val_lens);
+}
+
+EXTERNC int
+dmtcp_send_queries_to_coordinator(const char *id,
+                                  uint32_t num,
+                                  const void *const *keys,
+                                  const uint32_t *key_lens,
+                                  void **vals,
+                                  uint32_t *val_lens)
+{
+  return CoordinatorAPI::sendQueriesToCoordinator(id, num, keys, key_lens,
+                                                  vals, val_lens);
+}
+
 EXTERNC int
 dmtcp_get_unique_id_from_coordinator(const char *id,    // DB name
                                      const void *key,   // hostid, pid, etc.
@@ -343,6 +343,7 @@ DmtcpWorker::resetOnFork()
   exitInProgress = false;
 
   ThreadSync::resetLocks();
+  ThreadSync::resetFastPath();
 
   WorkerState::setCurrentState(WorkerState::RUNNING);
 
@@ -380,6 +381,7 @@ dmtcp_finalize()
   WorkerState::setCurrentState(WorkerState::UNKNOWN);
 
   JTRACE("Process exiting.");
+  JASSERT_TRY_FLUSH_TRACE_BUFFERS();
 }
 
 void
@@ -504,6 +506,10 @@ DmtcpWorker::preCheckpoint()
 
   ProcessInfo::instance().numPeers(numPeers);
 
+  // User threads are suspended; a suspended thread may be holding the flush
+  // lock, so don't wait for it.
+  JASSERT_TRY_FLUSH_TRACE_BUFFERS();
+
   WorkerState::setCurrentState(WorkerState::CHECKPOINTING);
   PluginManager::eventHook(DMTCP_EVENT_PRECHECKPOINT);
 }
@@ -536,6 +542,7 @@ DmtcpWorker::postRestart(double ckptReadTime)
 {
   JTRACE("begin postRestart()");
   WorkerState::setCurrentState(WorkerState::RESTARTING);
+  ThreadSync::initFastPath();
 
   JTRACE("Waiting for Restart barrier");
   CoordinatorAPI::waitForBarrier("DMT:Restart");
@@ -118,6 +118,8 @@ pthread_atfork_child()
   UniquePid child = UniquePid(host, getpid(), child_time);
   string child_name = jalib::Filesystem::GetProgramName() + "_(forked)";
   ThreadSync::resetLocks();
+  ThreadSync::resetFastPath();
+  jassert_internal::trace_reset_on_fork();
 
   UniquePid::resetOnFork(child);
   Util::initializeLogFile(dmtcp_get_tmpdir(), child_name.c_str(), NULL);
@@ -357,6 +359,10 @@ dmtcpPrepareForExec(const char *path,
 
   Util::adjustRlimitStack();
 
+  // If we were forked on the fast path, the coordinator's DMT_ACCEPT must be
+  // consumed before the coordinator socket passes to the new program.
+  CoordinatorAPI::recvPendingHandshakeReply();
+
   // Remove FD_CLOEXEC flag from protected file descriptors.
   for (size_t i = PROTECTED_FD_START; i < PROTECTED_FD_END; i++) {
     int flags = fcntl(i, F_GETFD, NULL);
@@ -365,6 +371,9 @@ dmtcpPrepareForExec(const char *path,
     }
   }
   JTRACE("Prepared for Exec") (getenv("LD_PRELOAD"));
+
+  // The trace buffers do not survive exec; drain them now.
+  JASSERT_FLUSH_TRACE_BUFFERS();
 }
 
 static void
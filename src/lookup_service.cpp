@@ -55,14 +55,25 @@ LookupService::addKeyValue(string id,
                            size_t valLen)
 {
   KeyValueMap &kvmap = _maps[id];
-
-  KeyValue k(key, keyLen);
+  KeyValueMap::iterator it = kvmap.find(KeyValue::borrow(key, keyLen));
   KeyValue *v = new KeyValue(val, valLen);
 
-  if (kvmap.find(k) != kvmap.end()) {
+  if (it != kvmap.end()) {
     JTRACE("Duplicate key");
+    it->second->destroy();
+    delete it->second;
+    it->second = v;
+    return;
   }
-  kvmap[k] = v;
+  kvmap[KeyValue(key, keyLen)] = v;
+}
+
+KeyValue *
+LookupService::find(KeyValueMap &kvmap, const void *key, size_t keyLen)
+{
+  KeyValueMap::iterator it = kvmap.find(KeyValue::borrow(key, keyLen));
+
+  return it == kvmap.end() ? NULL : it->second;
 }
 
 void
@@ -72,17 +83,15 @@ LookupService::query(string id,
                      void **val,
                      size_t *valLen)
 {
-  KeyValueMap &kvmap = _maps[id];
-  KeyValue k(key, keyLen);
+  KeyValue *v = find(_maps[id], key, keyLen);
 
-  if (kvmap.find(k) == kvmap.end()) {
+  if (v == NULL) {
     JTRACE("Lookup Failed, Key not found.");
     *val = NULL;
     *valLen = 0;
     return;
   }
 
-  KeyValue *v = kvmap[k];
   *valLen = v->len();
   *val = new char[v->len()];
   memcpy(*val, v->data(), *valLen);
@@ -102,37 +111,103 @@ LookupService::registerData(const DmtcpMessage &msg, const void *data)
 }
 
 void
-LookupService::respondToQuery(jalib::JSocket &remote,
-                              const DmtcpMessage &msg,
-                              const void *key)
+LookupService::registerDataBatch(const DmtcpMessage &msg, const void *data)
+{
+  const char *p = (const char *)data;
+  const char *end = p + msg.extraBytes;
+  KeyValueMap &kvmap = _maps[msg.nsid];
+  size_t n = 0;
+
+  while (p < end) {
+    uint32_t lens[2];
+    JASSERT(p + sizeof(lens) <= end) (msg.extraBytes);
+    memcpy(lens, p, sizeof(lens));
+    p += sizeof(lens);
+    JASSERT(lens[0] > 0 && lens[1] > 0 && p + lens[0] + lens[1] <= end)
+      (lens[0]) (lens[1]) (msg.extraBytes);
+
+    KeyValueMap::iterator it = kvmap.find(KeyValue::borrow(p, lens[0]));
+    KeyValue *v = new KeyValue(p + lens[0], lens[1]);
+    if (it != kvmap.end()) {
+      it->second->destroy();
+      delete it->second;
+      it->second = v;
+    } else {
+      kvmap[KeyValue(p, lens[0])] = v;
+    }
+    p += lens[0] + lens[1];
+    n++;
+  }
+  JTRACE("Registered key-value pairs") (msg.nsid) (n);
+}
+
+void
+LookupService::respondToQuery(const DmtcpMessage &msg,
+                              const void *key,
+                              DmtcpMessage *reply,
+                              vector<char> *replyData)
 {
   JASSERT(msg.keyLen > 0 && msg.keyLen == msg.extraBytes)
     (msg.keyLen) (msg.extraBytes);
   void *val = NULL;
   size_t valLen = 0;
-  DmtcpMessage reply;
 
   if (msg.type == DMT_NAME_SERVICE_GET_UNIQUE_ID) {
-    reply.type = DMT_NAME_SERVICE_GET_UNIQUE_ID_RESPONSE;
+    reply->type = DMT_NAME_SERVICE_GET_UNIQUE_ID_RESPONSE;
     getUniqueId(msg.nsid, key, msg.keyLen, &val,
                 msg.uniqueIdOffset, msg.valLen);
     valLen = msg.valLen;
   } else {
-    reply.type = DMT_NAME_SERVICE_QUERY_RESPONSE;
+    reply->type = DMT_NAME_SERVICE_QUERY_RESPONSE;
     query(msg.nsid, key, msg.keyLen, &val, &valLen);
   }
 
-  reply.keyLen = 0;
-  reply.valLen = valLen;
-  reply.extraBytes = reply.valLen;
+  reply->keyLen = 0;
+  reply->valLen = valLen;
+  reply->extraBytes = reply->valLen;
 
-  remote << reply;
-  if (valLen > 0) {
-    remote.writeAll((char *)val, valLen);
-  }
+  replyData->assign((char *)val, (char *)val + valLen);
   delete[] (char *)val;
 }
 
+void
+LookupService::respondToQueryBatch(const DmtcpMessage &msg,
+                                   const void *data,
+                                   DmtcpMessage *reply,
+                                   vector<char> *replyData)
+{
+  const char *p = (const char *)data;
+  const char *end = p + msg.extraBytes;
+  KeyValueMap &kvmap = _maps[msg.nsid];
+  vector<char> &buf = *replyData;
+
+  buf.clear();
+
+  // Answer the whole batch with a single reply.
+  while (p < end) {
+    uint32_t keyLen;
+    JASSERT(p + sizeof(keyLen) <= end) (msg.extraBytes);
+    memcpy(&keyLen, p, sizeof(keyLen));
+    p += sizeof(keyLen);
+    JASSERT(keyLen > 0 && p + keyLen <= end) (keyLen) (msg.extraBytes);
+
+    KeyValue *v = find(kvmap, p, keyLen);
+    uint32_t valLen = v == NULL ? 0 : v->len();
+    size_t pos = buf.size();
+    buf.resize(pos + sizeof(valLen) + valLen);
+    memcpy(&buf[pos], &valLen, sizeof(valLen));
+    if (valLen > 0) {
+      memcpy(&buf[pos + sizeof(valLen)], v->data(), valLen);
+    }
+    p += keyLen;
+  }
+
+  reply->type = DMT_NAME_SERVICE_QUERY_BATCH_RESPONSE;
+  reply->keyLen = 0;
+  reply->valLen = buf.size();
+  reply->extraBytes = reply->valLen;
+}
+
 void
 LookupService::getUniqueId(const char *id,    // DB name
                            const void *key,   // Key: can be hostid, pid, etc.
@@ -142,38 +217,34 @@ LookupService::getUniqueId(const char *id,    // DB name
                            size_t val_len)    // Expected value length
 {
   KeyValueMap &kvmap = _maps[id];
-  KeyValue k(key, key_len);
+  KeyValue *v = find(kvmap, key, key_len);
 
   // if key does not exist in the key-value map, add it
-  if (kvmap.find(k) == kvmap.end()) {
+  if (v == NULL) {
     if (_lastUniqueIds.find(id) == _lastUniqueIds.end()) {
       _lastUniqueIds[id] = 1;
       _offsets[id] = offset;
     }
     JTRACE("Assigning a new unique id to client request")
        (id) (_lastUniqueIds[id]);
-    KeyValue *v = new KeyValue(&_lastUniqueIds[id], val_len);
+    v = new KeyValue(&_lastUniqueIds[id], val_len);
     _lastUniqueIds[id] += _offsets[id];
-    kvmap[k] = v;
+    kvmap[KeyValue(key, key_len)] = v;
   }
 
-  KeyValue *v = kvmap[k];
   JASSERT(v->len() == val_len);
   *val = new char[v->len()];
   memcpy(*val, v->data(), val_len);
 }
 
 void
-LookupService::sendAllMappings(jalib::JSocket &remote,
-                               const DmtcpMessage &msg)
+LookupService::sendAllMappings(const DmtcpMessage &msg,
+                               DmtcpMessage *reply,
+                               vector<char> *replyData)
 {
-  void *val = NULL;
-  size_t valLen = 0;
   ostringstream o;
 
-  DmtcpMessage reply(DMT_NAME_SERVICE_QUERY_ALL_RESPONSE);
-
-  map<KeyValue, KeyValue *>::iterator i;
+  KeyValueMap::iterator i;
   KeyValueMap &kvmap = _maps[msg.nsid];
 
   for (i = kvmap.begin(); i != kvmap.end(); i++) {
@@ -191,16 +262,10 @@ LookupService::sendAllMappings(jalib::JSocket &remote,
     o.write((const char*)v->data(), len);
   }
 
-  reply.keyLen = 0;
-  valLen = o.tellp();
-  reply.valLen = valLen;
-  reply.extraBytes = reply.valLen;
-  val = new char[reply.extraBytes];
-  memcpy(val, o.str().c_str(), reply.extraBytes);
-
-  remote << reply;
-  if (valLen > 0) {
-    remote.writeAll((char *)val, valLen);
-  }
-  delete[] (char *)val;
+  string s = o.str();
+  reply->type = DMT_NAME_SERVICE_QUERY_ALL_RESPONSE;
+  reply->keyLen = 0;
+  reply->valLen = s.length();
+  reply->extraBytes = reply->valLen;
+  replyData->assign(s.begin(), s.end());
 }
@@ -22,6 +22,7 @@
 #ifndef LOOKUP_SERVICE_H
 #define LOOKUP_SERVICE_H
 
+#include <stdint.h>
 #include <string.h>
 #include <map>
 #include "../jalib/jsocket.h"
@@ -41,15 +42,24 @@ class KeyValue
 
     ~KeyValue() {}
 
+    // Refers to the caller's buffer; used for lookups and never destroyed.
+    static KeyValue borrow(const void *data, size_t len)
+    {
+      KeyValue kv;
+      kv._data = (void *)data;
+      kv._len = len;
+      return kv;
+    }
+
     void destroy()
     {
       JASSERT(_data != NULL);
       JALLOC_HELPER_FREE(_data);
     }
 
-    void *data() { return _data; }
+    void *data() const { return _data; }
 
-    size_t len() { return _len; }
+    size_t len() const { return _len; }
 
     bool operator<(const KeyValue &that) const
     {
@@ -70,10 +80,35 @@ class KeyValue
     }
 
   private:
+    KeyValue() : _data(NULL), _len(0) {}
+
     void *_data;
     size_t _len;
 };
 
+struct KeyValueHash {
+  size_t operator()(const KeyValue &kv) const
+  {
+    // FNV-1a
+    const unsigned char *p = (const unsigned char *)kv.data();
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < kv.len(); i++) {
+      h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return (size_t)h;
+  }
+};
+
+/*
+ * Batched requests carry many keys in the extra data of a single message:
+ *   DMT_REGISTER_NAME_SERVICE_DATA_BATCH:
+ *     { uint32_t keyLen; uint32_t valLen; key; val } ...
+ *   DMT_NAME_SERVICE_QUERY_BATCH:
+ *     { uint32_t keyLen; key } ...
+ *   DMT_NAME_SERVICE_QUERY_BATCH_RESPONSE, one entry per key, in order:
+ *     { uint32_t valLen; val } ...       (valLen == 0: key not found)
+ */
+
 class LookupService
 {
   public:
@@ -83,9 +118,18 @@ class LookupService
 
     void reset();
     void registerData(const DmtcpMessage &msg, const void *data);
-    void respondToQuery(jalib::JSocket &remote,
-                        const DmtcpMessage &msg,
-                        const void *data);
+    void registerDataBatch(const DmtcpMessage &msg, const void *data);
+
+    // The respondTo* and sendAllMappings functions fill in reply and its
+    // extra data; the caller sends them.
+    void respondToQuery(const DmtcpMessage &msg,
+                        const void *data,
+                        DmtcpMessage *reply,
+                        vector<char> *replyData);
+    void respondToQueryBatch(const DmtcpMessage &msg,
+                             const void *data,
+                             DmtcpMessage *reply,
+                             vector<char> *replyData);
     void getUniqueId(const char *id,    // DB name
                      const void *key,   // Key: can be hostid, pid, etc.
                      size_t key_len,  // Length of the key
@@ -93,11 +137,12 @@ class LookupService
                      uint32_t offset,   // Difference in two unique ids
                      size_t val_len); // Expected value length
 
-    void sendAllMappings(jalib::JSocket &remote,
-                         const DmtcpMessage &msg);
+    void sendAllMappings(const DmtcpMessage &msg,
+                         DmtcpMessage *reply,
+                         vector<char> *replyData);
 
   private:
-    typedef map<KeyValue, KeyValue *>KeyValueMap;
+    typedef unordered_map<KeyValue, KeyValue *, KeyValueHash>KeyValueMap;
     typedef map<string, KeyValueMap>::iterator MapIterator;
     void addKeyValue(string id,
                      const void *key,
@@ -109,6 +154,7 @@ class LookupService
                size_t keyLen,
                void **val,
                size_t *valLen);
+    KeyValue *find(KeyValueMap &kvmap, const void *key, size_t keyLen);
 
   private:
     map<string, KeyValueMap>_maps;
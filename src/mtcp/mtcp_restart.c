@@ -40,6 +40,7 @@
 #define _GNU_SOURCE 1
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/mempolicy.h>
 #include <sched.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -47,6 +48,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/shm.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -126,12 +128,20 @@ typedef struct RestoreInfo {
 #endif
   MYINFO_GS_T myinfo_gs;
   int mtcp_restart_pause;  // Used by env. var. DMTCP_RESTART_PAUSE
+  char chunk_dir[FILENAMESIZE]; // Used for DMTCP_CHUNKED_AREA
 } RestoreInfo;
 static RestoreInfo rinfo;
 
 /* Internal routines */
-static void readmemoryareas(int fd);
-static int read_one_memory_area(int fd);
+static void readmemoryareas(int fd, const char *chunk_dir);
+static int read_one_memory_area(int fd, const char *chunk_dir);
+static void readchunks(int fd, const char *chunk_dir, VA addr, size_t size);
+static void prefetch_hot_pages(Area *area);
+static void *mmap_hugetlb_area(Area *area, int prot);
+static void advise_huge_pages(Area *area);
+static void bind_numa_nodes(Area *area);
+static void restore_numa_policy(Area *area);
+static void restore_sysv_shm_segment(Area *area);
 #if 0
 static void adjust_for_smaller_file_size(Area *area, int fd);
 #endif /* if 0 */
@@ -142,7 +152,8 @@ static void restart_slow_path(void);
 static int doAreasOverlap(VA addr1, size_t size1, VA addr2, size_t size2);
 static int hasOverlappingMapping(VA addr, size_t size);
 static void remapMtcpRestartToReservedArea(RestoreInfo *rinfo);
-static void mtcp_simulateread(int fd, MtcpHeader *mtcpHdr);
+static void mtcp_simulateread(int fd, MtcpHeader *mtcpHdr,
+                              const char *chunk_dir);
 void restore_libc(ThreadTLSInfo *tlsInfo,
                   int tls_pid_offset,
                   int tls_tid_offset,
@@ -244,6 +255,7 @@ main(int argc, char *argv[], char **environ)
   rinfo.fd = -1;
   rinfo.mtcp_restart_pause = 0; /* false */
   rinfo.use_gdb = 0;
+  rinfo.chunk_dir[0] = '\0';
   shift;
   while (argc > 0) {
     if (mtcp_strcmp(argv[0], "--use-gdb") == 0) {
@@ -256,6 +268,13 @@ main(int argc, char *argv[], char **environ)
     } else if (mtcp_strcmp(argv[0], "--stderr-fd") == 0) {
       rinfo.stderr_fd = mtcp_strtol(argv[1]);
       shift; shift;
+    } else if (mtcp_strcmp(argv[0], "--chunk-dir") == 0) {
+      if (mtcp_strlen(argv[1]) >= sizeof(rinfo.chunk_dir)) {
+        MTCP_PRINTF("***ERROR: chunk dir name too long: %s\n", argv[1]);
+        mtcp_abort();
+      }
+      mtcp_strcpy(rinfo.chunk_dir, argv[1]);
+      shift; shift;
     } else if (mtcp_strcmp(argv[0], "--mtcp-restart-pause") == 0) {
       rinfo.mtcp_restart_pause = argv[1][0] - '0'; /* true */
       shift; shift;
@@ -285,6 +304,28 @@ main(int argc, char *argv[], char **environ)
     mtcp_readfile(rinfo.fd, &mtcpHdr, sizeof mtcpHdr);
   } else {
     int rc = -1;
+
+    // Unless given explicitly, the chunk store is next to the ckpt image.
+    if (rinfo.chunk_dir[0] == '\0' &&
+        mtcp_strlen(ckptImage) + sizeof(DMTCP_CHUNK_STORE_DIR) + 2 <
+        sizeof(rinfo.chunk_dir)) {
+      char *slash = NULL;
+      char *s;
+      mtcp_strcpy(rinfo.chunk_dir, ckptImage);
+      for (s = rinfo.chunk_dir; *s != '\0'; s++) {
+        if (*s == '/') {
+          slash = s;
+        }
+      }
+      if (slash != NULL) {
+        slash[1] = '\0';
+      } else {
+        mtcp_strcpy(rinfo.chunk_dir, "./");
+      }
+      mtcp_strncat(rinfo.chunk_dir, DMTCP_CHUNK_STORE_DIR,
+                   sizeof(DMTCP_CHUNK_STORE_DIR));
+    }
+
     rinfo.fd = mtcp_sys_open2(ckptImage, O_RDONLY);
     if (rinfo.fd == -1) {
       MTCP_PRINTF("***ERROR opening ckpt image (%s); errno: %d\n",
@@ -307,7 +348,7 @@ main(int argc, char *argv[], char **environ)
   }
 
   if (simulate) {
-    mtcp_simulateread(rinfo.fd, &mtcpHdr);
+    mtcp_simulateread(rinfo.fd, &mtcpHdr, rinfo.chunk_dir);
     return 0;
   }
 
@@ -539,7 +580,7 @@ restart_slow_path()
 // Used by util/readdmtcp.sh
 // So, we use mtcp_printf to stdout instead of MTCP_PRINTF (diagnosis for DMTCP)
 static void
-mtcp_simulateread(int fd, MtcpHeader *mtcpHdr)
+mtcp_simulateread(int fd, MtcpHeader *mtcpHdr, const char *chunk_dir)
 {
   int mtcp_sys_errno;
 
@@ -566,14 +607,20 @@ mtcp_simulateread(int fd, MtcpHeader *mtcpHdr)
       break;
     }
     if ((area.properties & DMTCP_ZERO_PAGE) == 0 &&
-        (area.properties & DMTCP_SKIP_WRITING_TEXT_SEGMENTS) == 0) {
+        (area.properties & DMTCP_SKIP_WRITING_TEXT_SEGMENTS) == 0 &&
+        (area.properties & DMTCP_FILE_BACKED_PAGES) == 0 &&
+        (area.properties & DMTCP_SYSV_SHM_SEGMENT) == 0) {
       void *addr = mtcp_sys_mmap(0, area.size, PROT_WRITE | PROT_READ,
                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
       if (addr == MAP_FAILED) {
         MTCP_PRINTF("***Error: mmap failed; errno: %d\n", mtcp_sys_errno);
         mtcp_abort();
       }
-      mtcp_readfile(fd, addr, area.size);
+      if (area.properties & DMTCP_CHUNKED_AREA) {
+        readchunks(fd, chunk_dir, addr, area.size);
+      } else {
+        mtcp_readfile(fd, addr, area.size);
+      }
       if (mtcp_sys_munmap(addr, area.size) == -1) {
         MTCP_PRINTF("***Error: munmap failed; errno: %d\n", mtcp_sys_errno);
         mtcp_abort();
@@ -657,7 +704,7 @@ restorememoryareas(RestoreInfo *rinfo_ptr)
 
   /* Restore memory areas */
   DPRINTF("restoring memory areas\n");
-  readmemoryareas(restore_info.fd);
+  readmemoryareas(restore_info.fd, restore_info.chunk_dir);
 
   /* Everything restored, close file and finish up */
 
@@ -921,10 +968,10 @@ unmap_memory_areas_and_restore_vdso(RestoreInfo *rinfo)
  *
  **************************************************************************/
 static void
-readmemoryareas(int fd)
+readmemoryareas(int fd, const char *chunk_dir)
 {
   while (1) {
-    if (read_one_memory_area(fd) == -1) {
+    if (read_one_memory_area(fd, chunk_dir) == -1) {
       break; /* error */
     }
   }
@@ -940,7 +987,7 @@ readmemoryareas(int fd)
 
 NO_OPTIMIZE
 static int
-read_one_memory_area(int fd)
+read_one_memory_area(int fd, const char *chunk_dir)
 {
   int mtcp_sys_errno;
   int imagefd;
@@ -971,19 +1018,44 @@ read_one_memory_area(int fd)
 
   /* Now mmap the data of the area into memory. */
 
+  /* CASE SYSV SHARED MEMORY SEGMENT: no data; the DMTCP_SYSV_SHM_DATA areas
+   * that follow are read into it.
+   */
+  if ((area.properties & DMTCP_SYSV_SHM_SEGMENT) != 0) {
+    restore_sysv_shm_segment(&area);
+  }
+
   /* CASE MAPPED AS ZERO PAGE: */
-  if ((area.properties & DMTCP_ZERO_PAGE) != 0) {
+  else if ((area.properties & DMTCP_ZERO_PAGE) != 0) {
     DPRINTF("restoring non-rwx anonymous area, %p bytes at %p\n",
             area.size, area.addr);
-    mmappedat = mtcp_sys_mmap(area.addr, area.size,
-                              area.prot,
-                              area.flags | MAP_FIXED, -1, 0);
+    if (area.properties & DMTCP_SYSV_SHM_DATA) {
+      /* Already mapped, and a new segment is zero-filled. */
+      mmappedat = area.addr;
+      if (!(area.prot & PROT_WRITE) &&
+          mtcp_sys_mprotect(area.addr, area.size, area.prot) < 0) {
+        MTCP_PRINTF("error %d write-protecting %p bytes at %p\n",
+                    mtcp_sys_errno, area.size, area.addr);
+        mtcp_abort();
+      }
+    } else if ((area.properties & DMTCP_HUGETLB) &&
+               (area.flags & MAP_ANONYMOUS)) {
+      mmappedat = mmap_hugetlb_area(&area, area.prot);
+    } else {
+      mmappedat = mtcp_sys_mmap(area.addr, area.size,
+                                area.prot,
+                                area.flags | MAP_FIXED, -1, 0);
+    }
 
     if (mmappedat != area.addr) {
       DPRINTF("error %d mapping %p bytes at %p\n",
               mtcp_sys_errno, area.size, area.addr);
       mtcp_abort();
     }
+    advise_huge_pages(&area);
+    if (area.properties & DMTCP_NUMA_MAP) {
+      restore_numa_policy(&area);
+    }
   }
 
 #ifdef FAST_RST_VIA_MMAP
@@ -994,7 +1066,10 @@ read_one_memory_area(int fd)
      *   anonymous (~MAP_ANONYMOUS).  It's okay, since the fd
      *   should have been opened with read permission, only.
      */
-    else if (area.flags & MAP_ANONYMOUS) {
+    else if ((area.flags & MAP_ANONYMOUS) &&
+             (area.properties & (DMTCP_CHUNKED_AREA |
+                                 DMTCP_FILE_BACKED_PAGES |
+                                 DMTCP_SYSV_SHM_DATA)) == 0) {
       mmapfile (fd, area.addr, area.size, area.prot,
                 area.flags & ~MAP_ANONYMOUS);
     }
@@ -1032,7 +1107,29 @@ read_one_memory_area(int fd)
       }
     }
 
-    if (area.flags & MAP_ANONYMOUS) {
+    if (area.properties & DMTCP_FILE_BACKED_PAGES) {
+      /* The pages were not saved; they must come from the unchanged file. */
+      if (area.flags & MAP_ANONYMOUS) {
+        MTCP_PRINTF("***ERROR: file %s (needed for %p bytes at %p) is missing"
+                    " or too small\n", area.name, area.size, area.addr);
+        mtcp_abort();
+      }
+#if defined(__x86_64__) || defined(__aarch64__)
+      struct stat st;
+      if (mtcp_sys_fstat(imagefd, &st) == -1 ||
+          (uint64_t)st.st_mtim.tv_sec != area.mtime_sec ||
+          (uint64_t)st.st_mtim.tv_nsec != area.mtime_nsec) {
+        MTCP_PRINTF("***ERROR: file %s was modified after checkpoint\n",
+                    area.name);
+        mtcp_abort();
+      }
+#endif /* if defined(__x86_64__) || defined(__aarch64__) */
+      DPRINTF("restoring clean file-backed area, %p bytes at %p from %s"
+              " + 0x%X\n", area.size, area.addr, area.name, area.offset);
+    } else if (area.properties & DMTCP_SYSV_SHM_DATA) {
+      DPRINTF("restoring SysV shared memory data, %p bytes at %p\n",
+              area.size, area.addr);
+    } else if (area.flags & MAP_ANONYMOUS) {
       DPRINTF("restoring anonymous area, %p  bytes at %p\n",
               area.size, area.addr);
     } else {
@@ -1046,9 +1143,22 @@ read_one_memory_area(int fd)
     /* POSIX says mmap would unmap old memory.  Munmap never fails if args
      * are valid.  Can we unmap vdso and vsyscall in Linux?  Used to use
      * mtcp_safemmap here to check for address conflicts.
+     * Clean file-backed pages are not written to, so keep area.prot for them.
      */
-    mmappedat = mtcp_sys_mmap(area.addr, area.size, area.prot | PROT_WRITE,
-                              area.flags, imagefd, area.offset);
+    int prot = area.prot;
+    if ((area.properties & DMTCP_FILE_BACKED_PAGES) == 0) {
+      prot |= PROT_WRITE;
+    }
+    if (area.properties & DMTCP_SYSV_SHM_DATA) {
+      /* Mapped (writable) by restore_sysv_shm_segment(). */
+      mmappedat = area.addr;
+    } else if ((area.properties & DMTCP_HUGETLB) &&
+               (area.flags & MAP_ANONYMOUS)) {
+      mmappedat = mmap_hugetlb_area(&area, prot);
+    } else {
+      mmappedat = mtcp_sys_mmap(area.addr, area.size, prot,
+                                area.flags, imagefd, area.offset);
+    }
 
     if (mmappedat == MAP_FAILED) {
       DPRINTF("error %d mapping %p bytes at %p\n",
@@ -1067,6 +1177,17 @@ read_one_memory_area(int fd)
       mtcp_abort();
     }
 
+    /* Ask for huge pages before the data is read, so that the page faults
+     * of the read allocate huge pages right away.
+     */
+    if (!try_skipping_existing_segment) {
+      advise_huge_pages(&area);
+    }
+
+    if ((area.properties & DMTCP_NUMA_MAP) && !try_skipping_existing_segment) {
+      bind_numa_nodes(&area);
+    }
+
 #if 0
 
     /*
@@ -1085,16 +1206,30 @@ read_one_memory_area(int fd)
       mtcp_sys_close(imagefd);
     }
 
-    if (try_skipping_existing_segment) {
+    if (area.properties & DMTCP_FILE_BACKED_PAGES) {
+      /* No data for this area in the ckpt image. */
+      if ((area.properties & DMTCP_HOT_MAP) &&
+          !try_skipping_existing_segment) {
+        prefetch_hot_pages(&area);
+      }
+    } else if (try_skipping_existing_segment) {
       // This fails on teracluster.  Presumably extra symbols cause overflow.
-      mtcp_skipfile(fd, area.size);
+      if (area.properties & DMTCP_CHUNKED_AREA) {
+        readchunks(fd, chunk_dir, NULL, area.size);
+      } else {
+        mtcp_skipfile(fd, area.size);
+      }
     } else if ((area.properties & DMTCP_SKIP_WRITING_TEXT_SEGMENTS) == 0) {
       /* This mmapfile after prev. mmap is okay; use same args again.
        *  Posix says prev. map will be munmapped.
        */
 
       /* ANALYZE THE CONDITION FOR DOING mmapfile MORE CAREFULLY. */
-      mtcp_readfile(fd, area.addr, area.size);
+      if (area.properties & DMTCP_CHUNKED_AREA) {
+        readchunks(fd, chunk_dir, area.addr, area.size);
+      } else {
+        mtcp_readfile(fd, area.addr, area.size);
+      }
       if (!(area.prot & PROT_WRITE)) {
         if (mtcp_sys_mprotect(area.addr, area.size, area.prot) < 0) {
           MTCP_PRINTF("error %d write-protecting %p bytes at %p\n",
@@ -1103,6 +1238,10 @@ read_one_memory_area(int fd)
         }
       }
     }
+
+    if ((area.properties & DMTCP_NUMA_MAP) && !try_skipping_existing_segment) {
+      restore_numa_policy(&area);
+    }
   }
   /* CASE NOT MAP_ANONYMOUS:
    * Otherwise, we mmap the original file contents to the area.
@@ -1114,6 +1253,314 @@ read_one_memory_area(int fd)
   return 0;
 }
 
+/* Bind each part of a DMTCP_NUMA_MAP area to the node that held its pages
+ * at checkpoint time, so that the page faults of reading the data allocate
+ * them there.  Runs of parts on the same node take one mbind() call.  This
+ * fails harmlessly if the node does not exist on this host.
+ */
+NO_OPTIMIZE
+static void
+bind_numa_nodes(Area *area)
+{
+#ifdef __NR_mbind
+  int mtcp_sys_errno;
+  VA mapStart = (VA)area->numa_map_start;
+  size_t granule = area->numa_map_granule;
+  VA end = area->addr + area->size;
+  VA start = area->addr;
+
+  if (granule == 0 || start < mapStart) {
+    return;
+  }
+  while (start < end) {
+    size_t i = (start - mapStart) / granule;
+    uint8_t node = DMTCP_NUMA_NO_NODE;
+    VA runEnd = end;
+
+    if (i < DMTCP_NUMA_MAP_BYTES) {
+      node = area->numa_map[i];
+      runEnd = mapStart + (i + 1) * granule;
+      while (++i < DMTCP_NUMA_MAP_BYTES && runEnd < end &&
+             area->numa_map[i] == node) {
+        runEnd += granule;
+      }
+      if (runEnd > end) {
+        runEnd = end;
+      }
+    }
+    if (node != DMTCP_NUMA_NO_NODE) {
+      uint64_t nodemask = 1ULL << node;
+      if (mtcp_sys_mbind(start, runEnd - start, MPOL_PREFERRED,
+                         &nodemask, 65, 0) == -1) {
+        DPRINTF("mbind(node %d) failed for %p bytes at %p; errno: %d\n",
+                node, runEnd - start, start, mtcp_sys_errno);
+      }
+    }
+    start = runEnd;
+  }
+  (void)mtcp_sys_errno; /* Stop compiler warning about unused variable */
+#endif /* ifdef __NR_mbind */
+}
+
+/* Replace the binding of bind_numa_nodes() by the memory policy that the
+ * area had at checkpoint time.  Pages already allocated stay where they are.
+ */
+NO_OPTIMIZE
+static void
+restore_numa_policy(Area *area)
+{
+#ifdef __NR_mbind
+  int mtcp_sys_errno;
+  int rc;
+
+  if (area->numa_policy == DMTCP_NUMA_NO_POLICY) {
+    rc = mtcp_sys_mbind(area->addr, area->size, MPOL_DEFAULT, NULL, 0, 0);
+  } else {
+    uint64_t nodemask = area->numa_nodemask;
+    rc = mtcp_sys_mbind(area->addr, area->size, (int)area->numa_policy,
+                        &nodemask, 65, 0);
+  }
+  if (rc == -1) {
+    DPRINTF("mbind(mode %d) failed for %p bytes at %p; errno: %d\n",
+            (int)area->numa_policy, area->size, area->addr, mtcp_sys_errno);
+  }
+  (void)mtcp_sys_errno; /* Stop compiler warning about unused variable */
+#endif /* ifdef __NR_mbind */
+}
+
+/* Map an anonymous DMTCP_HUGETLB area with hugetlbfs pages of the original
+ * size.  If no such pages are available, map it with normal pages and mark
+ * it DMTCP_HUGE_PAGE_ADVISED, so that it gets transparent huge pages instead.
+ */
+NO_OPTIMIZE
+static void *
+mmap_hugetlb_area(Area *area, int prot)
+{
+  int mtcp_sys_errno;
+  void *addr;
+
+#ifdef MAP_HUGETLB
+  int flags = area->flags | MAP_HUGETLB;
+# ifdef MAP_HUGE_SHIFT
+  int pageShift = 0;
+  while (pageShift < 63 && (1ULL << pageShift) < area->huge_page_size) {
+    pageShift++;
+  }
+  flags |= pageShift << MAP_HUGE_SHIFT;
+# endif /* ifdef MAP_HUGE_SHIFT */
+
+  addr = mtcp_sys_mmap(area->addr, area->size, prot, flags, -1, 0);
+  if (addr != MAP_FAILED) {
+    DPRINTF("restored %p bytes at %p with %p-byte huge pages\n",
+            area->size, area->addr, area->huge_page_size);
+    return addr;
+  }
+  DPRINTF("mmap(MAP_HUGETLB) failed for %p bytes at %p; errno: %d\n",
+          area->size, area->addr, mtcp_sys_errno);
+#endif /* ifdef MAP_HUGETLB */
+  (void)mtcp_sys_errno; /* Stop compiler warning about unused variable */
+
+  area->properties |= DMTCP_HUGE_PAGE_ADVISED;
+  addr = mtcp_sys_mmap(area->addr, area->size, prot, area->flags, -1,
+                       area->offset);
+  return addr;
+}
+
+/* Restore the MADV_HUGEPAGE advice of a DMTCP_HUGE_PAGE_ADVISED area. */
+NO_OPTIMIZE
+static void
+advise_huge_pages(Area *area)
+{
+#ifdef MADV_HUGEPAGE
+  int mtcp_sys_errno;
+
+  if ((area->properties & DMTCP_HUGE_PAGE_ADVISED) &&
+      mtcp_sys_madvise(area->addr, area->size, MADV_HUGEPAGE) == -1) {
+    DPRINTF("madvise(HUGEPAGE) failed for %p bytes at %p; errno: %d\n",
+            area->size, area->addr, mtcp_sys_errno);
+  }
+  (void)mtcp_sys_errno; /* Stop compiler warning about unused variable */
+#endif /* ifdef MADV_HUGEPAGE */
+}
+
+/* For a DMTCP_CHUNKED_AREA, the ckpt image holds a list of ChunkRefs instead
+ * of the data (see chunkstore.cpp).  Read the list from fd and the data of
+ * each chunk from the chunk store into addr.  If addr is NULL, the area is
+ * being skipped and only the list is consumed.
+ */
+NO_OPTIMIZE
+static void
+readchunks(int fd, const char *chunk_dir, VA addr, size_t size)
+{
+  int mtcp_sys_errno;
+  char path[FILENAMESIZE + 64];
+  size_t dirlen = mtcp_strlen(chunk_dir);
+  size_t offset = 0;
+  ChunkRef ref;
+  int i;
+
+  if (addr != NULL && dirlen == 0) {
+    MTCP_PRINTF("***ERROR: ckpt image uses a chunk store, but no chunk dir"
+                " is known\n");
+    mtcp_abort();
+  }
+
+  while (offset < size) {
+    if (mtcp_readfile(fd, &ref, sizeof(ref)) != (int)sizeof(ref) ||
+        ref.size == 0 || ref.size > size - offset) {
+      MTCP_PRINTF("***ERROR: invalid chunk list in ckpt image\n");
+      mtcp_abort();
+    }
+
+    if (addr != NULL) {
+      /* <chunk_dir>/<first 2 hex digits>/<32 hex digits> */
+      char *p = path;
+      mtcp_memcpy(p, chunk_dir, dirlen);
+      p += dirlen;
+      *p++ = '/';
+      for (i = 0; i < 32; i++) {
+        int nibble = (ref.hash[i / 16] >> (60 - 4 * (i % 16))) & 0xf;
+        p[i + 3] = nibble < 10 ? '0' + nibble : 'a' + nibble - 10;
+      }
+      p[0] = p[3];
+      p[1] = p[4];
+      p[2] = '/';
+      p[35] = '\0';
+
+      int chunkfd = mtcp_sys_open2(path, O_RDONLY);
+      if (chunkfd == -1) {
+        MTCP_PRINTF("***ERROR opening chunk (%s); errno: %d\n",
+                    path, mtcp_sys_errno);
+        mtcp_abort();
+      }
+      if (mtcp_readfile(chunkfd, addr + offset, ref.size) != (int)ref.size) {
+        MTCP_PRINTF("***ERROR: chunk (%s) is truncated\n", path);
+        mtcp_abort();
+      }
+      mtcp_sys_close(chunkfd);
+    }
+    offset += ref.size;
+  }
+}
+
+/* Create a SysV shared memory segment for a DMTCP_SYSV_SHM_SEGMENT area and
+ * attach it at the original address, so that its contents can be read
+ * directly into it.  The segment gets the original mode (plus owner access,
+ * to read the data in) and, if it had them, huge pages.  A read-only
+ * attachment is made writable here; the svipc plugin finds the segment
+ * through /proc/self/maps in its postRestart, takes it over, and attaches it
+ * read-only again.  The key is provisional.  If the segment can't be
+ * created, fall back to a private anonymous mapping, which the plugin copies
+ * into a new segment.
+ */
+NO_OPTIMIZE
+static void
+restore_sysv_shm_segment(Area *area)
+{
+  int mtcp_sys_errno;
+  void *addr;
+
+#ifdef __NR_shmget
+  key_t key = mtcp_sys_getpid();
+  int shmflg = IPC_CREAT | IPC_EXCL | (area->shm_mode & 0777) | 0600;
+  int shmid = -1;
+  int i;
+
+# ifdef SHM_HUGETLB
+  if (area->properties & DMTCP_HUGETLB) {
+    int pageShift = 0;
+    while (pageShift < 63 && (1ULL << pageShift) < area->huge_page_size) {
+      pageShift++;
+    }
+    shmflg |= SHM_HUGETLB;
+#  ifdef SHM_HUGE_SHIFT
+    shmflg |= pageShift << SHM_HUGE_SHIFT;
+#  endif /* ifdef SHM_HUGE_SHIFT */
+  }
+# endif /* ifdef SHM_HUGETLB */
+
+  for (i = 0; i < 64 && shmid == -1; i++, key++) {
+    shmid = mtcp_sys_shmget(key, area->size, shmflg);
+    if (shmid == -1 && mtcp_sys_errno != EEXIST) {
+# ifdef SHM_HUGETLB
+      if (shmflg & SHM_HUGETLB) {
+        /* No huge pages available; use normal pages. */
+        DPRINTF("error %d creating SysV shared memory segment with huge"
+                " pages; using normal pages\n", mtcp_sys_errno);
+        shmflg = IPC_CREAT | IPC_EXCL | (area->shm_mode & 0777) | 0600;
+        continue;
+      }
+# endif /* ifdef SHM_HUGETLB */
+      break;
+    }
+  }
+  if (shmid != -1) {
+    addr = mtcp_sys_shmat(shmid, area->addr, area->shm_flags & ~SHM_RDONLY);
+    if (addr == area->addr) {
+      DPRINTF("restoring SysV shared memory segment %d, %p bytes at %p\n",
+              shmid, area->size, area->addr);
+      return;
+    }
+    DPRINTF("error %d attaching SysV shared memory segment at %p\n",
+            mtcp_sys_errno, area->addr);
+    mtcp_sys_shmctl(shmid, IPC_RMID, NULL);
+  } else {
+    DPRINTF("error %d creating SysV shared memory segment of %p bytes\n",
+            mtcp_sys_errno, area->size);
+  }
+#endif /* ifdef __NR_shmget */
+
+  addr = mtcp_sys_mmap(area->addr, area->size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+  if (addr != area->addr) {
+    MTCP_PRINTF("error %d mapping %p bytes at %p\n",
+                mtcp_sys_errno, area->size, area->addr);
+    mtcp_abort();
+  }
+}
+
+/* Start reading the parts of a file-backed area that were in use at
+ * checkpoint time.  This is asynchronous; mtcp_restart goes on with the next
+ * area while the kernel reads these pages into the page cache.  The other
+ * pages of the area are read when first accessed.
+ */
+NO_OPTIMIZE
+static void
+prefetch_hot_pages(Area *area)
+{
+  int mtcp_sys_errno;
+  size_t numBits = DMTCP_HOT_MAP_BYTES * 8;
+  size_t start = 0;
+  size_t i;
+
+  if (area->hot_map_granule == 0) {
+    return;
+  }
+
+  for (i = 0; i <= numBits; i++) {
+    int hot = i < numBits && (area->hot_map[i / 8] & (1 << (i % 8)));
+    if (hot) {
+      continue;
+    }
+    if (i > start) {
+      size_t offset = start * area->hot_map_granule;
+      size_t len = (i - start) * area->hot_map_granule;
+      if (offset >= area->size) {
+        break;
+      }
+      if (len > area->size - offset) {
+        len = area->size - offset;
+      }
+      if (mtcp_sys_madvise(area->addr + offset, len, MADV_WILLNEED) == -1) {
+        DPRINTF("madvise(WILLNEED) failed for %p bytes at %p; errno: %d\n",
+                len, area->addr + offset, mtcp_sys_errno);
+      }
+    }
+    start = i + 1;
+  }
+  (void)mtcp_sys_errno; /* Stop compiler warning about unused variable */
+}
+
 #if 0
 
 // See note above.
@@ -340,6 +340,17 @@ struct linux_dirent {
   mtcp_inline_syscall(set_tid_address, 1, args)
 
 // #define mtcp_sys_stat(args...) mtcp_inline_syscall(stat, 2, args)
+# define mtcp_sys_fstat(args ...)   mtcp_inline_syscall(fstat, 2, args)
+# define mtcp_sys_madvise(args ...) mtcp_inline_syscall(madvise, 3, args)
+# ifdef __NR_mbind
+#  define mtcp_sys_mbind(args ...) mtcp_inline_syscall(mbind, 6, args)
+# endif // ifdef __NR_mbind
+# ifdef __NR_shmget
+#  define mtcp_sys_shmget(args ...) mtcp_inline_syscall(shmget, 3, args)
+#  define mtcp_sys_shmat(args ...) \
+  (void *)mtcp_inline_syscall(shmat, 3, args)
+#  define mtcp_sys_shmctl(args ...) mtcp_inline_syscall(shmctl, 3, args)
+# endif // ifdef __NR_shmget
 # define mtcp_sys_getuid(args ...)  mtcp_inline_syscall(getuid, 0)
 # define mtcp_sys_geteuid(args ...) mtcp_inline_syscall(geteuid, 0)
 
@@ -0,0 +1,82 @@
+/****************************************************************************
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#ifndef NODEPROXY_H
+#define NODEPROXY_H
+
+#include <stdint.h>
+
+/*
+ * Wire format between dmtcp_nodeproxy and dmtcp_coordinator.
+ *
+ * The proxy opens one TCP connection to the coordinator and sends a plain
+ * DMT_PROXY_HELLO message; the coordinator answers with DMT_ACCEPT.  From
+ * then on, every byte in either direction is part of a frame:
+ *
+ *   NodeProxyFrame header; char payload[header.len];
+ *
+ * Each local connection to the proxy (worker, name-service connection,
+ * dmtcp_command, ...) is given its own channel number, starting at 1 and
+ * assigned in the order in which the channels first send data.  The
+ * payload of a channel frame is a slice of the byte stream that the local
+ * process would otherwise have exchanged with the coordinator directly; a
+ * frame with len == 0 means the channel was closed by the sender.
+ *
+ * Channel 0 carries whole DmtcpMessages between the proxy and coordinator:
+ *
+ *   DMT_PROXY_BARRIER (proxy -> coordinator): every worker behind the proxy
+ *     has reached msg.barrier.  msg.numPeers NodeProxyArrival records follow.
+ *
+ *   DMT_PROXY_BROADCAST (coordinator -> proxy): deliver one message to
+ *     several channels.  The extra data is msg.numPeers uint32_t channel
+ *     numbers, followed by the DmtcpMessage to deliver and its extra data.
+ *
+ *   DMT_PROXY_CKPT_FILENAMES (proxy -> coordinator): the DMT_CKPT_FILENAME
+ *     and DMT_UNIQUE_CKPT_FILENAME messages of the local workers.  The extra
+ *     data is msg.numPeers NodeProxyCkptFilename records, each followed by
+ *     len bytes of the original message's extra data.
+ */
+
+#define NODEPROXY_CONTROL_CHANNEL 0
+
+// Neither end sends, or accepts, a frame with a larger payload.
+#define NODEPROXY_MAX_FRAME_SIZE  (64 * 1024 * 1024)
+
+// Bytes that one channel may have buffered on its way to a slow reader
+// before the sender stops reading more for it.
+#define NODEPROXY_MAX_PENDING     (4 * 1024 * 1024)
+
+namespace dmtcp
+{
+struct NodeProxyFrame {
+  uint32_t channel;
+  uint32_t len;
+};
+
+struct NodeProxyArrival {
+  uint32_t channel;
+  int32_t state;
+};
+
+struct NodeProxyCkptFilename {
+  uint32_t channel;
+  uint32_t type;
+  uint32_t len;
+};
+}
+#endif // ifndef NODEPROXY_H
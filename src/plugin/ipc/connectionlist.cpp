@@ -23,6 +23,8 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <signal.h>
+#include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -81,11 +83,22 @@
 
 using namespace dmtcp;
 
+// Upper bound for the initial size of the fd table; larger fds grow it.
+#define MAX_INITIAL_FD_TABLE_SIZE 1024
+#define MIN_FD_TABLE_SIZE         64
+
 // This is the first program after dmtcp_launch
 static bool freshProcess = true;
 
 ConnectionList::~ConnectionList()
-{}
+{
+  if (_fdTable != NULL) {
+    JALLOC_HELPER_FREE(_fdTable);
+  }
+  for (size_t i = 0; i < _retiredFdTables.size(); i++) {
+    JALLOC_HELPER_FREE(_retiredFdTables[i]);
+  }
+}
 
 void
 ConnectionList::eventHook(DmtcpEvent_t event, DmtcpEventData_t *data)
@@ -148,9 +161,11 @@ ConnectionList::deleteStaleConnections()
 {
   // build list of stale connections
   vector<int>staleFds;
-  for (FdToConMapT::iterator i = _fdToCon.begin(); i != _fdToCon.end(); ++i) {
-    if (_isBadFd(i->first)) {
-      staleFds.push_back(i->first);
+  if (_fdTable != NULL) {
+    for (size_t fd = 0; fd < _fdTable->size; fd++) {
+      if (_fdTable->slots[fd] != NULL && _isBadFd(fd)) {
+        staleFds.push_back(fd);
+      }
     }
   }
 
@@ -216,7 +231,7 @@ ConnectionList::serialize(jalib::JBinarySerializer &o)
       _connections[key] = con;
       const vector<int32_t> &fds = con->getFds();
       for (size_t i = 0; i < fds.size(); i++) {
-        _fdToCon[fds[i]] = con;
+        setFdConnection(fds[i], con);
       }
       JSERIALIZE_ASSERT_POINT("[EndConnection]");
     }
@@ -248,19 +263,62 @@ ConnectionList::list()
 Connection *
 ConnectionList::getConnection(const ConnectionIdentifier &id)
 {
-  if (_connections.find(id) == _connections.end()) {
-    return NULL;
-  }
-  return _connections[id];
+  iterator i = _connections.find(id);
+
+  return i == _connections.end() ? NULL : i->second;
 }
 
+// Lock-free: this is on the path of every wrapper that takes an fd.
 Connection *
 ConnectionList::getConnection(int fd)
 {
-  if (_fdToCon.find(fd) == _fdToCon.end()) {
+  FdTable *table = __atomic_load_n(&_fdTable, __ATOMIC_ACQUIRE);
+
+  if (table == NULL || fd < 0 || (size_t)fd >= table->size) {
     return NULL;
   }
-  return _fdToCon[fd];
+  return __atomic_load_n(&table->slots[fd], __ATOMIC_ACQUIRE);
+}
+
+// Must be called with _lock held.
+void
+ConnectionList::setFdConnection(int fd, Connection *c)
+{
+  JASSERT(fd >= 0) (fd);
+
+  FdTable *table = _fdTable;
+  if (table == NULL || (size_t)fd >= table->size) {
+    size_t size;
+    if (table != NULL) {
+      size = table->size;
+    } else {
+      struct rlimit rlim;
+      size = MAX_INITIAL_FD_TABLE_SIZE;
+      if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 && rlim.rlim_cur < size) {
+        size = rlim.rlim_cur;
+      }
+      if (size < MIN_FD_TABLE_SIZE) {
+        size = MIN_FD_TABLE_SIZE;
+      }
+    }
+    while (size <= (size_t)fd) {
+      size *= 2;
+    }
+
+    FdTable *newTable = (FdTable *)
+      JALLOC_HELPER_MALLOC(sizeof(FdTable) + size * sizeof(Connection *));
+    newTable->size = size;
+    newTable->slots = (Connection **)(newTable + 1);
+    memset(newTable->slots, 0, size * sizeof(Connection *));
+    if (table != NULL) {
+      memcpy(newTable->slots, table->slots,
+             table->size * sizeof(Connection *));
+      _retiredFdTables.push_back(table);
+    }
+    __atomic_store_n(&_fdTable, newTable, __ATOMIC_RELEASE);
+    table = newTable;
+  }
+  __atomic_store_n(&table->slots[fd], c, __ATOMIC_RELEASE);
 }
 
 void
@@ -268,7 +326,8 @@ ConnectionList::add(int fd, Connection *c)
 {
   _lock_tbl();
 
-  if (_fdToCon.find(fd) != _fdToCon.end()) {
+  Connection *con = getConnection(fd);
+  if (con != NULL) {
     /* In ordinary situations, we never exercise this path since we already
      * capture close() and remove the connection. However, there is one
      * particular case where this assumption fails -- when glibc opens a socket
@@ -276,7 +335,6 @@ ConnectionList::add(int fd, Connection *c)
      * bypassing our close wrapper. This behavior is observed when dealing with
      * getaddrinfo().
      */
-    Connection *con = _fdToCon[fd];
     /*
      * The incoming Connection object pointer, c, and the one
      * present in our existing lists (local variable, con)
@@ -296,21 +354,19 @@ ConnectionList::add(int fd, Connection *c)
     processCloseWork(fd);
   }
 
-  if (_connections.find(c->id()) == _connections.end()) {
-    _connections[c->id()] = c;
-  }
+  _connections.insert(std::make_pair(c->id(), c));
   c->addFd(fd);
-  _fdToCon[fd] = c;
+  setFdConnection(fd, c);
   _unlock_tbl();
 }
 
 void
 ConnectionList::processCloseWork(int fd)
 {
-  JASSERT(_fdToCon.find(fd) != _fdToCon.end());
-  Connection *con = _fdToCon[fd];
+  Connection *con = getConnection(fd);
+  JASSERT(con != NULL) (fd);
 
-  _fdToCon.erase(fd);
+  setFdConnection(fd, NULL);
   con->removeFd(fd);
   if (con->numFds() == 0) {
     _connections.erase(con->id());
@@ -321,8 +377,14 @@ ConnectionList::processCloseWork(int fd)
 void
 ConnectionList::processClose(int fd)
 {
+  // Every close() is reported to every connection list, and most fds belong
+  // to at most one of them; skip the lock for the others.
+  if (getConnection(fd) == NULL) {
+    return;
+  }
+
   _lock_tbl();
-  if (_fdToCon.find(fd) != _fdToCon.end()) {
+  if (getConnection(fd) != NULL) {
     processCloseWork(fd);
   }
   _unlock_tbl();
@@ -335,13 +397,15 @@ ConnectionList::processDup(int oldfd, int newfd)
     return;
   }
 
+  // As in processClose(), nothing to do for fds of other connection lists.
+  if (getConnection(oldfd) == NULL && getConnection(newfd) == NULL) {
+    return;
+  }
+
   _lock_tbl();
-  if (_fdToCon.find(newfd) != _fdToCon.end()) {
-    Connection *newFdCon = _fdToCon[newfd];
-    Connection *oldFdCon = NULL;
-    if (_fdToCon.find(oldfd) != _fdToCon.end()) {
-      oldFdCon = _fdToCon[oldfd];
-    }
+  Connection *newFdCon = getConnection(newfd);
+  if (newFdCon != NULL) {
+    Connection *oldFdCon = getConnection(oldfd);
     /*
      * The Connection object pointer corresponding to oldfd,
      * oldFdCon, and the one corresponding to the newfd, newFdCon,
@@ -361,10 +425,10 @@ ConnectionList::processDup(int oldfd, int newfd)
     processCloseWork(newfd);
   }
 
-  // Add only if the oldfd was already in the _fdToCon table.
-  if (_fdToCon.find(oldfd) != _fdToCon.end()) {
-    Connection *con = _fdToCon[oldfd];
-    _fdToCon[newfd] = con;
+  // Add only if the oldfd was already in the fd table.
+  Connection *con = getConnection(oldfd);
+  if (con != NULL) {
+    setFdConnection(newfd, con);
     con->addFd(newfd);
   }
   _unlock_tbl();
@@ -538,59 +602,101 @@ ConnectionList::registerIncomingCons()
   }
 }
 
+// Missing fds owned by this process for one receiver: a single message.
+struct FdBatch {
+  struct sockaddr_un addr;
+  socklen_t len;
+  vector<int32_t>fds;
+  string ids;   // The fds' ConnectionIdentifiers, back to back.
+};
+
 void
 ConnectionList::sendReceiveMissingFds()
 {
-  size_t i;
-
-  vector<int>outgoingCons;
   SharedData::IncomingConMap *maps;
   uint32_t nmaps;
   SharedData::getMissingConMaps(&maps, &nmaps);
-  for (i = 0; i < nmaps; i++) {
+
+  // Group the fds that we send by receiver, UTIL_IPC_MAX_FDS per message.
+  vector<FdBatch>batches;
+  map<string, size_t>receivers;   // Receiver address -> its latest batch.
+  for (uint32_t i = 0; i < nmaps; i++) {
     ConnectionIdentifier *id = (ConnectionIdentifier *)maps[i].id;
     Connection *con = getConnection(*id);
-    if (con != NULL && con->hasLock()) {
-      outgoingCons.push_back(i);
+    if (con == NULL || !con->hasLock()) {
+      continue;
+    }
+
+    string addr((const char *)&maps[i].addr, maps[i].len);
+    map<string, size_t>::iterator it = receivers.find(addr);
+    size_t b;
+    if (it != receivers.end() &&
+        batches[it->second].fds.size() < UTIL_IPC_MAX_FDS) {
+      b = it->second;
+    } else {
+      b = batches.size();
+      batches.push_back(FdBatch());
+      memcpy(&batches[b].addr, &maps[i].addr, sizeof(maps[i].addr));
+      batches[b].len = maps[i].len;
+      receivers[addr] = b;
     }
+
+    FdBatch &batch = batches[b];
+    batch.fds.push_back(con->getFds()[0]);
+    batch.ids.append((const char *)id, sizeof(*id));
   }
 
   int restoreFd = protectedFd();
-  size_t numOutgoingCons = outgoingCons.size();
-  while (numOutgoingCons > 0 || numIncomingCons > 0) {
+  size_t nextBatch = 0;
+  bool sendBlocked = false;
+  while (nextBatch < batches.size() || numIncomingCons > 0) {
     struct pollfd socketFd = { 0 };
-    if (outgoingCons.size() > 0) {
-      socketFd.fd = restoreFd;
+    socketFd.fd = restoreFd;
+    if (nextBatch < batches.size()) {
       socketFd.events = POLLOUT;
     }
     if (numIncomingCons > 0) {
-      socketFd.fd = restoreFd;
       socketFd.events |= POLLIN;
     }
 
-    int ret = _real_poll(&socketFd, 1, -1);
+    // A receiver whose queue is full shows up as EAGAIN from sendmsg(), not
+    // as a missing POLLOUT.  Keep receiving and retry the send shortly.
+    int ret = _real_poll(&socketFd, 1, sendBlocked ? 10 : -1);
     JASSERT(ret != -1) (JASSERT_ERRNO);
 
-    if (numOutgoingCons > 0 && (socketFd.revents & POLLOUT)) {
-      size_t idx = outgoingCons.back();
-      outgoingCons.pop_back();
-      ConnectionIdentifier *id = (ConnectionIdentifier *)maps[idx].id;
-      Connection *con = getConnection(*id);
-      JTRACE("Sending Missing Con") (*id);
-      JASSERT(Util::sendFd(restoreFd, con->getFds()[0], id, sizeof(*id),
-                           maps[idx].addr, maps[idx].len) != -1);
-      numOutgoingCons--;
+    if (nextBatch < batches.size() &&
+        (sendBlocked || (socketFd.revents & POLLOUT))) {
+      FdBatch &batch = batches[nextBatch];
+      JTRACE("Sending Missing Cons") (batch.fds.size());
+      ret = Util::sendFds(restoreFd, &batch.fds[0], batch.fds.size(),
+                          &batch.ids[0], batch.ids.length(),
+                          batch.addr, batch.len, MSG_DONTWAIT);
+      sendBlocked = (ret == -1 && (errno == EAGAIN || errno == EWOULDBLOCK));
+      if (!sendBlocked) {
+        JASSERT(ret != -1) (JASSERT_ERRNO);
+        nextBatch++;
+      }
     }
 
     if (numIncomingCons > 0 && (socketFd.revents & POLLIN)) {
-      ConnectionIdentifier id;
-      int fd = Util::receiveFd(restoreFd, &id, sizeof(id));
-      JASSERT(fd != -1);
-      Connection *con = getConnection(id);
-      JTRACE("Received Missing Con") (id);
-      JASSERT(con != NULL);
-      con->restoreDupFds(fd);
-      numIncomingCons--;
+      char ids[UTIL_IPC_MAX_FDS * sizeof(ConnectionIdentifier)];
+      int32_t fds[UTIL_IPC_MAX_FDS];
+      size_t len = 0;
+      int n = Util::receiveFds(restoreFd, fds, UTIL_IPC_MAX_FDS,
+                               ids, sizeof(ids), &len);
+      JASSERT(n > 0) (JASSERT_ERRNO);
+      JASSERT(len == n * sizeof(ConnectionIdentifier) &&
+              (size_t)n <= numIncomingCons) (len) (n) (numIncomingCons);
+
+      for (int i = 0; i < n; i++) {
+        ConnectionIdentifier id;
+        memcpy(&id, ids + i * sizeof(id), sizeof(id));
+        Connection *con = getConnection(id);
+        JTRACE("Received Missing Con") (id);
+        JASSERT(con != NULL);
+        con->restoreDupFds(fds[i]);
+      }
+      numIncomingCons -= n;
     }
   }
   dmtcp_close_protected_fd(restoreFd);
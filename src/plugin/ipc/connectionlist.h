@@ -44,6 +44,7 @@ class ConnectionList
     typedef map<ConnectionIdentifier, Connection *>::iterator iterator;
 
     ConnectionList()
+      : _fdTable(NULL)
     {
       numIncomingCons = 0;
       DmtcpMutexInit(&_lock, DMTCP_MUTEX_NORMAL);
@@ -96,7 +97,16 @@ class ConnectionList
     iterator end() { return _connections.end(); }
 
   private:
+    // Connections indexed by fd.  The table is replaced by a larger copy
+    // when an fd does not fit; the old one is kept around for lookups that
+    // may still be reading it.
+    struct FdTable {
+      size_t size;
+      Connection **slots;
+    };
+
     void processCloseWork(int fd);
+    void setFdConnection(int fd, Connection *c);
     void _lock_tbl()
     {
       JASSERT(DmtcpMutexLock(&_lock) == 0);
@@ -111,8 +121,9 @@ class ConnectionList
     typedef map<ConnectionIdentifier, Connection *>ConnectionMapT;
     ConnectionMapT _connections;
 
-    typedef map<int, Connection *>FdToConMapT;
-    FdToConMapT _fdToCon;
+    // Written under _lock; read without it.
+    FdTable *_fdTable;
+    vector<FdTable *>_retiredFdTables;
 
     size_t numIncomingCons;
 };
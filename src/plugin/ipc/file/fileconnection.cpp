@@ -25,6 +25,8 @@
 #include <sys/file.h>
 #include <sys/ioctl.h>
 #include <sys/select.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
 #include <sys/un.h>
 #include <termios.h>
 #include <time.h>
@@ -45,11 +47,52 @@
 #include "fileconnlist.h"
 #include "filewrappers.h"
 
+// From <linux/fs.h>; not included to avoid clashes with <sys/mount.h>.
+#ifndef FICLONE
+# define FICLONE _IOW(0x94, 9, int)
+#endif // ifndef FICLONE
+
+// A ckpt copy is only reused if the file was last changed at least this long
+// before the copy was made.  Timestamps have a granularity of a timer tick on
+// many filesystems, so a write right after the copy may not change them.
+#define MIN_CTIME_AGE_FOR_REUSE 1
+
+// The backing files of shared mappings (FILE_SHM) are saved incrementally:
+// only extents whose hash changed since the last checkpoint are written.
+#define SHM_FILE_EXTENT_SIZE       (1024 * 1024)
+
+// Backing files at least this large are saved by several threads.
+#define SHM_FILE_PARALLEL_MIN_SIZE (64 * 1024 * 1024)
+#define SHM_FILE_MAX_THREADS       8
+
 using namespace dmtcp;
 
 static void writeFileFromFd(int fd, int destFd);
 static bool areFilesEqual(int fd, int destFd, size_t size);
 
+/* What we know about the ckpt copy of a FILE_SHM backing file from the last
+ * checkpoint.  FILE_SHM connections are recreated at every checkpoint (see
+ * FileConnList::prepareShmList()), so this is kept per file.
+ */
+typedef struct {
+  string path;
+  struct stat copyStat;
+  vector<uint64_t> extentHashes;
+} ShmFileCopy;
+
+typedef std::pair<uint64_t, uint64_t> FileId;  // st_dev, st_ino
+static map<FileId, ShmFileCopy> shmFileCopies;
+
+typedef struct {
+  int srcFd;
+  int destFd;
+  size_t numExtents;
+  size_t nextExtent;
+  const vector<uint64_t> *oldHashes;
+  vector<uint64_t> *newHashes;
+  uint64_t bytesWritten;
+} ShmFileSaveState;
+
 static bool
 _isVimApp()
 {
@@ -217,27 +260,47 @@ FileConnection::preCkpt()
     JASSERT(SharedData::getCkptLeaderForFile(_st_dev, _st_ino, &id));
     if (id == _id) {
       _savedFilePath = getSavedFilePath(_path);
-      JASSERT(FileConnList::createDirectoryTree(_savedFilePath))
-        (_savedFilePath)
-        .Text("Unable to create directory in File Path");
-
-      int destFd = _real_open(
-          _savedFilePath.c_str(), O_CREAT | O_WRONLY | O_TRUNC,
-          S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-      JASSERT(destFd != -1) (JASSERT_ERRNO) (_path) (_savedFilePath);
 
-      JTRACE("Saving checkpointed copy of the file") (_path) (_savedFilePath);
+      int srcFd = _fds[0];
       if (_fcntlFlags & O_WRONLY) {
         // If the file is opened() in write-only mode. Open it in readonly mode
         // to create the ckpt copy.
-        int tmpfd = _real_open(_path.c_str(), O_RDONLY, 0);
-        JASSERT(tmpfd != -1);
-        writeFileFromFd(tmpfd, destFd);
-        _real_close(tmpfd);
+        srcFd = _real_open(_path.c_str(), O_RDONLY, 0);
+        JASSERT(srcFd != -1);
+      }
+
+      // Synchronize memory buffer with data in filesystem
+      // On some Linux kernels, the shared-memory test will fail without this.
+      // This also makes later writes through a shared mapping update mtime.
+      fsync(srcFd);
+
+      struct stat srcStat;
+      JASSERT(fstat(srcFd, &srcStat) == 0) (_path) (JASSERT_ERRNO);
+      if (_type == FILE_SHM && S_ISREG(srcStat.st_mode)) {
+        saveShmFile(srcFd, srcStat);
+      } else if (isSavedCopyCurrent(srcStat)) {
+        JTRACE("File unchanged since last checkpoint; reusing copy")
+          (_path) (_savedFilePath);
       } else {
-        writeFileFromFd(_fds[0], destFd);
+        JASSERT(FileConnList::createDirectoryTree(_savedFilePath))
+          (_savedFilePath)
+          .Text("Unable to create directory in File Path");
+
+        int destFd = _real_open(
+            _savedFilePath.c_str(), O_CREAT | O_WRONLY | O_TRUNC,
+            S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+        JASSERT(destFd != -1) (JASSERT_ERRNO) (_path) (_savedFilePath);
+
+        JTRACE("Saving checkpointed copy of the file")
+          (_path) (_savedFilePath);
+        writeFileFromFd(srcFd, destFd);
+        recordSavedCopy(srcStat, destFd);
+        _real_close(destFd);
+      }
+
+      if (srcFd != _fds[0]) {
+        _real_close(srcFd);
       }
-      _real_close(destFd);
     } else {
       JTRACE("Not checkpointing this file") (_path);
       _ckpted_file = false;
@@ -256,6 +319,243 @@ FileConnection::preCkpt()
   }
 }
 
+/* Returns true if the ckpt copy written at an earlier checkpoint is still a
+ * copy of the file: same file, size and ctime (which, unlike mtime, can't be
+ * set back by the user), and the copy itself hasn't been touched since.
+ */
+bool
+FileConnection::isSavedCopyCurrent(const struct stat &srcStat)
+{
+  if (_lastSavedFilePath.empty() || _lastSavedFilePath != _savedFilePath) {
+    return false;
+  }
+
+  const struct stat &last = _lastSavedSrcStat;
+  if (srcStat.st_dev != last.st_dev || srcStat.st_ino != last.st_ino ||
+      srcStat.st_size != last.st_size ||
+      srcStat.st_mtim.tv_sec != last.st_mtim.tv_sec ||
+      srcStat.st_mtim.tv_nsec != last.st_mtim.tv_nsec ||
+      srcStat.st_ctim.tv_sec != last.st_ctim.tv_sec ||
+      srcStat.st_ctim.tv_nsec != last.st_ctim.tv_nsec) {
+    return false;
+  }
+
+  struct stat copyStat;
+  if (stat(_savedFilePath.c_str(), &copyStat) != 0) {
+    return false;
+  }
+  const struct stat &lastCopy = _lastSavedCopyStat;
+  return copyStat.st_ino == lastCopy.st_ino &&
+         copyStat.st_size == lastCopy.st_size &&
+         copyStat.st_mtim.tv_sec == lastCopy.st_mtim.tv_sec &&
+         copyStat.st_mtim.tv_nsec == lastCopy.st_mtim.tv_nsec;
+}
+
+void
+FileConnection::recordSavedCopy(const struct stat &srcStat, int destFd)
+{
+  struct timespec now;
+
+  _lastSavedFilePath.clear();
+  if (clock_gettime(CLOCK_REALTIME, &now) != 0 ||
+      srcStat.st_ctim.tv_sec + MIN_CTIME_AGE_FOR_REUSE > now.tv_sec ||
+      fstat(destFd, &_lastSavedCopyStat) != 0) {
+    return;
+  }
+  _lastSavedSrcStat = srcStat;
+  _lastSavedFilePath = _savedFilePath;
+}
+
+static uint64_t
+hashExtent(const char *buf, size_t len)
+{
+  const uint64_t c1 = 0x87c37b91114253d5ULL;
+  const uint64_t c2 = 0x4cf5ad432745937fULL;
+  uint64_t h = len;
+  size_t i;
+
+  for (i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t w;
+    memcpy(&w, buf + i, sizeof(w));
+    h ^= w * c1;
+    h = ((h << 31) | (h >> 33)) * c2;
+  }
+  if (i < len) {
+    uint64_t w = 0;
+    memcpy(&w, buf + i, len - i);
+    h ^= w * c1;
+    h = ((h << 31) | (h >> 33)) * c2;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/* Returns true if the len bytes of buf are already in fd at offset. */
+static bool
+isExtentSaved(int fd, off_t offset, const char *buf, ssize_t len, char *tmp)
+{
+  ssize_t done = 0;
+
+  while (done < len) {
+    ssize_t n = pread(fd, tmp + done, len - done, offset + done);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    done += n;
+  }
+  return memcmp(buf, tmp, len) == 0;
+}
+
+/* Worker for FileConnection::saveShmFile(): claims extents one at a time and
+ * writes those that changed since the last checkpoint.  The hash is not
+ * cryptographic, so an extent with an unchanged hash is compared with the
+ * copy before it is skipped.
+ */
+static void *
+saveShmFileExtents(void *arg)
+{
+  ShmFileSaveState *state = (ShmFileSaveState *)arg;
+  char *buf = (char *)JALLOC_HELPER_MALLOC(SHM_FILE_EXTENT_SIZE);
+  char *oldBuf = (char *)JALLOC_HELPER_MALLOC(SHM_FILE_EXTENT_SIZE);
+  uint64_t bytesWritten = 0;
+
+  while (1) {
+    size_t i = __sync_fetch_and_add(&state->nextExtent, 1);
+    if (i >= state->numExtents) {
+      break;
+    }
+    off_t offset = (off_t)i * SHM_FILE_EXTENT_SIZE;
+    ssize_t len = 0;
+    while (len < SHM_FILE_EXTENT_SIZE) {
+      ssize_t n = pread(state->srcFd, buf + len, SHM_FILE_EXTENT_SIZE - len,
+                        offset + len);
+      if (n == -1 && errno == EINTR) {
+        continue;
+      }
+      JASSERT(n != -1) (JASSERT_ERRNO).Text("Read failed");
+      if (n == 0) {
+        break;
+      }
+      len += n;
+    }
+
+    uint64_t hash = hashExtent(buf, len);
+    (*state->newHashes)[i] = hash;
+    if (i < state->oldHashes->size() && (*state->oldHashes)[i] == hash &&
+        isExtentSaved(state->destFd, offset, buf, len, oldBuf)) {
+      continue;
+    }
+    for (ssize_t done = 0; done < len;) {
+      ssize_t n = pwrite(state->destFd, buf + done, len - done,
+                         offset + done);
+      if (n == -1 && errno == EINTR) {
+        continue;
+      }
+      JASSERT(n > 0) (JASSERT_ERRNO).Text("Write failed");
+      done += n;
+    }
+    bytesWritten += len;
+  }
+  JALLOC_HELPER_FREE(buf);
+  JALLOC_HELPER_FREE(oldBuf);
+  __sync_fetch_and_add(&state->bytesWritten, bytesWritten);
+  return NULL;
+}
+
+/* Save the backing file of a shared mapping.  A clone of the copy from the
+ * last checkpoint becomes the starting point, and only extents that changed
+ * since are written.  The old copy is left alone, since the last ckpt image
+ * refers to it until the new one is complete.  Large files are processed by
+ * several threads.
+ */
+void
+FileConnection::saveShmFile(int srcFd, const struct stat &srcStat)
+{
+  ShmFileCopy &last = shmFileCopies[FileId(srcStat.st_dev, srcStat.st_ino)];
+  vector<uint64_t> oldHashes;
+  int destFd = -1;
+
+  JASSERT(FileConnList::createDirectoryTree(_savedFilePath))
+    (_savedFilePath)
+    .Text("Unable to create directory in File Path");
+
+  struct stat st;
+  if (!last.path.empty() && last.path != _savedFilePath &&
+      stat(last.path.c_str(), &st) == 0 &&
+      st.st_ino == last.copyStat.st_ino &&
+      st.st_size == last.copyStat.st_size &&
+      st.st_mtim.tv_sec == last.copyStat.st_mtim.tv_sec &&
+      st.st_mtim.tv_nsec == last.copyStat.st_mtim.tv_nsec) {
+    int lastFd = _real_open(last.path.c_str(), O_RDONLY, 0);
+    if (lastFd != -1) {
+      destFd = _real_open(
+          _savedFilePath.c_str(), O_CREAT | O_RDWR | O_TRUNC,
+          S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+      if (destFd != -1) {
+        writeFileFromFd(lastFd, destFd);
+      }
+      _real_close(lastFd);
+    }
+    if (destFd != -1) {
+      oldHashes.swap(last.extentHashes);
+    }
+  }
+
+  if (destFd == -1) {
+    destFd = _real_open(
+        _savedFilePath.c_str(), O_CREAT | O_RDWR | O_TRUNC,
+        S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+  }
+  JASSERT(destFd != -1) (JASSERT_ERRNO) (_path) (_savedFilePath);
+  JASSERT(ftruncate(destFd, srcStat.st_size) == 0)
+    (_savedFilePath) (JASSERT_ERRNO);
+
+  ShmFileSaveState state;
+  state.srcFd = srcFd;
+  state.destFd = destFd;
+  state.numExtents =
+    (srcStat.st_size + SHM_FILE_EXTENT_SIZE - 1) / SHM_FILE_EXTENT_SIZE;
+  state.nextExtent = 0;
+  state.oldHashes = &oldHashes;
+  state.newHashes = &last.extentHashes;
+  state.bytesWritten = 0;
+  last.extentHashes.assign(state.numExtents, 0);
+
+  size_t numThreads = 1;
+  if (srcStat.st_size >= SHM_FILE_PARALLEL_MIN_SIZE) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    numThreads = MIN(SHM_FILE_MAX_THREADS, MAX(ncpus, 1));
+    numThreads = MIN(numThreads, state.numExtents);
+  }
+
+  pthread_t threads[SHM_FILE_MAX_THREADS];
+  size_t numStarted = 0;
+  while (numStarted + 1 < numThreads &&
+         dmtcp_create_helper_thread(&threads[numStarted], saveShmFileExtents,
+                                    &state) == 0) {
+    numStarted++;
+  }
+  saveShmFileExtents(&state);
+  for (size_t i = 0; i < numStarted; i++) {
+    JASSERT(dmtcp_join_helper_thread(threads[i], NULL) == 0);
+  }
+
+  JTRACE("Saved checkpointed copy of shared-memory file")
+    (_path) (_savedFilePath) (srcStat.st_size) (state.bytesWritten)
+    (numStarted + 1);
+
+  last.path.clear();
+  if (fstat(destFd, &last.copyStat) == 0) {
+    last.path = _savedFilePath;
+  }
+  _real_close(destFd);
+}
+
 /* Given an open file-descriptor for a saved file, saves a copy
  * of its existing copy, and replaces the existing copy with the
  * saved file.
@@ -545,6 +845,17 @@ FileConnection::openFile()
 static bool
 areFilesEqual(int fd, int savedFd, size_t size)
 {
+  struct stat st1, st2;
+  if (fstat(fd, &st1) == 0 && fstat(savedFd, &st2) == 0) {
+    if (st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino) {
+      return true;
+    }
+    if (S_ISREG(st1.st_mode) && S_ISREG(st2.st_mode) &&
+        ((size_t)st1.st_size < size || (size_t)st2.st_size < size)) {
+      return false;
+    }
+  }
+
   long page_size = sysconf(_SC_PAGESIZE);
   const size_t bufSize = 1024 * page_size;
   char *buf1 = (char *)JALLOC_HELPER_MALLOC(bufSize);
@@ -578,17 +889,90 @@ areFilesEqual(int fd, int savedFd, size_t size)
   return size == 0;
 }
 
+/* Copy fd to destFd from *offset on with copy_file_range(), which lets the
+ * filesystem share extents or copy on the server side.  Returns false if it
+ * is not supported for this pair of files; *offset is how far it got.
+ */
+static bool
+copyFileRange(int fd, int destFd, off_t *offset, off_t srcSize)
+{
+#ifdef __NR_copy_file_range
+  while (1) {
+    loff_t inOff = *offset;
+    loff_t outOff = *offset;
+    ssize_t n = syscall(__NR_copy_file_range, fd, &inOff, destFd, &outOff,
+                        (size_t)1 << 30, 0);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1) {
+      return false;
+    }
+    if (n == 0) {
+      // Some kernels return 0 for files whose size isn't known (procfs).
+      return *offset >= srcSize;
+    }
+    *offset += n;
+  }
+#endif // ifdef __NR_copy_file_range
+  return false;
+}
+
+/* Same as copyFileRange(), but with sendfile(), which works across
+ * filesystems and still avoids a copy through user space.
+ */
+static bool
+sendFile(int fd, int destFd, off_t *offset, off_t srcSize)
+{
+  if (lseek(destFd, *offset, SEEK_SET) != *offset) {
+    return false;
+  }
+  while (1) {
+    off_t inOff = *offset;
+    ssize_t n = sendfile(destFd, fd, &inOff, 0x7ffff000);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1) {
+      return false;
+    }
+    if (n == 0) {
+      return *offset >= srcSize;
+    }
+    *offset += n;
+  }
+}
+
+/* Copy the contents of fd into the empty file destFd.  In order of
+ * preference: a reflink (FICLONE) when both are on the same copy-on-write
+ * filesystem, copy_file_range(), sendfile(), and a plain read/write loop.
+ */
 static void
 writeFileFromFd(int fd, int destFd)
 {
-  long page_size = sysconf(_SC_PAGESIZE);
-  const size_t bufSize = 1024 * page_size;
-  char *buf = (char *)JALLOC_HELPER_MALLOC(bufSize);
-
   // Synchronize memory buffer with data in filesystem
   // On some Linux kernels, the shared-memory test will fail without this.
   fsync(fd);
 
+  struct stat st;
+  JASSERT(fstat(fd, &st) == 0) (fd) (JASSERT_ERRNO);
+  if (S_ISREG(st.st_mode)) {
+    if (ioctl(destFd, FICLONE, fd) == 0) {
+      return;
+    }
+    off_t copied = 0;
+    if (copyFileRange(fd, destFd, &copied, st.st_size) ||
+        sendFile(fd, destFd, &copied, st.st_size)) {
+      return;
+    }
+    // Start over; the destination may have been written past 'copied'.
+    JASSERT(ftruncate(destFd, 0) == 0) (destFd) (JASSERT_ERRNO);
+  }
+
+  long page_size = sysconf(_SC_PAGESIZE);
+  const size_t bufSize = 1024 * page_size;
+  char *buf = (char *)JALLOC_HELPER_MALLOC(bufSize);
+
   off_t offset = lseek(fd, 0, SEEK_CUR);
   JASSERT(lseek(fd, 0, SEEK_SET) == 0)
     (fd) (JASSERT_ERRNO) (jalib::Filesystem::GetDeviceName(fd));
@@ -127,6 +127,9 @@ class FileConnection : public Connection
     void calculateRelativePath();
     string getSavedFilePath(const string &path);
     void overwriteFileWithBackup(int savedFd);
+    bool isSavedCopyCurrent(const struct stat &srcStat);
+    void saveShmFile(int srcFd, const struct stat &srcStat);
+    void recordSavedCopy(const struct stat &srcStat, int destFd);
 
     string _path;
     string _savedFilePath;
@@ -145,6 +148,12 @@ class FileConnection : public Connection
     uint64_t _st_dev;
     uint64_t _st_ino;
     int64_t _st_size;
+
+    // Not serialized: the file and its ckpt copy when the copy was last
+    // written by this process; see isSavedCopyCurrent().
+    string _lastSavedFilePath;
+    struct stat _lastSavedSrcStat;
+    struct stat _lastSavedCopyStat;
 };
 
 class FifoConnection : public Connection
@@ -468,18 +468,35 @@ FileConnList::recreateShmFileAndMap(const ProcMapsArea &area)
   int fd = _real_open(area.name, O_CREAT | O_EXCL | O_RDWR,
                       S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
   JASSERT(fd != -1 || errno == EEXIST) (area.name);
+  bool isNewFile = (fd != -1);
 
   if (fd == -1) {
     fd = _real_open(area.name, O_RDWR);
     JASSERT(fd != -1) (JASSERT_ERRNO);
   }
 
-  // Get to the correct offset.
-  JASSERT(lseek(fd, area.offset, SEEK_SET) == area.offset) (JASSERT_ERRNO);
-
-  // Now populate file contents from memory.
-  JASSERT(Util::writeAll(fd, area.addr, area.size) == (ssize_t)area.size)
-    (JASSERT_ERRNO);
+  // Now populate file contents from memory.  A file we just created reads
+  // back as zeros wherever nothing was written, so zero blocks are skipped;
+  // the last block is always written to extend the file to its full size.
+  const size_t blockSize = 1024 * 1024;
+  const size_t pagesPerBlock = blockSize / Util::pageSize();
+  for (size_t off = 0; off < area.size; off += blockSize) {
+    size_t len = MIN(blockSize, area.size - off);
+    char *addr = (char *)area.addr + off;
+    if (isNewFile && off + len < area.size &&
+        Util::areZeroPages(addr, pagesPerBlock)) {
+      continue;
+    }
+    for (size_t done = 0; done < len;) {
+      ssize_t n = pwrite(fd, addr + done, len - done,
+                         area.offset + off + done);
+      if (n == -1 && errno == EINTR) {
+        continue;
+      }
+      JASSERT(n > 0) (area.name) (JASSERT_ERRNO);
+      done += n;
+    }
+  }
   restoreShmArea(area, fd);
 }
 
@@ -291,22 +291,22 @@ ConnectionRewirer::registerNSData(void *addr,
                                   ConnectionListT *conList)
 {
   iterator i;
+  vector<const void *> keys, vals;
+  vector<uint32_t> keyLens, valLens;
 
   JASSERT(theRewirer != NULL);
   for (i = conList->begin(); i != conList->end(); ++i) {
-    const ConnectionIdentifier &id = i->first;
-    dmtcp_send_key_val_pair_to_coordinator("Socket",
-                                           (const void *)&id,
-                                           (uint32_t)sizeof(id),
-                                           addr,
-                                           (uint32_t)addrLen);
-
-    /*
-    sockaddr_in *sn = (sockaddr_in*) &_restoreAddr;
-    unsigned short port = htons(sn->sin_port);
-    char *ip = inet_ntoa(sn->sin_addr);
-    JTRACE("Send NS information:")(id)(sn->sin_family)(port)(ip);
-    */
+    keys.push_back(&i->first);
+    keyLens.push_back(sizeof(i->first));
+    vals.push_back(addr);
+    valLens.push_back(addrLen);
+  }
+
+  // All connections in one message.
+  if (!keys.empty()) {
+    dmtcp_send_key_val_pairs_to_coordinator("Socket", keys.size(),
+                                            &keys[0], &keyLens[0],
+                                            &vals[0], &valLens[0]);
   }
 
   // debugPrint();
@@ -316,25 +316,35 @@ void
 ConnectionRewirer::sendQueries()
 {
   iterator i;
+  size_t num = _pendingOutgoing.size();
+
+  if (num == 0) {
+    return;
+  }
 
+  // Look up all outgoing connections with one request.
+  vector<const void *> keys;
+  vector<uint32_t> keyLens;
+  vector<void *> vals;
+  vector<uint32_t> valLens;
+  vector<struct RemoteAddr> remotes(num);
   for (i = _pendingOutgoing.begin(); i != _pendingOutgoing.end(); ++i) {
-    const ConnectionIdentifier &id = i->first;
-    struct RemoteAddr remote;
-    uint32_t len = sizeof(remote.addr);
-    JASSERT(dmtcp_send_query_to_coordinator("Socket",
-                                            (const void *)&id,
-                                            (uint32_t)sizeof(id),
-                                            &remote.addr,
-                                            &len) != 0);
-    remote.len = len;
-
-    /*
-    sockaddr_in *sn = (sockaddr_in*) &remote.addr;
-    unsigned short port = htons(sn->sin_port);
-    char *ip = inet_ntoa(sn->sin_addr);
-    JTRACE("Send Queries. Get remote from coordinator:")(id)(sn->sin_family)(port)(ip);
-    */
-    _remoteInfo[id] = remote;
+    keys.push_back(&i->first);
+    keyLens.push_back(sizeof(i->first));
+    vals.push_back(&remotes[vals.size()].addr);
+    valLens.push_back(sizeof(remotes[0].addr));
+  }
+
+  JASSERT(dmtcp_send_queries_to_coordinator("Socket", num,
+                                            &keys[0], &keyLens[0],
+                                            &vals[0], &valLens[0]) ==
+          (int)num);
+
+  size_t n = 0;
+  for (i = _pendingOutgoing.begin(); i != _pendingOutgoing.end(); ++i, ++n) {
+    JASSERT(valLens[n] != 0) (i->first);
+    remotes[n].len = valLens[n];
+    _remoteInfo[i->first] = remotes[n];
   }
 }
 
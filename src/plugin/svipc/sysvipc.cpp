@@ -35,6 +35,7 @@
 #include "jserialize.h"
 #include "config.h"
 #include "dmtcp.h"
+#include "procselfmaps.h"
 #include "shareddata.h"
 #include "util.h"
 
@@ -537,6 +538,20 @@ SysVShm::shmaddrToShmid(const void *shmaddr)
   return shmid;
 }
 
+// Called from writeckpt.cpp while the user threads are suspended.
+bool
+SysVShm::getCkptLeaderShmInfo(const void *shmaddr, int *mode, int *shmflg)
+{
+  for (Iterator i = _map.begin(); i != _map.end(); ++i) {
+    ShmSegment *shmObj = (ShmSegment *)i->second;
+    if (shmObj->isCkptLeaderShmaddr(shmaddr)) {
+      shmObj->getCkptLeaderShmInfo(mode, shmflg);
+      return true;
+    }
+  }
+  return false;
+}
+
 /*
  * Semaphore
  */
@@ -694,6 +709,23 @@ ShmSegment::isValidShmaddr(const void *shmaddr)
   return _shmaddrToFlag.find((void *)shmaddr) != _shmaddrToFlag.end();
 }
 
+bool
+ShmSegment::isCkptLeaderShmaddr(const void *shmaddr)
+{
+  // Only the first address of the leader is saved in the ckpt image.
+  return _isCkptLeader && !_shmaddrToFlag.empty() &&
+         _shmaddrToFlag.begin()->first == shmaddr;
+}
+
+// The permission bits of the segment and the shmat() flags of the saved
+// address, for mtcp_restart to restore the segment with.
+void
+ShmSegment::getCkptLeaderShmInfo(int *mode, int *shmflg)
+{
+  *mode = _flags & 0777;
+  *shmflg = _shmaddrToFlag.begin()->second;
+}
+
 bool
 ShmSegment::isStale()
 {
@@ -772,6 +804,26 @@ ShmSegment::preCheckpoint()
   }
 }
 
+/* Returns the id of the segment that mtcp_restart created and attached at
+ * our first address (see restore_sysv_shm_segment()), or -1 if the area was
+ * restored as anonymous memory.  For SysV shm, the inode field of
+ * /proc/self/maps holds the shmid.
+ */
+int
+ShmSegment::findRestoredSegment()
+{
+  ProcSelfMaps procSelfMaps;
+  ProcMapsArea area;
+  const void *addr = _shmaddrToFlag.begin()->first;
+
+  while (procSelfMaps.getNextArea(&area)) {
+    if (area.addr == addr) {
+      return Util::isSysVShmArea(area) ? (int)area.inodenum : -1;
+    }
+  }
+  return -1;
+}
+
 void
 ShmSegment::postRestart()
 {
@@ -779,6 +831,35 @@ ShmSegment::postRestart()
     return;
   }
 
+  JASSERT(!_shmaddrToFlag.empty());
+  int restoredId = findRestoredSegment();
+  if (restoredId != -1) {
+    // The data is already in place; take over the segment.
+    struct shmid_ds info;
+    JASSERT(_real_shmctl(restoredId, IPC_STAT, &info) != -1)
+      (restoredId) (JASSERT_ERRNO);
+    info.shm_perm.mode = _flags & 0777;
+    JASSERT(_real_shmctl(restoredId, IPC_SET, &info) != -1)
+      (restoredId) (JASSERT_ERRNO);
+
+    _realId = restoredId;
+    SysVShm::instance().updateMapping(_id, _realId);
+    SysVShm::instance().updateKeyMapping(_key, info.shm_perm.__key);
+
+    ShmaddrToFlagIter i = _shmaddrToFlag.begin();
+    if (_dmtcpMappedAddr) {
+      JASSERT(_real_shmdt(i->first) == 0) (i->first) (JASSERT_ERRNO);
+    } else if (i->second & SHM_RDONLY) {
+      // mtcp_restart had to attach it writable to read the data into it.
+      JASSERT(_real_shmdt(i->first) == 0) (i->first) (JASSERT_ERRNO);
+      JASSERT(_real_shmat(_realId, i->first, i->second) == i->first)
+        (_realId) (i->first) (i->second) (JASSERT_ERRNO);
+    }
+    JTRACE("Adopted shared memory segment restored in place")
+      (_id) (_realId) (i->first);
+    return;
+  }
+
   int tmpShmFlags = (_flags & IPC_CREAT) ? _flags : (_flags | IPC_CREAT);
   key_t realKey = dmtcp_virtual_to_real_pid(getpid());
   _realId = _real_shmget(realKey, _size, tmpShmFlags);
@@ -141,6 +141,7 @@ class SysVShm : public SysVIPC
     static SysVShm &instance();
 
     int shmaddrToShmid(const void *shmaddr);
+    bool getCkptLeaderShmInfo(const void *shmaddr, int *mode, int *shmflg);
     virtual void on_shmget(int shmid, key_t realKey, key_t key,
                            size_t size, int shmflg);
     virtual void on_shmat(int shmid,
@@ -253,6 +254,8 @@ class ShmSegment : public SysVObj
     virtual void preResume();
 
     bool isValidShmaddr(const void *shmaddr);
+    bool isCkptLeaderShmaddr(const void *shmaddr);
+    void getCkptLeaderShmInfo(int *mode, int *shmflg);
     void remapAll();
     void remapFirstAddrForOwnerOnRestart();
 
@@ -260,6 +263,8 @@ class ShmSegment : public SysVObj
     void on_shmdt(const void *shmaddr);
 
   private:
+    int findRestoredSegment();
+
     size_t _size;
     int _dmtcpMappedAddr;
     shmatt_t _nattch;
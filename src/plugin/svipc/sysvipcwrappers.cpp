@@ -140,6 +140,15 @@ dmtcp_svipc_inside_shmdt()
   return inside_shmdt;
 }
 
+// Called by writeckpt.cpp; the segment mapped at addr is restored directly
+// by mtcp_restart, with the given mode and shmat() flags, and adopted by
+// ShmSegment::postRestart().
+EXTERNC bool
+dmtcp_svipc_restores_shm_in_place(const void *addr, int *mode, int *shmflg)
+{
+  return SysVShm::instance().getCkptLeaderShmInfo(addr, mode, shmflg);
+}
+
 extern "C"
 int
 shmdt(const void *shmaddr)
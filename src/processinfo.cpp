@@ -248,9 +248,12 @@ ProcessInfo::growStack()
 #ifdef LOGGING
   {
     ProcSelfMaps maps;
-    while (maps.getNextArea(&area)) {
-      if ((VA)&area >= area.addr && (VA)&area < area.endAddr) { // Stack found
-        JTRACE("New stack size") ((void *)area.addr) (area.size);
+    ProcMapsEntry entry;
+    while (maps.getNextEntry(&entry)) {
+      if ((VA)&entry >= entry.addr && (VA)&entry < entry.endAddr) {
+        // Stack found
+        JTRACE("New stack size")
+          ((void *)entry.addr) (entry.endAddr - entry.addr);
         break;
       }
     }
@@ -28,6 +28,43 @@
 using namespace dmtcp;
 
 
+// Size of the last /proc/self/maps read, used to size the next buffer.
+static size_t lastNumBytes = 0;
+
+static inline unsigned long int
+readDec(const char **p)
+{
+  unsigned long int v = 0;
+
+  while (**p >= '0' && **p <= '9') {
+    v = v * 10 + (**p - '0');
+    (*p)++;
+  }
+  return v;
+}
+
+static inline unsigned long int
+readHex(const char **p)
+{
+  unsigned long int v = 0;
+
+  while (1) {
+    char c = **p;
+    if ((c >= '0') && (c <= '9')) {
+      c -= '0';
+    } else if ((c >= 'a') && (c <= 'f')) {
+      c -= 'a' - 10;
+    } else if ((c >= 'A') && (c <= 'F')) {
+      c -= 'A' - 10;
+    } else {
+      break;
+    }
+    v = v * 16 + c;
+    (*p)++;
+  }
+  return v;
+}
+
 ProcSelfMaps::ProcSelfMaps()
   : dataIdx(0),
   numAreas(0),
@@ -35,8 +72,6 @@ ProcSelfMaps::ProcSelfMaps()
   fd(-1),
   numAllocExpands(0)
 {
-  char buf[4096];
-
   // NOTE: preExpand() verifies that we have at least 10 chunks pre-allocated
   // for each level of the allocator.  See jalib/jalloc.cpp:preExpand().
   // It assumes no allocation larger than jalloc.cpp:MAX_CHUNKSIZE.
@@ -54,43 +89,44 @@ ProcSelfMaps::ProcSelfMaps()
   // setcontext() on the various threads will be a memory leak on restart.
   // We should check for that.
 
-  fd = _real_open("/proc/self/maps", O_RDONLY);
-  JASSERT(fd != -1) (JASSERT_ERRNO);
-  ssize_t numRead = 0;
-
-  // Get an approximation of the required buffer size.
-  do {
-    numRead = Util::readAll(fd, buf, sizeof(buf));
-    if (numRead > 0) {
-      numBytes += numRead;
-    }
-  } while (numRead > 0);
+  // The buffer must be allocated before reading, since allocating it will
+  // most likely change the layout of /proc/self/maps.  Generating the file
+  // is expensive for processes with many mappings, so guess the size from
+  // the previous read and read it again only if the guess was too small.
+  size_t size = __atomic_load_n(&lastNumBytes, __ATOMIC_RELAXED);
+  size = size + size / 4 + 4096;
+  if (size < 64 * 1024) {
+    size = 64 * 1024;
+  }
 
-  // Now allocate a buffer. Note that this will most likely change the layout
-  // of /proc/self/maps, so we need to recalculate numBytes.
-  size_t size = numBytes + 4096; // Add a one page buffer.
-  data = (char *)JALLOC_HELPER_MALLOC(size);
-  JASSERT(lseek(fd, 0, SEEK_SET) == 0);
+  while (1) {
+    data = (char *)JALLOC_HELPER_MALLOC(size);
 
-  numBytes = Util::readAll(fd, data, size);
-  JASSERT(numBytes > 0) (numBytes);
+    fd = _real_open("/proc/self/maps", O_RDONLY);
+    JASSERT(fd != -1) (JASSERT_ERRNO);
+    ssize_t numRead = Util::readAll(fd, data, size);
+    JASSERT(numRead > 0) (numRead) (JASSERT_ERRNO);
+    _real_close(fd);
 
-  // TODO(kapil): Replace this assert with more robust code that would
-  // reallocate the buffer with an extended size.
-  JASSERT(numBytes < size) (numBytes) (size);
+    numBytes = numRead;
+    if (numBytes < size) {
+      break;
+    }
+    JALLOC_HELPER_FREE(data);
+    size *= 2;
+  }
+  __atomic_store_n(&lastNumBytes, numBytes, __ATOMIC_RELAXED);
 
   // TODO(kapil): Validate the read data.
   JASSERT(isValidData());
 
-  _real_close(fd);
-
-  for (size_t i = 0; i < numBytes; i++) {
-    if (data[i] == '\n') {
-      numAreas++;
-    }
+  const char *p = data;
+  const char *end = data + numBytes;
+  while ((p = (const char *)memchr(p, '\n', end - p)) != NULL) {
+    numAreas++;
+    p++;
   }
 }
-
 ProcSelfMaps::~ProcSelfMaps()
 {
   JALLOC_HELPER_FREE(data);
@@ -115,48 +151,8 @@ ProcSelfMaps::isValidData()
   return true;
 }
 
-unsigned long int
-ProcSelfMaps::readDec()
-{
-  unsigned long int v = 0;
-
-  while (1) {
-    char c = data[dataIdx];
-    if ((c >= '0') && (c <= '9')) {
-      c -= '0';
-    } else {
-      break;
-    }
-    v = v * 10 + c;
-    dataIdx++;
-  }
-  return v;
-}
-
-unsigned long int
-ProcSelfMaps::readHex()
-{
-  unsigned long int v = 0;
-
-  while (1) {
-    char c = data[dataIdx];
-    if ((c >= '0') && (c <= '9')) {
-      c -= '0';
-    } else if ((c >= 'a') && (c <= 'f')) {
-      c -= 'a' - 10;
-    } else if ((c >= 'A') && (c <= 'F')) {
-      c -= 'A' - 10;
-    } else {
-      break;
-    }
-    v = v * 16 + c;
-    dataIdx++;
-  }
-  return v;
-}
-
 int
-ProcSelfMaps::getNextArea(ProcMapsArea *area)
+ProcSelfMaps::getNextEntry(ProcMapsEntry *entry)
 {
   char rflag, sflag, wflag, xflag;
 
@@ -164,85 +160,109 @@ ProcSelfMaps::getNextArea(ProcMapsArea *area)
     return 0;
   }
 
-  area->addr = (VA)readHex();
-  JASSERT(area->addr != NULL);
+  const char *p = data + dataIdx;
+  const char *eol = (const char *)memchr(p, '\n', numBytes - dataIdx);
+  JASSERT(eol != NULL) (dataIdx) (numBytes);
 
-  JASSERT(data[dataIdx++] == '-');
+  entry->addr = (VA)readHex(&p);
+  JASSERT(entry->addr != NULL);
 
-  area->endAddr = (VA)readHex();
-  JASSERT(area->endAddr != NULL);
+  JASSERT(*p++ == '-');
 
-  JASSERT(data[dataIdx++] == ' ');
+  entry->endAddr = (VA)readHex(&p);
+  JASSERT(entry->endAddr != NULL);
 
-  JASSERT(area->endAddr >= area->addr);
-  area->size = area->endAddr - area->addr;
+  JASSERT(*p++ == ' ');
 
-  rflag = data[dataIdx++];
+  JASSERT(entry->endAddr >= entry->addr);
+
+  rflag = *p++;
   JASSERT((rflag == 'r') || (rflag == '-'));
 
-  wflag = data[dataIdx++];
+  wflag = *p++;
   JASSERT((wflag == 'w') || (wflag == '-'));
 
-  xflag = data[dataIdx++];
+  xflag = *p++;
   JASSERT((xflag == 'x') || (xflag == '-'));
 
-  sflag = data[dataIdx++];
+  sflag = *p++;
   JASSERT((sflag == 's') || (sflag == 'p'));
 
-  JASSERT(data[dataIdx++] == ' ');
+  JASSERT(*p++ == ' ');
 
-  area->offset = readHex();
-  JASSERT(data[dataIdx++] == ' ');
+  entry->offset = readHex(&p);
+  JASSERT(*p++ == ' ');
 
-  area->devmajor = readHex();
-  JASSERT(data[dataIdx++] == ':');
+  entry->devmajor = readHex(&p);
+  JASSERT(*p++ == ':');
 
-  area->devminor = readHex();
-  JASSERT(data[dataIdx++] == ' ');
+  entry->devminor = readHex(&p);
+  JASSERT(*p++ == ' ');
 
-  area->inodenum = readDec();
+  entry->inodenum = readDec(&p);
 
-  while (data[dataIdx] == ' ') {
-    dataIdx++;
+  while (*p == ' ') {
+    p++;
   }
 
-  area->name[0] = '\0';
-  if (data[dataIdx] == '/' || data[dataIdx] == '[' || data[dataIdx] == '(') {
+  entry->name = p;
+  entry->nameLen = 0;
+  if (*p == '/' || *p == '[' || *p == '(') {
     // absolute pathname, or [stack], [vdso], etc.
     // On some machines, deleted files have a " (deleted)" prefix to the
     // filename.
-    size_t i = 0;
-    while (data[dataIdx] != '\n') {
-      area->name[i++] = data[dataIdx++];
-      JASSERT(i < sizeof(area->name));
-    }
-    area->name[i] = '\0';
+    entry->nameLen = eol - p;
+    JASSERT(entry->nameLen < FILENAMESIZE) (entry->nameLen);
   }
 
-  JASSERT(data[dataIdx++] == '\n');
+  JASSERT(p + entry->nameLen == eol) (dataIdx);
+  dataIdx = eol + 1 - data;
 
-  area->prot = 0;
+  entry->prot = 0;
   if (rflag == 'r') {
-    area->prot |= PROT_READ;
+    entry->prot |= PROT_READ;
   }
   if (wflag == 'w') {
-    area->prot |= PROT_WRITE;
+    entry->prot |= PROT_WRITE;
   }
   if (xflag == 'x') {
-    area->prot |= PROT_EXEC;
+    entry->prot |= PROT_EXEC;
   }
 
-  area->flags = MAP_FIXED;
+  entry->flags = MAP_FIXED;
   if (sflag == 's') {
-    area->flags |= MAP_SHARED;
+    entry->flags |= MAP_SHARED;
   }
   if (sflag == 'p') {
-    area->flags |= MAP_PRIVATE;
+    entry->flags |= MAP_PRIVATE;
   }
-  if (area->name[0] == '\0') {
-    area->flags |= MAP_ANONYMOUS;
+  if (entry->nameLen == 0) {
+    entry->flags |= MAP_ANONYMOUS;
+  }
+
+  return 1;
+}
+
+int
+ProcSelfMaps::getNextArea(ProcMapsArea *area)
+{
+  ProcMapsEntry entry;
+
+  if (!getNextEntry(&entry)) {
+    return 0;
   }
 
+  area->addr = entry.addr;
+  area->endAddr = entry.endAddr;
+  area->size = entry.endAddr - entry.addr;
+  area->offset = entry.offset;
+  area->prot = entry.prot;
+  area->flags = entry.flags;
+  area->devmajor = entry.devmajor;
+  area->devminor = entry.devminor;
+  area->inodenum = entry.inodenum;
+  memcpy(area->name, entry.name, entry.nameLen);
+  area->name[entry.nameLen] = '\0';
   area->properties = 0;
 
   return 1;
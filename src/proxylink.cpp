@@ -0,0 +1,590 @@
+/****************************************************************************
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#include "proxylink.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/sockios.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include "../jalib/jassert.h"
+#include "util.h"
+
+using namespace dmtcp;
+
+#define PUMP_CHUNK_SIZE (64 * 1024)
+
+// Like Util::writeAll(), but a vanished peer is an error, not a SIGPIPE.
+static bool
+sendAll(int fd, const void *buf, size_t len)
+{
+  const char *p = (const char *)buf;
+
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+ProxyLink::ProxyLink(const jalib::JSocket &sock,
+                     const struct sockaddr_storage *addr,
+                     socklen_t len)
+  : _sock(sock),
+    _addrLen(len),
+    _started(false),
+    _closed(false),
+    _drainWanted(0),
+    _lastChannel(NODEPROXY_CONTROL_CHANNEL)
+{
+  memcpy(&_addr, addr, sizeof(_addr));
+  JASSERT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, _ctrlFds) == 0)
+    (JASSERT_ERRNO);
+  _eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  JASSERT(_eventFd != -1) (JASSERT_ERRNO);
+  _wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  JASSERT(_wakeFd != -1) (JASSERT_ERRNO);
+  pthread_mutex_init(&_eventLock, NULL);
+}
+
+ProxyLink::~ProxyLink()
+{
+  join();
+  _sock.close();
+  close(_ctrlFds[0]);
+  close(_ctrlFds[1]);
+  close(_eventFd);
+  close(_wakeFd);
+  pthread_mutex_destroy(&_eventLock);
+}
+
+void
+ProxyLink::start()
+{
+  sigset_t all, old;
+
+  // The coordinator relies on SIGALRM interrupting epoll_wait() in the
+  // event loop; make sure the helper thread never takes it instead.
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  JASSERT(pthread_create(&_thread, NULL, demuxThread, this) == 0)
+    (JASSERT_ERRNO);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  _started = true;
+}
+
+void
+ProxyLink::join()
+{
+  if (_started) {
+    pthread_join(_thread, NULL);
+    _started = false;
+  }
+}
+
+bool
+ProxyLink::nextEvent(Event *ev)
+{
+  uint64_t count;
+
+  if (read(_eventFd, &count, sizeof(count)) == -1) {
+    JASSERT(errno == EAGAIN || errno == EINTR) (JASSERT_ERRNO);
+  }
+
+  pthread_mutex_lock(&_eventLock);
+  if (_events.empty()) {
+    pthread_mutex_unlock(&_eventLock);
+    return false;
+  }
+  *ev = _events.front();
+  _events.pop_front();
+  pthread_mutex_unlock(&_eventLock);
+
+  if (ev->type == CLOSED) {
+    _closed = true;
+  }
+  return true;
+}
+
+void
+ProxyLink::pushEvent(const Event &ev)
+{
+  uint64_t one = 1;
+
+  pthread_mutex_lock(&_eventLock);
+  _events.push_back(ev);
+  pthread_mutex_unlock(&_eventLock);
+  JASSERT(write(_eventFd, &one, sizeof(one)) == sizeof(one)) (JASSERT_ERRNO);
+}
+
+void
+ProxyLink::channelRead()
+{
+  uint64_t one = 1;
+
+  // Pairs with the store in flushDeferred(): either the helper thread sees
+  // the socketpair drained, or we see _drainWanted and wake it up.
+  if (__atomic_load_n(&_drainWanted, __ATOMIC_SEQ_CST)) {
+    JASSERT(write(_wakeFd, &one, sizeof(one)) == sizeof(one)) (JASSERT_ERRNO);
+  }
+}
+
+void
+ProxyLink::broadcast(const DmtcpMessage &msg,
+                     const void *extraData,
+                     const vector<uint32_t> &channels)
+{
+  if (_closed || channels.empty()) {
+    return;
+  }
+
+  DmtcpMessage hdr(DMT_PROXY_BROADCAST);
+  hdr.numPeers = channels.size();
+  hdr.extraBytes = channels.size() * sizeof(uint32_t) + sizeof(msg) +
+    msg.extraBytes;
+
+  Util::writeAll(_ctrlFds[0], &hdr, sizeof(hdr));
+  Util::writeAll(_ctrlFds[0], &channels[0],
+                 channels.size() * sizeof(uint32_t));
+  Util::writeAll(_ctrlFds[0], &msg, sizeof(msg));
+  if (msg.extraBytes > 0) {
+    Util::writeAll(_ctrlFds[0], extraData, msg.extraBytes);
+  }
+}
+
+CoordClient *
+ProxyLink::client(uint32_t channel) const
+{
+  map<uint32_t, CoordClient *>::const_iterator it = _clients.find(channel);
+  return it == _clients.end() ? NULL : it->second;
+}
+
+void
+ProxyLink::addClient(uint32_t channel, CoordClient *client)
+{
+  _clients[channel] = client;
+}
+
+void
+ProxyLink::removeClient(uint32_t channel)
+{
+  _clients.erase(channel);
+}
+
+void *
+ProxyLink::demuxThread(void *arg)
+{
+  ((ProxyLink *)arg)->demux();
+  return NULL;
+}
+
+void
+ProxyLink::demux()
+{
+  vector<struct pollfd>fds;
+  vector<uint32_t>channels;
+
+  while (true) {
+    struct pollfd pfd;
+    fds.clear();
+    channels.clear();
+
+    // Stop taking frames from the proxy while the event loop is behind on
+    // some channel; the proxy in turn stops reading from its local processes.
+    pfd.fd = _sock.sockfd();
+    pfd.events = isThrottled() ? 0 : POLLIN;
+    fds.push_back(pfd);
+    pfd.fd = _ctrlFds[1];
+    pfd.events = POLLIN;
+    fds.push_back(pfd);
+    pfd.fd = _wakeFd;
+    fds.push_back(pfd);
+
+    map<uint32_t, Pump>::iterator it;
+    for (it = _pumps.begin(); it != _pumps.end(); it++) {
+      pfd.fd = it->second.fd;
+      pfd.events = it->second.closing ? 0 : POLLIN;
+      if (!it->second.pending.empty()) {
+        pfd.events |= POLLOUT;
+      }
+      fds.push_back(pfd);
+      channels.push_back(it->first);
+    }
+
+    int ret = poll(&fds[0], fds.size(), -1);
+    if (ret == -1 && errno == EINTR) {
+      continue;
+    }
+    JASSERT(ret != -1) (JASSERT_ERRNO);
+
+    if (fds[2].revents & POLLIN) {
+      uint64_t count;
+      if (read(_wakeFd, &count, sizeof(count)) == -1) {
+        JASSERT(errno == EAGAIN || errno == EINTR) (JASSERT_ERRNO);
+      }
+    }
+
+    for (size_t i = 0; i < channels.size(); i++) {
+      short revents = fds[i + 3].revents;
+      if (revents & POLLOUT) {
+        flushPump(channels[i]);
+      }
+      if (revents & (POLLIN | POLLHUP | POLLERR)) {
+        drainPump(channels[i]);
+      }
+    }
+
+    if (fds[1].revents & POLLIN) {
+      readBroadcast();
+    }
+
+    if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+      if (!readFrame()) {
+        break;
+      }
+    }
+
+    flushDeferred();
+  }
+
+  JNOTE("node proxy disconnected") (_pumps.size());
+  while (!_pumps.empty()) {
+    closePump(_pumps.begin()->first);
+  }
+
+  Event ev;
+  ev.type = CLOSED;
+  pushEvent(ev);
+}
+
+bool
+ProxyLink::readFrame()
+{
+  NodeProxyFrame frame;
+
+  if (_sock.readAll((char *)&frame, sizeof(frame)) != sizeof(frame)) {
+    return false;
+  }
+  if (frame.len > NODEPROXY_MAX_FRAME_SIZE) {
+    JWARNING(false) (frame.channel) (frame.len)
+      .Text("Oversized frame from node proxy; dropping the proxy");
+    return false;
+  }
+
+  string payload(frame.len, '\0');
+  if (frame.len > 0 &&
+      _sock.readAll(&payload[0], frame.len) != (ssize_t)frame.len) {
+    return false;
+  }
+
+  if (frame.channel == NODEPROXY_CONTROL_CHANNEL) {
+    readControl(payload);
+    return true;
+  }
+
+  map<uint32_t, Pump>::iterator it = _pumps.find(frame.channel);
+  if (frame.len == 0) {
+    if (it != _pumps.end()) {
+      it->second.closing = true;
+      if (it->second.pending.empty()) {
+        closePump(frame.channel);
+      }
+    }
+    return true;
+  }
+
+  if (it == _pumps.end()) {
+    // The proxy numbers channels in the order in which they first send
+    // data, so an unknown lower number is a late frame for a channel that
+    // the coordinator has already closed.
+    if (frame.channel <= _lastChannel) {
+      return true;
+    }
+    _lastChannel = frame.channel;
+
+    int sv[2];
+    JASSERT(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == 0)
+      (JASSERT_ERRNO);
+    JASSERT(fcntl(sv[1], F_SETFL, O_NONBLOCK) == 0) (JASSERT_ERRNO);
+
+    Pump &pump = _pumps[frame.channel];
+    pump.fd = sv[1];
+    pump.closing = false;
+
+    Event ev;
+    ev.type = NEW_CHANNEL;
+    ev.channel = frame.channel;
+    ev.fd = sv[0];
+    pushEvent(ev);
+  }
+
+  writeToPump(frame.channel, payload.data(), frame.len);
+  return true;
+}
+
+void
+ProxyLink::readControl(const string &payload)
+{
+  DmtcpMessage msg;
+
+  JASSERT(payload.length() >= sizeof(msg)) (payload.length());
+  memcpy(&msg, payload.data(), sizeof(msg));
+  msg.assertValid();
+  JASSERT(payload.length() == sizeof(msg) + msg.extraBytes)
+    (msg.extraBytes) (payload.length());
+
+  const char *extra = payload.data() + sizeof(msg);
+  Event ev;
+  if (msg.type == DMT_PROXY_BARRIER) {
+    JASSERT(msg.extraBytes == msg.numPeers * sizeof(NodeProxyArrival))
+      (msg.numPeers) (msg.extraBytes);
+    ev.type = BARRIER;
+    ev.barrier = msg.barrier;
+    ev.arrivals.resize(msg.numPeers);
+    if (msg.numPeers > 0) {
+      memcpy(&ev.arrivals[0], extra, msg.extraBytes);
+    }
+  } else if (msg.type == DMT_PROXY_CKPT_FILENAMES) {
+    ev.type = CKPT_FILENAMES;
+    size_t offset = 0;
+    for (uint32_t i = 0; i < msg.numPeers; i++) {
+      NodeProxyCkptFilename rec;
+      JASSERT(offset + sizeof(rec) <= msg.extraBytes) (offset);
+      memcpy(&rec, extra + offset, sizeof(rec));
+      offset += sizeof(rec);
+      JASSERT(offset + rec.len <= msg.extraBytes) (offset) (rec.len);
+
+      CkptFilename filename;
+      filename.channel = rec.channel;
+      filename.type = (DmtcpMessageType)rec.type;
+      filename.data.assign(extra + offset, rec.len);
+      ev.filenames.push_back(filename);
+      offset += rec.len;
+    }
+  } else {
+    JASSERT(false) (msg.type).Text("Unexpected message from node proxy");
+  }
+
+  // Handed to the event loop by flushDeferred().
+  _deferred.push_back(ev);
+}
+
+void
+ProxyLink::readBroadcast()
+{
+  DmtcpMessage msg;
+
+  JASSERT(Util::readAll(_ctrlFds[1], &msg, sizeof(msg)) == sizeof(msg))
+    (JASSERT_ERRNO);
+  msg.assertValid();
+  JASSERT(msg.type == DMT_PROXY_BROADCAST) (msg.type);
+
+  string frame((const char *)&msg, sizeof(msg));
+  frame.resize(sizeof(msg) + msg.extraBytes);
+  JASSERT(Util::readAll(_ctrlFds[1], &frame[sizeof(msg)], msg.extraBytes) ==
+          (ssize_t)msg.extraBytes) (JASSERT_ERRNO);
+
+  // Anything the event loop wrote to these channels before the broadcast
+  // must reach the proxy first.
+  const uint32_t *channels = (const uint32_t *)&frame[sizeof(msg)];
+  for (size_t i = 0; i < msg.numPeers; i++) {
+    drainPump(channels[i]);
+  }
+
+  sendFrame(NODEPROXY_CONTROL_CHANNEL, frame.data(), frame.size());
+}
+
+void
+ProxyLink::sendFrame(uint32_t channel, const void *buf, size_t len)
+{
+  NodeProxyFrame frame;
+
+  frame.channel = channel;
+  frame.len = len;
+
+  // On failure, the next readFrame() notices the dead proxy.
+  if (sendAll(_sock.sockfd(), &frame, sizeof(frame)) && len > 0) {
+    sendAll(_sock.sockfd(), buf, len);
+  }
+}
+
+void
+ProxyLink::writeToPump(uint32_t channel, const char *buf, size_t len)
+{
+  Pump &pump = _pumps[channel];
+
+  if (pump.pending.empty()) {
+    ssize_t n = send(pump.fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n == -1) {
+      if (errno != EAGAIN && errno != EINTR) {
+        // The event loop closed its end; drainPump() reports that upstream.
+        return;
+      }
+      n = 0;
+    }
+    buf += n;
+    len -= n;
+  }
+  if (len > 0) {
+    pump.pending.append(buf, len);
+  }
+}
+
+void
+ProxyLink::flushPump(uint32_t channel)
+{
+  map<uint32_t, Pump>::iterator it = _pumps.find(channel);
+
+  if (it == _pumps.end()) {
+    return;
+  }
+
+  Pump &pump = it->second;
+  while (!pump.pending.empty()) {
+    ssize_t n = send(pump.fd, pump.pending.data(), pump.pending.size(),
+                     MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1 && errno == EAGAIN) {
+      return;
+    }
+    if (n == -1) {
+      pump.pending.clear();
+      break;
+    }
+    pump.pending.erase(0, n);
+  }
+
+  if (pump.closing) {
+    closePump(channel);
+  }
+}
+
+void
+ProxyLink::drainPump(uint32_t channel)
+{
+  map<uint32_t, Pump>::iterator it = _pumps.find(channel);
+
+  if (it == _pumps.end()) {
+    return;
+  }
+
+  char buf[PUMP_CHUNK_SIZE];
+  while (true) {
+    ssize_t n = read(it->second.fd, buf, sizeof(buf));
+    if (n > 0) {
+      sendFrame(channel, buf, n);
+      continue;
+    }
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1 && errno == EAGAIN) {
+      return;
+    }
+
+    // The event loop closed its end of the channel.
+    sendFrame(channel, NULL, 0);
+    closePump(channel);
+    return;
+  }
+}
+
+void
+ProxyLink::closePump(uint32_t channel)
+{
+  map<uint32_t, Pump>::iterator it = _pumps.find(channel);
+
+  if (it != _pumps.end()) {
+    close(it->second.fd);
+    _pumps.erase(it);
+  }
+}
+
+bool
+ProxyLink::isThrottled() const
+{
+  map<uint32_t, Pump>::const_iterator it;
+
+  for (it = _pumps.begin(); it != _pumps.end(); it++) {
+    if (it->second.pending.size() >= NODEPROXY_MAX_PENDING) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+ProxyLink::isPumpIdle(uint32_t channel) const
+{
+  map<uint32_t, Pump>::const_iterator it = _pumps.find(channel);
+
+  if (it == _pumps.end()) {
+    return true;
+  }
+  if (!it->second.pending.empty()) {
+    return false;
+  }
+
+  // SIOCOUTQ on a unix socket counts the bytes the peer has not read yet.
+  int unread = 0;
+  if (ioctl(it->second.fd, SIOCOUTQ, &unread) == -1) {
+    return true;
+  }
+  return unread == 0;
+}
+
+void
+ProxyLink::flushDeferred()
+{
+  // Aggregated messages must not overtake what the same workers sent
+  // before them on their own channels, so hold them until the event loop
+  // has read everything already queued on those channels.  Reads by the
+  // event loop raise no event here; while something is held, it signals
+  // _wakeFd instead (see channelRead()).
+  __atomic_store_n(&_drainWanted, !_deferred.empty(), __ATOMIC_SEQ_CST);
+  while (!_deferred.empty()) {
+    Event &ev = _deferred.front();
+    for (size_t i = 0; i < ev.arrivals.size(); i++) {
+      if (!isPumpIdle(ev.arrivals[i].channel)) {
+        return;
+      }
+    }
+    for (size_t i = 0; i < ev.filenames.size(); i++) {
+      if (!isPumpIdle(ev.filenames[i].channel)) {
+        return;
+      }
+    }
+
+    pushEvent(ev);
+    _deferred.pop_front();
+  }
+  __atomic_store_n(&_drainWanted, 0, __ATOMIC_SEQ_CST);
+}
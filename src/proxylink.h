@@ -0,0 +1,150 @@
+/****************************************************************************
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#ifndef PROXYLINK_H
+#define PROXYLINK_H
+
+#include <pthread.h>
+#include <sys/socket.h>
+#include "../jalib/jsocket.h"
+#include "dmtcpalloc.h"
+#include "dmtcpmessagetypes.h"
+#include "nodeproxy.h"
+
+namespace dmtcp
+{
+class CoordClient;
+
+/*
+ * Coordinator end of a connection from a dmtcp_nodeproxy (see nodeproxy.h).
+ *
+ * A helper thread demultiplexes the proxy's channels onto socketpairs, so
+ * that the coordinator's event loop sees each proxied process as an
+ * ordinary CoordClient with its own socket.  Only the traffic that the
+ * proxy aggregates (barrier arrivals, checkpoint filenames and broadcasts)
+ * bypasses those sockets; it is exchanged with the event loop through
+ * nextEvent() and broadcast().
+ */
+class ProxyLink
+{
+  public:
+    enum EventType {
+      NEW_CHANNEL,   // fd is the coordinator end of the channel's socketpair
+      BARRIER,       // all listed channels have reached barrier
+      CKPT_FILENAMES,  // the listed channels' checkpoint filenames
+      CLOSED         // the proxy went away; no more events will follow
+    };
+
+    struct CkptFilename {
+      uint32_t channel;
+      DmtcpMessageType type;
+      string data;   // extra data of the DMT_CKPT_FILENAME message
+    };
+
+    struct Event {
+      EventType type;
+      uint32_t channel;
+      int fd;
+      string barrier;
+      vector<NodeProxyArrival> arrivals;
+      vector<CkptFilename> filenames;
+    };
+
+    ProxyLink(const jalib::JSocket &sock,
+              const struct sockaddr_storage *addr,
+              socklen_t len);
+    ~ProxyLink();
+
+    void start();
+    void join();
+
+    // Readable whenever nextEvent() has something to return.
+    int eventFd() const { return _eventFd; }
+    bool nextEvent(Event *ev);
+
+    // The event loop has read a message from one of this link's channels.
+    void channelRead();
+
+    // Deliver msg (followed by extraBytes of extraData) to each channel.
+    void broadcast(const DmtcpMessage &msg,
+                   const void *extraData,
+                   const vector<uint32_t> &channels);
+
+    const struct sockaddr_storage *addr() const { return &_addr; }
+
+    socklen_t addrLen() const { return _addrLen; }
+
+    // Bookkeeping for the event loop; not touched by the helper thread.
+    CoordClient *client(uint32_t channel) const;
+    void addClient(uint32_t channel, CoordClient *client);
+    void removeClient(uint32_t channel);
+    size_t numClients() const { return _clients.size(); }
+
+    bool isClosed() const { return _closed; }
+
+  private:
+    struct Pump {
+      int fd;
+      string pending;
+      bool closing;
+    };
+
+    static void *demuxThread(void *arg);
+    void demux();
+    bool readFrame();
+    void readControl(const string &payload);
+    void readBroadcast();
+    void sendFrame(uint32_t channel, const void *buf, size_t len);
+    void writeToPump(uint32_t channel, const char *buf, size_t len);
+    void flushPump(uint32_t channel);
+    void drainPump(uint32_t channel);
+    void closePump(uint32_t channel);
+    bool isPumpIdle(uint32_t channel) const;
+    bool isThrottled() const;
+    void flushDeferred();
+    void pushEvent(const Event &ev);
+
+    jalib::JSocket _sock;
+    struct sockaddr_storage _addr;
+    socklen_t _addrLen;
+    pthread_t _thread;
+    bool _started;
+    bool _closed;
+
+    // Event loop -> helper thread: DMT_PROXY_BROADCAST records.
+    int _ctrlFds[2];
+
+    // Event loop -> helper thread: a channel was read while _drainWanted.
+    int _wakeFd;
+    int _drainWanted;
+
+    // Helper thread -> event loop.
+    int _eventFd;
+    pthread_mutex_t _eventLock;
+    list<Event> _events;
+
+    // Owned by the helper thread.
+    uint32_t _lastChannel;
+    map<uint32_t, Pump> _pumps;
+    list<Event> _deferred;   // BARRIER and CKPT_FILENAMES events
+
+    // Owned by the event loop.
+    map<uint32_t, CoordClient *> _clients;
+};
+}
+#endif // ifndef PROXYLINK_H
@@ -26,11 +26,14 @@
 #include <string>
 
 #include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 
+#include <sys/eventfd.h>
 #include <sys/stat.h>
 
 #include "constants.h"
+#include "util.h"
 
 #include "jassert.h"
 #include "jfilesystem.h"
@@ -337,28 +340,64 @@ static const char *multiHostProcessing =
   "wait\n"
 ;
 
-string
-writeScript(const string &ckptDir,
-            bool uniqueCkptFilenames,
-            const time_t &ckptTimeStamp,
-            const uint32_t theCheckpointInterval,
-            const int thePort,
-            const UniquePid &compId,
-            const map<string, vector<string> > &restartFilenames,
-            const map<string, vector<string> >& rshCmdFileNames,
-            const map<string, vector<string> >& sshCmdFileNames)
+// Path of the restart script (or manifest) without the extension.
+static string
+uniqueBasename(const ScriptInfo &info)
 {
   ostringstream o;
-  string uniqueFilename;
 
-  o << string(ckptDir) << "/"
-    << RESTART_SCRIPT_BASENAME << "_" << compId;
-  if (uniqueCkptFilenames) {
+  o << info.ckptDir << "/" << RESTART_SCRIPT_BASENAME << "_" << info.compId;
+  if (info.uniqueCkptFilenames) {
     o << "_" << std::setw(5) << std::setfill('0') <<
-        compId.computationGeneration();
+        info.compId.computationGeneration();
+  }
+  return o.str();
+}
+
+// Create a symlink from <dir>/<filename> -> uniqueFilename.
+static void
+linkLatest(const string &uniqueFilename, const string &filename)
+{
+  string dirname = jalib::Filesystem::DirName(uniqueFilename);
+  int dirfd = open(dirname.c_str(), O_DIRECTORY | O_RDONLY);
+  JASSERT(dirfd != -1) (dirname) (JASSERT_ERRNO);
+
+  unlinkat(dirfd, filename.c_str(), 0);
+  JTRACE("linking filename to uniqueFilename")
+    (filename) (dirname) (uniqueFilename);
+
+  // FIXME:  Handle error case of symlink()
+  JWARNING(symlinkat(basename(uniqueFilename.c_str()), dirfd,
+                     filename.c_str()) == 0) (JASSERT_ERRNO);
+  JASSERT(close(dirfd) == 0);
+}
+
+string
+writeScript(const ScriptInfo &info)
+{
+  const string uniqueFilename = uniqueBasename(info) + "." RESTART_SCRIPT_EXT;
+  const time_t &ckptTimeStamp = info.ckptTimeStamp;
+  const uint32_t theCheckpointInterval = info.checkpointInterval;
+  const int thePort = info.port;
+
+  // Group the checkpoint images by host and by the remote shell used to
+  // launch them.
+  map<string, vector<string> > restartFilenames;
+  map<string, vector<string> > rshCmdFileNames;
+  map<string, vector<string> > sshCmdFileNames;
+  vector<CkptFile>::const_iterator f;
+  for (f = info.files.begin(); f != info.files.end(); f++) {
+    if (f->shellType.empty()) {
+      restartFilenames[f->hostname].push_back(f->filename);
+    } else if (f->shellType == "rsh") {
+      rshCmdFileNames[f->hostname].push_back(f->filename);
+    } else if (f->shellType == "ssh") {
+      sshCmdFileNames[f->hostname].push_back(f->filename);
+    } else {
+      JASSERT(0) (f->shellType)
+        .Text("Shell command not supported. Report this to DMTCP community.");
+    }
   }
-  o << "." << RESTART_SCRIPT_EXT;
-  uniqueFilename = o.str();
 
   const bool isSingleHost = ((rshCmdFileNames.size() == 0) && (sshCmdFileNames.size() == 0) && (restartFilenames.size() == 1));
 
@@ -587,29 +626,155 @@ writeScript(const string &ckptDir,
   }
 
   fclose(fp);
-  {
-    string filename = RESTART_SCRIPT_BASENAME "." RESTART_SCRIPT_EXT;
-    string dirname = jalib::Filesystem::DirName(uniqueFilename);
-    int dirfd = open(dirname.c_str(), O_DIRECTORY | O_RDONLY);
-    JASSERT(dirfd != -1) (dirname) (JASSERT_ERRNO);
-
-    /* Set execute permission for user. */
-    struct stat buf;
-    JASSERT(::stat(uniqueFilename.c_str(), &buf) == 0);
-    JASSERT(chmod(uniqueFilename.c_str(), buf.st_mode | S_IXUSR) == 0);
-
-    // Create a symlink from
-    // dmtcp_restart_script.sh -> dmtcp_restart_script_<curCompId>.sh
-    unlink(filename.c_str());
-    JTRACE("linking \"dmtcp_restart_script.sh\" filename to uniqueFilename")
-      (filename) (dirname) (uniqueFilename);
-
-    // FIXME:  Handle error case of symlink()
-    JWARNING(symlinkat(basename(uniqueFilename.c_str()), dirfd,
-                       filename.c_str()) == 0) (JASSERT_ERRNO);
-    JASSERT(close(dirfd) == 0);
+
+  /* Set execute permission for user. */
+  struct stat buf;
+  JASSERT(::stat(uniqueFilename.c_str(), &buf) == 0);
+  JASSERT(chmod(uniqueFilename.c_str(), buf.st_mode | S_IXUSR) == 0);
+
+  // dmtcp_restart_script.sh -> dmtcp_restart_script_<curCompId>.sh
+  linkLatest(uniqueFilename, RESTART_SCRIPT_BASENAME "." RESTART_SCRIPT_EXT);
+  return uniqueFilename;
+}
+
+static string
+jsonString(const string &s)
+{
+  string o = "\"";
+
+  for (size_t i = 0; i < s.length(); i++) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\') {
+      o += '\\';
+      o += c;
+    } else if (c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      o += buf;
+    } else {
+      o += c;
+    }
   }
+  return o + "\"";
+}
+
+string
+writeManifest(const ScriptInfo &info, const string &scriptPath)
+{
+  const string uniqueFilename = uniqueBasename(info) + "." RESTART_MANIFEST_EXT;
+  const string tmpFilename = uniqueFilename + ".tmp";
+  char hostname[80];
+
+  gethostname(hostname, sizeof(hostname));
+  hostname[sizeof(hostname) - 1] = '\0';
+
+  // Same grouping as in the restart script, but keep the remote shell with
+  // each host instead of picking a default for it.
+  map<std::pair<string, string>, vector<string> > hosts;
+  vector<CkptFile>::const_iterator f;
+  for (f = info.files.begin(); f != info.files.end(); f++) {
+    hosts[std::make_pair(f->hostname, f->shellType)].push_back(f->filename);
+  }
+
+  ostringstream o;
+  o << "{\n"
+    << "  \"computation\": " << jsonString(info.compId.toString()) << ",\n"
+    << "  \"generation\": " << info.compId.computationGeneration() << ",\n"
+    << "  \"timestamp\": " << (long)info.ckptTimeStamp << ",\n"
+    << "  \"coordinator\": { \"host\": " << jsonString(hostname)
+    << ", \"port\": " << info.port << " },\n"
+    << "  \"checkpointInterval\": " << info.checkpointInterval << ",\n"
+    << "  \"restartScript\": " << jsonString(scriptPath) << ",\n"
+    << "  \"numProcesses\": " << info.files.size() << ",\n"
+    << "  \"hosts\": [";
+
+  map<std::pair<string, string>, vector<string> >::const_iterator host;
+  for (host = hosts.begin(); host != hosts.end(); host++) {
+    o << (host == hosts.begin() ? "\n" : ",\n")
+      << "    { \"name\": " << jsonString(host->first.first)
+      << ", \"remoteShell\": " << jsonString(host->first.second)
+      << ",\n      \"images\": [";
+    for (size_t i = 0; i < host->second.size(); i++) {
+      o << (i == 0 ? "\n" : ",\n")
+        << "        " << jsonString(host->second[i]);
+    }
+    o << "\n      ] }";
+  }
+  o << "\n  ]\n}\n";
+
+  // Write to a temporary file first, so that readers never see a partial
+  // manifest.
+  int fd = open(tmpFilename.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  JASSERT(fd != -1) (tmpFilename) (JASSERT_ERRNO);
+  string json = o.str();
+  JASSERT(Util::writeAll(fd, json.data(), json.length()) ==
+          (ssize_t)json.length()) (tmpFilename) (JASSERT_ERRNO);
+  JASSERT(close(fd) == 0) (JASSERT_ERRNO);
+  JASSERT(rename(tmpFilename.c_str(), uniqueFilename.c_str()) == 0)
+    (tmpFilename) (uniqueFilename) (JASSERT_ERRNO);
+
+  // dmtcp_restart_script.json -> dmtcp_restart_script_<curCompId>.json
+  linkLatest(uniqueFilename,
+             RESTART_SCRIPT_BASENAME "." RESTART_MANIFEST_EXT);
   return uniqueFilename;
 }
+
+AsyncWriter::AsyncWriter()
+  : _busy(false)
+{
+  _eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  JASSERT(_eventFd != -1) (JASSERT_ERRNO);
+}
+
+AsyncWriter::~AsyncWriter()
+{
+  wait();
+  close(_eventFd);
+}
+
+void
+AsyncWriter::start(const ScriptInfo &info)
+{
+  sigset_t all, old;
+
+  wait();
+  _info = info;
+  _scriptPath.clear();
+
+  // Leave SIGINT to the coordinator's main thread.
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  JASSERT(pthread_create(&_thread, NULL, run, this) == 0) (JASSERT_ERRNO);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  _busy = true;
+}
+
+string
+AsyncWriter::wait()
+{
+  if (_busy) {
+    uint64_t count;
+    pthread_join(_thread, NULL);
+    _busy = false;
+    // Consume the notification; the job is over either way.
+    if (read(_eventFd, &count, sizeof(count)) == -1) {
+      JASSERT(errno == EAGAIN || errno == EINTR) (JASSERT_ERRNO);
+    }
+  }
+  return _scriptPath;
+}
+
+void *
+AsyncWriter::run(void *arg)
+{
+  AsyncWriter *writer = (AsyncWriter *)arg;
+  uint64_t one = 1;
+
+  writer->_scriptPath = writeScript(writer->_info);
+  writeManifest(writer->_info, writer->_scriptPath);
+  JASSERT(write(writer->_eventFd, &one, sizeof(one)) == sizeof(one))
+    (JASSERT_ERRNO);
+  return NULL;
+}
 } // namespace dmtcp {
 } // namespace RestartScript {
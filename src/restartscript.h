@@ -22,6 +22,7 @@
 #ifndef __RESTART_SCRIPT_H__
 #define __RESTART_SCRIPT_H__
 
+#include <pthread.h>
 #include <time.h>
 
 #include "dmtcpalloc.h"
@@ -31,15 +32,58 @@ namespace dmtcp
 {
 namespace RestartScript
 {
-string writeScript(const string &ckptDir,
-                   bool uniqueCkptFilenames,
-                   const time_t &ckptTimeStamp,
-                   const uint32_t theCheckpointInterval,
-                   const int thePort,
-                   const UniquePid &compId,
-                   const map<string, vector<string> > &restartFilenames,
-                   const map<string, vector<string> >& rshFilenames,
-                   const map<string, vector<string> >& sshFilenames);
+struct CkptFile {
+  string filename;
+  string hostname;
+  string shellType;   // "", "rsh" or "ssh"
+};
+
+// Everything needed to describe one checkpoint of the computation.
+struct ScriptInfo {
+  string ckptDir;
+  bool uniqueCkptFilenames;
+  time_t ckptTimeStamp;
+  uint32_t checkpointInterval;
+  int port;
+  UniquePid compId;
+  vector<CkptFile> files;
+};
+
+string writeScript(const ScriptInfo &info);
+
+// Writes the same information as a JSON manifest, for tools that would
+// otherwise have to parse the restart script.
+string writeManifest(const ScriptInfo &info, const string &scriptPath);
+
+/*
+ * Runs writeScript() and writeManifest() on a helper thread, so that the
+ * coordinator's event loop is not held up by them on large computations.
+ */
+class AsyncWriter
+{
+  public:
+    AsyncWriter();
+    ~AsyncWriter();
+
+    // Readable once the job passed to start() is done.
+    int eventFd() const { return _eventFd; }
+
+    bool isBusy() const { return _busy; }
+
+    void start(const ScriptInfo &info);
+
+    // Waits for the current job and returns the restart script's path.
+    string wait();
+
+  private:
+    static void *run(void *arg);
+
+    ScriptInfo _info;
+    string _scriptPath;
+    pthread_t _thread;
+    bool _busy;
+    int _eventFd;
+};
 } // namespace dmtcp {
 } // namespace RestartScript {
 #endif // #ifndef __RESTART_SCRIPT_H__
@@ -242,6 +242,7 @@ void
 ThreadList::threadExit()
 {
   curThread->state = ST_ZOMBIE;
+  jassert_internal::trace_thread_exit();
 }
 
 /*****************************************************************************
@@ -21,6 +21,8 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -58,6 +60,21 @@ using namespace dmtcp;
  *
  * XXX: Currently this security is provided only for the clone wrapper; this
  * should be extended to other calls as well.           -- KAPIL
+ *
+ * Fast path for readers:
+ *   Taking the read lock writes to the lock word shared by all threads, which
+ *   is costly for hot wrappers like malloc/free.  Instead, a reader normally
+ *   just sets the inCriticalSection flag in its own FastPathSlot, and then
+ *   checks _fastPathBlocked.  A writer (the ckpt thread, or a thread taking
+ *   the lock in exclusive mode), after acquiring the write lock, increments
+ *   _fastPathBlocked and waits until no other slot has its flag set.
+ *   Readers that see _fastPathBlocked fall back to the read lock.
+ *
+ *   Both sides store first and load second, so each needs a full barrier in
+ *   between.  Where the kernel supports it, the writer issues
+ *   membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED), which executes a barrier
+ *   on every running thread of the process, and the reader gets away with a
+ *   compiler barrier.
  */
 
 // NOTE: PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP is not POSIX.
@@ -79,6 +96,26 @@ static bool _checkpointThreadInitialized = false;
 
 static DmtcpMutex preResumeThreadCountLock = DMTCP_MUTEX_INITIALIZER;
 
+#ifndef MEMBARRIER_CMD_PRIVATE_EXPEDITED
+# define MEMBARRIER_CMD_PRIVATE_EXPEDITED          (1 << 3)
+# define MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED (1 << 4)
+#endif // ifndef MEMBARRIER_CMD_PRIVATE_EXPEDITED
+
+#define MAX_FAST_PATH_SLOTS 4096
+
+// One per thread, each in its own cache line.
+typedef struct {
+  volatile int inCriticalSection;
+  pid_t owner;
+} __attribute__((aligned(64))) FastPathSlot;
+
+static FastPathSlot _fastPathSlots[MAX_FAST_PATH_SLOTS];
+static int _numFastPathSlots = 0;
+static volatile int _fastPathBlocked = 0;
+static bool _fastPathUsesMembarrier = false;
+static __thread FastPathSlot *_fastPathSlot = NULL;
+static __thread bool _wrapperExecutionLockHeldExcl = false;
+
 static __thread int _wrapperExecutionLockLockCount = 0;
 static __thread int _threadCreationLockLockCount = 0;
 #if TRACK_DLOPEN_DLSYM_FOR_LOCKS
@@ -87,6 +124,8 @@ static __thread bool _threadPerformingDlopenDlsym = false;
 static __thread bool _isOkToGrabWrapperExecutionLock = true;
 static __thread bool _hasThreadFinishedInitialization = false;
 
+static void releaseFastPathSlot();
+
 
 /* The following two functions dmtcp_libdlLock{Lock,Unlock} are used by dlopen
  * plugin.
@@ -129,6 +168,124 @@ ThreadSync::initMotherOfAll()
 
   initThread();
   _hasThreadFinishedInitialization = true;
+  initFastPath();
+}
+
+/* Called with no thread inside a wrapper: at startup, in the child after
+ * fork, and on restart.  Membarrier registration belongs to the address
+ * space, so it is lost across fork and restart; the kernel on the restart
+ * host may also lack it, in which case readers switch to a full barrier.
+ */
+void
+ThreadSync::initFastPath()
+{
+#ifdef __NR_membarrier
+  _fastPathUsesMembarrier =
+    _real_syscall(__NR_membarrier,
+                  MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+#else // ifdef __NR_membarrier
+  _fastPathUsesMembarrier = false;
+#endif // ifdef __NR_membarrier
+}
+
+static FastPathSlot *
+claimFastPathSlot()
+{
+  pid_t tid = dmtcp_gettid();
+
+  for (int i = 0; i < MAX_FAST_PATH_SLOTS; i++) {
+    if (_fastPathSlots[i].owner == 0 &&
+        __sync_bool_compare_and_swap(&_fastPathSlots[i].owner, 0, tid)) {
+      int n;
+      while ((n = _numFastPathSlots) <= i &&
+             !__sync_bool_compare_and_swap(&_numFastPathSlots, n, i + 1)) {
+      }
+      _fastPathSlot = &_fastPathSlots[i];
+      return _fastPathSlot;
+    }
+  }
+
+  // Out of slots; this thread always uses the read lock.
+  return NULL;
+}
+
+static void
+releaseFastPathSlot()
+{
+  if (_fastPathSlot != NULL) {
+    _fastPathSlot->owner = 0;
+    _fastPathSlot = NULL;
+  }
+}
+
+static bool
+enterFastCriticalSection()
+{
+  FastPathSlot *slot = _fastPathSlot;
+
+  if (slot == NULL && (slot = claimFastPathSlot()) == NULL) {
+    return false;
+  }
+
+  slot->inCriticalSection = 1;
+  if (_fastPathUsesMembarrier) {
+    asm volatile ("" ::: "memory");
+  } else {
+    __sync_synchronize();
+  }
+  if (_fastPathBlocked == 0) {
+    return true;
+  }
+  slot->inCriticalSection = 0;
+  return false;
+}
+
+static bool
+leaveFastCriticalSection()
+{
+  FastPathSlot *slot = _fastPathSlot;
+
+  if (slot == NULL || slot->inCriticalSection == 0) {
+    return false;
+  }
+  __atomic_store_n(&slot->inCriticalSection, 0, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Must be called while holding the write lock.
+static void
+blockFastPath()
+{
+  __sync_fetch_and_add(&_fastPathBlocked, 1);
+
+  bool done = false;
+#ifdef __NR_membarrier
+  if (_fastPathUsesMembarrier) {
+    done = _real_syscall(__NR_membarrier,
+                         MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0) == 0;
+  }
+#endif // ifdef __NR_membarrier
+  if (!done) {
+    // Readers use a full barrier in this case.
+    __sync_synchronize();
+  }
+
+  for (int i = 0; i < _numFastPathSlots; i++) {
+    FastPathSlot *slot = &_fastPathSlots[i];
+    if (slot == _fastPathSlot) {
+      continue;
+    }
+    while (slot->inCriticalSection) {
+      struct timespec sleepTime = { 0, 100 * 1000 };
+      nanosleep(&sleepTime, NULL);
+    }
+  }
+}
+
+static void
+unblockFastPath()
+{
+  __sync_fetch_and_sub(&_fastPathBlocked, 1);
 }
 
 void
@@ -153,6 +310,7 @@ ThreadSync::acquireLocks()
   JTRACE("Waiting for other threads to exit DMTCP-Wrappers");
   JASSERT(DmtcpRWLockWrLock(&_wrapperExecutionLock) == 0);
   _wrapperExecutionLockAcquiredByCkptThread = true;
+  blockFastPath();
 
   JTRACE("Waiting for newly created threads to finish initialization")
     (_uninitializedThreadCount);
@@ -168,6 +326,7 @@ ThreadSync::releaseLocks()
   JASSERT(WorkerState::currentState() == WorkerState::SUSPENDED);
 
   JTRACE("Releasing ThreadSync locks");
+  unblockFastPath();
   JASSERT(DmtcpRWLockUnlock(&_wrapperExecutionLock) == 0);
   _wrapperExecutionLockAcquiredByCkptThread = false;
   JASSERT(DmtcpRWLockUnlock(&_threadCreationLock) == 0);
@@ -201,6 +360,28 @@ ThreadSync::resetLocks()
   _checkpointThreadInitialized = false;
   _wrapperExecutionLockAcquiredByCkptThread = false;
   _threadCreationLockAcquiredByCkptThread = false;
+  _wrapperExecutionLockHeldExcl = false;
+}
+
+// Only for a process with a single thread (the child after fork): all slots
+// but the caller's belong to threads that no longer exist.  Not called at
+// exit, where other threads may still be in wrappers and using their slots.
+void
+ThreadSync::resetFastPath()
+{
+  memset(_fastPathSlots, 0, _numFastPathSlots * sizeof(_fastPathSlots[0]));
+  _numFastPathSlots = 0;
+  _fastPathBlocked = 0;
+  _fastPathSlot = NULL;
+}
+
+// Called by an exiting thread after its last wrapper.
+void
+ThreadSync::threadExiting()
+{
+  unsetOkToGrabLock();
+  releaseFastPathSlot();
+  jalib::JAllocDispatcher::threadExiting();
 }
 
 bool
@@ -348,6 +529,10 @@ ThreadSync::wrapperExecutionLockLock()
         isOkToGrabLock() == true &&
         _wrapperExecutionLockLockCount == 0) {
       incrementWrapperExecutionLockLockCount();
+      if (enterFastCriticalSection()) {
+        lockAcquired = true;
+        break;
+      }
       int retVal = DmtcpRWLockTryRdLock(&_wrapperExecutionLock);
       if (retVal != 0 && retVal == EBUSY) {
         decrementWrapperExecutionLockLockCount();
@@ -426,6 +611,9 @@ ThreadSync::wrapperExecutionLockLockExcl()
     lockAcquired = retVal == 0 ? true : false;
     if (!lockAcquired) {
       decrementWrapperExecutionLockLockCount();
+    } else {
+      blockFastPath();
+      _wrapperExecutionLockHeldExcl = true;
     }
   }
   errno = saved_errno;
@@ -439,6 +627,15 @@ ThreadSync::wrapperExecutionLockUnlock()
 {
   int saved_errno = errno;
 
+  if (_wrapperExecutionLockHeldExcl) {
+    _wrapperExecutionLockHeldExcl = false;
+    unblockFastPath();
+  } else if (leaveFastCriticalSection()) {
+    decrementWrapperExecutionLockLockCount();
+    errno = saved_errno;
+    return;
+  }
+
   if (DmtcpRWLockUnlock(&_wrapperExecutionLock) != 0) {
     fprintf(stderr, "ERROR %s:%d %s: Failed to release lock\n",
             __FILE__, __LINE__, __PRETTY_FUNCTION__);
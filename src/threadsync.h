@@ -57,8 +57,11 @@ namespace ThreadSync
 void acquireLocks();
 void releaseLocks();
 void resetLocks();
+void resetFastPath();
 void initThread();
 void initMotherOfAll();
+void initFastPath();
+void threadExiting();
 
 void destroyDmtcpWorkerLockLock();
 void destroyDmtcpWorkerLockUnlock();
@@ -175,7 +175,7 @@ pthread_start(void *arg)
    */
   PluginManager::eventHook(DMTCP_EVENT_PTHREAD_RETURN, NULL);
   WRAPPER_EXECUTION_ENABLE_CKPT();
-  ThreadSync::unsetOkToGrabLock();
+  ThreadSync::threadExiting();
   return result;
 }
 
@@ -243,7 +243,7 @@ pthread_exit(void *retval)
   ThreadList::threadExit();
   PluginManager::eventHook(DMTCP_EVENT_PTHREAD_EXIT, NULL);
   WRAPPER_EXECUTION_ENABLE_CKPT();
-  ThreadSync::unsetOkToGrabLock();
+  ThreadSync::threadExiting();
   _real_pthread_exit(retval);
   for (;;) { // To hide compiler warning about "noreturn" function
   }
@@ -137,6 +137,10 @@ Util::initializeLogFile(const char *tmpDir,
 
   JASSERT_SET_LOG(o.str(), tmpDir, UniquePid::ThisProcess().toString());
 
+  if (getenv(ENV_VAR_JTRACE_BUFFER_SIZE) != NULL) {
+    JASSERT_SET_TRACE_BUFFER(atol(getenv(ENV_VAR_JTRACE_BUFFER_SIZE)));
+  }
+
   ostringstream a;
   a << "\n========================================";
   a << "\nProcess Information";
@@ -174,6 +174,43 @@ Util::writeAll(int fd, const void *buf, size_t count)
   return num_written;
 }
 
+// Like writeAll(), for the buffers of iov, with as few writev() calls as
+// possible.  The entries of iov are modified.
+ssize_t
+Util::writevAll(int fd, struct iovec *iov, int iovcnt)
+{
+  size_t num_written = 0;
+
+  while (iovcnt > 0 && iov->iov_len == 0) {
+    iov++;
+    iovcnt--;
+  }
+  while (iovcnt > 0) {
+    ssize_t rc = writev(fd, iov, iovcnt);
+    if (rc == -1) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      } else {
+        return rc;
+      }
+    } else if (rc == 0) {
+      break;
+    }
+    num_written += rc;
+    while (iovcnt > 0 && (size_t)rc >= iov->iov_len) {
+      rc -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + rc;
+      iov->iov_len -= rc;
+    }
+  }
+  JASSERT(iovcnt == 0) (num_written) (iovcnt);
+  return num_written;
+}
+
 // Fails, succeeds, or partial read due to EOF (returns num read)
 // return value:
 // -1: unrecoverable error
@@ -29,17 +29,24 @@
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#include <linux/mempolicy.h>
 #include "jassert.h"
+#include "chunkstore.h"
 #include "constants.h"
 #include "dmtcp.h"
 #include "processinfo.h"
 #include "procmapsarea.h"
 #include "procselfmaps.h"
 #include "shareddata.h"
+#include "syscallwrappers.h"
 #include "util.h"
 
 #define DEV_ZERO_DELETED_STR "/dev/zero (deleted)"
 #define DEV_NULL_DELETED_STR "/dev/null (deleted)"
+#define ANON_HUGEPAGE_STR "/anon_hugepage"
 
 /* Shared memory regions for Direct Rendering Infrastructure */
 #define DEV_DRI_SHMEM        "/dev/dri/card"
@@ -50,17 +57,73 @@
 #define _real_open           NEXT_FNC(open)
 #define _real_close          NEXT_FNC(close)
 
+/* Bits of a /proc/self/pagemap entry (see Documentation/vm/pagemap.txt). */
+#define PM_PRESENT           (1ULL << 63)
+#define PM_SWAPPED           (1ULL << 62)
+#define PM_FILE_OR_SHARED    (1ULL << 61)
+#define PM_ENTRIES_PER_READ  512
+
+/* A run of clean pages shorter than this is saved along with the dirty pages
+ * around it, since each area header takes a page in the ckpt image.
+ */
+#define MIN_CLEAN_FILE_PAGES 16
+
+#define SMAPS_BUFFER_SIZE    (64 * 1024)
+#define THP_ENABLED_FILE     "/sys/kernel/mm/transparent_hugepage/enabled"
+#define THP_SIZE_FILE  "/sys/kernel/mm/transparent_hugepage/hpage_pmd_size"
+
+/* The zero pages of an area are found in pieces of this size, or, for areas
+ * with huge pages, in pieces aligned to the huge page size.  The size of a
+ * transparent huge page is read from THP_SIZE_FILE (it is 512 MB on arm64
+ * with 64 KB pages); DEFAULT_THP_GRANULE is used if it can't be read.
+ */
+#define ZERO_PAGE_GRANULE    (1024 * 1024)
+#define DEFAULT_THP_GRANULE  (2 * 1024 * 1024)
+
+/* get_mempolicy() fails unless the node mask has room for all possible
+ * nodes.  The node of a few pages of each part of a DMTCP_NUMA_MAP area is
+ * sampled with move_pages(), NUMA_PAGES_PER_QUERY pages per call.
+ */
+#define NUMA_MAX_NODES           1024
+#define NUMA_MASK_LONGS          (NUMA_MAX_NODES / (8 * sizeof(unsigned long)))
+#define NUMA_SAMPLES_PER_GRANULE 16
+#define NUMA_PAGES_PER_QUERY     1024
+
 using namespace dmtcp;
 
 EXTERNC int dmtcp_infiniband_enabled(void) __attribute__((weak));
 
 static bool skipWritingTextSegments = false;
+static bool skipCleanFilePages = false;
+static int pagemapFd = -1;
+static uint64_t pagemapEntries[PM_ENTRIES_PER_READ];
+static uintptr_t pagemapFirstPage = 0;
+static size_t pagemapNumEntries = 0;
 
 // FIXME:  Why do we create two global variable here?  They should at least
 // be static (file-private), and preferably local to a function.
 ProcSelfMaps *procSelfMaps = NULL;
 vector<ProcMapsArea> *nscdAreas = NULL;
 
+/* An area that /proc/self/smaps reports as using huge pages. */
+struct HugePageRange {
+  VA start;
+  VA end;
+  uint64_t properties;  // DMTCP_HUGE_PAGES, DMTCP_HUGE_PAGE_ADVISED,
+                        // and/or DMTCP_HUGETLB
+  uint64_t pageSize;
+};
+
+static vector<HugePageRange> *hugePageRanges = NULL;
+static char smapsBuf[SMAPS_BUFFER_SIZE];
+static size_t thpGranule = 0;
+
+static bool numaEnabled = false;
+static int numaThreadPolicy = MPOL_DEFAULT;
+static unsigned long numaThreadNodes[NUMA_MASK_LONGS];
+static void *numaPages[NUMA_PAGES_PER_QUERY];
+static int numaStatus[NUMA_PAGES_PER_QUERY];
+
 // FIXME:  If we allocate in the middle of reading
 // /proc/self/maps, we modify the mapping.  But whenever we
 // add to nscdAreas, we risk allocating memory.  So, we're depending
@@ -75,6 +138,13 @@ vector<ProcMapsArea> *nscdAreas = NULL;
 
 // static void sync_shared_mem(void);
 static void writememoryarea(int fd, Area *area, int stack_was_seen);
+static void writeareadata(int fd, Area *area);
+static void write_file_backed_area(int fd, Area *area);
+static bool may_be_hugetlb_area(const ProcMapsArea &area);
+static void read_huge_page_ranges(bool hugetlbMapped);
+static void mark_huge_page_area(Area *area);
+static void init_numa_placement();
+static void record_numa_placement(Area *area);
 
 static void remap_nscd_areas(const vector<ProcMapsArea> &areas);
 
@@ -95,11 +165,23 @@ mtcp_writememoryareas(int fd)
 
   // DeviceInfo dev_info;
   int stack_was_seen = 0;
+  bool hugetlbMapped;
 
   if (getenv(ENV_VAR_SKIP_WRITING_TEXT_SEGMENTS) != NULL) {
     skipWritingTextSegments = true;
   }
 
+  skipCleanFilePages = false;
+  if (getenv(ENV_VAR_SKIP_CLEAN_FILE_PAGES) != NULL) {
+    pagemapFd = _real_open("/proc/self/pagemap", O_RDONLY);
+    if (pagemapFd == -1) {
+      JWARNING(false) (JASSERT_ERRNO)
+      .Text("Can't open /proc/self/pagemap; saving all file-backed pages");
+    } else {
+      skipCleanFilePages = true;
+    }
+  }
+
   JTRACE("Performing checkpoint.");
 
   // Here we want to sync the shared memory pages with the backup files
@@ -119,6 +201,7 @@ mtcp_writememoryareas(int fd)
       nscdAreas = new vector<ProcMapsArea>();
     }
     nscdAreas->clear();
+    hugetlbMapped = false;
 
     // This block is to ensure that the object is deleted as soon as we leave
     // this block.
@@ -136,6 +219,9 @@ mtcp_writememoryareas(int fd)
 
         nscdAreas->push_back(area);
       }
+      if (!hugetlbMapped && may_be_hugetlb_area(area)) {
+        hugetlbMapped = true;
+      }
     }
   }
 
@@ -145,6 +231,9 @@ mtcp_writememoryareas(int fd)
     delete procSelfMaps;
   }
 
+  read_huge_page_ranges(hugetlbMapped);
+  init_numa_placement();
+
   /* Finally comes the memory contents */
   procSelfMaps = new ProcSelfMaps();
   while (procSelfMaps->getNextArea(&area)) {
@@ -243,10 +332,32 @@ mtcp_writememoryareas(int fd)
       JTRACE("saving area as Anonymous") (area.name);
       area.flags = MAP_PRIVATE | MAP_ANONYMOUS;
       area.name[0] = '\0';
+    } else if (Util::strStartsWith(area.name, ANON_HUGEPAGE_STR)) {
+      /* A MAP_SHARED | MAP_ANONYMOUS | MAP_HUGETLB area.  Like
+       * "/dev/zero (deleted)", it is saved as anonymous, so that its zero
+       * pages are elided and mtcp_restart maps it with huge pages again.
+       */
+      JTRACE("saving area as Anonymous") (area.name);
+      area.flags = MAP_PRIVATE | MAP_ANONYMOUS;
+      area.name[0] = '\0';
     } else if (Util::isSysVShmArea(area)) {
       JTRACE("saving area as Anonymous") (area.name);
       area.flags = MAP_PRIVATE | MAP_ANONYMOUS;
       area.name[0] = '\0';
+      int mode;
+      int shmflg;
+      if (dmtcp_svipc_restores_shm_in_place != NULL &&
+          dmtcp_svipc_restores_shm_in_place(area.addr, &mode, &shmflg)) {
+        // Let mtcp_restart create the segment and read the data into it.
+        Area segment = area;
+        segment.properties = DMTCP_SYSV_SHM_SEGMENT;
+        segment.shm_mode = mode;
+        segment.shm_flags = shmflg;
+        mark_huge_page_area(&segment);
+        segment.properties &= DMTCP_SYSV_SHM_SEGMENT | DMTCP_HUGETLB;
+        Util::writeAll(fd, &segment, sizeof(segment));
+        area.properties |= DMTCP_SYSV_SHM_DATA;
+      }
     } else if (Util::isNscdArea(area)) {
       /* Special Case Handling: nscd is enabled*/
       area.prot = PROT_READ | PROT_WRITE;
@@ -286,6 +397,11 @@ mtcp_writememoryareas(int fd)
       stack_was_seen = 1;
     }
 
+    mark_huge_page_area(&area);
+    if (numaEnabled && (area.flags & MAP_ANONYMOUS)) {
+      record_numa_placement(&area);
+    }
+
     // the whole thing comes after the restore image
     writememoryarea(fd, &area, stack_was_seen);
   }
@@ -297,6 +413,13 @@ mtcp_writememoryareas(int fd)
   /* It's now safe to do this, since we're done using writememoryarea() */
   remap_nscd_areas(*nscdAreas);
 
+  ChunkStore::printStats();
+
+  if (pagemapFd != -1) {
+    _real_close(pagemapFd);
+    pagemapFd = -1;
+  }
+
   area.addr = NULL; // End of data
   area.size = -1; // End of data
   Util::writeAll(fd, &area, sizeof(area));
@@ -320,33 +443,34 @@ remap_nscd_areas(const vector<ProcMapsArea> &areas)
 /* This function returns a range of zero or non-zero pages. If the first page
  * is non-zero, it searches for all contiguous non-zero pages and returns them.
  * If the first page is all-zero, it searches for contiguous zero pages and
- * returns them.
+ * returns them.  Pages are looked at in pieces of granule bytes (a power of
+ * two), and a range ends at a multiple of granule or at the end of the area.
  */
 static void
-mtcp_get_next_page_range(Area *area, size_t *size, int *is_zero)
+mtcp_get_next_page_range(Area *area, size_t granule, size_t *size,
+                         int *is_zero)
 {
   char *pg;
   char *prevAddr;
+  char *end = area->addr + area->size;
   size_t count = 0;
-  const size_t one_MB = (1024 * 1024);
 
-  if (area->size < one_MB) {
+  if (area->size < granule) {
     *size = area->size;
     *is_zero = 0;
     return;
   }
-  *size = one_MB;
-  *is_zero = Util::areZeroPages(area->addr, one_MB / MTCP_PAGE_SIZE);
+  pg = (char *)(((uintptr_t)area->addr + granule) & ~(granule - 1));
+  *size = MIN(pg, end) - area->addr;
+  *is_zero = Util::areZeroPages(area->addr, *size / MTCP_PAGE_SIZE);
   prevAddr = area->addr;
-  for (pg = area->addr + one_MB;
-       pg < area->addr + area->size;
-       pg += one_MB) {
-    size_t minsize = MIN(one_MB, (size_t)(area->addr + area->size - pg));
+  for (; pg < end; pg += granule) {
+    size_t minsize = MIN(granule, (size_t)(end - pg));
     if (*is_zero != Util::areZeroPages(pg, minsize / MTCP_PAGE_SIZE)) {
       break;
     }
     *size += minsize;
-    if (*is_zero && ++count % 10 == 0) { // madvise every 10MB
+    if (*is_zero && ++count % 10 == 0) { // madvise every 10 pieces
       if (madvise(prevAddr, area->addr + *size - prevAddr,
                   MADV_DONTNEED) == -1) {
         JNOTE("error doing madvise(..., MADV_DONTNEED)")
@@ -386,6 +510,16 @@ mtcp_write_non_rwx_and_anonymous_pages(int fd, Area *orig_area)
     .Text("error adding PROT_READ to mem region");
   }
 
+  /* Keep the pieces of a huge page area huge page aligned, so that
+   * mtcp_restart can map each of them with huge pages again.
+   */
+  size_t granule = ZERO_PAGE_GRANULE;
+  if (area.properties & DMTCP_HUGETLB) {
+    granule = MAX(area.huge_page_size, (uint64_t)thpGranule);
+  } else if (area.properties & DMTCP_HUGE_PAGES) {
+    granule = thpGranule;
+  }
+
   while (area.size > 0) {
     size_t size;
     int is_zero;
@@ -394,16 +528,19 @@ mtcp_write_non_rwx_and_anonymous_pages(int fd, Area *orig_area)
       size = area.size;
       is_zero = 0;
     } else {
-      mtcp_get_next_page_range(&a, &size, &is_zero);
+      mtcp_get_next_page_range(&a, granule, &size, &is_zero);
     }
 
-    a.properties = is_zero ? DMTCP_ZERO_PAGE : 0;
+    a.properties = (area.properties &
+                    (DMTCP_SYSV_SHM_DATA | DMTCP_NUMA_MAP | DMTCP_HUGE_PAGES |
+                     DMTCP_HUGE_PAGE_ADVISED | DMTCP_HUGETLB)) |
+                   (is_zero ? DMTCP_ZERO_PAGE : 0);
     a.size = size;
 
-    Util::writeAll(fd, &a, sizeof(a));
     if (!is_zero) {
-      Util::writeAll(fd, a.addr, a.size);
+      writeareadata(fd, &a);
     } else {
+      Util::writeAll(fd, &a, sizeof(a));
       if (madvise(a.addr, a.size, MADV_DONTNEED) == -1) {
         JNOTE("error doing madvise(..., MADV_DONTNEED)")
           (JASSERT_ERRNO) (a.addr) ((int)a.size);
@@ -481,6 +618,15 @@ writememoryarea(int fd, Area *area, int stack_was_seen)
     //  and not to trust the kernel's "[vdso]" label.
     JTRACE("skipping vDSO special section")
       (area->name) (addr) (area->size);
+  } else if ((area->properties & (DMTCP_HUGE_PAGES | DMTCP_HUGETLB)) &&
+             (area->prot & PROT_READ) &&
+             (area->flags & MAP_ANONYMOUS) &&
+             area->name[0] != '\0') {
+    /* Keep named huge page areas (e.g., the heap) in one piece, so that
+     * mtcp_restart can map all of it with huge pages before reading the data
+     * back in.  Unnamed ones have their zero pages elided below.
+     */
+    writeareadata(fd, area);
   } else if (area->prot == 0 ||
              (area->name[0] == '\0' &&
               ((area->flags & MAP_ANONYMOUS) != 0) &&
@@ -502,9 +648,488 @@ writememoryarea(int fd, Area *area, int stack_was_seen)
       area->properties |= DMTCP_SKIP_WRITING_TEXT_SEGMENTS;
       Util::writeAll(fd, area, sizeof(*area));
       JTRACE("Skipping over text segments") (area->name) ((void *)area->addr);
+    } else if (skipCleanFilePages &&
+               (area->flags & MAP_PRIVATE) &&
+               area->name[0] == '/' &&
+               !Util::strEndsWith(area->name, DELETED_FILE_SUFFIX)) {
+      write_file_backed_area(fd, area);
     } else {
-      Util::writeAll(fd, area, sizeof(*area));
-      Util::writeAll(fd, area->addr, area->size);
+      writeareadata(fd, area);
+    }
+  }
+}
+
+/* Write the area header followed by its contents. */
+static void
+writeareadata(int fd, Area *area)
+{
+  if (ChunkStore::isEnabled()) {
+    ChunkStore::writeArea(fd, area);
+  } else {
+    Util::writeAll(fd, area, sizeof(*area));
+    Util::writeAll(fd, area->addr, area->size);
+  }
+}
+
+static bool
+read_pagemap_entry(VA page, uint64_t *entry)
+{
+  uintptr_t pageNum = (uintptr_t)page / MTCP_PAGE_SIZE;
+
+  if (pageNum < pagemapFirstPage ||
+      pageNum >= pagemapFirstPage + pagemapNumEntries) {
+    ssize_t rc = pread(pagemapFd, pagemapEntries, sizeof(pagemapEntries),
+                       pageNum * sizeof(pagemapEntries[0]));
+    if (rc < (ssize_t)sizeof(pagemapEntries[0])) {
+      pagemapNumEntries = 0;
+      return false;
+    }
+    pagemapFirstPage = pageNum;
+    pagemapNumEntries = rc / sizeof(pagemapEntries[0]);
+  }
+
+  *entry = pagemapEntries[pageNum - pagemapFirstPage];
+  return true;
+}
+
+/* A page of a private file mapping is dirty if it has been replaced by a
+ * private (anonymous) copy, i.e., it is present but not in the page cache, or
+ * it has been swapped out.  Pages that were never touched, or only read, are
+ * still identical to the file contents.
+ */
+static int
+is_page_dirty(VA page)
+{
+  uint64_t entry;
+
+  if (!read_pagemap_entry(page, &entry)) {
+    return 1;
+  }
+  return (entry & PM_SWAPPED) ||
+         ((entry & PM_PRESENT) && !(entry & PM_FILE_OR_SHARED));
+}
+
+/* Returns the size of the next run of dirty or clean pages in [start, end).
+ * Runs of fewer than MIN_CLEAN_FILE_PAGES clean pages are folded into the
+ * dirty run.
+ */
+static size_t
+get_next_file_page_range(VA start, VA end, int *is_dirty)
+{
+  VA page = start;
+  VA cleanStart = NULL;
+
+  if (!is_page_dirty(start)) {
+    while (page < end && !is_page_dirty(page)) {
+      page += MTCP_PAGE_SIZE;
+    }
+    if (page == end ||
+        (size_t)(page - start) >= MIN_CLEAN_FILE_PAGES * MTCP_PAGE_SIZE) {
+      *is_dirty = 0;
+      return page - start;
+    }
+  }
+
+  *is_dirty = 1;
+  for (; page < end; page += MTCP_PAGE_SIZE) {
+    if (is_page_dirty(page)) {
+      cleanStart = NULL;
+    } else {
+      if (cleanStart == NULL) {
+        cleanStart = page;
+      }
+      if ((size_t)(page + MTCP_PAGE_SIZE - cleanStart) >=
+          MIN_CLEAN_FILE_PAGES * MTCP_PAGE_SIZE) {
+        return cleanStart - start;
+      }
+    }
+  }
+  return end - start;
+}
+
+/* Parse one line of /proc/self/smaps into cur.  A line that starts a new
+ * area ends the previous one, which is recorded if it uses huge pages.
+ */
+static void
+parse_smaps_line(const char *line, HugePageRange *cur)
+{
+  char *end;
+  unsigned long start = strtoul(line, &end, 16);
+
+  if (*end == '-') {
+    if (cur->properties != 0) {
+      hugePageRanges->push_back(*cur);
+    }
+    cur->start = (VA)start;
+    cur->end = (VA)strtoul(end + 1, NULL, 16);
+    cur->properties = 0;
+    cur->pageSize = 0;
+  } else if (Util::strStartsWith(line, "KernelPageSize:")) {
+    cur->pageSize = strtoull(line + strlen("KernelPageSize:"), NULL, 10) * 1024;
+  } else if (Util::strStartsWith(line, "AnonHugePages:")) {
+    if (strtoull(line + strlen("AnonHugePages:"), NULL, 10) > 0) {
+      cur->properties |= DMTCP_HUGE_PAGES;
+    }
+  } else if (Util::strStartsWith(line, "VmFlags:")) {
+    // Two-letter flags, each preceded by a space.
+    for (const char *flag = strchr(line, ' '); flag != NULL;
+         flag = strchr(flag + 1, ' ')) {
+      if (strncmp(flag, " hg", 3) == 0) {
+        cur->properties |= DMTCP_HUGE_PAGES | DMTCP_HUGE_PAGE_ADVISED;
+      } else if (strncmp(flag, " ht", 3) == 0) {
+        cur->properties |= DMTCP_HUGETLB;
+      }
+    }
+  }
+}
+
+/* Returns true if the area may be mapped from hugetlbfs.  Only
+ * /proc/self/smaps tells for sure; shared memory and deleted files are
+ * assumed to be.
+ */
+static bool
+may_be_hugetlb_area(const ProcMapsArea &area)
+{
+  struct statfs fs;
+
+  if (area.name[0] != '/' ||
+      Util::strStartsWith(area.name, DEV_ZERO_DELETED_STR) ||
+      Util::strStartsWith(area.name, DEV_NULL_DELETED_STR)) {
+    return false;
+  }
+  if (Util::isSysVShmArea(area) ||
+      Util::strEndsWith(area.name, DELETED_FILE_SUFFIX)) {
+    return true;
+  }
+  return _real_syscall(SYS_statfs, area.name, &fs) == 0 &&
+         fs.f_type == HUGETLBFS_MAGIC;
+}
+
+/* Returns true if transparent huge pages are enabled, even if only for
+ * madvise()d areas.
+ */
+static bool
+thp_enabled()
+{
+  char buf[128];
+  int fd = _real_open(THP_ENABLED_FILE, O_RDONLY);
+
+  if (fd == -1) {
+    return false;
+  }
+  ssize_t len = Util::readAll(fd, buf, sizeof(buf) - 1);
+  _real_close(fd);
+  if (len <= 0) {
+    return true;
+  }
+  buf[len] = '\0';
+  return strstr(buf, "[never]") == NULL;
+}
+
+static size_t
+read_thp_size()
+{
+  char buf[64];
+  int fd = _real_open(THP_SIZE_FILE, O_RDONLY);
+
+  if (fd == -1) {
+    return DEFAULT_THP_GRANULE;
+  }
+  ssize_t len = Util::readAll(fd, buf, sizeof(buf) - 1);
+  _real_close(fd);
+  if (len <= 0) {
+    return DEFAULT_THP_GRANULE;
+  }
+  buf[len] = '\0';
+  unsigned long long size = strtoull(buf, NULL, 10);
+  if (size == 0 || (size & (size - 1)) != 0) {
+    return DEFAULT_THP_GRANULE;
+  }
+  return size;
+}
+
+/* Collect the areas that use transparent huge pages or hugetlbfs.  Only
+ * /proc/self/smaps has this information; it is read once per checkpoint,
+ * before /proc/self/maps, since it may allocate.  Reading it costs time in
+ * proportion to the memory of the process, so it is skipped if there can be
+ * no huge pages.
+ */
+static void
+read_huge_page_ranges(bool hugetlbMapped)
+{
+  if (hugePageRanges == NULL) {
+    hugePageRanges = new vector<HugePageRange>();
+  }
+  hugePageRanges->clear();
+  if (thpGranule == 0) {
+    thpGranule = read_thp_size();
+  }
+
+  if (!hugetlbMapped && !thp_enabled()) {
+    JTRACE("No huge pages possible; not reading /proc/self/smaps");
+    return;
+  }
+
+  int fd = _real_open("/proc/self/smaps", O_RDONLY);
+  if (fd == -1) {
+    JTRACE("Can't open /proc/self/smaps; not saving huge page state")
+      (JASSERT_ERRNO);
+    return;
+  }
+
+  HugePageRange cur;
+  memset(&cur, 0, sizeof(cur));
+  size_t len = 0;
+  while (1) {
+    ssize_t rc = read(fd, smapsBuf + len, sizeof(smapsBuf) - len);
+    if (rc == -1 && errno == EINTR) {
+      continue;
+    }
+    if (rc <= 0) {
+      break;
+    }
+    len += rc;
+
+    char *line = smapsBuf;
+    char *eol;
+    while ((eol = (char *)memchr(line, '\n', smapsBuf + len - line)) != NULL) {
+      *eol = '\0';
+      parse_smaps_line(line, &cur);
+      line = eol + 1;
+    }
+    len = smapsBuf + len - line;
+    JASSERT(len < sizeof(smapsBuf)) (len);
+    memmove(smapsBuf, line, len);
+  }
+  if (cur.properties != 0) {
+    hugePageRanges->push_back(cur);
+  }
+  _real_close(fd);
+
+  JTRACE("Areas with huge pages") (hugePageRanges->size());
+}
+
+/* Copy the huge page state of the range that contains area, if any. */
+static void
+mark_huge_page_area(Area *area)
+{
+  size_t lo = 0;
+  size_t hi = hugePageRanges->size();
+
+  // Find the last range that starts at or below area->addr.
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if ((*hugePageRanges)[mid].start <= area->addr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo == 0) {
+    return;
+  }
+
+  const HugePageRange &range = (*hugePageRanges)[lo - 1];
+  if (area->addr < range.end) {
+    area->properties |= range.properties;
+    if (range.properties & DMTCP_HUGETLB) {
+      area->huge_page_size = range.pageSize;
+    }
+    JTRACE("Area uses huge pages")
+      ((void *)area->addr) (area->size) (range.properties) (range.pageSize);
+  }
+}
+
+/* NUMA placement is only recorded if the process may use more than one
+ * node.  The policy of the checkpoint thread is what get_mempolicy() reports
+ * for areas without a policy of their own; see record_numa_placement().
+ */
+static void
+init_numa_placement()
+{
+  unsigned long nodes[NUMA_MASK_LONGS];
+  int numNodes = 0;
+
+  numaEnabled = false;
+  memset(nodes, 0, sizeof(nodes));
+  if (_real_syscall(SYS_get_mempolicy, NULL, nodes, NUMA_MAX_NODES, NULL,
+                    MPOL_F_MEMS_ALLOWED) == -1) {
+    return;
+  }
+  for (size_t i = 0; i < NUMA_MASK_LONGS; i++) {
+    numNodes += __builtin_popcountl(nodes[i]);
+  }
+  if (numNodes < 2) {
+    return;
+  }
+
+  memset(numaThreadNodes, 0, sizeof(numaThreadNodes));
+  if (_real_syscall(SYS_get_mempolicy, &numaThreadPolicy, numaThreadNodes,
+                    NUMA_MAX_NODES, NULL, 0) == -1) {
+    JTRACE("get_mempolicy failed; not saving NUMA placement")
+      (JASSERT_ERRNO);
+    return;
+  }
+  numaEnabled = true;
+  JTRACE("Saving NUMA placement") (numNodes) (numaThreadPolicy);
+}
+
+/* Return the node of most of the n pages whose move_pages() status is given,
+ * or DMTCP_NUMA_NO_NODE if none of them is present.
+ */
+static uint8_t
+majority_node(const int *status, size_t n)
+{
+  int node = DMTCP_NUMA_NO_NODE;
+  size_t best = 0;
+
+  for (size_t i = 0; i < n; i++) {
+    if (status[i] < 0 || status[i] >= 64 || status[i] == node) {
+      continue;
+    }
+    size_t count = 0;
+    for (size_t j = i; j < n; j++) {
+      count += status[j] == status[i];
+    }
+    if (count > best) {
+      best = count;
+      node = status[i];
+    }
+  }
+  return node;
+}
+
+/* Record the memory policy of the area and, in area->numa_map, the node of
+ * each of up to DMTCP_NUMA_MAP_BYTES parts of it.  Only a few pages of each
+ * part are looked at.
+ */
+static void
+record_numa_placement(Area *area)
+{
+  int mode;
+  unsigned long nodes[NUMA_MASK_LONGS];
+  bool hasNode = false;
+
+  area->numa_policy = DMTCP_NUMA_NO_POLICY;
+  memset(nodes, 0, sizeof(nodes));
+  if (_real_syscall(SYS_get_mempolicy, &mode, nodes, NUMA_MAX_NODES,
+                    area->addr, MPOL_F_ADDR) == 0 &&
+      (mode != numaThreadPolicy ||
+       memcmp(nodes, numaThreadNodes, sizeof(nodes)) != 0)) {
+    bool fits = true;
+    for (size_t i = 1; i < NUMA_MASK_LONGS; i++) {
+      fits = fits && nodes[i] == 0;
+    }
+    if (fits) {
+      area->numa_policy = mode;
+      area->numa_nodemask = nodes[0];
+    }
+  }
+
+  size_t numPages = area->size / MTCP_PAGE_SIZE;
+  if (numPages == 0) {
+    return;
+  }
+  size_t pagesPerGranule =
+    (numPages + DMTCP_NUMA_MAP_BYTES - 1) / DMTCP_NUMA_MAP_BYTES;
+  size_t numGranules = (numPages + pagesPerGranule - 1) / pagesPerGranule;
+  size_t samples = MIN(pagesPerGranule, (size_t)NUMA_SAMPLES_PER_GRANULE);
+  size_t granulesPerQuery = NUMA_PAGES_PER_QUERY / samples;
+
+  area->numa_map_start = (uint64_t)area->addr;
+  area->numa_map_granule = pagesPerGranule * MTCP_PAGE_SIZE;
+  memset(area->numa_map, DMTCP_NUMA_NO_NODE, sizeof(area->numa_map));
+
+  for (size_t g = 0; g < numGranules; g += granulesPerQuery) {
+    size_t n = 0;
+    size_t last = MIN(numGranules, g + granulesPerQuery);
+    for (size_t i = g; i < last; i++) {
+      for (size_t j = 0; j < samples; j++) {
+        size_t page = MIN(i * pagesPerGranule + j * pagesPerGranule / samples,
+                          numPages - 1);
+        numaPages[n++] = area->addr + page * MTCP_PAGE_SIZE;
+      }
+    }
+    if (_real_syscall(SYS_move_pages, 0, n, numaPages, NULL, numaStatus,
+                      0) == -1) {
+      JTRACE("move_pages failed; not saving NUMA placement")
+        (JASSERT_ERRNO) ((void *)area->addr) (area->size);
+      break;
+    }
+    for (size_t i = g; i < last; i++) {
+      area->numa_map[i] = majority_node(&numaStatus[(i - g) * samples],
+                                        samples);
+      hasNode = hasNode || area->numa_map[i] != DMTCP_NUMA_NO_NODE;
+    }
+  }
+
+  if (hasNode || area->numa_policy != DMTCP_NUMA_NO_POLICY) {
+    area->properties |= DMTCP_NUMA_MAP;
+  }
+}
+
+/* Record which pages of a clean file-backed area are mapped in, i.e., were
+ * accessed by the process.  On restart, mtcp_restart asks the kernel to read
+ * these parts of the file ahead, while the rest is faulted in on demand.
+ */
+static void
+record_hot_pages(Area *area)
+{
+  size_t numPages = area->size / MTCP_PAGE_SIZE;
+  size_t pagesPerBit = (numPages + DMTCP_HOT_MAP_BYTES * 8 - 1) /
+                       (DMTCP_HOT_MAP_BYTES * 8);
+  uint64_t entry;
+
+  memset(area->hot_map, 0, sizeof(area->hot_map));
+  area->hot_map_granule = pagesPerBit * MTCP_PAGE_SIZE;
+  for (size_t i = 0; i < numPages; i++) {
+    if (read_pagemap_entry(area->addr + i * MTCP_PAGE_SIZE, &entry) &&
+        (entry & PM_PRESENT)) {
+      size_t bit = i / pagesPerBit;
+      area->hot_map[bit / 8] |= 1 << (bit % 8);
+      area->properties |= DMTCP_HOT_MAP;
+    }
+  }
+}
+
+/* Save a private file mapping, leaving out the pages that are unchanged from
+ * the file.  For those, only an area header with DMTCP_FILE_BACKED_PAGES is
+ * written, and mtcp_restart maps them from the file again.  If the file on
+ * disk is no longer the one that is mapped, all pages are saved.
+ */
+static void
+write_file_backed_area(int fd, Area *area)
+{
+  struct stat st;
+
+  if (stat(area->name, &st) != 0 || st.st_ino != area->inodenum) {
+    JTRACE("file replaced since mapping; saving all pages") (area->name);
+    writeareadata(fd, area);
+    return;
+  }
+
+  area->mtime_sec = st.st_mtim.tv_sec;
+  area->mtime_nsec = st.st_mtim.tv_nsec;
+  pagemapNumEntries = 0;
+
+  VA end = area->addr + area->size;
+  for (VA addr = area->addr; addr < end;) {
+    int is_dirty;
+    Area a = *area;
+
+    a.addr = addr;
+    a.size = get_next_file_page_range(addr, end, &is_dirty);
+    a.endAddr = a.addr + a.size;
+    a.offset = area->offset + (addr - area->addr);
+    if (is_dirty) {
+      writeareadata(fd, &a);
+    } else {
+      JTRACE("skipping clean file-backed pages")
+        (a.name) ((void *)a.addr) (a.size) (a.offset);
+      a.properties |= DMTCP_FILE_BACKED_PAGES;
+      record_hot_pages(&a);
+      Util::writeAll(fd, &a, sizeof(a));
     }
+    addr += a.size;
   }
 }
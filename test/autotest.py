@@ -732,6 +732,8 @@ runTest("alarm",        1, ["./test/alarm"])
 
 runTest("sched_test",    2, ["./test/sched_test"])
 
+runTest("hugepage",      1, ["./test/hugepage"])
+
 # In 32-bit Ubuntu 9.10, the default small stacksize (8 MB) forces
 # legacy_va_layout, which places vdso in low memory.  This collides with text
 # in low memory (0x110000) in the statically linked mtcp_restart executable.
@@ -745,6 +747,15 @@ resource.setrlimit(resource.RLIMIT_STACK, [newCurrLimit, oldLimit[1]])
 runTest("dmtcp5",        2, ["./test/dmtcp5"])
 resource.setrlimit(resource.RLIMIT_STACK, oldLimit)
 
+# Launch through a dmtcp_nodeproxy, so that barriers, checkpoint filenames
+# and broadcasts take the aggregated path.  Restart connects directly.
+nodeproxy = runCmd(BIN+"dmtcp_nodeproxy --quiet --port "+p0)
+sleep(S)
+runTest("nodeproxy",     2, ["--coord-port "+p0+" ./test/dmtcp1",
+                             "--coord-port "+p0+" ./test/dmtcp2"])
+nodeproxy.kill()
+nodeproxy.wait()
+
 # Test for a bunch of system calls. We want to use the 'kc' mode for
 # (sets exitAfterCkptOnce in src/dmtcp_coordinator.cpp) for
 # checkpointing so that the process is killed right after checkpoint. Otherwise
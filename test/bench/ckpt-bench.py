@@ -0,0 +1,247 @@
+#!/usr/bin/env python3
+"""End-to-end checkpoint/restart benchmark.
+
+Launches ckpt-workload under dmtcp_launch, sweeps memory size, thread
+count, open files, socket pairs, process count, data pattern and
+compression, and for each point measures:
+  ckpt_stall_s     time for a blocking checkpoint (dmtcp_command -bc)
+  image_bytes      total size of the checkpoint images
+  write_mbps       image_bytes / ckpt_stall_s
+  restart_s        time from dmtcp_restart until all processes are running
+  first_work_s     time from dmtcp_restart until the workload makes progress
+Results are written as JSON.
+
+By default each parameter is varied on its own around the base point; with
+--full the cartesian product of all values is run.
+"""
+
+import argparse
+import glob
+import itertools
+import json
+import os
+import platform
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+DMTCP_ROOT = os.path.abspath(os.path.join(BENCH_DIR, '..', '..'))
+BIN = os.path.join(DMTCP_ROOT, 'bin')
+WORKLOAD = os.path.join(BENCH_DIR, 'ckpt-workload')
+
+BASE = {'mem': 64, 'threads': 1, 'files': 0, 'sockets': 0, 'procs': 1,
+        'pattern': 'text', 'gzip': 0}
+SWEEP = {'mem': [16, 64, 256, 1024],
+         'threads': [1, 4, 16],
+         'files': [0, 100, 1000],
+         'sockets': [0, 16, 128],
+         'procs': [1, 2, 4, 8],
+         'pattern': ['text', 'random', 'zero'],
+         'gzip': [0, 1]}
+TIMEOUT = 600
+
+class BenchError(Exception):
+  pass
+
+def wait_for(predicate, what, timeout=TIMEOUT, interval=0.01):
+  deadline = time.time() + timeout
+  while time.time() < deadline:
+    result = predicate()
+    if result:
+      return result
+    time.sleep(interval)
+  raise BenchError('timed out waiting for ' + what)
+
+class Coordinator:
+  def __init__(self, workDir):
+    portFile = os.path.join(workDir, 'coord-port')
+    subprocess.check_call([os.path.join(BIN, 'dmtcp_coordinator'),
+                           '--daemon', '--quiet', '--coord-port', '0',
+                           '--port-file', portFile])
+    self.port = wait_for(lambda: os.path.isfile(portFile) and
+                         open(portFile).read().strip(), 'coordinator port')
+
+  def command(self, *args):
+    return subprocess.run([os.path.join(BIN, 'dmtcp_command'),
+                           '--coord-port', self.port] + list(args),
+                          stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                          universal_newlines=True).stdout
+
+  def status(self):
+    status = {}
+    for line in self.command('--status').splitlines():
+      if '=' in line:
+        key, val = line.strip().split('=', 1)
+        status[key] = val
+    return (int(status.get('NUM_PEERS', 0)),
+            status.get('RUNNING') == 'yes')
+
+  def wait_running(self, numPeers):
+    wait_for(lambda: self.status() == (numPeers, True),
+             '%d running processes' % numPeers)
+
+  def quit(self):
+    self.command('--quit')
+
+def read_heartbeat(path):
+  try:
+    with open(path) as f:
+      return int(f.read().strip() or 0)
+  except (IOError, ValueError):
+    return 0
+
+def run_point(point, args):
+  workDir = tempfile.mkdtemp(prefix='dmtcp-ckpt-bench-', dir=args.tmpdir)
+  ckptDir = os.path.join(workDir, 'ckpt')
+  os.mkdir(ckptDir)
+  coord = Coordinator(workDir)
+  devnull = open(os.devnull, 'w')
+  procs = []
+  try:
+    env = dict(os.environ)
+    env['DMTCP_GZIP'] = str(point['gzip'])
+    env['DMTCP_TMPDIR'] = workDir
+    launch = [os.path.join(BIN, 'dmtcp_launch'), '--coord-host', 'localhost',
+              '--coord-port', coord.port, '--ckptdir', ckptDir,
+              WORKLOAD, '-m', str(point['mem']), '-t', str(point['threads']),
+              '-f', str(point['files']), '-s', str(point['sockets']),
+              '-p', str(point['procs']), '-d', point['pattern'],
+              '-w', workDir]
+    procs.append(subprocess.Popen(launch, stdout=devnull, stderr=devnull,
+                                  env=env))
+    wait_for(lambda: len(glob.glob(os.path.join(workDir, 'ready.*'))) ==
+             point['procs'], 'workload to start')
+    coord.wait_running(point['procs'])
+
+    start = time.time()
+    coord.command('--bcheckpoint')
+    stall = time.time() - start
+    images = glob.glob(os.path.join(ckptDir, 'ckpt_*.dmtcp'))
+    if len(images) != point['procs']:
+      raise BenchError('expected %d images, found %d' %
+                       (point['procs'], len(images)))
+    imageBytes = sum(os.path.getsize(f) for f in images)
+
+    coord.command('--kill')
+    procs[0].wait(TIMEOUT)
+    wait_for(lambda: coord.status()[0] == 0, 'processes to exit')
+
+    heartbeat = os.path.join(workDir, 'heartbeat')
+    start = time.time()
+    procs.append(subprocess.Popen(
+      [os.path.join(BIN, 'dmtcp_restart'), '--coord-host', 'localhost',
+       '--coord-port', coord.port] + images,
+      stdout=devnull, stderr=devnull, env=env))
+    coord.wait_running(point['procs'])
+    restart = time.time() - start
+    startNs = int(start * 1e9)
+    wait_for(lambda: read_heartbeat(heartbeat) > startNs,
+             'work to resume', interval=0.001)
+    firstWork = (read_heartbeat(heartbeat) - startNs) / 1e9
+
+    return {'ckpt_stall_s': stall,
+            'image_bytes': imageBytes,
+            'write_mbps': imageBytes / stall / 1e6 if stall > 0 else 0,
+            'restart_s': restart,
+            'first_work_s': firstWork}
+  finally:
+    coord.command('--kill')
+    for p in procs:
+      try:
+        p.wait(10)
+      except subprocess.TimeoutExpired:
+        p.kill()
+    coord.quit()
+    devnull.close()
+    if not args.keep:
+      shutil.rmtree(workDir, ignore_errors=True)
+
+def sweep_points(args):
+  values = dict(SWEEP)
+  for key in SWEEP:
+    val = getattr(args, key)
+    if val is not None:
+      conv = str if key == 'pattern' else int
+      values[key] = [conv(v) for v in val.split(',')]
+
+  if args.full:
+    keys = sorted(values)
+    for combo in itertools.product(*[values[k] for k in keys]):
+      yield dict(zip(keys, combo))
+    return
+
+  seen = []
+  for key in sorted(values):
+    for val in values[key]:
+      point = dict(BASE)
+      point[key] = val
+      if point not in seen:
+        seen.append(point)
+        yield point
+
+def main():
+  parser = argparse.ArgumentParser(
+    description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+  parser.add_argument('-o', '--output', help='write JSON results here')
+  parser.add_argument('-r', '--reps', type=int, default=3,
+                      help='runs per point; the median is reported')
+  parser.add_argument('--full', action='store_true',
+                      help='run the cartesian product of all values')
+  parser.add_argument('--tmpdir', default=None,
+                      help='where to put workload files and images')
+  parser.add_argument('--keep', action='store_true',
+                      help='keep the images and workload files')
+  for key, vals in sorted(SWEEP.items()):
+    parser.add_argument('--' + key, metavar='V1,V2,...',
+                        help='values of %s (default: %s)' %
+                        (key, ','.join(str(v) for v in vals)))
+  args = parser.parse_args()
+
+  for path in [WORKLOAD, os.path.join(BIN, 'dmtcp_launch')]:
+    if not os.path.isfile(path):
+      sys.exit('%s not found; run make first.' % path)
+
+  report = {
+    'date': time.strftime('%Y-%m-%dT%H:%M:%S'),
+    'host': platform.node(),
+    'kernel': platform.release(),
+    'machine': platform.machine(),
+    'ncpus': os.cpu_count(),
+    'reps': args.reps,
+    'results': [],
+  }
+  failed = False
+  for point in sweep_points(args):
+    samples = []
+    for i in range(args.reps):
+      try:
+        samples.append(run_point(point, args))
+      except (BenchError, subprocess.SubprocessError) as e:
+        sys.stderr.write('%s: %s\n' % (point, e))
+        failed = True
+        break
+    if not samples:
+      continue
+    result = dict(point)
+    for key in samples[0]:
+      result[key] = statistics.median(s[key] for s in samples)
+    result['samples'] = samples
+    report['results'].append(result)
+    sys.stderr.write('%s\n' % json.dumps(
+      {k: round(v, 3) if isinstance(v, float) else v
+       for k, v in result.items() if k != 'samples'}, sort_keys=True))
+
+  out = json.dumps(report, indent=2, sort_keys=True)
+  if args.output:
+    with open(args.output, 'w') as f:
+      f.write(out + '\n')
+  else:
+    print(out)
+  sys.exit(1 if failed else 0)
+
+if __name__ == '__main__':
+  main()
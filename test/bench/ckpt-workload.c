@@ -0,0 +1,220 @@
+// Synthetic workload for ckpt-bench.py.  Each process allocates and fills
+// a memory region, opens files and socket pairs, and starts worker threads
+// that keep dirtying its memory.  Process 0 writes the wall-clock time of
+// its latest unit of work to a heartbeat file, so the driver can tell when
+// useful work resumes after restart.
+//
+// Usage: ckpt-workload [-m MB] [-t THREADS] [-f FILES] [-s SOCKETPAIRS]
+//                      [-p PROCESSES] [-d random|text|zero] -w WORKDIR
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define errExit(msg) \
+  do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+#define PAGE_SIZE 4096
+
+static size_t memSize = 64UL * 1024 * 1024;
+static int numThreads = 1;
+static int numFiles = 0;
+static int numSocketPairs = 0;
+static int numProcesses = 1;
+static const char *pattern = "random";
+static const char *workDir = NULL;
+
+static char *region;
+static volatile uint64_t workDone;
+
+static void
+fill_region(int rank)
+{
+  uint64_t x = 88172645463325252ULL + rank;
+  static const char text[] =
+    "All work and no play makes Jack a dull boy.  The quick brown fox "
+    "jumps over the lazy dog.  ";
+
+  region = mmap(NULL, memSize, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    errExit("mmap");
+  }
+  if (strcmp(pattern, "random") == 0) {
+    for (size_t i = 0; i + sizeof(x) <= memSize; i += sizeof(x)) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+      memcpy(region + i, &x, sizeof(x));
+    }
+  } else if (strcmp(pattern, "text") == 0) {
+    for (size_t i = 0; i < memSize; i++) {
+      region[i] = text[i % (sizeof(text) - 1)];
+    }
+  } else {
+    // Touch every page so that it is allocated, but leave it zero.
+    for (size_t i = 0; i < memSize; i += PAGE_SIZE) {
+      region[i] = 0;
+    }
+  }
+}
+
+static void
+open_fds(int rank)
+{
+  char path[4096];
+
+  for (int i = 0; i < numFiles; i++) {
+    snprintf(path, sizeof(path), "%s/file.%d.%d", workDir, rank, i);
+    int fd = open(path, O_CREAT | O_RDWR, 0600);
+    if (fd == -1) {
+      errExit("open");
+    }
+    if (write(fd, path, strlen(path)) == -1) {
+      errExit("write");
+    }
+  }
+  for (int i = 0; i < numSocketPairs; i++) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+      errExit("socketpair");
+    }
+    // Leave some data in flight, to be drained and refilled.
+    if (write(sv[0], "ping", 4) != 4) {
+      errExit("write");
+    }
+  }
+}
+
+static void *
+worker(void *arg)
+{
+  size_t numPages = memSize / PAGE_SIZE;
+  size_t page = (size_t)arg;
+
+  while (1) {
+    // Dirty one byte per page, walking the region.
+    region[(page % numPages) * PAGE_SIZE + (page & (PAGE_SIZE - 1))]++;
+    page += 7919;
+    __sync_fetch_and_add(&workDone, 1);
+  }
+  return NULL;
+}
+
+static void
+write_marker(const char *name, int rank)
+{
+  char path[4096];
+
+  snprintf(path, sizeof(path), "%s/%s.%d", workDir, name, rank);
+  int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+  if (fd == -1) {
+    errExit("open");
+  }
+  close(fd);
+}
+
+static void
+run(int rank)
+{
+  int heartbeatFd = -1;
+
+  fill_region(rank);
+  open_fds(rank);
+  for (int i = 0; i < numThreads; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker, (void *)(size_t)i) != 0) {
+      errExit("pthread_create");
+    }
+  }
+
+  if (rank == 0) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/heartbeat", workDir);
+    heartbeatFd = open(path, O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if (heartbeatFd == -1) {
+      errExit("open");
+    }
+  }
+  write_marker("ready", rank);
+
+  while (1) {
+    struct timespec delay = { 0, 1000 * 1000 };
+    uint64_t last = workDone;
+
+    nanosleep(&delay, NULL);
+    if (heartbeatFd != -1 && workDone != last) {
+      struct timespec now;
+      char buf[32];
+      clock_gettime(CLOCK_REALTIME, &now);
+      int len = snprintf(buf, sizeof(buf), "%020llu\n",
+                         (unsigned long long)now.tv_sec * 1000000000ULL +
+                         now.tv_nsec);
+      if (pwrite(heartbeatFd, buf, len, 0) != len) {
+        errExit("pwrite");
+      }
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:t:f:s:p:d:w:")) != -1) {
+    switch (opt) {
+    case 'm':
+      memSize = strtoul(optarg, NULL, 10) * 1024 * 1024;
+      break;
+    case 't':
+      numThreads = atoi(optarg);
+      break;
+    case 'f':
+      numFiles = atoi(optarg);
+      break;
+    case 's':
+      numSocketPairs = atoi(optarg);
+      break;
+    case 'p':
+      numProcesses = atoi(optarg);
+      break;
+    case 'd':
+      pattern = optarg;
+      break;
+    case 'w':
+      workDir = optarg;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-m MB] [-t THREADS] [-f FILES] "
+              "[-s SOCKETPAIRS] [-p PROCESSES] [-d random|text|zero] "
+              "-w WORKDIR\n", argv[0]);
+      return 1;
+    }
+  }
+  if (workDir == NULL || memSize < PAGE_SIZE || numThreads < 1 ||
+      numProcesses < 1) {
+    fprintf(stderr, "%s: invalid arguments\n", argv[0]);
+    return 1;
+  }
+
+  for (int rank = 1; rank < numProcesses; rank++) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      errExit("fork");
+    }
+    if (pid == 0) {
+      run(rank);
+    }
+  }
+  run(0);
+  return 0;
+}
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""Measure the overhead of DMTCP's wrappers.
+
+Runs wrapper-bench natively and under dmtcp_launch with various plugin
+configurations, and writes the results as JSON.  With --baseline, compares
+against an earlier result file and exits non-zero on regressions.
+"""
+
+import argparse
+import json
+import os
+import platform
+import subprocess
+import sys
+import time
+
+BENCH_DIR = os.path.dirname(os.path.abspath(__file__))
+DMTCP_ROOT = os.path.abspath(os.path.join(BENCH_DIR, '..', '..'))
+BENCH_BIN = os.path.join(BENCH_DIR, 'wrapper-bench')
+LAUNCH = os.path.join(DMTCP_ROOT, 'bin', 'dmtcp_launch')
+
+# (config name, dmtcp_launch arguments); None means run natively.
+CONFIGS = [
+  ('native', None),
+  ('dmtcp', []),
+  ('no-plugins', ['--disable-all-plugins']),
+  ('no-alloc', ['--disable-alloc-plugin']),
+  ('no-dl', ['--disable-dl-plugin']),
+  ('no-alloc-no-dl', ['--disable-alloc-plugin', '--disable-dl-plugin']),
+  ('ptrace', ['--ptrace']),
+  ('modify-env', ['--modify-env']),
+  ('pathvirt', ['--pathvirt']),
+]
+
+def run_config(name, launchArgs, args):
+  cmd = [BENCH_BIN, '-r', str(args.reps), '-s', str(args.scale)] + args.bench
+  if launchArgs is not None:
+    cmd = [LAUNCH, '--new-coordinator', '--coord-port', '0', '--quiet'] + \
+          launchArgs + cmd
+  env = dict(os.environ)
+  env.pop('LD_PRELOAD', None)
+  proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                        universal_newlines=True, env=env)
+  if proc.returncode != 0:
+    sys.stderr.write('%s: failed (exit %d)\n%s' %
+                     (name, proc.returncode, proc.stderr))
+    return None
+  results = {}
+  for line in proc.stdout.splitlines():
+    line = line.strip()
+    if line.startswith('{'):
+      r = json.loads(line)
+      results[r.pop('bench')] = r
+  return results
+
+def compare(report, baseline, threshold):
+  regressions = []
+  for config, benches in report['configs'].items():
+    old = baseline.get('configs', {}).get(config)
+    if not old:
+      continue
+    for bench, r in benches.items():
+      if bench not in old:
+        continue
+      before = old[bench]['ns_per_call_median']
+      after = r['ns_per_call_median']
+      if before > 0 and (after - before) / before * 100 > threshold:
+        regressions.append((config, bench, before, after))
+  for config, bench, before, after in regressions:
+    print('REGRESSION %-16s %-16s %10.1f ns -> %10.1f ns (%+.1f%%)' %
+          (config, bench, before, after, (after - before) / before * 100))
+  return len(regressions) == 0
+
+def main():
+  parser = argparse.ArgumentParser(description=__doc__)
+  parser.add_argument('-o', '--output', help='write JSON results here')
+  parser.add_argument('-c', '--config', action='append',
+                      choices=[c[0] for c in CONFIGS],
+                      help='configuration to run (default: all)')
+  parser.add_argument('-r', '--reps', type=int, default=5,
+                      help='repetitions per benchmark (default: 5)')
+  parser.add_argument('-s', '--scale', type=float, default=1.0,
+                      help='scale the number of iterations (default: 1.0)')
+  parser.add_argument('--baseline', help='earlier JSON results to compare to')
+  parser.add_argument('--threshold', type=float, default=10.0,
+                      help='allowed slowdown in percent (default: 10)')
+  parser.add_argument('bench', nargs='*', help='benchmarks (default: all)')
+  args = parser.parse_args()
+
+  if not os.path.isfile(BENCH_BIN):
+    sys.exit('%s not found; run make first.' % BENCH_BIN)
+
+  report = {
+    'date': time.strftime('%Y-%m-%dT%H:%M:%S'),
+    'host': platform.node(),
+    'kernel': platform.release(),
+    'machine': platform.machine(),
+    'reps': args.reps,
+    'scale': args.scale,
+    'configs': {},
+  }
+  for name, launchArgs in CONFIGS:
+    if args.config and name not in args.config:
+      continue
+    results = run_config(name, launchArgs, args)
+    if results is not None:
+      report['configs'][name] = results
+
+  # Overhead relative to running natively.
+  native = report['configs'].get('native', {})
+  for name, benches in report['configs'].items():
+    for bench, r in benches.items():
+      if name != 'native' and bench in native:
+        r['overhead_ns'] = round(r['ns_per_call_median'] -
+                                 native[bench]['ns_per_call_median'], 2)
+
+  out = json.dumps(report, indent=2, sort_keys=True)
+  if args.output:
+    with open(args.output, 'w') as f:
+      f.write(out + '\n')
+  else:
+    print(out)
+
+  if args.baseline:
+    with open(args.baseline) as f:
+      if not compare(report, json.load(f), args.threshold):
+        sys.exit(1)
+
+if __name__ == '__main__':
+  main()
@@ -0,0 +1,403 @@
+// Measures the per-call cost of system calls and library calls that DMTCP
+// wraps.  Run it natively and under dmtcp_launch to see the overhead of the
+// wrapper layer; see run-bench.py.
+//
+// Usage: wrapper-bench [-r REPS] [-s SCALE] [BENCH ...]
+// Prints one JSON object per benchmark on stdout.
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define errExit(msg) \
+  do { perror(msg); exit(EXIT_FAILURE); } while (0)
+
+typedef struct {
+  const char *name;
+  long iterations;  // Default number of calls per repetition.
+  void (*setup)(void);
+  void (*run)(long iterations);
+  void (*teardown)(void);
+} Bench;
+
+static volatile long sink;
+
+static void
+bench_getpid(long n)
+{
+  for (long i = 0; i < n; i++) {
+    sink += getpid();
+  }
+}
+
+static void
+bench_gettid(long n)
+{
+  for (long i = 0; i < n; i++) {
+    sink += syscall(SYS_gettid);
+  }
+}
+
+static void
+bench_open_close(long n)
+{
+  for (long i = 0; i < n; i++) {
+    int fd = open("/dev/null", O_RDONLY);
+    if (fd == -1) {
+      errExit("open");
+    }
+    close(fd);
+  }
+}
+
+static void
+bench_socket_close(long n)
+{
+  for (long i = 0; i < n; i++) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) {
+      errExit("socket");
+    }
+    close(fd);
+  }
+}
+
+static int listenFd = -1;
+static struct sockaddr_un listenAddr;
+
+static void
+setup_connect(void)
+{
+  listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listenFd == -1) {
+    errExit("socket");
+  }
+  memset(&listenAddr, 0, sizeof(listenAddr));
+  listenAddr.sun_family = AF_UNIX;
+  // Abstract socket; nothing to clean up on the filesystem.
+  snprintf(listenAddr.sun_path + 1, sizeof(listenAddr.sun_path) - 1,
+           "dmtcp-wrapper-bench-%d", getpid());
+  if (bind(listenFd, (struct sockaddr *)&listenAddr,
+           sizeof(listenAddr)) == -1 || listen(listenFd, 128) == -1) {
+    errExit("bind/listen");
+  }
+}
+
+static void
+bench_socket_connect(long n)
+{
+  for (long i = 0; i < n; i++) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+      errExit("socket");
+    }
+    if (connect(fd, (struct sockaddr *)&listenAddr,
+                sizeof(listenAddr)) == -1) {
+      errExit("connect");
+    }
+    int peer = accept(listenFd, NULL, NULL);
+    if (peer == -1) {
+      errExit("accept");
+    }
+    close(peer);
+    close(fd);
+  }
+}
+
+static void
+teardown_connect(void)
+{
+  close(listenFd);
+}
+
+static void
+bench_fork(long n)
+{
+  for (long i = 0; i < n; i++) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      errExit("fork");
+    }
+    if (pid == 0) {
+      _exit(0);
+    }
+    if (waitpid(pid, NULL, 0) != pid) {
+      errExit("waitpid");
+    }
+  }
+}
+
+static void *
+thread_start(void *arg)
+{
+  return arg;
+}
+
+static void
+bench_pthread_create(long n)
+{
+  for (long i = 0; i < n; i++) {
+    pthread_t thread;
+    int rc = pthread_create(&thread, NULL, thread_start, NULL);
+    if (rc != 0) {
+      errno = rc;
+      errExit("pthread_create");
+    }
+    pthread_join(thread, NULL);
+  }
+}
+
+static int epollFd = -1;
+static int pipeFds[2];
+
+static void
+setup_epoll(void)
+{
+  struct epoll_event ev;
+
+  if (pipe(pipeFds) == -1) {
+    errExit("pipe");
+  }
+  epollFd = epoll_create1(0);
+  if (epollFd == -1) {
+    errExit("epoll_create1");
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  if (epoll_ctl(epollFd, EPOLL_CTL_ADD, pipeFds[0], &ev) == -1) {
+    errExit("epoll_ctl");
+  }
+}
+
+static void
+bench_epoll_wait(long n)
+{
+  struct epoll_event ev;
+
+  for (long i = 0; i < n; i++) {
+    sink += epoll_wait(epollFd, &ev, 1, 0);
+  }
+}
+
+static void
+teardown_epoll(void)
+{
+  close(epollFd);
+  close(pipeFds[0]);
+  close(pipeFds[1]);
+}
+
+static void
+setup_pipe(void)
+{
+  if (pipe(pipeFds) == -1) {
+    errExit("pipe");
+  }
+}
+
+static void
+bench_poll(long n)
+{
+  struct pollfd pfd = { pipeFds[0], POLLIN, 0 };
+
+  for (long i = 0; i < n; i++) {
+    sink += poll(&pfd, 1, 0);
+  }
+}
+
+static void
+teardown_pipe(void)
+{
+  close(pipeFds[0]);
+  close(pipeFds[1]);
+}
+
+static void
+bench_malloc_free(long n)
+{
+  for (long i = 0; i < n; i++) {
+    void *p = malloc(64 + (i & 255));
+    if (p == NULL) {
+      errExit("malloc");
+    }
+    sink += (long)p;
+    free(p);
+  }
+}
+
+static void
+bench_kill(long n)
+{
+  pid_t pid = getpid();
+
+  for (long i = 0; i < n; i++) {
+    sink += kill(pid, 0);
+  }
+}
+
+static void
+bench_waitpid(long n)
+{
+  for (long i = 0; i < n; i++) {
+    // No children: returns -1/ECHILD after going through the pid wrappers.
+    sink += waitpid(-1, NULL, WNOHANG);
+  }
+}
+
+static void
+bench_timer_create(long n)
+{
+  for (long i = 0; i < n; i++) {
+    struct sigevent sev;
+    timer_t timerid;
+
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_NONE;
+    if (timer_create(CLOCK_MONOTONIC, &sev, &timerid) == -1) {
+      errExit("timer_create");
+    }
+    timer_delete(timerid);
+  }
+}
+
+static void
+bench_shmget(long n)
+{
+  for (long i = 0; i < n; i++) {
+    int shmid = shmget(IPC_PRIVATE, 4096, IPC_CREAT | 0600);
+    if (shmid == -1) {
+      errExit("shmget");
+    }
+    shmctl(shmid, IPC_RMID, NULL);
+  }
+}
+
+static Bench benches[] = {
+  { "getpid",         2000000, NULL,          bench_getpid,         NULL },
+  { "gettid",         2000000, NULL,          bench_gettid,         NULL },
+  { "open_close",      200000, NULL,          bench_open_close,     NULL },
+  { "socket_close",    100000, NULL,          bench_socket_close,   NULL },
+  { "socket_connect",   20000, setup_connect, bench_socket_connect,
+    teardown_connect },
+  { "fork",              1000, NULL,          bench_fork,           NULL },
+  { "pthread_create",   10000, NULL,          bench_pthread_create, NULL },
+  { "epoll_wait",     1000000, setup_epoll,   bench_epoll_wait,
+    teardown_epoll },
+  { "poll",           1000000, setup_pipe,    bench_poll, teardown_pipe },
+  { "malloc_free",    2000000, NULL,          bench_malloc_free,    NULL },
+  { "kill",           1000000, NULL,          bench_kill,           NULL },
+  { "waitpid",        1000000, NULL,          bench_waitpid,        NULL },
+  { "timer_create",    100000, NULL,          bench_timer_create,   NULL },
+  { "shmget",           20000, NULL,          bench_shmget,         NULL },
+};
+
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static double
+now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int
+compare_double(const void *a, const void *b)
+{
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void
+run_bench(const Bench *b, int reps, double scale)
+{
+  long n = (long)(b->iterations * scale);
+  double *samples = malloc(reps * sizeof(double));
+
+  if (n < 1) {
+    n = 1;
+  }
+  if (b->setup) {
+    b->setup();
+  }
+  // Warm up: first calls resolve symbols and populate wrapper state.
+  b->run(n / 10 + 1);
+  for (int r = 0; r < reps; r++) {
+    double start = now_ns();
+    b->run(n);
+    samples[r] = (now_ns() - start) / n;
+  }
+  if (b->teardown) {
+    b->teardown();
+  }
+
+  qsort(samples, reps, sizeof(double), compare_double);
+  printf("{\"bench\": \"%s\", \"iterations\": %ld, \"reps\": %d, "
+         "\"ns_per_call_min\": %.2f, \"ns_per_call_median\": %.2f, "
+         "\"ns_per_call_max\": %.2f}\n",
+         b->name, n, reps, samples[0], samples[reps / 2], samples[reps - 1]);
+  fflush(stdout);
+  free(samples);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int reps = 5;
+  double scale = 1.0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "r:s:l")) != -1) {
+    switch (opt) {
+    case 'r':
+      reps = atoi(optarg);
+      break;
+    case 's':
+      scale = atof(optarg);
+      break;
+    case 'l':
+      for (size_t i = 0; i < NUM_BENCHES; i++) {
+        printf("%s\n", benches[i].name);
+      }
+      return 0;
+    default:
+      fprintf(stderr, "Usage: %s [-l] [-r REPS] [-s SCALE] [BENCH ...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (reps < 1) {
+    reps = 1;
+  }
+
+  for (size_t i = 0; i < NUM_BENCHES; i++) {
+    int selected = (optind == argc);
+    for (int j = optind; j < argc; j++) {
+      if (strcmp(argv[j], benches[i].name) == 0) {
+        selected = 1;
+      }
+    }
+    if (selected) {
+      run_bench(&benches[i], reps, scale);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,122 @@
+// MAP_HUGETLB and MADV_HUGEPAGE need _GNU_SOURCE with -std=gnu99
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Checkpoint areas with transparent huge pages and hugetlbfs pages.  Only
+// every other huge page is written to, so that the zero huge pages in between
+// are elided from the ckpt image.
+
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define NUM_HUGE_PAGES 8
+
+static char *
+map_thp_area(size_t size)
+{
+  // Over-allocate, so that a huge page aligned part of size bytes fits.
+  char *addr = mmap(NULL, size + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (addr == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  char *start = (char *)(((uintptr_t)addr + HUGE_PAGE_SIZE - 1) &
+                         ~((uintptr_t)HUGE_PAGE_SIZE - 1));
+  if (start > addr) {
+    munmap(addr, start - addr);
+  }
+  munmap(start + size, addr + HUGE_PAGE_SIZE - start);
+#ifdef MADV_HUGEPAGE
+  if (madvise(start, size, MADV_HUGEPAGE) == -1) {
+    perror("madvise(MADV_HUGEPAGE)");
+  }
+#endif
+  return start;
+}
+
+static char *
+map_hugetlb_area(size_t size, int flags)
+{
+#ifdef MAP_HUGETLB
+  char *addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    flags | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+  if (addr != MAP_FAILED) {
+    return addr;
+  }
+#endif
+  // No hugetlbfs pages are reserved on this host.
+  return NULL;
+}
+
+static void
+update(char *area, int count)
+{
+  int i;
+
+  if (area == NULL) {
+    return;
+  }
+  for (i = 0; i < NUM_HUGE_PAGES; i += 2) {
+    int *page = (int *)(area + (size_t)i * HUGE_PAGE_SIZE);
+    if (page[0] != count - 1 || page[HUGE_PAGE_SIZE / sizeof(int) - 1] != i) {
+      fprintf(stderr, "huge page %d of %p: expected %d, got %d\n",
+              i, area, count - 1, page[0]);
+      abort();
+    }
+    page[0] = count;
+  }
+  for (i = 1; i < NUM_HUGE_PAGES; i += 2) {
+    int *page = (int *)(area + (size_t)i * HUGE_PAGE_SIZE);
+    if (page[0] != 0) {
+      fprintf(stderr, "huge page %d of %p: expected zero page\n", i, area);
+      abort();
+    }
+  }
+}
+
+static void
+init(char *area)
+{
+  int i;
+
+  if (area == NULL) {
+    return;
+  }
+  for (i = 0; i < NUM_HUGE_PAGES; i += 2) {
+    int *page = (int *)(area + (size_t)i * HUGE_PAGE_SIZE);
+    page[HUGE_PAGE_SIZE / sizeof(int) - 1] = i;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  size_t size = (size_t)NUM_HUGE_PAGES * HUGE_PAGE_SIZE;
+  char *thp = map_thp_area(size);
+  char *hugetlb = map_hugetlb_area(size, MAP_PRIVATE);
+  char *sharedHugetlb = map_hugetlb_area(size, MAP_SHARED);
+  int count = 1;
+
+  if (hugetlb == NULL || sharedHugetlb == NULL) {
+    printf("No hugetlbfs pages available; using transparent huge pages"
+           " only\n");
+  }
+  init(thp);
+  init(hugetlb);
+  init(sharedHugetlb);
+
+  while (1) {
+    update(thp, count);
+    update(hugetlb, count);
+    update(sharedHugetlb, count);
+    printf(" %2d ", count++);
+    fflush(stdout);
+    sleep(2);
+  }
+  return 0;
+}
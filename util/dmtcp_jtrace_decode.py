@@ -0,0 +1,81 @@
+#!/usr/bin/env python
+
+# Decode a jassertlog file written with DMTCP_JTRACE_BUFFER_SIZE set.
+# Buffered JTRACE messages are stored as binary records (see the comment
+# above JTraceRecordHeader in jalib/jassert.cpp), interleaved with plain
+# text written synchronously by JNOTE/JWARNING/JASSERT.
+
+import struct
+import sys
+import time
+
+RECORD_MAGIC = b'\0JTR'
+HEADER = struct.Struct('=IIQII')  # magic, len, timestamp (ns), tid, seq
+
+def usage():
+  print("USAGE:  dmtcp_jtrace_decode.py [--sort] jassertlog.* ...\n"
+        + "  Prints buffered JTRACE records as text, prefixed by their\n"
+        + "  timestamp and thread id.  With --sort, all records from all\n"
+        + "  files are printed in timestamp order.  Plain text (JNOTE,\n"
+        + "  JWARNING, JASSERT) is printed after the record that precedes\n"
+        + "  it in its file.")
+  sys.exit(1)
+
+def decode(data):
+  """Yield (timestamp, tid, seq, text) tuples; text outside of records
+  is returned with timestamp None."""
+  pos = 0
+  while pos < len(data):
+    start = data.find(RECORD_MAGIC, pos)
+    if start == -1:
+      start = len(data)
+    if start > pos:
+      yield (None, None, None, data[pos:start].decode('utf-8', 'replace'))
+    if start + HEADER.size > len(data):
+      break
+    (magic, length, timestamp, tid, seq) = HEADER.unpack_from(data, start)
+    body = data[start + HEADER.size:start + HEADER.size + length]
+    yield (timestamp, tid, seq, body.decode('utf-8', 'replace'))
+    pos = start + HEADER.size + length
+
+def prefix(timestamp, tid):
+  secs = timestamp // 1000000000
+  return "%s.%06d [tid %d] " % (time.strftime("%H:%M:%S", time.localtime(secs)),
+                                (timestamp % 1000000000) // 1000, tid)
+
+if len(sys.argv) < 2 or sys.argv[1] in ('--help', '-h'):
+  usage()
+
+sortRecords = sys.argv[1] == '--sort'
+files = sys.argv[2:] if sortRecords else sys.argv[1:]
+if not files:
+  usage()
+
+# With --sort, each record is keyed by (timestamp, tid, seq, 0).  Plain text
+# is keyed like the record before it in the same file, with a larger last
+# element, so that it stays next to that record; text before the first
+# record of a file sorts first.
+records = []
+for (fileIdx, filename) in enumerate(files):
+  with open(filename, 'rb') as f:
+    lastKey = (0, 0, 0)
+    textIdx = 0
+    for (timestamp, tid, seq, text) in decode(f.read()):
+      if timestamp is None:
+        if sortRecords:
+          textIdx += 1
+          records.append((lastKey + (fileIdx, textIdx), None, text))
+        else:
+          sys.stdout.write(text)
+      elif sortRecords:
+        lastKey = (timestamp, tid, seq)
+        textIdx = 0
+        records.append((lastKey + (0, 0), tid, text))
+      else:
+        sys.stdout.write(prefix(timestamp, tid) + text)
+
+for (key, tid, text) in sorted(records, key=lambda r: r[0]):
+  if tid is None:
+    sys.stdout.write(text)
+  else:
+    sys.stdout.write(prefix(key[0], tid) + text)
@@ -0,0 +1,102 @@
+#!/usr/bin/env python
+
+# Remove the chunks of a chunk store (DMTCP_CHUNK_STORE=1) that no ckpt image
+# refers to any more.  Each image written with the chunk store has a list of
+# the chunks it uses in <image>.chunks (see src/chunkstore.h).  A chunk is
+# kept if it is in the list of an existing image, in the list of an image
+# still being written (<image>.chunks.temp), or if it was stored or used
+# within the grace period, since an image being written may use it before
+# its list is complete.
+
+import os
+import sys
+import time
+
+CHUNK_STORE_DIR = 'ckpt_chunks'
+REF_LIST_SUFFIX = '.chunks'
+TEMP_SUFFIX = '.temp'
+DEFAULT_GRACE = 3600
+
+def usage():
+  print("USAGE:  dmtcp_prune_chunks.py [--dry-run] [--grace SECONDS] CKPT_DIR\n"
+        + "  Removes the chunks in CKPT_DIR/" + CHUNK_STORE_DIR + " that are\n"
+        + "  not used by any ckpt image in CKPT_DIR (or its subdirectories),\n"
+        + "  and that were not stored or used in the last SECONDS seconds\n"
+        + "  (default: " + str(DEFAULT_GRACE) + ").  With --dry-run, only\n"
+        + "  prints what would be removed.")
+  sys.exit(1)
+
+def remove(path, dryRun):
+  if dryRun:
+    print("would remove " + path)
+  else:
+    os.remove(path)
+
+def read_ref_lists(ckptDir, dryRun):
+  refs = set()
+  for (dirpath, dirnames, filenames) in os.walk(ckptDir):
+    if CHUNK_STORE_DIR in dirnames:
+      dirnames.remove(CHUNK_STORE_DIR)
+    for name in filenames:
+      path = os.path.join(dirpath, name)
+      if name.endswith(REF_LIST_SUFFIX):
+        if not os.path.exists(path[:-len(REF_LIST_SUFFIX)]):
+          # The image was removed; so is the list.
+          remove(path, dryRun)
+          continue
+      elif not name.endswith(REF_LIST_SUFFIX + TEMP_SUFFIX):
+        continue
+      with open(path) as f:
+        refs.update(line.strip() for line in f)
+  return refs
+
+if len(sys.argv) < 2 or sys.argv[1] in ('--help', '-h'):
+  usage()
+
+args = sys.argv[1:]
+dryRun = False
+grace = DEFAULT_GRACE
+while len(args) > 1:
+  if args[0] == '--dry-run':
+    dryRun = True
+    args = args[1:]
+  elif args[0] == '--grace' and len(args) > 2:
+    grace = int(args[1])
+    args = args[2:]
+  else:
+    usage()
+if len(args) != 1:
+  usage()
+
+ckptDir = args[0]
+chunkDir = os.path.join(ckptDir, CHUNK_STORE_DIR)
+if not os.path.isdir(chunkDir):
+  print("No chunk store in " + ckptDir)
+  sys.exit(1)
+
+refs = read_ref_lists(ckptDir, dryRun)
+cutoff = time.time() - grace
+numRemoved = 0
+bytesRemoved = 0
+numKept = 0
+for subdir in sorted(os.listdir(chunkDir)):
+  subdirPath = os.path.join(chunkDir, subdir)
+  if not os.path.isdir(subdirPath):
+    continue
+  for name in os.listdir(subdirPath):
+    path = os.path.join(subdirPath, name)
+    st = os.stat(path)
+    # Leftovers of a chunk that was being written (name.temp.XXXXXX) are
+    # removed once they are old enough, too.
+    if name.split('.')[0] in refs and TEMP_SUFFIX not in name:
+      numKept += 1
+    elif st.st_mtime >= cutoff:
+      numKept += 1
+    else:
+      remove(path, dryRun)
+      numRemoved += 1
+      bytesRemoved += st.st_size
+
+print("%s %d chunks (%d bytes); kept %d chunks"
+      % ("Would remove" if dryRun else "Removed", numRemoved, bytesRemoved,
+         numKept))